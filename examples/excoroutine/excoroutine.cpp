@@ -0,0 +1,152 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * excoroutine -- Shows the C++20 coroutines of gnelib/Coroutines.h.  A
+ * coroutine connects to an echo server over a loopback connection with
+ * awaitConnect, and then writes packets and co_awaits each echo with
+ * awaitReceive, without a thread waiting for it.  This is only built when
+ * the compiler supports coroutines, and exits with 1 if the exchange
+ * failed, so it also serves as a test of the awaiters.
+ */
+
+#include <gnelib.h>
+#include <gnelib/Coroutines.h>
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+using namespace GNE;
+
+const int ECHOES = 100;
+
+/**
+ * Writes back every packet it receives.
+ */
+class EchoListener : public ConnectionListener {
+public:
+  void onNewConn( SyncConnection& ) {}
+
+  void onReceive( Connection& conn ) {
+    Packet* next;
+    while ( ( next = conn.stream().getNextPacket() ) != NULL ) {
+      conn.stream().writePacket( *next, true );
+      PacketParser::destroyPacket( next );
+    }
+  }
+};
+
+class EchoServer : public ServerConnectionListener {
+public:
+  typedef SmartPtr<EchoServer> sptr;
+
+  static sptr create() {
+    sptr ret( new EchoServer() );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void getNewConnectionParams( ConnectionParams& params ) {
+    params.setListener( ConnectionListener::sptr( new EchoListener ) );
+  }
+
+  void onListenFailure( const Error& error, const Address&,
+                        const ConnectionListener::sptr& ) {
+    cout << "Listen failure: " << error.toString() << endl;
+  }
+
+private:
+  EchoServer() {}
+};
+
+/**
+ * Where the coroutine reports to main.
+ */
+struct Outcome {
+  Outcome() : finished( false ), echoes( 0 ) {}
+
+  ConditionVariable sync;
+  bool finished;
+  int echoes;
+  string error;
+};
+
+AsyncTask exchange( AsyncConnection::sptr conn, ClientConnection::sptr cli,
+                    Outcome& outcome ) {
+  string error;
+  int echoes = 0;
+  try {
+    co_await awaitConnect( *conn, cli );
+    for ( int i = 0; i < ECHOES; ++i ) {
+      CustomPacket packet;
+      packet.getBuffer() << (gint32)i;
+      conn->write( packet );
+
+      SmartPtr<CustomPacket> echo = co_await awaitReceive<CustomPacket>( *conn );
+      Buffer& buf = echo->getBuffer();
+      buf.flip();
+      gint32 value;
+      buf >> value;
+      if ( value != i ) {
+        error = "an echo came back out of order";
+        break;
+      }
+      ++echoes;
+    }
+  } catch ( Error& e ) {
+    error = e.toString();
+  }
+
+  LockCV lock( outcome.sync );
+  outcome.echoes = echoes;
+  outcome.error = error;
+  outcome.finished = true;
+  outcome.sync.broadcast();
+}
+
+int main() {
+  //No network is needed for a loopback connection.
+  if ( initGNE( NO_NET, atexit ) ) {
+    exit(1);
+  }
+
+  EchoServer::sptr server = EchoServer::create();
+  AsyncConnection::sptr conn = AsyncConnection::create();
+  ClientConnection::sptr cli = ClientConnection::create();
+  if ( cli->open( server, ConnectionParams( conn ) ) ) {
+    cout << "Could not open the loopback connection." << endl;
+    return 1;
+  }
+
+  Outcome outcome;
+  exchange( conn, cli, outcome );
+  {
+    LockCV lock( outcome.sync );
+    while ( !outcome.finished )
+      outcome.sync.wait();
+  }
+  cli->disconnect();
+
+  cout << outcome.echoes << " of " << ECHOES << " echoes received";
+  if ( !outcome.error.empty() )
+    cout << ", failed with: " << outcome.error;
+  cout << "." << endl;
+
+  return ( outcome.echoes == ECHOES ) ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * exinterestperf -- Measures InterestGrid and ObjectBrokerServer together
+ * with many objects moving around many clients, each of which only sees the
+ * objects near it.  Each tick the objects and clients move, then for every
+ * client the objects that came into and went out of view are found, and the
+ * delta packets for the objects it sees are made and acknowledged at once.
+ * No networking is done by this example.
+ */
+
+#include <gnelib.h>
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace GNE;
+using namespace GNE::Console;
+
+const int OBJECTS = 10000;
+const int CLIENTS = 1000;
+const int TICKS = 20;
+const float WORLD_SIZE = 10000.0f;
+const float CELL_SIZE = 200.0f;
+const float VIEW_RADIUS = 300.0f;
+const float MAX_SPEED = 20.0f;
+
+float randomFloat( float max ) {
+  return max * (float)rand() / (float)RAND_MAX;
+}
+
+/**
+ * Moves a coordinate by up to speed, bouncing off the edges of the world.
+ */
+void step( float& pos, float& speed ) {
+  pos += speed;
+  if ( pos < 0.0f || pos >= WORLD_SIZE ) {
+    speed = -speed;
+    pos += 2 * speed;
+  }
+}
+
+/**
+ * An object with a position, which changes every tick, and a kind, which
+ * never does, sent as three fields.
+ */
+class MovingObject : public NetworkObject {
+public:
+  MovingObject() : kind( rand() % 8 ) {
+    x = randomFloat( WORLD_SIZE );
+    y = randomFloat( WORLD_SIZE );
+    dx = randomFloat( 2 * MAX_SPEED ) - MAX_SPEED;
+    dy = randomFloat( 2 * MAX_SPEED ) - MAX_SPEED;
+  }
+
+  void move() {
+    step( x, dx );
+    step( y, dy );
+  }
+
+  Packet* createCreationPacket() {
+    CustomPacket* ret = new CustomPacket();
+    ret->getBuffer() << x << y << kind;
+    return ret;
+  }
+
+  Packet* createUpdatePacket( const void* param ) {
+    return createCreationPacket();
+  }
+
+  Packet* createDeathPacket() { return NULL; }
+
+  void incomingUpdatePacket( const Packet& packet ) {}
+
+  void incomingDeathPacket( const Packet* packet ) {}
+
+  int getFieldCount() const { return 3; }
+
+  void writeField( Buffer& raw, int field ) {
+    switch ( field ) {
+      case 0: raw << x; break;
+      case 1: raw << y; break;
+      default: raw << kind; break;
+    }
+  }
+
+  float x, y;
+  float dx, dy;
+  guint8 kind;
+};
+
+struct Client {
+  Client() : baselines( 8 ) {
+    x = randomFloat( WORLD_SIZE );
+    y = randomFloat( WORLD_SIZE );
+    dx = randomFloat( 2 * MAX_SPEED ) - MAX_SPEED;
+    dy = randomFloat( 2 * MAX_SPEED ) - MAX_SPEED;
+  }
+
+  float x, y;
+  float dx, dy;
+  int viewer;
+  ObjectBaselines baselines;
+};
+
+int main() {
+  if ( initGNE( NL_IP, atexit ) ) {
+    exit(1);
+  }
+  initConsole();
+  setTitle( "GNE Interest Management Benchmark" );
+  srand( 1 );
+
+  ObjectBrokerServer server;
+  InterestGrid grid( CELL_SIZE );
+  //Arrays so that each element is constructed with its own position.
+  MovingObject* objects = new MovingObject[OBJECTS];
+  Client* clients = new Client[CLIENTS];
+
+  Time start = Timer::getCurrentTime();
+  for ( int i = 0; i < OBJECTS; ++i ) {
+    server.getCreationPacket( objects[i] );
+    grid.moveObject( objects[i].getObjectId(), objects[i].x, objects[i].y );
+  }
+  for ( int i = 0; i < CLIENTS; ++i )
+    clients[i].viewer = grid.addViewer( clients[i].x, clients[i].y,
+                                        VIEW_RADIUS );
+  Time setupTime = Timer::getCurrentTime() - start;
+
+  gout << OBJECTS << " objects, " << CLIENTS << " clients, "
+       << TICKS << " ticks." << endl;
+  gout << "Setup: " << setupTime << endl;
+
+  Time gridTime, deltaTime;
+  long interests = 0, entered = 0, left = 0, packets = 0, bytes = 0;
+  vector<int> enteredIds, leftIds;
+  for ( int tick = 0; tick < TICKS; ++tick ) {
+    start = Timer::getCurrentTime();
+    for ( int i = 0; i < OBJECTS; ++i ) {
+      objects[i].move();
+      grid.moveObject( objects[i].getObjectId(), objects[i].x, objects[i].y );
+    }
+    for ( int i = 0; i < CLIENTS; ++i ) {
+      step( clients[i].x, clients[i].dx );
+      step( clients[i].y, clients[i].dy );
+      grid.moveViewer( clients[i].viewer, clients[i].x, clients[i].y );
+    }
+    gridTime += Timer::getCurrentTime() - start;
+
+    start = Timer::getCurrentTime();
+    for ( int i = 0; i < CLIENTS; ++i ) {
+      Client& c = clients[i];
+      enteredIds.clear();
+      leftIds.clear();
+      grid.getChanges( c.viewer, enteredIds, leftIds );
+      entered += (long)enteredIds.size();
+      left += (long)leftIds.size();
+
+      const set<int>& ids = grid.getInterests( c.viewer );
+      interests += (long)ids.size();
+      vector<ObjectDeltaPacket::sptr> deltas =
+        server.getDeltaPackets( c.baselines, ids );
+
+      ObjectDeltaPacket ack;
+      for ( size_t p = 0; p < deltas.size(); ++p ) {
+        bytes += deltas[p]->getSize();
+        ack.addAck( deltas[p]->getSequence() );
+      }
+      packets += (long)deltas.size();
+      server.useDeltaAck( c.baselines, ack );
+    }
+    deltaTime += Timer::getCurrentTime() - start;
+  }
+
+  long clientTicks = (long)CLIENTS * TICKS;
+  gout << "Grid updates:  " << gridTime << " ("
+       << ( gridTime.getTotaluSec() / TICKS ) << " us/tick)" << endl;
+  gout << "Delta packets: " << deltaTime << " ("
+       << ( deltaTime.getTotaluSec() / TICKS ) << " us/tick)" << endl;
+  gout << "Per client per tick: " << ( interests / clientTicks )
+       << " objects seen, " << ( (double)entered / clientTicks )
+       << " entered, " << ( (double)left / clientTicks ) << " left, "
+       << ( (double)packets / clientTicks ) << " packets, "
+       << ( bytes / clientTicks ) << " bytes" << endl;
+  gout << "Sending every object to every client would be "
+       << ( (double)OBJECTS * clientTicks / interests )
+       << " times as many objects." << endl;
+
+  for ( int i = 0; i < OBJECTS; ++i )
+    server.deregisterObject( objects[i] );
+  delete[] objects;
+  delete[] clients;
+
+  gout << "Press a key to continue." << flush;
+  getch();
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * exjoinperf -- Measures what it costs the server to send the world to a
+ * client that just joined, first with an ObjectBrokerServer::getCreationPacket
+ * for each object, then with ObjectBrokerServer::getSnapshot, which keeps
+ * each object's creation data until the object changes.  The time the
+ * client takes to create the objects from a snapshot is also shown.  No
+ * networking is done by this example.
+ */
+
+#include <gnelib.h>
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+using namespace GNE;
+using namespace GNE::Console;
+
+const int OBJECTS = 10000;
+const int JOINS = 20;
+//The part of the objects that change between joins, in percent.
+const int CHANGED = 10;
+
+/**
+ * An object with a few fields, created from a CustomPacket.
+ */
+class WorldObject : public NetworkObject {
+public:
+  WorldObject() : x( 0 ), y( 0 ), health( 100 ), kind( 0 ) {}
+
+  explicit WorldObject( int id ) : NetworkObject( id ) {}
+
+  static NetworkObject* create( int id, const Packet& packet ) {
+    WorldObject* ret = new WorldObject( id );
+    Buffer& buf = const_cast<CustomPacket&>(
+      static_cast<const CustomPacket&>( packet ) ).getBuffer();
+    buf.flip();
+    buf >> ret->x >> ret->y >> ret->health >> ret->kind;
+    return ret;
+  }
+
+  Packet* createCreationPacket() {
+    CustomPacket* ret = new CustomPacket();
+    ret->getBuffer() << x << y << health << kind;
+    return ret;
+  }
+
+  Packet* createUpdatePacket( const void* param ) {
+    return createCreationPacket();
+  }
+
+  Packet* createDeathPacket() { return NULL; }
+
+  void incomingUpdatePacket( const Packet& packet ) {}
+
+  void incomingDeathPacket( const Packet* packet ) {}
+
+  float x, y;
+  guint16 health;
+  guint8 kind;
+};
+
+/**
+ * The old way: a creation packet for each object, written out as it would be
+ * sent.  Returns the bytes written.
+ */
+int joinWithPackets( ObjectBrokerServer& server, WorldObject* objects ) {
+  Buffer frame;
+  int bytes = 0;
+  for ( int i = 0; i < OBJECTS; ++i ) {
+    ObjectCreationPacket::sptr packet = server.getCreationPacket( objects[i] );
+    if ( frame.getRemaining() < packet->getSize() ) {
+      bytes += frame.getPosition();
+      frame.clear();
+    }
+    frame << *packet;
+  }
+  return bytes + frame.getPosition();
+}
+
+void change( WorldObject* objects ) {
+  for ( int i = 0; i < OBJECTS; ++i ) {
+    if ( rand() % 100 < CHANGED ) {
+      objects[i].x += 1.0f;
+      objects[i].markDirty();
+    }
+  }
+}
+
+void report( const char* name, const Time& t, int bytes ) {
+  gout << name << ( t.getTotaluSec() / JOINS ) << " us per join, "
+       << bytes << " bytes" << endl;
+}
+
+int main() {
+  if ( initGNE( NL_IP, atexit ) ) {
+    exit(1);
+  }
+  initConsole();
+  setTitle( "GNE Join Snapshot Benchmark" );
+  srand( 1 );
+  ObjectBrokerClient::registerObject( CustomPacket::ID, WorldObject::create );
+
+  ObjectBrokerServer server;
+  WorldObject* objects = new WorldObject[OBJECTS];
+  for ( int i = 0; i < OBJECTS; ++i ) {
+    objects[i].x = (float)( rand() % 1000 );
+    objects[i].y = (float)( rand() % 1000 );
+    objects[i].kind = (guint8)( rand() % 8 );
+    server.getCreationPacket( objects[i] );
+  }
+
+  gout << OBJECTS << " objects, " << JOINS << " joins, " << CHANGED
+       << "% of objects changed between joins." << endl;
+
+  Time packetTime;
+  int bytes = 0;
+  for ( int i = 0; i < JOINS; ++i ) {
+    change( objects );
+    Time start = Timer::getCurrentTime();
+    bytes = joinWithPackets( server, objects );
+    packetTime += Timer::getCurrentTime() - start;
+  }
+  report( "Creation packets:  ", packetTime, bytes );
+
+  Time start = Timer::getCurrentTime();
+  SmartPtr<Buffer> snapshot = server.getSnapshot();
+  Time coldTime = Timer::getCurrentTime() - start;
+  gout << "First snapshot:    " << coldTime.getTotaluSec() << " us, "
+       << snapshot->getPosition() << " bytes" << endl;
+
+  Time snapshotTime;
+  for ( int i = 0; i < JOINS; ++i ) {
+    change( objects );
+    start = Timer::getCurrentTime();
+    snapshot = server.getSnapshot();
+    snapshotTime += Timer::getCurrentTime() - start;
+  }
+  report( "Cached snapshots:  ", snapshotTime, snapshot->getPosition() );
+
+  Time clientTime;
+  for ( int i = 0; i < JOINS; ++i ) {
+    ObjectBrokerClient client;
+    snapshot->flip();
+    start = Timer::getCurrentTime();
+    client.useSnapshot( *snapshot );
+    clientTime += Timer::getCurrentTime() - start;
+    for ( int j = 0; j < OBJECTS; ++j ) {
+      NetworkObject* obj = client.getObjectById( objects[j].getObjectId() );
+      client.deregisterObject( *obj );
+      delete obj;
+    }
+  }
+  report( "Client snapshots:  ", clientTime, snapshot->getLimit() );
+
+  for ( int i = 0; i < OBJECTS; ++i )
+    server.deregisterObject( objects[i] );
+  delete[] objects;
+
+  gout << "Press a key to continue." << flush;
+  getch();
+
+  return 0;
+}
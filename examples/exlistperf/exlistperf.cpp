@@ -0,0 +1,235 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * exlistperf -- Measures how many queries a ListServer answers per second.
+ * First the queries are given straight to ListServer::process, so only the
+ * server's own work is timed, with the answer pages kept between changes
+ * and with them made again for every query.  Then a ListServer is opened on
+ * a local port, and a few threads get lists from it with
+ * ListServerConnection as fast as they can, while game servers send
+ * heartbeats.
+ */
+
+#include <gnelib.h>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace GNE;
+using namespace GNE::Console;
+
+const int GAMES = 10;
+const int SERVERS = 5000;
+const int QUERIES = 200000;
+//The part of the queries followed by a heartbeat changing a server, in
+//percent.
+const int CHANGED = 10;
+const int PORT = 27999;
+const int CLIENTS = 4;
+const int NET_SECONDS = 5;
+
+/**
+ * A ListServer that counts its answers instead of sending them.
+ */
+class CountingListServer : public ListServer {
+public:
+  static SmartPtr<CountingListServer> create() {
+    SmartPtr<CountingListServer> ret( new CountingListServer() );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void send( const Address& dest, const Buffer& data ) {
+    ++answers;
+    bytes += data.getPosition();
+  }
+
+  int answers;
+  long bytes;
+
+private:
+  CountingListServer() : answers( 0 ), bytes( 0 ) {}
+};
+
+string gameName( int game ) {
+  ostringstream ret;
+  ret << "game" << game;
+  return ret.str();
+}
+
+Address serverAddress( int server ) {
+  ostringstream ret;
+  ret << "10." << server / 65536 << "." << server / 256 % 256 << "."
+      << server % 256 << ":4000";
+  return Address( ret.str() );
+}
+
+void heartbeat( ListServer& server, int i, int players ) {
+  Buffer hb( ListServer::PAGE_LEN );
+  hb << ListServer::MAGIC << (gbyte)ListServer::Heartbeat << (gint32)0
+     << gameName( i % GAMES ) << string( ( i / GAMES ) % 3 ? "" : "ctf" )
+     << string( "A game server with a name" ) << (gint32)players
+     << (gint32)16 << string( "map=dm4 timelimit=20" );
+  server.process( hb.getData(), hb.getPosition(), serverAddress( i ) );
+}
+
+void runQueries( CountingListServer& server, bool change ) {
+  std::vector<Buffer> queries( GAMES, Buffer( ListServer::PAGE_LEN ) );
+  for ( int g = 0; g < GAMES; ++g ) {
+    queries[g] << ListServer::MAGIC << (gbyte)ListServer::Query << (guint32)1
+               << gameName( g ) << string() << (gbyte)ListServer::NotFull
+               << (gint32)0;
+    while ( queries[g].getPosition() < ListServer::PAGE_LEN )
+      queries[g] << (gbyte)0;
+  }
+  Address client( "192.168.0.1:5000" );
+
+  server.answers = 0;
+  server.bytes = 0;
+  Time start = Timer::getCurrentTime();
+  for ( int i = 0; i < QUERIES; ++i ) {
+    Buffer& q = queries[ i % GAMES ];
+    server.process( q.getData(), q.getPosition(), client );
+    if ( change && rand() % 100 < CHANGED )
+      heartbeat( server, rand() % SERVERS, rand() % 17 );
+  }
+  Time t = Timer::getCurrentTime() - start;
+  gout << "  " << (int)( QUERIES / ( t.getTotaluSec() / 1000000.0 ) )
+       << " queries/s, " << server.bytes / server.answers
+       << " bytes per answer" << endl;
+}
+
+/**
+ * Gets lists from the ListServer as fast as it can.
+ */
+class QueryThread : public Thread {
+public:
+  typedef SmartPtr<QueryThread> sptr;
+
+  static sptr create( const Address& dest, int game ) {
+    sptr ret( new QueryThread( dest, game ) );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  int lists;
+  int servers;
+  int failures;
+
+protected:
+  void run() {
+    ListServerConnection::sptr conn = ListServerConnection::create( dest );
+    if ( conn->open() ) {
+      ++failures;
+      return;
+    }
+    conn->setGame( gameName( game ) );
+    while ( !shutdown ) {
+      vector<ListServerConnection::GameListData> list;
+      if ( conn->getGameList( list, string(), 0, 1000 ) )
+        ++failures;
+      ++lists;
+      servers += (int)list.size();
+    }
+  }
+
+private:
+  QueryThread( const Address& dest, int game )
+    : Thread( "QueryThr" ), lists( 0 ), servers( 0 ), failures( 0 ),
+      dest( dest ), game( game ) {}
+
+  Address dest;
+  int game;
+};
+
+void runNetwork() {
+  ListServer::sptr server = ListServer::create();
+  if ( server->open( PORT ) ) {
+    gout << "Could not open port " << PORT << ", skipping." << endl;
+    return;
+  }
+
+  //A game server per game on this machine, so the lists are not empty.
+  Address dest( "localhost" );
+  dest.setPort( PORT );
+  for ( int g = 0; g < GAMES; ++g ) {
+    ListServerConnection::sptr game = ListServerConnection::create( dest );
+    if ( !game->open() ) {
+      game->setGame( gameName( g ) );
+      ListServerConnection::GameListData data;
+      data.serverName = "Local server";
+      data.maxPlayers = 16;
+      game->sendHeartbeat( data, 4000 + g );
+    }
+  }
+
+  vector<QueryThread::sptr> threads;
+  for ( int i = 0; i < CLIENTS; ++i ) {
+    threads.push_back( QueryThread::create( dest, i % GAMES ) );
+    threads.back()->start();
+  }
+  Thread::sleep( NET_SECONDS * 1000 );
+
+  int lists = 0, failures = 0;
+  for ( int i = 0; i < CLIENTS; ++i ) {
+    threads[i]->shutDown();
+    threads[i]->join();
+    lists += threads[i]->lists;
+    failures += threads[i]->failures;
+  }
+  server->close();
+
+  gout << "  " << lists / NET_SECONDS << " lists/s from " << CLIENTS
+       << " threads, " << failures << " timed out" << endl;
+}
+
+int main() {
+  if ( initGNE( NL_IP, atexit ) ) {
+    exit(1);
+  }
+  initConsole();
+  setTitle( "GNE List Server Benchmark" );
+  srand( 1 );
+
+  SmartPtr<CountingListServer> server = CountingListServer::create();
+  for ( int i = 0; i < SERVERS; ++i )
+    heartbeat( *server, i, rand() % 17 );
+  gout << SERVERS << " servers in " << GAMES << " games, " << QUERIES
+       << " queries for the first page of a game." << endl;
+
+  gout << "No changes:" << endl;
+  runQueries( *server, false );
+  gout << "A heartbeat changing a server after " << CHANGED
+       << "% of queries, pages kept for 1 s:" << endl;
+  runQueries( *server, true );
+  gout << "The same, pages made again for each query:" << endl;
+  server->setRefreshInterval( 0 );
+  runQueries( *server, true );
+
+  gout << "Over UDP on this machine:" << endl;
+  runNetwork();
+
+  gout << "Press a key to continue." << flush;
+  getch();
+
+  return 0;
+}
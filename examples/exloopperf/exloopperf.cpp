@@ -0,0 +1,163 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * exloopperf -- Measures how many packets a second go through a loopback
+ * connection, made with ClientConnection::open to a ServerConnectionListener
+ * in the same process, and then through a connection to the same listener
+ * over sockets on this machine.
+ */
+
+#include <gnelib.h>
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+using namespace GNE;
+using namespace GNE::Console;
+
+const int PACKETS = 1000000;
+//The most packets written that have not been received yet, to bound the
+//memory used by the queues.
+const int WINDOW = 10000;
+const int PORT = 27998;
+
+/**
+ * Counts the packets received, and wakes main when enough arrived.
+ */
+class CountingListener : public ConnectionListener {
+public:
+  typedef SmartPtr<CountingListener> sptr;
+
+  CountingListener() : received( 0 ) {}
+
+  void onNewConn( SyncConnection& ) {}
+
+  void onReceive( Connection& conn ) {
+    int count = 0;
+    Packet* next;
+    while ( ( next = conn.stream().getNextPacket() ) != NULL ) {
+      PacketParser::destroyPacket( next );
+      ++count;
+    }
+    LockCV lock( sync );
+    received += count;
+    sync.broadcast();
+  }
+
+  void waitFor( int count ) {
+    LockCV lock( sync );
+    while ( received < count )
+      sync.wait();
+  }
+
+  int received;
+  ConditionVariable sync;
+};
+
+class OurListener : public ServerConnectionListener {
+public:
+  typedef SmartPtr<OurListener> sptr;
+
+  static sptr create() {
+    sptr ret( new OurListener() );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void getNewConnectionParams( ConnectionParams& params ) {
+    listener = CountingListener::sptr( new CountingListener );
+    params.setListener( listener );
+  }
+
+  void onListenFailure( const Error& error, const Address&,
+                        const ConnectionListener::sptr& ) {
+    gout << "Listen failure: " << error.toString() << endl;
+  }
+
+  CountingListener::sptr listener;
+
+private:
+  OurListener() {}
+};
+
+/**
+ * Writes the packets on conn and reports how fast the other end got them.
+ */
+void run( const ClientConnection::sptr& conn, OurListener& server ) {
+  conn->connect();
+  Error e = conn->waitForConnect();
+  if ( e.getCode() != Error::NoError ) {
+    gout << "  Could not connect: " << e.toString() << endl;
+    return;
+  }
+
+  CustomPacket packet;
+  packet.getBuffer() << (gint32)12345;
+  Time start = Timer::getCurrentTime();
+  for ( int i = 0; i < PACKETS; ++i ) {
+    conn->stream().writePacket( packet, true );
+    if ( i % 1000 == 999 && i >= WINDOW )
+      server.listener->waitFor( i - WINDOW );
+  }
+  server.listener->waitFor( PACKETS );
+  Time t = Timer::getCurrentTime() - start;
+
+  gout << "  " << (int)( PACKETS / ( t.getTotaluSec() / 1000000.0 ) )
+       << " packets/s" << endl;
+  conn->disconnect();
+}
+
+int main() {
+  if ( initGNE( NL_IP, atexit ) ) {
+    exit(1);
+  }
+  initConsole();
+  setTitle( "GNE Loopback Connection Benchmark" );
+
+  gout << PACKETS << " reliable packets of " << CustomPacket().getSize() + 4
+       << " bytes, written as fast as possible." << endl;
+
+  OurListener::sptr server = OurListener::create();
+  ConnectionParams params( ConnectionListener::getNullListener() );
+
+  gout << "Loopback connection:" << endl;
+  ClientConnection::sptr loop = ClientConnection::create();
+  if ( !loop->open( server, params ) )
+    run( loop, *server );
+
+  gout << "Over sockets on this machine:" << endl;
+  if ( server->open( PORT ) || server->listen() ) {
+    gout << "  Could not listen on port " << PORT << ", skipping." << endl;
+  } else {
+    Address dest( "localhost" );
+    dest.setPort( PORT );
+    ClientConnection::sptr net = ClientConnection::create();
+    if ( net->open( dest, params ) )
+      gout << "  Could not open a socket, skipping." << endl;
+    else
+      run( net, *server );
+  }
+  server->close();
+
+  gout << "Press a key to continue." << flush;
+  getch();
+
+  return 0;
+}
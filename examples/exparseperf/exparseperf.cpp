@@ -0,0 +1,174 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * exparseperf -- Measures how fast frames are parsed by PacketParser, and in
+ * particular how fast malformed frames are rejected.  Each set of frames is
+ * run through both the throwing parseNextPacket and the error code returning
+ * tryParseNextPacket, the latter being what Connection uses for data from
+ * the network.  No networking is done by this example.
+ */
+
+#include <gnelib.h>
+#include <gnelib/RateAdjustPacket.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace GNE;
+using namespace GNE::Console;
+
+typedef vector<Buffer> FrameSet;
+
+const int ITERATIONS = 20000;
+
+/**
+ * Frames of valid packets, to compare the malformed results against.
+ */
+FrameSet makeValidFrames() {
+  FrameSet ret;
+  for ( int i = 0; i < 16; ++i ) {
+    Buffer buf;
+    CustomPacket cp;
+    cp.getBuffer() << (guint32)i << (guint32)(i * 3);
+    RateAdjustPacket rp;
+    rp.rate = 1000 * i;
+    buf << cp << rp << PacketParser::END_OF_PACKET;
+    buf.flip();
+    ret.push_back( buf );
+  }
+  return ret;
+}
+
+/**
+ * Frames that start with a packet ID that was never registered.
+ */
+FrameSet makeUnknownFrames() {
+  FrameSet ret;
+  for ( int i = 0; i < 16; ++i ) {
+    Buffer buf;
+    buf << (guint8)( 9 + ( i % 6 ) ) << (guint32)i << PacketParser::END_OF_PACKET;
+    buf.flip();
+    ret.push_back( buf );
+  }
+  return ret;
+}
+
+/**
+ * Frames where a packet claims more data than the frame holds.
+ */
+FrameSet makeTruncatedFrames() {
+  FrameSet ret;
+  for ( int i = 0; i < 16; ++i ) {
+    Buffer buf;
+    if ( i % 2 ) {
+      //A CustomPacket whose length runs past the end of the frame.
+      buf << (guint8)CustomPacket::ID << (guint16)400 << (guint32)i;
+    } else {
+      //A PingPacket cut off in the middle.
+      buf << (guint8)PingPacket::ID << (guint32)i << (guint16)0;
+    }
+    buf.flip();
+    ret.push_back( buf );
+  }
+  return ret;
+}
+
+/**
+ * Parses every frame using the throwing interface, returning the number of
+ * frames that were rejected.
+ */
+int runThrowing( FrameSet& frames ) {
+  int rejected = 0;
+  for ( FrameSet::iterator iter = frames.begin(); iter != frames.end(); ++iter ) {
+    iter->rewind();
+    try {
+      Packet* next;
+      while ( ( next = PacketParser::parseNextPacket( *iter ) ) != NULL )
+        PacketParser::destroyPacket( next );
+    } catch ( Error& ) {
+      ++rejected;
+    }
+  }
+  return rejected;
+}
+
+/**
+ * Parses every frame using the error code interface, returning the number of
+ * frames that were rejected.
+ */
+int runErrorCode( FrameSet& frames ) {
+  int rejected = 0;
+  for ( FrameSet::iterator iter = frames.begin(); iter != frames.end(); ++iter ) {
+    iter->rewind();
+    iter->clearReadError();
+    Packet* next;
+    int id;
+    Error::ErrorCode code;
+    while ( ( code = PacketParser::tryParseNextPacket( *iter, next, id ) )
+            == Error::NoError && next != NULL )
+      PacketParser::destroyPacket( next );
+    if ( code != Error::NoError )
+      ++rejected;
+  }
+  return rejected;
+}
+
+void runTest( const char* name, FrameSet frames ) {
+  int frameCount = (int)frames.size() * ITERATIONS;
+  int rejected = 0;
+
+  Time start = Timer::getCurrentTime();
+  for ( int i = 0; i < ITERATIONS; ++i )
+    rejected += runThrowing( frames );
+  Time throwTime = Timer::getCurrentTime() - start;
+
+  start = Timer::getCurrentTime();
+  for ( int i = 0; i < ITERATIONS; ++i )
+    rejected -= runErrorCode( frames );
+  Time codeTime = Timer::getCurrentTime() - start;
+
+  gout << name << ": " << frameCount << " frames" << endl;
+  gout << "  exceptions:  " << throwTime << " ("
+       << ( frameCount / ( throwTime.getTotalmSec() + 1 ) ) << " frames/ms)"
+       << endl;
+  gout << "  error codes: " << codeTime << " ("
+       << ( frameCount / ( codeTime.getTotalmSec() + 1 ) ) << " frames/ms)"
+       << endl;
+  if ( rejected != 0 )
+    gout << "  WARNING: the two methods rejected different frames!" << endl;
+}
+
+int main() {
+  if ( initGNE( NL_IP, atexit ) ) {
+    exit(1);
+  }
+  initConsole();
+  setTitle( "GNE Packet Parsing Benchmark" );
+
+  gout << "Parsing each frame set " << ITERATIONS << " times." << endl;
+  runTest( "Valid frames", makeValidFrames() );
+  runTest( "Unknown packet IDs", makeUnknownFrames() );
+  runTest( "Truncated packets", makeTruncatedFrames() );
+
+  gout << "Press a key to continue." << flush;
+  getch();
+
+  return 0;
+}
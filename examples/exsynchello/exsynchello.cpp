@@ -74,10 +74,9 @@ public:
       //but since we refused unreliable connections in OurListener, we will
       //get it reliably and on the SyncConnection.
       for (int c=0; c<2; ++c) {
-        HelloPacket message;
-        conn >> message;
+        HelloPacket::sptr message = conn.receive<HelloPacket>();
         received = true;
-        gout << acquire << "Got message: \"" << message.getMessage() << "\""
+        gout << acquire << "Got message: \"" << message->getMessage() << "\""
           << endl << release;
         
         HelloPacket response("Hello, client!  I'm the syncronous server!");
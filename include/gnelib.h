@@ -30,6 +30,7 @@
 #endif
 
 #include <gnelib/Address.h>
+#include <gnelib/AsyncConnection.h>
 #include <gnelib/Buffer.h>
 #include <gnelib/ClientConnection.h>
 #include <gnelib/ConnectionListener.h>
@@ -48,24 +49,38 @@
 #include <gnelib/Errors.h>
 #include <gnelib/GNE.h>
 #include <gnelib/GNEDebug.h>
+#include <gnelib/HandshakeQueue.h>
+#include <gnelib/InterestGrid.h>
+#include <gnelib/InterpolationBuffer.h>
+#include <gnelib/ListServer.h>
 #include <gnelib/ListServerConnection.h>
 #include <gnelib/Lock.h>
+#include <gnelib/MessageListener.h>
+#include <gnelib/MessagePacket.h>
 #include <gnelib/Mutex.h>
 #include <gnelib/NetworkObject.h>
+#include <gnelib/ObjectBaselines.h>
 #include <gnelib/ObjectBroker.h>
 #include <gnelib/ObjectBrokerClient.h>
 #include <gnelib/ObjectBrokerPacket.h>
 #include <gnelib/ObjectBrokerServer.h>
 #include <gnelib/ObjectCreationPacket.h>
 #include <gnelib/ObjectDeathPacket.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <gnelib/ObjectStates.h>
 #include <gnelib/ObjectUpdatePacket.h>
+#include <gnelib/ObjectUpdateBatchPacket.h>
 #include <gnelib/Packet.h>
 #include <gnelib/PacketFeeder.h>
 #include <gnelib/PacketStream.h>
 #include <gnelib/PacketParser.h>
 #include <gnelib/PingPacket.h>
 #include <gnelib/ReceiveEventListener.h>
+#include <gnelib/ReplicationFanout.h>
 #include <gnelib/ServerConnectionListener.h>
+#include <gnelib/SessionTable.h>
+#include <gnelib/SessionToken.h>
+#include <gnelib/SharedUnreliableSocket.h>
 #include <gnelib/SmartPtr.h>
 #include <gnelib/SyncConnection.h>
 #include <gnelib/SynchronizedObject.h>
@@ -75,6 +90,8 @@
 #include <gnelib/Time.h>
 #include <gnelib/Timer.h>
 #include <gnelib/TimerCallback.h>
+#include <gnelib/UpdateScheduler.h>
 #include <gnelib/WeakPtr.h>
+#include <gnelib/WorkerPool.h>
 
 #endif
@@ -0,0 +1,170 @@
+#ifndef ASYNCCONNECTION_H_INCLUDED_71D24E90
+#define ASYNCCONNECTION_H_INCLUDED_71D24E90
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/ConnectionListener.h>
+#include <gnelib/Error.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/WeakPtr.h>
+
+namespace GNE {
+class Connection;
+class ClientConnection;
+class Packet;
+
+/**
+ * @ingroup midlevel
+ *
+ * Like SyncConnection, this gives the packets of a Connection one at a time
+ * in the order they arrive, so that an exchange such as a login can be
+ * written as a sequence of steps, but without blocking a thread while
+ * waiting.  Instead each connect or receive is given a Handler, which is
+ * called from the connection's event thread when it completes.  The
+ * gnelib/Coroutines.h header turns these into C++20 awaitables, so that a
+ * coroutine can co_await each step, and thousands of exchanges can wait at
+ * once without a thread each.
+ *
+ * The AsyncConnection must be the listener of the Connection, by passing it
+ * to ConnectionParams::setListener.  Events it has no use for are passed to
+ * the listener given to create, if any, which is also told of onConnect and
+ * onNewConn before the handler, so it may still refuse the connection.
+ *
+ * Only one connect or receive may be waiting at a time.  Once the
+ * connection fails or disconnects, the waiting handler and every later one
+ * is completed with the error.
+ */
+class AsyncConnection : public ConnectionListener {
+public: //typedefs
+  typedef SmartPtr<AsyncConnection> sptr;
+  typedef WeakPtr<AsyncConnection> wptr;
+
+  /**
+   * Told when a connect or receive completes.
+   */
+  class Handler {
+  public:
+    virtual ~Handler();
+
+    /**
+     * Called once when the operation completes, with the packet received,
+     * or NULL for connect or when there is an error.  The error code is
+     * Error::NoError on success.  This is called on the connection's event
+     * thread, the connecting thread for connect, or the thread starting the
+     * operation if it completed at once.  It may start the next operation.
+     */
+    virtual void onComplete( const SmartPtr<Packet>& packet,
+                             const Error& error ) = 0;
+  };
+
+  /**
+   * Creates an AsyncConnection, passing the events it does not use to
+   * next, which may be NULL.
+   */
+  static sptr create(
+      const SmartPtr<ConnectionListener>& next = SmartPtr<ConnectionListener>() );
+
+  virtual ~AsyncConnection();
+
+  /**
+   * Returns the Connection this listens to, or NULL if it has not connected
+   * yet.
+   */
+  SmartPtr<Connection> getConnection() const;
+
+  /**
+   * Starts connecting conn, which must have been opened with this as its
+   * listener, and calls handler once the connection is made or failed.
+   */
+  void connect( const SmartPtr<ClientConnection>& conn, Handler& handler );
+
+  /**
+   * Calls handler with the next packet, at once if a packet is already
+   * waiting or the connection has failed, or else when one arrives.
+   */
+  void receive( Handler& handler );
+
+  /**
+   * Takes the next packet if one is waiting, without waiting.
+   *
+   * @return the packet, or NULL if there is none.
+   * @throw Error if the connection has failed.
+   */
+  SmartPtr<Packet> tryReceive();
+
+  /**
+   * Writes a packet, which never waits, as with SyncConnection.
+   *
+   * @throw Error if the connection has failed.
+   */
+  void write( const Packet& packet, bool reliable = true );
+
+  /**
+   * Returns the error the connection failed with, or an Error with code
+   * Error::NoError if it has not.
+   */
+  Error getError() const;
+
+private:
+  explicit AsyncConnection( const SmartPtr<ConnectionListener>& next );
+
+  /**
+   * Ends the waiting operation with the given error, if there is one.
+   */
+  void fail( const Error& error );
+
+  /**
+   * Calls the waiting receive handler if there is one and a packet or an
+   * error for it.
+   */
+  void completeReceive();
+
+  virtual void onConnect( SyncConnection& conn );
+  virtual void onConnectFailure( Connection& conn, const Error& error );
+  virtual void onNewConn( SyncConnection& newConn );
+  virtual void onDisconnect( Connection& conn );
+  virtual void onExit( Connection& conn );
+  virtual void onTimeout( Connection& conn );
+  virtual void onError( Connection& conn, const Error& error );
+  virtual void onFailure( Connection& conn, const Error& error );
+  virtual void onReceive( Connection& conn );
+
+  SmartPtr<ConnectionListener> next;
+
+  /**
+   * Guards the members below.
+   */
+  mutable Mutex sync;
+
+  SmartPtr<Connection> conn;
+
+  /**
+   * The waiting operation, or NULL, and whether it is a receive.
+   */
+  Handler* waiting;
+  bool receiving;
+
+  Error error;
+};
+
+} //namespace GNE
+
+#endif
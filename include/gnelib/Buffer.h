@@ -21,6 +21,7 @@
  */
 
 #include <gnelib/gnetypes.h>
+#include <gnelib/Error.h>
 
 namespace GNE {
   class Time;
@@ -187,6 +188,59 @@ public:
    */
   void flip();
 
+  /**
+   * Returns true if read errors on this Buffer throw BufferError, which is
+   * the default.
+   *
+   * @see setReadExceptions
+   */
+  bool getReadExceptions() const;
+
+  /**
+   * Sets whether read errors on this Buffer throw BufferError.  When read
+   * exceptions are turned off, a read that fails leaves its destination set
+   * to zero (or empty), records the error code so it can be checked later with
+   * getReadError, and moves the position to the limit so that all further
+   * reads also fail.  Only the first error is recorded.  This is how
+   * PacketParser::tryParseNextPacket avoids throwing on malformed data.
+   */
+  void setReadExceptions( bool enabled );
+
+  /**
+   * Returns the code of the first read error that happened while read
+   * exceptions were off, or Error::NoError if no such error happened since
+   * the last call to clearReadError.
+   */
+  Error::ErrorCode getReadError() const;
+
+  /**
+   * Resets the read error to Error::NoError.
+   */
+  void clearReadError();
+
+  /**
+   * Reports that a read failed with the given error code.  This is called by
+   * the Buffer itself, but is also meant for Packet::readPacket methods that
+   * find their data invalid, so that they honor the read exception setting.
+   * If read exceptions are on, this throws BufferError with the given code,
+   * else the error is recorded as described in setReadExceptions.
+   */
+  void failRead( Error::ErrorCode code );
+
+  /**
+   * Reports that a packet read from this Buffer, such as one wrapped in
+   * another packet, has an unknown ID.  Like failRead with
+   * Error::UnknownPacket, but throws UnknownPacket with the ID if read
+   * exceptions are on, and else records the ID for getUnknownPacketId.
+   */
+  void failUnknownPacket( int id );
+
+  /**
+   * Returns the ID given to failUnknownPacket if the read error is
+   * Error::UnknownPacket, or 0 if it was not given.
+   */
+  int getUnknownPacketId() const;
+
   /**
    * Returns the maximum possible serialized size of a string of the given
    * length in ASCII characters.
@@ -286,7 +340,10 @@ public:
    * Stream operators for reading from this Buffer.
    *
    * Any of the read operators will increase the position and will throw
-   * a BufferError with code BufferUnderflow if there is no more data to read.
+   * a BufferError with code BufferUnderflow if there is no more data to read,
+   * unless read exceptions are turned off.
+   *
+   * @see setReadExceptions
    */
   Buffer& operator >> (gint8& x);
   /**
@@ -321,11 +378,21 @@ public:
   static const int RAW_PACKET_LEN;
 
 private:
+  /**
+   * Returns true if size more bytes can be read, else calls failRead with
+   * BufferUnderflow and returns false.
+   */
+  bool checkRead( int size );
+
   int position;
   int limit;
   int capacity;
 
   gbyte* data;
+
+  bool readExceptions;
+  Error::ErrorCode readError;
+  int unknownPacketId;
 };
 
 }
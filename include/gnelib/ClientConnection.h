@@ -22,6 +22,7 @@
 
 #include <gnelib/Connection.h>
 #include <gnelib/Thread.h>
+#include <gnelib/ConditionVariable.h>
 #include <gnelib/Address.h>
 #include <gnelib/SmartPtr.h>
 #include <gnelib/WeakPtr.h>
@@ -32,6 +33,7 @@ class Error;
 class ClientConnectionParams;
 class ConnectionParams;
 class SyncConnection;
+class ServerConnectionListener;
 
 /**
  * @ingroup midlevel
@@ -73,9 +75,31 @@ public:
    */
   bool open(const Address& dest, const ConnectionParams& p);
 
+  /**
+   * Opens a loopback connection to a ServerConnectionListener in this
+   * process, such as the one of the host player's own listen server, which
+   * does not have to be open or listening.  connect works as usual, calling
+   * getNewConnectionParams and onNewConn on the server's side and onConnect
+   * on ours, but there is no handshake and there are no sockets.  The
+   * packets written on one end are given to the other end's PacketStream
+   * as they are, without being written to frames and parsed, except for
+   * messages.  Unreliable packets are never lost except to the incoming
+   * limits, stream packets are sent reliably, and there is no session
+   * token or address.  If there is an error, the function returns true.
+   * @pre Connection's state is NeedsInitialization
+   * @post Connection's state is ReadyToConnect
+   * @param server the listener to connect to.
+   * @see isLoopback
+   */
+  bool open(const SmartPtr<ServerConnectionListener>& server,
+            const ConnectionParams& p);
+
   /**
    * Starts connection to the specified target.  This method does not block,
-   * and a thread will be started to handle the connection process.
+   * and a thread will be started to handle the connection process, unless
+   * ConnectionParams::setAsyncConnect was set, in which case it is handled
+   * by threads shared by all connections, waiting for the server through
+   * the event generator.
    * onConnect() or onConnectFailure() will be called depending on the
    * outcome of this process.  The exception is that if an error occurs
    * during onConnect or it chooses to reject the connection,
@@ -124,7 +148,8 @@ private:
 
 private: //thread functions
   /**
-   * Connection starts a new thread lasting only while it is connecting.
+   * Connection starts a new thread lasting only while it is connecting,
+   * unless ConnectionParams::setAsyncConnect was set.
    */
   virtual void run();
 
@@ -135,24 +160,82 @@ private: //thread functions
   virtual void shutDown();
 
 private:
+  class ConnectStep;
+  friend class ConnectStep;
+
+  /**
+   * Connects the socket and sends the CRP, throwing an Error on error.  A
+   * loopback connection is made here instead.
+   */
+  void beginHandshake();
+
   /**
-   * Does the GNE protocol handshake, throwing an Error on error.
+   * Starts connecting the socket for a ConnectStep, which sends the CRP once
+   * the socket can be written to.  The socket does not block until the
+   * handshake is done.  Throws an Error on error.
    */
-  void doHandshake();
+  void beginConnect();
 
   /**
-   * Sends the CRP, throwing an Error on error.
+   * Makes the ServerConnection of a loopback connection and starts it,
+   * throwing an Error if the server refused it.
    */
-  void sendCRP();
+  void connectLoopback();
 
   /**
-   * Tries to get the CAP (or refusal packet), throwing an Error on error or
-   * if the connection was refused.
+   * Does the rest of the GNE protocol handshake once the CAP arrives,
+   * throwing an Error on error.
+   */
+  void finishHandshake();
+
+  /**
+   * Does the rest of the handshake like finishHandshake, with the CAP read
+   * into cap, where check is what rawRead returned.
+   */
+  void answerCAP(Buffer& cap, int check);
+
+  /**
+   * Starts the connection's threads once the handshake succeeded, then calls
+   * callOnConnect.  If step is given, the EventThread runs it to call
+   * callOnConnect instead of this thread.
+   */
+  void finishConnect( const SmartPtr< ConnectionListener >& origListener,
+                      const SmartPtr< ConnectStep >& step );
+
+  /**
+   * Calls onConnect, finishing the connection if it succeeded, then calls
+   * connectDone.
+   */
+  void callOnConnect( const SmartPtr< ConnectionListener >& origListener );
+
+  /**
+   * Wakes the threads in waitForConnect.  Called once the connection
+   * attempt is over, whether it succeeded or not.
+   */
+  void connectDone();
+
+  /**
+   * Sends the CRP, throwing an Error on error, or if the connect failed.
+   * Returns false if nothing was sent because the socket is still
+   * connecting, which only happens after beginConnect.
+   */
+  bool sendCRP();
+
+  /**
+   * Parses the CAP (or refusal packet) read into cap, where check is what
+   * rawRead returned, throwing an Error on error or if the connection was
+   * refused.
    * @return an address to connect to the remote unreliable connection.  If
    *         no unreliable connection was requested, the value of the
    *         returned address is undefined.
    */
-  Address getCAP();
+  Address getCAP(Buffer& cap, int check);
+
+  /**
+   * Sends the hash of our compression dictionary and starts compressing,
+   * throwing an Error on error.
+   */
+  void sendCompressionInfo();
 
   /**
    * Sets up the unreliable connection, throwing an Error on error.
@@ -169,6 +252,12 @@ private:
    */
   Error connError;
 
+  /**
+   * Signaled when connectFinished is set.
+   */
+  ConditionVariable connectSync;
+  bool connectFinished;
+
   //Temp storage of connection params.
   typedef SmartPtr< ClientConnectionParams > ParamsSPtr;
   ParamsSPtr params;
@@ -26,14 +26,22 @@
 #include <gnelib/Error.h>
 #include <gnelib/Errors.h>
 #include <gnelib/SocketPair.h>
+#include <gnelib/ParityFec.h>
+#include <gnelib/FrameCompressor.h>
 #include <gnelib/Address.h>
 #include <gnelib/ConnectionStats.h>
+#include <gnelib/SessionToken.h>
+#include <gnelib/HandshakeQueue.h>
 #include <gnelib/SmartPtr.h>
 #include <gnelib/WeakPtr.h>
 
+#include <vector>
+
 namespace GNE {
 class ConnectionListener;
+class ConnectionParams;
 class EventThread;
+class SessionTable;
 class SyncConnection;
 
 /**
@@ -170,6 +178,37 @@ public:
    */
   ConnectionStats getStats(int reliable) const;
 
+  /**
+   * Returns the stats of the compression of reliable frames.  The stats are
+   * all 0 if compression was not agreed on when connecting.
+   *
+   * @see ConnectionParams::setCompression
+   */
+  CompressionStats getCompressionStats() const;
+
+  /**
+   * Returns the token of this connection's session, given by a server with
+   * a SessionTable while connecting, or an invalid token if there is none.
+   *
+   * @see SessionTable
+   * @see ConnectionParams::setResumeToken
+   */
+  SessionToken getSessionToken() const;
+
+  /**
+   * Returns true if this connection resumed a session the server's
+   * SessionTable was holding, because the client connected with its token.
+   */
+  bool isResumed() const;
+
+  /**
+   * Returns true if this is a loopback connection, between a
+   * ClientConnection and a ServerConnectionListener in the same process,
+   * which has no sockets.
+   * @see ClientConnection::open
+   */
+  bool isLoopback() const;
+
   /**
    * Returns the local address of this connection.  If the requested socket
    * has not been opened, the returned Address will be invalid (!isValid()).
@@ -250,6 +289,36 @@ public:
   void disconnectSendAll(int waitTime = 10000);
 
 protected:
+  /**
+   * Flags sent with the unreliable request in the CRP and with the
+   * acceptance in the CAP to agree on optional protocol features.  Older
+   * versions of %GNE only check whether these bytes are 0, so they ignore
+   * the flags, and the features are not used.
+   */
+  enum HandshakeFlags {
+    /**
+     * The client can put a token in front of its datagrams, and in the CAP,
+     * the server has given it one for its SharedUnreliableSocket.
+     */
+    SharedUnrelFlag = 0x02,
+
+    /**
+     * Sent in the CRP features by a client that can compress frames, and in
+     * the CAP by a server that agrees to.  If agreed, the CAP ends with the
+     * hash of the server's FrameCompressor dictionary, and then the client
+     * sends the hash of its own.
+     */
+    CompressFlag = 0x04,
+
+    /**
+     * Sent in the CRP features by a client that can take a SessionToken, and
+     * the CRP then ends with the token of the session it wants to resume, if
+     * it has one.  Set in the CAP by a server with a SessionTable, and the
+     * CAP then ends with the client's SessionToken.
+     */
+    ResumeFlag = 0x08
+  };
+
   /**
    * This method must be called and set to a weak pointer referencing this
    * object before the end of the static create function of the child class.
@@ -271,9 +340,11 @@ protected:
 
   /**
    * A utility function for ServerConnection and ClientConnection to add the
-   * version information to a packet.
+   * version information to a packet.  The features are HandshakeFlags sent
+   * in the last byte of the game name, which older versions of %GNE never
+   * read since it is always the null terminator for them.
    */
-  void addVersions(Buffer& raw);
+  void addVersions(Buffer& raw, gbyte features = 0);
 
   /**
    * A utility function for ServerConnection and ClientConnection to check to
@@ -298,8 +369,46 @@ protected:
    *   Error::GNETheirVersionLow if the GNE protocol versions do not match.
    * @throw WrongGame if the game names don't match.
    * @throw UserVersionMismatch if the user version numbers don't match.
+   * @return the features the remote side sent with addVersions.
+   */
+  gbyte checkVersions(Buffer& raw);
+
+  /**
+   * Called by ServerConnection and ClientConnection when compression has
+   * been agreed on, with the dictionary hash of the remote side.
    */
-  void checkVersions(Buffer& raw);
+  void startCompression(guint32 remoteDictHash);
+
+  /**
+   * Writes a SessionToken to a handshake packet.
+   */
+  static void writeToken(Buffer& raw, const SessionToken& token);
+
+  /**
+   * Reads a SessionToken from a handshake packet.
+   */
+  static SessionToken readToken(Buffer& raw);
+
+  /**
+   * Makes a and b the two ends of a loopback connection, creating their
+   * PacketStreams with the rates from their params, as if a and b had
+   * agreed on them while connecting.  Called before either starts its
+   * threads.
+   */
+  static void linkLoopback(Connection& a, const ConnectionParams& ap,
+                           Connection& b, const ConnectionParams& bp);
+
+  /**
+   * The session token and whether it was resumed, set while connecting.
+   */
+  SessionToken sessionToken;
+  bool resumed;
+
+  /**
+   * The table of the server's session for this connection, if there is
+   * one.  The session is held when we disconnect.
+   */
+  SmartPtr<SessionTable> sessionTable;
 
   //For information about events, see the ConnectionListener class.
   void onReceive();
@@ -309,6 +418,12 @@ protected:
    */
   SocketPair sockets;
 
+  /**
+   * True while the connection is registered to receive from its
+   * SharedUnreliableSocket.  Guarded by sync.
+   */
+  bool sharedRegistered;
+
   /**
    * The PacketStream associated with this Connection.  This object also
    * contains information about the in and out connection rates.
@@ -335,6 +450,16 @@ protected:
    */
   void startThreads();
 
+  /**
+   * Starts the threads like startThreads, but the EventThread runs
+   * connectStep as its first event, so onConnect or onNewConn is called on
+   * it with sConn rather than on the calling thread.
+   *
+   * @pre state must be Connecting.
+   */
+  void startThreads( const HandshakeQueue::Step::sptr& connectStep,
+                     const SmartPtr<SyncConnection>& sConn );
+
   /**
    * The connecting has just finished and the state needs to be changed.
    */
@@ -419,11 +544,89 @@ private:
   //SyncConnection might call our event functions.
   friend class SyncConnection;
 
+  //SharedUnreliableSocket passes us the datagrams it receives for us.
+  friend class SharedUnreliableSocket;
+
   /**
-   * Parses the packets received, then calls onReceive.
+   * Reads a frame from a socket, then passes it to onReceiveFrame.
    */
   void onReceive(bool reliable);
 
+  /**
+   * Called by SharedUnreliableSocket with an unreliable frame of the given
+   * size, starting at the current position of buf.
+   */
+  void onReceiveShared(Buffer& buf, int bytes);
+
+  /**
+   * Handles a received frame of the given size, rebuilding lost frames from
+   * parity if it can, then parses the frames and calls onReceive.
+   */
+  void onReceiveFrame(Buffer& buf, int bytes, bool reliable);
+
+  /**
+   * Parses the packets in buf and adds them to the PacketStream.  Returns
+   * false if there was an error, after it has been processed.
+   */
+  bool parseFrame(Buffer& buf, bool reliable);
+
+  /**
+   * Called by PacketStream to give the packets to the other end of a
+   * loopback connection, which takes ownership of them.  Returns false if
+   * the other end is gone.
+   */
+  bool writeLoopback(std::vector<Packet*>& packets, bool reliable);
+
+  /**
+   * Called by PacketStream to give a reliable frame to the other end of a
+   * loopback connection, which is used for messages.  Returns false if the
+   * other end is gone.
+   */
+  bool writeLoopbackFrame(Buffer& raw);
+
+  /**
+   * Gives the other end of a loopback connection its onExit, in place of
+   * the ExitPacket.
+   */
+  void exitLoopback();
+
+  /**
+   * Adds the packets from the other end of a loopback connection to the
+   * PacketStream and calls onReceive, or drops them like a frame.
+   */
+  void onReceiveLoopback(std::vector<Packet*>& packets, bool reliable);
+
+  /**
+   * Returns PacketStream::getInQueueRoom for the other end of a loopback
+   * connection, or -1 if it is gone.
+   */
+  int getLoopbackPeerRoom();
+
+  /**
+   * Calls PacketStream::wakeWriter for the other end of a loopback
+   * connection, once our in queue has room for its packets again.
+   */
+  void wakeLoopbackPeer();
+
+  /**
+   * The other end of a loopback connection, set by linkLoopback and not
+   * changed after, so it is read without sync.
+   */
+  wptr loopbackPeer;
+  bool loopback;
+
+  /**
+   * Rebuilds unreliable frames lost from groups sent with parity.
+   */
+  ParityFecDecoder fecDecoder;
+
+  /**
+   * Compresses outgoing reliable frames if compressOut is true, and
+   * decompresses incoming ones.  compressOut is set while connecting.
+   */
+  FrameCompressor compressor;
+  bool compressOut;
+
   /**
    * Determines whether the error given is fatal or non-fatal, and calls the
    * appropriate event, and handles disconnects if necessary.
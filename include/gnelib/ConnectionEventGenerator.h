@@ -22,6 +22,7 @@
 
 #include <gnelib/ConditionVariable.h>
 #include <gnelib/Thread.h>
+#include <gnelib/Time.h>
 #include <gnelib/SmartPointers.h>
 
 #include <nl.h>
@@ -64,7 +65,22 @@ public:
   void reg(NLsocket socket, const SmartPtr<ReceiveEventListener>& listener);
 
   /**
-   * Removes a socket.  If the socket is not registered, then no action takes
+   * Registers a socket like reg, but the listener's onReceive is called
+   * when the socket can be written to, such as once a non-blocking connect
+   * has finished or failed, and until the socket is unregistered.  These
+   * sockets are checked every WRITE_POLL_TIME milliseconds, between polls
+   * of the others.
+   */
+  void regWrite(NLsocket socket, const SmartPtr<ReceiveEventListener>& listener);
+
+  /**
+   * How often in milliseconds the sockets given to regWrite are checked.
+   */
+  static const int WRITE_POLL_TIME;
+
+  /**
+   * Removes a socket given to reg or regWrite.  If the socket is not
+   * registered, then no action takes
    * place.  This method will not block to wait for the unregistration to take
    * place.
    *
@@ -72,6 +88,31 @@ public:
    */
   void unreg(NLsocket socket);
 
+  /**
+   * Stops polling a registered socket, without unregistering it, so that no
+   * more events are generated for it until it is resumed.  For a TCP socket
+   * this lets the operating system's flow control push back on the sender.
+   * If the socket is not registered, no action takes place.  If it is
+   * already paused, only the time to resume is changed.
+   *
+   * @param socket the low-level HawkNL socket to pause.
+   * @param ms the time in milliseconds after which the socket is resumed
+   *           automatically, or 0 to pause it until resume is called.
+   */
+  void pause(NLsocket socket, int ms);
+
+  /**
+   * Resumes polling a socket paused with pause.  If the socket is not paused
+   * then no action takes place.
+   */
+  void resume(NLsocket socket);
+
+  /**
+   * Returns true if the socket is in the group polled for events, which it
+   * is while registered and not paused.
+   */
+  bool isPolled(NLsocket socket);
+
   /**
    * Tells the event generator to shutdown.  This function is called
    * internally on library cleanup, so you should not call it.
@@ -92,6 +133,34 @@ private:
 
   ConnectionsMap connections;
 
+  /**
+   * The group and listeners of the sockets given to regWrite.
+   */
+  NLint writeGroup;
+  ConnectionsMap writers;
+
+  /**
+   * Polls the group for the given status, and calls the listeners in
+   * listeners of the sockets found.  mapCtrl must not be acquired.
+   */
+  void poll(NLint pollGroup, NLenum status, ConnectionsMap& listeners,
+            int ms);
+
+  /**
+   * The registered sockets that are paused, and the time they resume.  A
+   * zero Time means the socket is paused until resume is called.
+   */
+  typedef std::map<NLsocket, Time> PausedMap;
+  typedef PausedMap::iterator PausedMapIter;
+  PausedMap paused;
+
+  /**
+   * Resumes the sockets whose pause time has passed, returning the number of
+   * milliseconds to the next automatic resume, or maxWait if that is sooner.
+   * mapCtrl must be acquired.
+   */
+  int resumeExpired( int maxWait );
+
   NLsocket* sockBuf;
 
   ConditionVariable mapCtrl;
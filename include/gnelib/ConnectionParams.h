@@ -21,6 +21,7 @@
  */
 
 #include <gnelib/SmartPointers.h>
+#include <gnelib/SessionToken.h>
 
 namespace GNE {
 class PacketFeeder;
@@ -158,6 +159,52 @@ public:
    */
   void setRates(int OutRate, int InRate);
 
+  /**
+   * The maximum number of packets that may wait in the incoming queue before
+   * %GNE stops reading from the connection.  The value 0 means no limit.
+   * Valid values are 0 or a positive integer.
+   *
+   * The default in queue limit is 0 (unlimited).
+   * @see PacketStream::setInQueueLimit
+   */
+  void setInQueueLimit(int limit);
+
+  /**
+   * Returns the value set by setInQueueLimit.
+   */
+  int getInQueueLimit() const;
+
+  /**
+   * The number of unreliable frames sent for each parity frame, which lets
+   * the remote side rebuild a lost frame.  The value 0 turns this off.
+   * Valid values are 0 or in the range [2..255].
+   *
+   * The default FEC group size is 0 (off).
+   * @see PacketStream::setFecGroupSize
+   */
+  void setFecGroupSize(int size);
+
+  /**
+   * Returns the value set by setFecGroupSize.
+   */
+  int getFecGroupSize() const;
+
+  /**
+   * Sets whether reliable frames may be compressed.  Compression is used
+   * only when both sides set this, and the remote side is using a version
+   * of %GNE that supports it.  Each side then compresses the frames it
+   * sends, using the FrameCompressor dictionary if both sides have the same
+   * one.  Use Connection::getCompressionStats to see if it pays off.
+   *
+   * The default for compression is false.
+   */
+  void setCompression(bool set);
+
+  /**
+   * Returns the value set by setCompression.
+   */
+  bool getCompression() const;
+
   /**
    * For client-side connections, this will set a local port, if you desire,
    * although most of the time you will want to keep this at its default value
@@ -191,6 +238,63 @@ public:
    */
   bool getUnrel() const;
 
+  /**
+   * For client-side connections, set this to true to make
+   * ClientConnection::connect use a few threads shared by all connections
+   * instead of starting a thread for each one.  The TCP connect is started
+   * without blocking on one of the threads set by GNE::setConnectThreads,
+   * the waits for it to finish and for the server's answer are driven by
+   * the event generator, and onConnect is called as the first event on the
+   * connection's own event thread, so many connections can be made at
+   * once, and an unreachable server only holds a socket until the
+   * handshake timeout.
+   *
+   * For server-side connections, set it in
+   * ServerConnectionListener::getNewConnectionParams to do the handshake
+   * the same way, on threads apart from the client's, and to call onNewConn
+   * on the event thread instead of on a thread for each connection.  A
+   * client that never sends its part of the handshake only holds a socket
+   * until the handshake timeout.
+   *
+   * The default for asyncConnect is false.
+   */
+  void setAsyncConnect(bool set);
+
+  /**
+   * Returns the value set by setAsyncConnect.
+   */
+  bool getAsyncConnect() const;
+
+  /**
+   * Sets the longest time in milliseconds to wait for each step of an event
+   * driven handshake, after which the connection fails with
+   * Error::ConnectionTimeOut.  0 means to wait forever.
+   *
+   * The default for handshakeTimeout is 10000.
+   */
+  void setHandshakeTimeout(int ms);
+
+  /**
+   * Returns the value set by setHandshakeTimeout.
+   */
+  int getHandshakeTimeout() const;
+
+  /**
+   * For client-side connections, sets the token of a session to resume,
+   * from Connection::getSessionToken of a connection to the same server
+   * that was lost.  If the server's SessionTable still holds the session,
+   * the new connection resumes it, and Connection::isResumed returns true.
+   * Otherwise a new session is started.
+   *
+   * The default is an invalid token, which starts a new session.
+   */
+  void setResumeToken(const SessionToken& token);
+
+  /**
+   * Returns the value set by setResumeToken.
+   */
+  SessionToken getResumeToken() const;
+
 private:
   SmartPtr<ConnectionListener> listener;
 
@@ -206,9 +310,21 @@ private:
 
   int inRate;
 
+  int inQueueLimit;
+
+  int fecGroupSize;
+
   int localPort;
 
   bool unrel;
+
+  bool compression;
+
+  bool asyncConnect;
+
+  int handshakeTimeout;
+
+  SessionToken resumeToken;
 };
 
 }
@@ -0,0 +1,181 @@
+#ifndef COROUTINES_H_INCLUDED_2F86B0D4
+#define COROUTINES_H_INCLUDED_2F86B0D4
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/**
+ * @file
+ * C++20 coroutine support for AsyncConnection.  The rest of %GNE only needs
+ * C++98, so this header is only included by the programs that use it, and
+ * is empty unless the compiler supports coroutines (such as with -std=c++20).
+ */
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <gnelib/AsyncConnection.h>
+#include <gnelib/ClientConnection.h>
+#include <gnelib/Errors.h>
+#include <gnelib/Packet.h>
+#include <coroutine>
+#include <exception>
+
+namespace GNE {
+
+/**
+ * @ingroup midlevel
+ *
+ * The return type of a coroutine that runs on its own once started, such as
+ * one for each connection:
+ *
+ * <pre>
+ * AsyncTask login( AsyncConnection::sptr conn, ClientConnection::sptr cli ) {
+ *   try {
+ *     co_await awaitConnect( *conn, cli );
+ *     conn->write( LoginPacket( name ) );
+ *     SmartPtr<LoginReplyPacket> reply =
+ *       co_await awaitReceive<LoginReplyPacket>( *conn );
+ *   } catch ( Error& e ) {
+ *     ...
+ *   }
+ * }
+ * </pre>
+ *
+ * The coroutine runs on the calling thread until its first co_await, and
+ * after that on the event thread that completes each step.  Its frame is
+ * freed when it returns.  An exception leaving the coroutine would have to
+ * be thrown on an event thread, so it ends the program instead; catch Error
+ * in the coroutine.
+ */
+struct AsyncTask {
+  struct promise_type {
+    AsyncTask get_return_object() { return AsyncTask(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+/**
+ * An AsyncConnection::Handler that resumes a coroutine.  Used by the
+ * awaiters below.
+ */
+class ResumeHandler : public AsyncConnection::Handler {
+public:
+  void onComplete( const SmartPtr<Packet>& packet, const Error& error ) {
+    result = packet;
+    this->error = error;
+    handle.resume();
+  }
+
+  /**
+   * Throws the error, if there was one.
+   */
+  void check() const {
+    if ( error.getCode() != Error::NoError )
+      throw error;
+  }
+
+  std::coroutine_handle<> handle;
+  SmartPtr<Packet> result;
+  Error error;
+};
+
+/**
+ * The awaiter returned by awaitConnect.
+ */
+class ConnectAwaiter {
+public:
+  ConnectAwaiter( AsyncConnection& conn, const ClientConnection::sptr& cli )
+    : conn( conn ), cli( cli ) {}
+
+  bool await_ready() const { return false; }
+
+  void await_suspend( std::coroutine_handle<> h ) {
+    handler.handle = h;
+    conn.connect( cli, handler );
+  }
+
+  void await_resume() const { handler.check(); }
+
+private:
+  AsyncConnection& conn;
+  ClientConnection::sptr cli;
+  ResumeHandler handler;
+};
+
+/**
+ * The awaiter returned by awaitReceive.
+ */
+template <class T>
+class ReceiveAwaiter {
+public:
+  explicit ReceiveAwaiter( AsyncConnection& conn ) : conn( conn ) {}
+
+  bool await_ready() {
+    handler.result = conn.tryReceive();
+    return static_cast<bool>( handler.result );
+  }
+
+  void await_suspend( std::coroutine_handle<> h ) {
+    handler.handle = h;
+    conn.receive( handler );
+  }
+
+  SmartPtr<T> await_resume() const {
+    handler.check();
+    if ( handler.result->getType() != T::ID )
+      throw PacketTypeMismatch( handler.result->getType() );
+    return static_pointer_cast<T>( handler.result );
+  }
+
+private:
+  AsyncConnection& conn;
+  ResumeHandler handler;
+};
+
+/**
+ * Connects cli, which must have been opened with conn as its listener, and
+ * resumes once connected.
+ *
+ * @throw Error if the connection failed.
+ */
+inline ConnectAwaiter awaitConnect( AsyncConnection& conn,
+                                    const ClientConnection::sptr& cli ) {
+  return ConnectAwaiter( conn, cli );
+}
+
+/**
+ * Resumes with the next packet, which must be of type T, as with
+ * SyncConnection::receive.  If it is not, PacketTypeMismatch is thrown and
+ * the packet is lost.
+ *
+ * @throw Error if the connection failed.
+ */
+template <class T>
+ReceiveAwaiter<T> awaitReceive( AsyncConnection& conn ) {
+  return ReceiveAwaiter<T>( conn );
+}
+
+} //namespace GNE
+
+#endif
+
+#endif
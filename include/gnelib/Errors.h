@@ -113,7 +113,7 @@ private:
  */
 class UnknownPacket : public Error {
 public:
-  UnknownPacket( int type ) : type( type ) {}
+  UnknownPacket( int type ) : Error( Error::UnknownPacket ), type( type ) {}
 
   virtual ~UnknownPacket() {}
 
@@ -27,10 +27,12 @@
 #include <gnelib/Time.h>
 #include <gnelib/SmartPtr.h>
 #include <gnelib/WeakPtr.h>
+#include <gnelib/HandshakeQueue.h>
 
 namespace GNE {
 class ConnectionListener;
 class Connection;
+class SyncConnection;
 
 /**
  * @ingroup internal
@@ -132,6 +134,16 @@ public:
    */
   void onReceive();
 
+  /**
+   * Runs the step as the first event, before any other, so the
+   * ConnectionListener's onConnect or onNewConn is called on this thread.
+   * While it runs, receive and error events also wake sConn directly, since
+   * onConnect may wait on it for packets.  This must be called before the
+   * thread is started.
+   */
+  void onConnect( const HandshakeQueue::Step::sptr& step,
+                  const SmartPtr<SyncConnection>& sConn );
+
   /**
    * Overrides Thread::shutDown so that the daemon thread will
    * be woken up since it might be waiting on a ConditionVariable.  Once it
@@ -195,6 +207,11 @@ private:
   //If this is true, we have a onFailure event which takes precedence over
   //everything.
   Error* failure;
+
+  //The step calling onConnect or onNewConn, which comes before even a
+  //failure, and the SyncConnection it connects, set until the step is done.
+  HandshakeQueue::Step::sptr connectStep;
+  SmartPtr<SyncConnection> connectSConn;
 };
 
 }
@@ -0,0 +1,181 @@
+#ifndef FRAMECOMPRESSOR_H_INCLUDED_6C19E7A2
+#define FRAMECOMPRESSOR_H_INCLUDED_6C19E7A2
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Mutex.h>
+#include <gnelib/Time.h>
+#include <gnelib/gnetypes.h>
+
+namespace GNE {
+class Buffer;
+
+/**
+ * @ingroup midlevel
+ *
+ * Statistics about the compression of a connection's frames, returned by
+ * Connection::getCompressionStats.
+ */
+struct CompressionStats {
+  CompressionStats() : framesSent(0), framesCompressed(0), bytesBefore(0),
+    bytesAfter(0), framesDecompressed(0), compressTime(0, 0),
+    decompressTime(0, 0) {}
+
+  /**
+   * The number of reliable frames that were given to the compressor.
+   */
+  int framesSent;
+
+  /**
+   * The number of those frames that were smaller compressed, and so were
+   * sent compressed.
+   */
+  int framesCompressed;
+
+  /**
+   * The total size of the frames given to the compressor.
+   */
+  unsigned long bytesBefore;
+
+  /**
+   * The total size of those frames as they were sent, compressed or not.
+   */
+  unsigned long bytesAfter;
+
+  /**
+   * The number of compressed frames received.
+   */
+  int framesDecompressed;
+
+  /**
+   * The total time spent compressing frames.
+   */
+  Time compressTime;
+
+  /**
+   * The total time spent decompressing frames.
+   */
+  Time decompressTime;
+
+  /**
+   * Returns bytesAfter / bytesBefore, or 1 if nothing was sent yet.  Values
+   * below 1 mean the compression is saving bandwidth.
+   */
+  double getRatio() const {
+    return bytesBefore ? (double)bytesAfter / (double)bytesBefore : 1.0;
+  }
+};
+
+/**
+ * @ingroup internal
+ *
+ * Compresses whole frames with a small LZ77 coder, in the same style as LZ4,
+ * for connections that agreed on compression in the handshake.  Frames are
+ * only a few hundred bytes, so the coder can optionally use a preset
+ * dictionary of data typical for the game, which both sides must have set
+ * with setDictionary.  The connection handshake checks that the
+ * dictionaries match before it is used.
+ *
+ * A compressed frame starts with FRAME_ID, which is reserved from the range
+ * of %GNE packet IDs and never registered with the PacketParser, followed
+ * by a flag byte, the uncompressed length, and the compressed data.  Frames
+ * that would not get smaller are sent as they are.
+ *
+ * Compressing and decompressing may happen at the same time from different
+ * threads.
+ */
+class FrameCompressor {
+public:
+  FrameCompressor();
+
+  /**
+   * The ID that marks the start of a compressed frame.
+   */
+  static const int FRAME_ID;
+
+  /**
+   * The longest preset dictionary allowed.
+   */
+  static const int MAX_DICTIONARY_LEN;
+
+  /**
+   * Sets the preset dictionary used by all connections, which should be
+   * samples of the data the game sends.  Only the last MAX_DICTIONARY_LEN
+   * bytes are used, and the data is copied.  Pass a length of 0 to remove
+   * the dictionary.  This must be called before any connections are made,
+   * and both sides must use the same dictionary for it to be used.
+   */
+  static void setDictionary(const gbyte* data, int len);
+
+  /**
+   * Returns a hash that identifies the current dictionary, or 0 if none is
+   * set.
+   */
+  static guint32 getDictionaryHash();
+
+  /**
+   * Sets whether the dictionary is used when compressing.  This should be
+   * set only if the remote side has the same dictionary.
+   */
+  void setUseDictionary(bool use);
+
+  /**
+   * Compresses the frame in raw, from 0 to its position, into out.  If the
+   * result is smaller it is written to out and true is returned, else out is
+   * unchanged and false is returned.  Either way the stats are updated.
+   */
+  bool compress(const Buffer& raw, Buffer& out);
+
+  /**
+   * Decompresses a frame starting with FRAME_ID at the position of in into
+   * out, which is then flipped for reading.  Returns false if the data is
+   * not valid.
+   */
+  bool decompress(Buffer& in, Buffer& out);
+
+  /**
+   * Returns the stats so far.
+   */
+  CompressionStats getStats() const;
+
+  /**
+   * Compresses len bytes of src into dst, which has room for cap bytes.
+   * Returns the size of the result, or 0 if it would not fit.  This is the
+   * raw coder, without the frame header.
+   */
+  static int compressBlock(const gbyte* src, int len, gbyte* dst, int cap,
+                           bool useDict);
+
+  /**
+   * Decompresses len bytes of src into dst, which must then hold exactly
+   * dstLen bytes.  Returns false if the data is not valid.
+   */
+  static bool decompressBlock(const gbyte* src, int len, gbyte* dst,
+                              int dstLen, bool useDict);
+
+private:
+  bool useDict;
+  CompressionStats stats;
+  mutable Mutex sync;
+};
+
+} //namespace GNE
+
+#endif
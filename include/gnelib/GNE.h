@@ -54,6 +54,24 @@ namespace GNE {
    */
   bool initGNE(NLenum networkType, int (*atexit_ptr)(void (*func)(void)), int timeToClose = 10000 );
 
+  /**
+   * Sets how many threads run the handshakes of connections made with
+   * ConnectionParams::setAsyncConnect, for each of the client and server
+   * sides.  These threads only parse the packets of the handshake once they
+   * arrive, so a few can serve many connections.  The default is 4.  Call
+   * this before initGNE for it to take effect.
+   */
+  void setHandshakeThreads( int threads );
+
+  /**
+   * Sets how many threads start connecting the sockets of ClientConnections
+   * made with ConnectionParams::setAsyncConnect.  The connect does not
+   * block, and the wait for it to finish holds no thread, so a few serve
+   * many connections.  The default is 4.  Call this before initGNE for it
+   * to take effect.
+   */
+  void setConnectThreads( int threads );
+
   /**
    * Shuts down %GNE and HawkNL.  All open connections will be closed, all
    * active timers will be shut down, and the shutDown method of all of the
@@ -0,0 +1,200 @@
+#ifndef HANDSHAKEQUEUE_H_INCLUDED_8A5F13C6
+#define HANDSHAKEQUEUE_H_INCLUDED_8A5F13C6
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/ConditionVariable.h>
+#include <gnelib/Thread.h>
+#include <gnelib/Time.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/WeakPtr.h>
+#include <gnelib/Error.h>
+#include <nl.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace GNE {
+
+/**
+ * @ingroup internal
+ *
+ * Runs the steps of connection handshakes on a few shared threads, instead
+ * of a thread for each connection.  A step that must wait for the remote
+ * side calls waitForData, which registers its socket with the
+ * ConnectionEventGenerator, and the step is posted again when data arrives.
+ * Steps that wait too long are cancelled.  Users of GNE should not need to use or
+ * know about this class.
+ */
+class HandshakeQueue {
+public:
+  typedef SmartPtr<HandshakeQueue> sptr;
+  typedef WeakPtr<HandshakeQueue> wptr;
+
+  /**
+   * A step of a handshake.
+   */
+  class Step {
+  public:
+    typedef SmartPtr<Step> sptr;
+
+    virtual ~Step();
+
+    /**
+     * Runs the step on one of the queue's threads.
+     */
+    virtual void run() = 0;
+
+    /**
+     * Called on one of the queue's threads instead of run when the step
+     * waited too long, with an error of Error::ConnectionTimeOut, or on the
+     * thread shutting down %GNE, with Error::ConnectionAborted, for steps
+     * waiting or posted but not run.  A socket given to waitForData is
+     * unregistered before this is called.
+     */
+    virtual void cancel( const Error& error ) = 0;
+  };
+
+  /**
+   * Creates a queue that starts the given number of threads once the first
+   * step is posted.
+   */
+  static sptr create( int threads );
+
+  ~HandshakeQueue();
+
+  /**
+   * Runs the step as soon as a thread is free.
+   */
+  void post( const Step::sptr& step );
+
+  /**
+   * Keeps the step until endWait is called for it, or until ms milliseconds
+   * pass, when it is cancelled.  If ms is 0, it waits until endWait.
+   */
+  void wait( const Step::sptr& step, int ms );
+
+  /**
+   * Stops a step waiting.  Returns false if it was not waiting, because it
+   * was cancelled already, in which case the caller must leave it alone.
+   */
+  bool endWait( const Step::sptr& step );
+
+  /**
+   * Waits like wait until data arrives on the socket, and then posts the
+   * step again.  The socket is registered with the ConnectionEventGenerator
+   * while the step waits, and unregistered before the step is posted or
+   * cancelled.
+   */
+  void waitForData( const Step::sptr& step, NLsocket socket, int ms );
+
+  /**
+   * Waits like waitForData, but until the socket can be written to, such as
+   * once a non-blocking connect has finished.
+   */
+  void waitForWrite( const Step::sptr& step, NLsocket socket, int ms );
+
+  /**
+   * Returns the number of steps waiting.
+   */
+  int getWaitingCount() const;
+
+  /**
+   * Stops the threads, and cancels every step not run.  This is called on
+   * %GNE shutdown, which waits for the threads with the other SYSTEM
+   * threads.  The threads hold the queue until they end, so it must be
+   * called before the queue can be destroyed once a step was posted.
+   */
+  void shutDown();
+
+private:
+  explicit HandshakeQueue( int threads );
+
+  /**
+   * Weak pointer to this, given to the threads.
+   */
+  wptr thisPtr;
+
+  class Worker;
+  friend class Worker;
+  class DataListener;
+  friend class DataListener;
+
+  /**
+   * Adds the step to waiting, returning false if stopping.  sync must be
+   * locked.
+   */
+  bool addWaiting( const Step::sptr& step, NLsocket socket, int ms );
+
+  /**
+   * Removes the waiting step, returning false if it was not waiting.  sync
+   * must be locked.
+   */
+  bool removeWaiting( Step* step );
+
+  /**
+   * Implements waitForData and waitForWrite.
+   */
+  void waitForSocket( const Step::sptr& step, NLsocket socket, int ms,
+                      bool write );
+
+  /**
+   * Starts the threads if they are not running yet.  sync must be locked.
+   */
+  void startWorkers();
+
+  /**
+   * The loop run by each of the threads.
+   */
+  void work();
+
+  /**
+   * Moves the steps whose time has passed to expired, returning the time
+   * in milliseconds until the next one will, or maxWait if that is sooner.
+   * sync must be locked.
+   */
+  int expire( std::vector<Step::sptr>& expired, int maxWait );
+
+  int threadCount;
+  std::vector<Thread::sptr> workers;
+
+  mutable ConditionVariable sync;
+  bool stopping;
+
+  std::deque<Step::sptr> ready;
+
+  /**
+   * A step waiting, with the time it is cancelled, or 0, and the socket it
+   * waits on, or NL_INVALID.
+   */
+  struct Waiting {
+    Time deadline;
+    Step::sptr step;
+    NLsocket socket;
+  };
+
+  std::map<Step*, Waiting> waiting;
+  std::set<std::pair<Time, Step*> > deadlines;
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef INTERESTGRID_H_INCLUDED_2B6E41D9
+#define INTERESTGRID_H_INCLUDED_2B6E41D9
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace GNE {
+
+/**
+ * @ingroup highlevel
+ *
+ * Decides which objects each client is interested in from where they are,
+ * so that ObjectBrokerServer only sends a client the objects near it.  The
+ * world is split into square cells, and each viewer, usually one for each
+ * client, sees the objects in every cell its view touches.
+ *
+ * Positions are given as objects and viewers move, and the set of objects
+ * each viewer sees is kept up to date as they do, by only looking at the
+ * cells an object or view moved into or out of, so the cost of a move does
+ * not depend on the number of objects.  Each tick, getChanges gives the
+ * objects that came into and went out of view, which need an
+ * ObjectCreationPacket and an ObjectDeathPacket sent to that client, and
+ * getInterests gives the IDs to pass to
+ * ObjectBrokerServer::getDeltaPackets( ObjectBaselines&, const std::set<int>& ).
+ *
+ * Objects are known by their object IDs, so they must be removed here when
+ * they are deregistered.  This class is not thread safe, except that
+ * getChanges and getInterests may be called at once for different viewers
+ * while nothing else uses the grid, as ReplicationFanout does.
+ */
+class InterestGrid {
+public:
+  /**
+   * Creates an empty grid with cells of the given size, which must be
+   * positive.  Cells about the size of a view radius work well.
+   */
+  explicit InterestGrid( float cellSize );
+
+  ~InterestGrid();
+
+  /**
+   * Returns the size of the cells.
+   */
+  float getCellSize() const;
+
+  /**
+   * Returns the number of objects in the grid.
+   */
+  int getObjectCount() const;
+
+  /**
+   * Returns the number of viewers.
+   */
+  int getViewerCount() const;
+
+  /**
+   * Adds a viewer at the given position, that sees the objects in the cells
+   * within radius of it in both directions, and returns its ID.  The objects
+   * it can see already are in its first getChanges.
+   */
+  int addViewer( float x, float y, float radius );
+
+  /**
+   * Moves a viewer.
+   */
+  void moveViewer( int viewer, float x, float y );
+
+  /**
+   * Removes a viewer, after which its ID is not used again.
+   */
+  void removeViewer( int viewer );
+
+  /**
+   * Sets the position of an object, adding it if it is not in the grid.
+   */
+  void moveObject( int objectId, float x, float y );
+
+  /**
+   * Removes an object, which leaves the view of all viewers that saw it.
+   */
+  void removeObject( int objectId );
+
+  /**
+   * Returns true if the viewer sees the object.
+   */
+  bool isInterested( int viewer, int objectId ) const;
+
+  /**
+   * Returns the IDs of the objects the viewer sees.
+   */
+  const std::set<int>& getInterests( int viewer ) const;
+
+  /**
+   * Gets the objects that came into view and went out of view of the viewer
+   * since the last call, appending them to entered and left.  An object
+   * that came into view and left again in that time is in neither.
+   */
+  void getChanges( int viewer, std::vector<int>& entered,
+                   std::vector<int>& left );
+
+private:
+  InterestGrid( const InterestGrid& );
+  InterestGrid& operator=( const InterestGrid& );
+
+  typedef std::pair<int, int> CellKey;
+
+  /**
+   * A rectangle of cells, with the max inclusive.
+   */
+  struct CellRange {
+    int minX, minY, maxX, maxY;
+
+    bool contains( const CellKey& cell ) const;
+  };
+
+  struct Viewer;
+
+  struct Cell {
+    std::vector<int> objects;
+    std::vector<Viewer*> viewers;
+  };
+
+  struct Viewer {
+    float radius;
+    CellRange range;
+    std::set<int> interests;
+
+    /**
+     * The objects whose view changed since the last getChanges, to true if
+     * they came into view.
+     */
+    std::map<int, bool> changes;
+  };
+
+  CellKey getCell( float x, float y ) const;
+
+  CellRange getRange( float x, float y, float radius ) const;
+
+  /**
+   * Adds or removes the viewer from every cell in range, and every object in
+   * them from its interests.
+   */
+  void addView( Viewer& viewer, const CellRange& range );
+  void removeView( Viewer& viewer, const CellRange& range );
+
+  /**
+   * Erases the cell if it has no objects or viewers.
+   */
+  void pruneCell( std::map<CellKey, Cell>::iterator cell );
+
+  static void enter( Viewer& viewer, int objectId );
+  static void leave( Viewer& viewer, int objectId );
+
+  Viewer& getViewer( int viewer );
+  const Viewer& getViewer( int viewer ) const;
+
+  float cellSize;
+
+  int nextViewer;
+
+  std::map<CellKey, Cell> cells;
+
+  /**
+   * The cells keep pointers to these, which a map never moves.
+   */
+  std::map<int, Viewer> viewers;
+
+  /**
+   * The cell of each object.
+   */
+  std::map<int, CellKey> objects;
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef INTERPOLATIONBUFFER_H_INCLUDED_5C0E8A27
+#define INTERPOLATIONBUFFER_H_INCLUDED_5C0E8A27
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Time.h>
+#include <gnelib/PingPacket.h>
+#include <vector>
+
+namespace GNE {
+
+/**
+ * @ingroup highlevel
+ *
+ * Keeps the last few states of a replicated object, each with the server
+ * time it was for, so that the client can show the object as it was a
+ * short delay ago, between two states it already has, instead of jumping
+ * to each state as it arrives.  Network jitter then does not show up as
+ * jerky movement, and the server can send updates less often.
+ *
+ * A state is a fixed number of float values, such as a position and a
+ * velocity, added with add when an update arrives, such as from
+ * NetworkObject::readField or incomingUpdatePacket.  The server time of a
+ * state is up to the game, such as its tick number times the tick length,
+ * sent in the update.  Each frame, sample gives the values at the current
+ * time on the server's clock less the delay, found from the clock offset
+ * measured by a PingPacket, passed to useClockOffset.  When the newest
+ * state is older than that, because updates stopped or were lost, the
+ * values are extrapolated from the last two states, for up to the
+ * extrapolation limit.
+ *
+ * The states are kept in a ring, so adding one never allocates.  States
+ * arriving out of order are put in their place, and those older than every
+ * state kept when it is full are dropped.  This class is not thread safe.
+ */
+class InterpolationBuffer {
+public:
+  /**
+   * Creates a buffer for states of valueCount values, keeping up to
+   * capacity of them.  The delay starts at 100ms and the extrapolation
+   * limit at 250ms.
+   */
+  explicit InterpolationBuffer( int valueCount, int capacity = 32 );
+
+  ~InterpolationBuffer();
+
+  int getValueCount() const;
+
+  int getCapacity() const;
+
+  /**
+   * Returns the number of states kept.
+   */
+  int getSampleCount() const;
+
+  /**
+   * Returns the server time of the newest state, or 0 if there are none.
+   */
+  Time getNewestTime() const;
+
+  /**
+   * Sets how far behind the server's clock states are shown.  This should
+   * be a bit more than the time between updates, plus the jitter, so that
+   * there is usually a newer state to move towards.
+   */
+  void setDelay( const Time& delay );
+
+  Time getDelay() const;
+
+  /**
+   * Sets how far past the newest state values are extrapolated.  After
+   * that, the values stay where they are until a newer state arrives.
+   */
+  void setMaxExtrapolation( const Time& limit );
+
+  Time getMaxExtrapolation() const;
+
+  /**
+   * Sets the offset from the local clock, Timer::getCurrentTime, to the
+   * server's, so that the server's time is the local time plus offset.
+   */
+  void setClockOffset( const Time& offset );
+
+  /**
+   * Uses the clock offset from a PingPacket reply sent to the server.  The
+   * offset of the reply with the lowest ping of the last few is used,
+   * because a reply delayed on one way is what makes an offset wrong.
+   * Replies whose request was not found, with a ping time of 0, are
+   * ignored.
+   */
+  void useClockOffset( const PingInformation& info );
+
+  Time getClockOffset() const;
+
+  /**
+   * Adds the state for the given server time, with getValueCount values.  A
+   * state with the same time as one kept replaces it.
+   *
+   * @return false if the state was dropped because it is older than all
+   *         those kept and the buffer is full.
+   */
+  bool add( const Time& serverTime, const float* values );
+
+  /**
+   * Writes the values to show at the given local time, which is usually
+   * Timer::getCurrentTime, to values.  This is the same as sampleAt with
+   * that time on the server's clock less the delay.
+   *
+   * @return false if there are no states, in which case values is not
+   *         changed.
+   */
+  bool sample( const Time& localTime, float* values ) const;
+
+  /**
+   * Writes the values for the given server time to values, interpolated
+   * between the states around it.  Before the oldest state its values are
+   * given, and after the newest they are extrapolated.
+   *
+   * @return false if there are no states, in which case values is not
+   *         changed.
+   */
+  bool sampleAt( const Time& serverTime, float* values ) const;
+
+  /**
+   * Removes every state, but keeps the clock offset.
+   */
+  void clear();
+
+private:
+  /**
+   * Returns the ring index of the ith oldest state.
+   */
+  int slot( int i ) const;
+
+  /**
+   * Writes a + (b - a) * t to values, from the states in slots a and b.
+   */
+  void blend( int a, int b, double t, float* values ) const;
+
+  int valueCount;
+  int capacity;
+
+  /**
+   * The ring of states, capacity of them starting at start, with values
+   * holding valueCount floats for each.
+   */
+  std::vector<Time> times;
+  std::vector<float> values;
+  int start;
+  int count;
+
+  Time delay;
+  Time maxExtrapolation;
+  Time clockOffset;
+
+  /**
+   * The last few ping replies given to useClockOffset, oldest first.
+   */
+  std::vector<PingInformation> pings;
+};
+
+} //namespace GNE
+
+#endif
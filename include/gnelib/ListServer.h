@@ -0,0 +1,340 @@
+#ifndef LISTSERVER_H_INCLUDED_4D93B1E6
+#define LISTSERVER_H_INCLUDED_4D93B1E6
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/ReceiveEventListener.h>
+#include <gnelib/Address.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/Time.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/WeakPtr.h>
+#include <gnelib/gnetypes.h>
+#include <nl.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace GNE {
+
+/**
+ * @ingroup highlevel
+ *
+ * A master server that keeps the list of running game servers, and answers
+ * the queries of clients looking for a game, all over one UDP socket.  Game
+ * servers register and send heartbeats with
+ * ListServerConnection::sendHeartbeat, and are dropped from the list if
+ * they stop for getServerTimeout.  Clients get the servers of a game with
+ * ListServerConnection::getGameList, which can filter them by mod and by
+ * whether they are full or empty.
+ *
+ * The list is kept in memory by game.  Each server's entry is serialized
+ * once, when its heartbeat changes it, and each page of an answer is made
+ * from those entries once for each filter asked for, and then sent as it is
+ * to every client asking for it, until the game's list changes.  Pages are
+ * made again at most every getRefreshInterval, so a game whose servers
+ * change all the time does not make its pages over for each query.  Each
+ * page fits in one datagram, and clients ask for each page of a long list.
+ *
+ * All of the methods in this class are safe to call from multiple threads at
+ * the same time.
+ */
+class ListServer {
+public:
+  typedef SmartPtr<ListServer> sptr;
+  typedef WeakPtr<ListServer> wptr;
+
+  /**
+   * The types of the datagrams sent to and from a ListServer.  Each starts
+   * with MAGIC and then the type.
+   */
+  enum MessageType {
+    /**
+     * From a game server: its port, game, mod, name, player count, most
+     * players, and info.
+     */
+    Heartbeat = 1,
+    /**
+     * From a game server: its port, when it stops.
+     */
+    Remove = 2,
+    /**
+     * From a client: an id echoed in the answer, the game, the mod or an
+     * empty string for any, the QueryFlags, and the page wanted.  The
+     * query is padded with zeros to PAGE_LEN bytes, so that a forged source
+     * address can't be sent more than the query's own size.
+     */
+    Query = 3,
+    /**
+     * To a client: the query id, the page, the number of pages, and the
+     * number of servers in the page, followed by the address, mod, name,
+     * player count, most players, and info of each.
+     */
+    QueryAnswer = 4
+  };
+
+  /**
+   * Filters a query can ask for.
+   */
+  enum QueryFlags {
+    /**
+     * Leave out the servers that have as many players as they can hold.
+     */
+    NotFull = 0x01,
+    /**
+     * Leave out the servers with no players.
+     */
+    NotEmpty = 0x02
+  };
+
+  /**
+   * The first four bytes of every datagram.
+   */
+  static const guint32 MAGIC;
+
+  /**
+   * The most bytes in a datagram sent or received.
+   */
+  static const int PAGE_LEN;
+
+  /**
+   * The most pages a query can be answered with.  The servers that don't
+   * fit are left out.
+   */
+  static const int MAX_PAGES;
+
+  /**
+   * The longest game, mod, or server name kept.  Longer ones are cut.
+   */
+  static const int MAX_NAME_LEN;
+
+  /**
+   * The longest server info kept.  Longer info is cut.
+   */
+  static const int MAX_INFO_LEN;
+
+  /**
+   * Creates a new, unopened, ListServer.
+   */
+  static sptr create();
+
+  /**
+   * Closes the socket if it is open.
+   */
+  virtual ~ListServer();
+
+  /**
+   * Opens the socket on the given port and starts answering on it.  If the
+   * socket is already open, this method has no effect and returns false.
+   *
+   * @return true if the socket could not be opened.
+   */
+  bool open(int port);
+
+  /**
+   * Closes the socket.  The list is kept, but servers will time out if the
+   * socket is not opened again soon.  It is OK to call this even if not
+   * open.
+   */
+  void close();
+
+  /**
+   * Returns true if the socket is open.
+   */
+  bool isOpen() const;
+
+  /**
+   * Returns the local address of the socket, or an invalid Address if the
+   * socket is not open.
+   */
+  Address getLocalAddress() const;
+
+  /**
+   * Returns the time in milliseconds after its last heartbeat that a server
+   * is dropped from the list.
+   */
+  int getServerTimeout() const;
+
+  /**
+   * Sets the time in milliseconds after its last heartbeat that a server is
+   * dropped from the list.  The default is 60000.
+   */
+  void setServerTimeout(int ms);
+
+  /**
+   * Returns the least time in milliseconds between making the pages for a
+   * filter of a game again after its list changes.
+   */
+  int getRefreshInterval() const;
+
+  /**
+   * Sets the least time in milliseconds between making the pages for a
+   * filter of a game again after its list changes, which is the longest
+   * time an answer can be out of date.  0 makes the pages again for the
+   * first query after each change.  The default is 1000.
+   */
+  void setRefreshInterval(int ms);
+
+  /**
+   * Returns the number of servers listed, for all games.
+   */
+  int getServerCount() const;
+
+  /**
+   * Returns the number of servers listed for a game.
+   */
+  int getServerCount(const std::string& game) const;
+
+  /**
+   * Handles a datagram received from the given address, as if it came in
+   * on the socket, sending any answer with send.  Datagrams that are not
+   * valid are ignored.
+   */
+  void process(const gbyte* data, int length, const Address& from);
+
+protected:
+  ListServer();
+
+  /**
+   * Classes inheriting ListServer must call this from their create function
+   * before using open.
+   */
+  void setThisPointer(const sptr& thisPointer);
+
+  /**
+   * Sends an answer.  This sends it on the socket, but can be overridden,
+   * for example to measure the server without a network.
+   */
+  virtual void send(const Address& dest, const Buffer& data);
+
+private:
+  /**
+   * A listed server, and its entry as written in the answer pages.
+   */
+  struct Server {
+    std::string mod;
+    int players;
+    int maxPlayers;
+    std::vector<gbyte> entry;
+    Time lastHeard;
+  };
+
+  typedef std::map<std::string, Server> Servers;
+
+  /**
+   * The pages answering the queries with one filter, made for the version
+   * of the game's list given.
+   */
+  struct Pages {
+    Pages() : version( 0 ) {}
+
+    guint32 version;
+    Time made;
+    std::vector< std::vector<gbyte> > pages;
+    std::vector<int> counts;
+  };
+
+  typedef std::map<std::pair<std::string, int>, Pages> PagesMap;
+
+  struct Game {
+    Game() : version( 1 ) {}
+
+    Servers servers;
+
+    /**
+     * Changed when the servers listed change.
+     */
+    guint32 version;
+
+    PagesMap pages;
+  };
+
+  typedef std::map<std::string, Game> Games;
+
+  /**
+   * Handles a datagram in the Buffer, from its position to its limit.
+   */
+  void handle(Buffer& in, const Address& from);
+
+  void onHeartbeat(Buffer& in, const Address& from);
+
+  void onRemove(Buffer& in, const Address& from);
+
+  void onQuery(Buffer& in, const Address& from);
+
+  /**
+   * Makes the pages for a filter of a game.  sync must be locked.
+   */
+  void makePages(const Game& game, const std::string& mod, int flags,
+                 Pages& pages);
+
+  /**
+   * Drops the servers not heard from in time, at most once a second.  sync
+   * must be locked.
+   */
+  void dropOldServers(const Time& now);
+
+  /**
+   * Reads one datagram and processes it.
+   */
+  void onReceive();
+
+  /**
+   * Closes the socket.  sockSync must be held.
+   */
+  void rawClose();
+
+  class Listener : public ReceiveEventListener {
+  public:
+    Listener(const ListServer::sptr& owner) : owner(owner) {}
+
+    void onReceive() {
+      ListServer::sptr o = owner.lock();
+      if (o)
+        o->onReceive();
+    }
+
+  private:
+    ListServer::wptr owner;
+  };
+
+  wptr this_;
+
+  /**
+   * The list, guarded by sync.
+   */
+  Games games;
+  int serverCount;
+  int serverTimeout;
+  int refreshInterval;
+  Time lastDrop;
+  mutable Mutex sync;
+
+  /**
+   * The socket, guarded by sockSync.
+   */
+  NLsocket socket;
+  mutable Mutex sockSync;
+};
+
+} //namespace GNE
+
+#endif
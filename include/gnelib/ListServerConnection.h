@@ -20,51 +20,169 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-#include <gnelib/Connection.h>
-#include <gnelib/ClientConnection.h>
+#include <gnelib/Address.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/WeakPtr.h>
+#include <gnelib/gnetypes.h>
+#include <nl.h>
+#include <string>
+#include <vector>
 
 namespace GNE {
 
 /**
  * @ingroup highlevel
  *
- * A Client-side connection to a game list server for retriving a list of
- * games.  This stuff is all very preliminary.  List server code will be
- * completed last so don't pay attention to these classes at all.
+ * The connection of a game server or a client to a ListServer, over UDP.
+ * A game server calls sendHeartbeat every so often, well within the list
+ * server's ListServer::getServerTimeout, to stay listed, and sendRemove
+ * when it stops.  A client calls getGameList to get the servers of its
+ * game.
  *
- * \todo The List server code will be completed only after the rest of GNE
- *       works and has been tested and finalized.
+ * A list longer than fits in one datagram is sent in pages, which
+ * getGameList asks for all at once after learning how many there are.  If
+ * the list changes between pages, a server may be missing or be listed
+ * twice.
+ *
+ * All of the methods in this class are safe to call from multiple threads at
+ * the same time, but only one thread at a time gets a list.
  */
-class ListServerConnection : public ClientConnection {
+class ListServerConnection {
 public:
+  typedef SmartPtr<ListServerConnection> sptr;
+  typedef WeakPtr<ListServerConnection> wptr;
+
   /**
    * Data about each game.
    */
   struct GameListData {
+    GameListData() : numPlayers( 0 ), maxPlayers( 0 ), latency( -1 ) {}
+
     std::string gameName;
 
     std::string modName;
 
     std::string serverName;
 
+    /**
+     * The address of the game server, as given by Address::toString.  It is
+     * not used by sendHeartbeat, since the list server uses the address the
+     * heartbeat came from.
+     */
     std::string address;
 
     int numPlayers;
 
-    int latency;
+    int maxPlayers;
 
-    void* gameSpecificData;
+    /**
+     * The list server does not know the latency to the game servers, so
+     * this is -1 in the lists from getGameList, for the application to fill
+     * in by pinging the servers it is interested in.
+     */
+    int latency;
 
+    /**
+     * Game specific data, up to ListServer::MAX_INFO_LEN bytes.
+     */
+    std::string info;
   };
 
-  ListServerConnection(std::string address);
+  /**
+   * Creates a connection to the list server at the given address.  open
+   * must be called before using it.
+   */
+  static sptr create(const Address& listServer);
 
+  /**
+   * Closes the socket if it is open.
+   */
   virtual ~ListServerConnection();
 
-  void setGame(std::string gameName);
+  /**
+   * Opens the socket.  If it is already open, this method has no effect and
+   * returns false.
+   *
+   * @return true if the socket could not be opened.
+   */
+  bool open();
 
-  void getGameList();
+  /**
+   * Closes the socket.  It is OK to call this even if not open.
+   */
+  void close();
+
+  /**
+   * Sets the game that heartbeats are sent for and lists are asked for.
+   */
+  void setGame(const std::string& gameName);
 
+  /**
+   * Returns the game set by setGame.
+   */
+  std::string getGame() const;
+
+  /**
+   * Sends a heartbeat for a game server of the game set with setGame, with
+   * the mod, name, player counts and info in server.  port is the port the
+   * game server listens on, or 0 if it is the port of this socket.
+   *
+   * @return true if the heartbeat could not be sent.
+   */
+  bool sendHeartbeat(const GameListData& server, int port);
+
+  /**
+   * Tells the list server that the game server listening on the given port
+   * has stopped.
+   *
+   * @return true if the message could not be sent.
+   */
+  bool sendRemove(int port);
+
+  /**
+   * Gets the list of the servers of the game set with setGame, blocking for
+   * up to timeout milliseconds.  Pages that do not arrive are asked for
+   * again a few times before the timeout.
+   *
+   * @param list the servers found are added to this list.
+   * @param mod only servers of this mod are listed, or all if empty.
+   * @param flags ListServer::QueryFlags to leave out some servers.
+   * @param timeout the longest time to wait, in milliseconds.
+   * @return true if the whole list did not arrive in time, in which case
+   *         the servers of the pages that did are still added.
+   */
+  bool getGameList(std::vector<GameListData>& list,
+                   const std::string& mod = std::string(), int flags = 0,
+                   int timeout = 2000);
+
+private:
+  explicit ListServerConnection(const Address& listServer);
+
+  /**
+   * Sends the query for a page.  sync must be locked.
+   */
+  bool sendQuery(guint32 id, const std::string& mod, int flags, int page);
+
+  Address listServer;
+
+  std::string game;
+
+  guint32 nextQueryId;
+
+  /**
+   * The socket, and a group holding only it to wait for answers with a
+   * timeout.
+   */
+  NLsocket socket;
+  NLint group;
+
+  mutable Mutex sync;
+
+  /**
+   * Held by getGameList, so that one thread at a time reads answers.
+   */
+  Mutex querySync;
 };
 
 }
@@ -0,0 +1,196 @@
+#ifndef MESSAGEFRAGMENTER_H_INCLUDED_5C93E0A1
+#define MESSAGEFRAGMENTER_H_INCLUDED_5C93E0A1
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Mutex.h>
+#include <gnelib/SmartPointers.h>
+#include <gnelib/gnetypes.h>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace GNE {
+class Buffer;
+class MessagePacket;
+
+/**
+ * @ingroup internal
+ *
+ * Keeps the state for the messages that PacketStream sends with
+ * writeMessage.  Outgoing messages are split into MessagePacket fragments
+ * that fill whatever room is left in a frame, one message after another.
+ * Since fragments are sent on the reliable connection they arrive whole
+ * and in order, so the receiver only has to append each one to the message
+ * it is building, and any fragment that does not continue it is a protocol
+ * violation.
+ *
+ * This class only keeps the state, and it is up to PacketStream to decide
+ * which frames the fragments go in.  All methods are thread safe.
+ */
+class MessageFragmenter {
+public:
+  MessageFragmenter();
+
+  ~MessageFragmenter();
+
+  /**
+   * How far a message has been sent or received.
+   */
+  struct Progress {
+    int messageId;
+    int done;
+    int total;
+  };
+
+  /**
+   * The result of receive.
+   */
+  enum Result {
+    /**
+     * The fragment is not valid.
+     */
+    Invalid,
+
+    /**
+     * The fragment was added to the message being received.
+     */
+    Partial,
+
+    /**
+     * The fragment finished the message.
+     */
+    Complete
+  };
+
+  /**
+   * Fragments shorter than this are not started at the end of a frame,
+   * unless they finish their message.
+   */
+  static const int MIN_FRAGMENT_LEN;
+
+  /**
+   * The default for setMaxMessageSize.
+   */
+  static const int DEFAULT_MAX_MESSAGE_SIZE;
+
+  /**
+   * Adds a message holding a copy of data from 0 to its position, and
+   * returns its ID.
+   */
+  int write(const Buffer& data);
+
+  /**
+   * Adds a message holding length bytes of the named file starting at
+   * offset, or the rest of the file if length is -1, and returns its ID.
+   * The file is opened now but only read as fragments are written.
+   *
+   * @return the message ID, or -1 if the file cannot be opened or does not
+   *         hold the range.
+   */
+  int writeFile(const std::string& fileName, long offset, long length);
+
+  /**
+   * Returns the number of messages not yet completely added to frames.
+   */
+  int getCount() const;
+
+  /**
+   * Reads ahead from the files of the next messages enough data to fill a
+   * frame.  The files are read without holding any lock, so this should be
+   * called without the caller's own locks before fill.
+   */
+  void prefetch();
+
+  /**
+   * Writes as many fragments as fit into the frame in raw, leaving room for
+   * the end of packet marker, and adds the progress of each message written
+   * to progress.  File messages only send what prefetch has read.
+   *
+   * @return the number of bytes written, or -1 if a file could not be
+   *         read, in which case the message cannot be finished.
+   */
+  int fill(Buffer& raw, std::vector<Progress>& progress);
+
+  /**
+   * Sets the largest message that will be accepted from the remote side, in
+   * bytes.  Receiving a larger message is a protocol violation, so this
+   * bounds the memory the remote side can make us allocate.
+   */
+  void setMaxMessageSize(int bytes);
+
+  /**
+   * Returns the largest message that will be accepted.
+   */
+  int getMaxMessageSize() const;
+
+  /**
+   * Handles a received fragment, which the caller still owns, and sets
+   * progress to how much of its message has arrived.  If it finishes the
+   * message, message is set to a new MessagePacket holding all of it, which
+   * the caller owns.
+   */
+  Result receive(const MessagePacket& fragment, Progress& progress,
+                 MessagePacket*& message);
+
+private:
+  /**
+   * A message is sent from either data or file.  File data is read by
+   * prefetch into ahead, and readFailed is set if the file ended early.
+   */
+  struct OutMessage {
+    SmartPtr<Buffer> data;
+    SmartPtr<FILE> file;
+    std::vector<gbyte> ahead;
+    bool readFailed;
+    guint16 id;
+    int total;
+    int sent;
+  };
+
+  /**
+   * A file read for prefetch to do once the lock is released.
+   */
+  struct FileRead {
+    guint16 id;
+    SmartPtr<FILE> file;
+    int len;
+  };
+
+  std::deque<OutMessage> out;
+
+  guint16 nextId;
+
+  /**
+   * The message being received, or NULL if between messages.
+   */
+  SmartPtr<Buffer> inData;
+
+  guint16 inId;
+
+  int maxMessageSize;
+
+  mutable Mutex sync;
+};
+
+} //namespace GNE
+
+#endif
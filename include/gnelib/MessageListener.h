@@ -0,0 +1,68 @@
+#ifndef MESSAGELISTENER_H_INCLUDED_2B6F04C8
+#define MESSAGELISTENER_H_INCLUDED_2B6F04C8
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/SmartPointers.h>
+
+namespace GNE {
+  class PacketStream;
+
+/**
+ * @ingroup midlevel
+ *
+ * A MessageListener is told how far messages sent with
+ * PacketStream::writeMessage have got, so that the progress of a large
+ * transfer such as a map download can be shown.  Set one with
+ * PacketStream::setMessageListener.  The provided functions do nothing, so
+ * you only need to override the events you want.
+ *
+ * Like PacketFeeder, the events are called directly from the threads doing
+ * the work, not from the EventThread, so they should return quickly.
+ */
+class MessageListener {
+public: //typedefs
+  typedef SmartPtr<MessageListener> sptr;
+  typedef WeakPtr<MessageListener> wptr;
+
+public:
+  virtual ~MessageListener() {}
+
+  /**
+   * Called from the PacketStream thread after each part of the message with
+   * the given ID is written to the network.  The last call for a message
+   * has sent equal to total.
+   */
+  virtual void onMessageSent(PacketStream& ps, int messageId, int sent,
+                             int total) {}
+
+  /**
+   * Called from the thread reading from the network when part of the
+   * message with the given ID has arrived.  When received equals total the
+   * message is complete, and it is in the incoming queue of ps as a
+   * MessagePacket.
+   */
+  virtual void onMessageReceived(PacketStream& ps, int messageId,
+                                 int received, int total) {}
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef MESSAGEPACKET_H_INCLUDED_7A1E5D93
+#define MESSAGEPACKET_H_INCLUDED_7A1E5D93
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Packet.h>
+#include <gnelib/SmartPointers.h>
+#include <gnelib/gnetypes.h>
+
+namespace GNE {
+class Buffer;
+
+/**
+ * @ingroup midlevel
+ *
+ * A MessagePacket holds a message of any size sent with
+ * PacketStream::writeMessage.  On the network the message is split into
+ * fragments that fit in a frame, but you only see the complete message,
+ * which is delivered as a single MessagePacket from
+ * PacketStream::getNextPacket once all of it has arrived.
+ *
+ * Copies of a MessagePacket share the same message data.
+ */
+class MessagePacket : public Packet {
+public: //typedefs
+  typedef SmartPtr<MessagePacket> sptr;
+  typedef WeakPtr<MessagePacket> wptr;
+
+public:
+  /**
+   * Creates an empty message, which is also suitable to call readPacket on.
+   */
+  MessagePacket();
+
+  MessagePacket( const MessagePacket& o );
+
+  virtual ~MessagePacket();
+
+  /**
+   * The ID for this type of packet.
+   */
+  static const int ID;
+
+  /**
+   * The number of bytes each fragment adds to the message data.
+   */
+  static const int HEADER_LEN;
+
+  /**
+   * Returns the ID that PacketStream::writeMessage returned for this
+   * message.
+   */
+  int getMessageId() const;
+
+  /**
+   * Returns the length of the whole message in bytes.
+   */
+  int getLength() const;
+
+  /**
+   * Returns the message data, with the position at 0 and the limit at the
+   * length of the message, ready for reading.
+   */
+  Buffer& getBuffer();
+
+  /**
+   * @see Packet::getSize()
+   */
+  virtual int getSize() const;
+
+  /**
+   * @see Packet::writePacket()
+   */
+  virtual void writePacket( Buffer& raw ) const;
+
+  /**
+   * @see Packet::readPacket()
+   */
+  virtual void readPacket( Buffer& raw );
+
+  /**
+   * Returns a new instance of this class using the constructor to fit the
+   * PacketCreateFunc signature.
+   */
+  static Packet* create();
+
+private:
+  friend class MessageFragmenter;
+
+  /**
+   * Creates a fragment of a message, holding length bytes of data starting
+   * at start, which are at offset in the message.
+   */
+  MessagePacket( guint16 messageId, guint32 totalLen, guint32 offset,
+                 const SmartPtr<Buffer>& data, int start, int length );
+
+  /**
+   * Writes everything but the fragment data, which must be length bytes
+   * written right after.
+   */
+  static void writeHeader( Buffer& raw, guint16 messageId, guint32 totalLen,
+                           guint32 offset, int length );
+
+  guint16 messageId;
+
+  /**
+   * The length of the whole message.
+   */
+  guint32 totalLen;
+
+  /**
+   * Where this fragment starts in the message.
+   */
+  guint32 offset;
+
+  SmartPtr<Buffer> data;
+
+  /**
+   * The range of data this fragment holds.
+   */
+  int start;
+  int length;
+};
+
+} //namespace GNE
+
+#endif
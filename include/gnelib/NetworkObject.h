@@ -20,9 +20,15 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <gnelib/gnetypes.h>
+#include <vector>
+
 namespace GNE {
   class Packet;
+  class Buffer;
   class ObjectBroker;
+  class ObjectBrokerServer;
+  class ObjectBrokerClient;
   
 /**
  * @ingroup highlevel
@@ -74,6 +80,22 @@ public:
    * currently under the management of an ObjectBroker.
    */
   bool hasValidId() const;
+
+  /**
+   * Marks this object as changed, so that the next
+   * ObjectBrokerServer::flushUpdates writes an update for it.  Marking an
+   * object more than once before the flush only sends one update.  This
+   * also makes the next ObjectBrokerServer::getSnapshot create a new
+   * creation packet for this object.  This does nothing if the object is not
+   * registered with an ObjectBrokerServer.
+   */
+  void markDirty();
+
+  /**
+   * Returns true if this object has been marked with markDirty since the
+   * last flushUpdates.
+   */
+  bool isDirty() const;
   
 public: //Events
   /**
@@ -110,6 +132,48 @@ public: //Events
    */
   virtual Packet* createUpdatePacket( const void* param ) = 0;
 
+  /**
+   * Called by ObjectBrokerServer::flushUpdates to write an update for this
+   * object straight into raw.  The default calls createUpdatePacket and
+   * writes the packet, but you can override this and readUpdate together
+   * to write the fields directly, which saves allocating a packet for
+   * every update.  The update must fit in an ObjectUpdateBatchPacket.
+   */
+  virtual void writeUpdate( Buffer& raw, const void* param );
+
+  /**
+   * Called by ObjectBrokerClient to read an update written by writeUpdate.
+   * raw has its limit at the end of the update.  The default reads the
+   * packet written by the default writeUpdate and passes it to
+   * incomingUpdatePacket.
+   */
+  virtual void readUpdate( Buffer& raw );
+
+  /**
+   * Returns the number of fields this object's state is split into for
+   * ObjectBrokerServer::getDeltaPackets, from 1 to
+   * ObjectDeltaPacket::MAX_FIELDS.  The number must not change while the
+   * object is registered.  The default is 1, so that the whole update
+   * written by writeUpdate is one field.
+   */
+  virtual int getFieldCount() const;
+
+  /**
+   * Writes the current value of the given field, from 0 to getFieldCount()
+   * - 1, into raw.  ObjectBrokerServer compares the bytes written with those
+   * the client has acknowledged, and only sends the fields that differ, so
+   * the same value must always be written as the same bytes.  The default
+   * calls writeUpdate with a NULL param.
+   */
+  virtual void writeField( Buffer& raw, int field );
+
+  /**
+   * Called by ObjectBrokerClient to read a field written by writeField.  raw
+   * has its limit at the end of the object's fields, so this must read
+   * exactly what writeField wrote.  The default calls readUpdate.
+   */
+  virtual void readField( Buffer& raw, int field );
+
   /**
    * When this object is released from the ObjectBroker system, it may want to
    * send a death packet if the remote end needs to know when an object dies.
@@ -173,11 +237,45 @@ private:
   //ObjectBroker is a friend so it can set our ObjectID through the
   //provided method.
   friend class ObjectBroker;
+  friend class ObjectBrokerServer;
+  friend class ObjectBrokerClient;
 
   void setObjectId( int newId );
 
 private:
   int objectId;
+
+  /**
+   * The server broker this object is registered with, or NULL.  Used by
+   * markDirty.
+   */
+  ObjectBrokerServer* server;
+
+  /**
+   * Protected by the sync mutex of server.
+   */
+  bool dirty;
+
+  /**
+   * Set from a counter in server each time this object is registered, so
+   * that ObjectBaselines can tell it apart from an earlier object with the
+   * same ID.
+   */
+  int serial;
+
+  /**
+   * On the client side, the sequence of the last ObjectDeltaPacket applied
+   * to this object, unwrapped to 32 bits by the client, or 0 for none.
+   * Protected by the sync mutex of the client.
+   */
+  guint32 deltaSeq;
+
+  /**
+   * On the server side, the creation packet as written to a Buffer, kept
+   * for ObjectBrokerServer::getSnapshot until markDirty.  Empty if there is
+   * none.  Protected by the sync mutex of server.
+   */
+  std::vector<gbyte> creationCache;
 };
 
 } //namespace GNE
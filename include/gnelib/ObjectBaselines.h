@@ -0,0 +1,216 @@
+#ifndef OBJECTBASELINES_H_INCLUDED_5D2F8A61
+#define OBJECTBASELINES_H_INCLUDED_5D2F8A61
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/gnetypes.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace GNE {
+  class UpdateScheduler;
+
+/**
+ * @ingroup highlevel
+ *
+ * What ObjectBrokerServer knows about the objects one client has, used to
+ * send that client only the fields of each object that it does not have
+ * yet.  Make one for each client, and pass it to
+ * ObjectBrokerServer::getDeltaPackets and ObjectBrokerServer::useDeltaAck.
+ *
+ * For each ObjectDeltaPacket sent, this keeps the state of the objects in
+ * it, for up to getMaxHistory packets.  When the client acknowledges a
+ * packet, those states become the baselines of the objects, and the next
+ * updates are made against them.  Fields sent since the baseline are sent
+ * again until a newer packet is acknowledged, so a lost packet never leaves
+ * the client with an old value.  Objects without a baseline are sent whole.
+ *
+ * This class is not thread safe on its own, but ObjectBrokerServer locks its
+ * mutex while using it.  When used with ObjectStates, which does not, only
+ * one thread may use an ObjectBaselines at a time.
+ */
+class ObjectBaselines {
+public:
+  /**
+   * Creates the baselines for a client that has no objects yet, which keeps
+   * the states for up to maxHistory unacknowledged packets, from 1 to 1024.
+   */
+  explicit ObjectBaselines( int maxHistory = 64 );
+
+  ~ObjectBaselines();
+
+  /**
+   * Returns the most unacknowledged packets remembered.  A packet
+   * acknowledged after it is forgotten is not used as a baseline.
+   */
+  int getMaxHistory() const;
+
+  /**
+   * Returns the number of objects with an acknowledged baseline.
+   */
+  int getBaselineCount() const;
+
+  /**
+   * Returns the number of packets sent and not yet acknowledged that are
+   * still remembered.
+   */
+  int getPendingCount() const;
+
+  /**
+   * Forgets all baselines and packets, so that every object is sent whole
+   * again.  Call this if the client has lost its objects.
+   */
+  void reset();
+
+private:
+  friend class ObjectBrokerServer;
+  friend class ObjectStates;
+
+  /**
+   * The fields of an object as written by NetworkObject::writeField, one
+   * after another.
+   */
+  struct State {
+    std::vector<gbyte> data;
+
+    /**
+     * The end of each field in data.
+     */
+    std::vector<int> ends;
+
+    int getStart( int field ) const;
+
+    /**
+     * Returns true if the field has the same bytes in both states.
+     */
+    bool sameField( const State& o, int field ) const;
+  };
+  typedef SmartPtr<State> StatePtr;
+
+  struct Baseline {
+    int serial;
+    guint32 sequence;
+    StatePtr state;
+
+    /**
+     * The fields sent in packets after the baseline.
+     */
+    guint32 sentSince;
+  };
+
+  struct SentObject {
+    int id;
+    int serial;
+    guint32 mask;
+    StatePtr state;
+  };
+
+  struct SentPacket {
+    guint32 sequence;
+    std::vector<SentObject> objects;
+  };
+
+  /**
+   * The packets being made by one call to getDeltaPackets.
+   */
+  struct Output {
+    Output( UpdateScheduler* scheduler, int budget );
+
+    std::vector<ObjectDeltaPacket::sptr> packets;
+
+    /**
+     * The packet being filled, the last of packets, or NULL.
+     */
+    ObjectDeltaPacket* packet;
+
+    /**
+     * The bytes of packets so far.
+     */
+    int used;
+
+    /**
+     * Told which objects the client is up to date with, if not NULL.
+     */
+    UpdateScheduler* scheduler;
+
+    /**
+     * The most bytes of packets, or -1 for no limit.
+     */
+    int budget;
+
+    Buffer fields;
+  };
+
+  /**
+   * Adds the fields of the object that the client may not have to out,
+   * unless that would go over its budget.  The state is copied if sent,
+   * unless shared is the same state already shared.
+   *
+   * @throw Error if the fields of the object are too large for a packet.
+   */
+  void writeDelta( Output& out, int id, int serial, const State& state,
+                   const StatePtr& shared );
+
+  /**
+   * Returns the fields of the object that the client may not have, given
+   * its current state.
+   */
+  guint32 getChangedFields( int id, int serial, const State& state ) const;
+
+  /**
+   * Starts remembering a new packet, and returns its sequence number.
+   */
+  guint16 startPacket();
+
+  /**
+   * Remembers that the fields in mask were sent in the last started packet.
+   */
+  void addSent( int id, int serial, guint32 mask, const StatePtr& state );
+
+  /**
+   * Makes the states sent in the packet with the given sequence number, as
+   * sent to the client, the baselines of their objects, unless they have
+   * newer ones.
+   */
+  void acknowledge( guint16 sequence );
+
+  int maxHistory;
+
+  /**
+   * The sequences are kept as 32 bit numbers so that a baseline any number
+   * of packets old compares right, and only the low 16 bits are sent.
+   */
+  guint32 nextSequence;
+
+  std::map<int, Baseline> baselines;
+
+  /**
+   * The unacknowledged packets, oldest first.
+   */
+  std::deque<SentPacket> history;
+};
+
+} //namespace GNE
+
+#endif
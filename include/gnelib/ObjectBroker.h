@@ -20,8 +20,8 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-#include <map>
 #include <gnelib/Mutex.h>
+#include <gnelib/ObjectIdTable.h>
 
 namespace GNE {
   class Packet;
@@ -72,7 +72,11 @@ public:
   void deregisterObject( NetworkObject& obj );
 
 protected:
-  ObjectBroker() {}
+  /**
+   * Creates a broker for the current setting of
+   * ObjectBrokerPacket::setWideObjectIds.
+   */
+  ObjectBroker();
 
   /**
    * Returns true if the object ID given exists.  The mutex sync must be locked
@@ -87,14 +91,10 @@ protected:
 
   mutable Mutex sync;
 
-  typedef std::map<int, NetworkObject*> ObjectsMap;
-
-  typedef std::map<int, NetworkObject*>::iterator ObjectsIter;
-  
   /**
    * Associates an integer object ID to a NetworkObject.
    */
-  ObjectsMap objects;
+  ObjectIdTable objects;
 };
 
 } //namespace GNE
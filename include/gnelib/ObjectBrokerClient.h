@@ -21,8 +21,13 @@
  */
 
 #include <gnelib/ObjectBroker.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <vector>
 
 namespace GNE {
+  class ObjectUpdateBatchPacket;
+  class Buffer;
+  class Time;
   bool initGNE(NLenum networkType, int (*atexit_ptr)(void (*func)(void)), int);
 
 /**
@@ -111,6 +116,84 @@ public:
    */
   NetworkObject& usePacket( const Packet& packet ); /* throw Error */
 
+  /**
+   * Uses many packets in order, such as all of those waiting after the game
+   * stalled, taking the locks once for all of them rather than once for
+   * each.  Each packet may be any type accepted by usePacket, an
+   * ObjectUpdateBatchPacket or an ObjectDeltaPacket, and is used the same as
+   * by usePacket, useUpdateBatch or useDeltaPacket, with the same Errors.
+   * The packets before an error have already been used.
+   *
+   * If latestOnly is true, an ObjectUpdatePacket is skipped when a later
+   * ObjectUpdatePacket in packets is for the same object, and no creation or
+   * death of that object comes between them.  This is only right when each
+   * update holds the whole state of the object, as incomingUpdatePacket
+   * would otherwise miss the changes in the skipped ones.
+   *
+   * If elapsed is not NULL, it is set to the time taken, so that a game can
+   * use fewer packets per frame when catching up takes too long.
+   *
+   * @return the number of packets used, not counting those skipped.
+   */
+  int usePackets( const std::vector<Packet*>& packets, bool ignoreUpdateError,
+                  bool latestOnly, Time* elapsed = NULL ); /* throw Error */
+
+  /**
+   * Applies each update in an ObjectUpdateBatchPacket from
+   * ObjectBrokerServer::flushUpdates, by calling NetworkObject::readUpdate
+   * on the object it is for.  If there is no object with the ID of an
+   * update, an Error with code Error::UnknownObjectId is thrown, unless
+   * ignoreUpdateError is true, in which case that update is skipped, for the
+   * same reasons as with usePacket.  The updates before the error have
+   * already been applied.
+   *
+   * If the packet is not valid, an Error with code
+   * Error::InvalidObjectPacket is thrown.
+   *
+   * @return the number of objects updated.
+   */
+  int useUpdateBatch( const ObjectUpdateBatchPacket& packet,
+                      bool ignoreUpdateError ); /* throw Error */
+
+  /**
+   * Creates every object in a snapshot made by
+   * ObjectBrokerServer::getSnapshot, read from the position of data to its
+   * limit, such as from MessagePacket::getBuffer.  Each object is created
+   * the same way as by usePacket with an ObjectCreationPacket, and the same
+   * Errors are thrown.  The objects before an error have already been
+   * created.
+   *
+   * @return the number of objects created.
+   */
+  int useSnapshot( Buffer& data ); /* throw Error */
+
+  /**
+   * Applies each object update in an ObjectDeltaPacket from
+   * ObjectBrokerServer::getDeltaPackets, by calling NetworkObject::readField
+   * for each field sent.  An update older than the last one applied to the
+   * same object is skipped, because it may have arrived out of order.
+   * Unknown objects are handled the same as in useUpdateBatch.
+   *
+   * The packet is remembered to be acknowledged in the next getDeltaAck,
+   * unless an update in it was skipped because its object is unknown, so
+   * that the server sends that object whole again.
+   *
+   * If the packet is not valid, an Error with code
+   * Error::InvalidObjectPacket is thrown.
+   *
+   * @return the number of objects updated.
+   */
+  int useDeltaPacket( const ObjectDeltaPacket& packet,
+                      bool ignoreUpdateError ); /* throw Error */
+
+  /**
+   * Returns a packet acknowledging the ObjectDeltaPacket packets applied
+   * since the last call, to be sent to the server for
+   * ObjectBrokerServer::useDeltaAck, or NULL if there are none.  Only the
+   * newest ObjectDeltaPacket::MAX_ACKS of them are kept.
+   */
+  ObjectDeltaPacket::sptr getDeltaAck();
+
 private:
   /**
    * Initializes the static packet ID lookup, called only by initGNE.
@@ -119,7 +202,22 @@ private:
 
   friend bool GNE::initGNE(NLenum, int (*)(void (*)(void)), int);
 
+  /**
+   * Does the work of usePacket.  The "sync" mutex must be locked.
+   */
+  NetworkObject* useLocked( const Packet& packet, bool ignoreUpdateError );
+
 private:
+  /**
+   * The sequence numbers of the delta packets to acknowledge, oldest first.
+   */
+  std::vector<guint16> deltaAcks;
+
+  /**
+   * The newest delta packet sequence received, unwrapped to 32 bits, or 0
+   * before the first.
+   */
+  guint32 lastDeltaSeq;
 };
 
 } //namespace GNE
@@ -57,10 +57,49 @@ public:
 
   /**
    * Sets the object ID for this packet.
-   * @param the new ID, in the range of [0..65535] (inclusive).
+   * @param the new ID, in the range of [0..getMaxObjectId()] (inclusive).
    */
   void setObjectId( int newId );
 
+  /**
+   * Sets whether object IDs are wide.  Normally an object ID is sent in 16
+   * bits, which limits a broker to 65535 objects.  Wide IDs are sent as
+   * variable length integers of 1 to 5 bytes, and allow about 16 million
+   * objects.  Wide IDs also hold a generation count, so an ID is not reused
+   * right after its object is deregistered.
+   *
+   * Both sides must use the same setting, since it changes the format of
+   * the packets.  This must be set before any ObjectBroker is created, and
+   * is false by default.
+   */
+  static void setWideObjectIds( bool wide );
+
+  /**
+   * Returns whether object IDs are wide.
+   */
+  static bool getWideObjectIds();
+
+  /**
+   * Returns the largest valid object ID for the current setting of
+   * setWideObjectIds.
+   */
+  static int getMaxObjectId();
+
+  /**
+   * Writes an object ID to raw in the format set by setWideObjectIds.
+   */
+  static void writeObjectId( Buffer& raw, guint32 id );
+
+  /**
+   * Reads an object ID written by writeObjectId.
+   */
+  static guint32 readObjectId( Buffer& raw );
+
+  /**
+   * Returns the number of bytes writeObjectId writes for id.
+   */
+  static int getObjectIdSize( guint32 id );
+
   /**
    * Returns the current size of this packet in bytes.
    */
@@ -83,7 +122,7 @@ protected:
   ObjectBrokerPacket( int id );
 
 private:
-  guint16 objectId;
+  guint32 objectId;
 };
 
 } //namespace GNE
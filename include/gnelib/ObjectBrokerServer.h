@@ -25,10 +25,19 @@
 #include <gnelib/ObjectCreationPacket.h>
 #include <gnelib/ObjectUpdatePacket.h>
 #include <gnelib/ObjectDeathPacket.h>
+#include <gnelib/ObjectUpdateBatchPacket.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <gnelib/ObjectBaselines.h>
+#include <gnelib/ObjectStates.h>
 #include <gnelib/Mutex.h>
+#include <gnelib/SmartPtr.h>
+#include <set>
+#include <vector>
 
 namespace GNE {
   class NetworkObject;
+  class UpdateScheduler;
+  class Buffer;
 
 /**
  * @ingroup highlevel
@@ -51,7 +60,7 @@ namespace GNE {
  * guaranteed order in relation to each other.
  *
  * There are 65535 available object IDs, so you cannot have more objects than
- * that.
+ * that, unless ObjectBrokerPacket::setWideObjectIds is used.
  *
  * Almost all methods return a smart pointer to a packet, which means you do
  * not need worry about memory allocation.
@@ -108,19 +117,172 @@ public:
    */
   ObjectDeathPacket::sptr getDeathPacket( NetworkObject& obj );
 
+  /**
+   * Returns the creation data of every registered object in one Buffer,
+   * from 0 to its position, for ObjectBrokerClient::useSnapshot.  This is
+   * meant for a client that just joined, and is best sent with
+   * PacketStream::writeMessage, which sends it in full frames reliably
+   * without holding up the game.
+   *
+   * The creation packet of each object is written once and kept, so later
+   * snapshots only call NetworkObject::createCreationPacket for objects
+   * marked with markDirty since, and the broker is locked once for all of
+   * them rather than once for each.  Objects that change without markDirty
+   * should be sent updates after the snapshot, such as with
+   * getDeltaPackets with a new ObjectBaselines, which sends every object
+   * whole at first.
+   */
+  SmartPtr<Buffer> getSnapshot();
+
+  /**
+   * The same as getSnapshot(), but only for the objects with the given IDs,
+   * such as from InterestGrid::getInterests.  IDs of objects not registered
+   * are ignored.
+   */
+  SmartPtr<Buffer> getSnapshot( const std::set<int>& objectIds );
+
+  /**
+   * Marks the given object as changed, the same as NetworkObject::markDirty.
+   * Does nothing if the object is not registered with this broker.
+   */
+  void markDirty( NetworkObject& obj );
+
+  /**
+   * Returns the number of objects marked as changed since the last
+   * flushUpdates, which includes any of them deregistered since.
+   */
+  int getDirtyCount() const;
+
+  /**
+   * Writes an update for each object marked as changed since the last call,
+   * in the order they were marked, and clears the marks.  This is meant to
+   * be called once per game tick.  The updates are written with
+   * NetworkObject::writeUpdate, passing param, and are packed into as few
+   * ObjectUpdateBatchPacket packets as possible, each small enough to fit in
+   * one frame.
+   *
+   * Objects deregistered after being marked are skipped.
+   *
+   * @throw Error if the update for an object is too large for a packet.
+   *        That object and the ones after it stay marked.
+   */
+  std::vector<ObjectUpdateBatchPacket::sptr> flushUpdates(
+      const void* param = NULL );
+
+  /**
+   * Writes the fields of every registered object that the client described
+   * by baselines may not have yet, packed into as few ObjectDeltaPacket
+   * packets as possible, each small enough to fit in one frame.  The fields
+   * are written with NetworkObject::writeField and compared with those of
+   * the newest packet the client acknowledged that had the object, so an
+   * object that has not changed since then is not sent at all.  An object
+   * is sent whole until the client acknowledges a packet with it.
+   *
+   * This is meant to be called once per game tick for each client, and the
+   * packets sent unreliably.  The client applies them with
+   * ObjectBrokerClient::useDeltaPacket, and returns acknowledgements to be
+   * passed to useDeltaAck.
+   *
+   * @throw Error if the fields of an object are too large for a packet.
+   */
+  std::vector<ObjectDeltaPacket::sptr> getDeltaPackets(
+      ObjectBaselines& baselines );
+
+  /**
+   * The same as getDeltaPackets( ObjectBaselines& ), but only for the
+   * objects with the given IDs, such as from InterestGrid::getInterests.
+   * The baselines of other objects are forgotten, because the client is
+   * expected to delete an object when it stops being interested in it, so
+   * the object is sent whole if it comes back.  IDs of objects not
+   * registered are ignored.
+   */
+  std::vector<ObjectDeltaPacket::sptr> getDeltaPackets(
+      ObjectBaselines& baselines, const std::set<int>& objectIds );
+
+  /**
+   * The same as getDeltaPackets( ObjectBaselines&, const std::set<int>& ),
+   * but when the client cannot be sent every object it sees each tick.  The
+   * objects are tried in the order of their priority in scheduler, and
+   * those that would make the packets larger than budget bytes in all are
+   * left for a later tick.  A negative budget means no limit, in which case
+   * the order still puts the important objects in the first packets.
+   *
+   * @see UpdateScheduler::getTickBudget
+   */
+  std::vector<ObjectDeltaPacket::sptr> getDeltaPackets(
+      ObjectBaselines& baselines, const std::set<int>& objectIds,
+      UpdateScheduler& scheduler, int budget );
+
+  /**
+   * Writes the fields of every registered object with
+   * NetworkObject::writeField, for making the delta packets of many clients
+   * with ObjectStates::getDeltaPackets.  Each object is written once, rather
+   * than once for each client, and the broker is not locked while the
+   * packets are made, so this is how the packets for many clients can be
+   * made at once on many threads, such as by ReplicationFanout.
+   */
+  ObjectStates::sptr captureStates();
+
+  /**
+   * Uses the acknowledgements in a packet from
+   * ObjectBrokerClient::getDeltaAck to update the baselines of that client.
+   * Acknowledgements for packets that are too old are ignored.
+   */
+  void useDeltaAck( ObjectBaselines& baselines,
+                    const ObjectDeltaPacket& packet );
+
 private:
   /**
-   * Returns the next valid ID, and marks it as taken.  The "sync" mutex must
-   * be locked when this method is called.  Returns false if there are no IDs
-   * remaining.
+   * Assigns the next free ID to the object, and marks it as taken.  The
+   * "sync" mutex must be locked when this method is called.  Returns false
+   * if there are no IDs remaining.
    */
   bool assignNextId( NetworkObject& o );
+
+  /**
+   * Writes the snapshot of the given objects.  The "sync" mutex must be
+   * locked.
+   */
+  SmartPtr<Buffer> writeSnapshot( const std::vector<NetworkObject*>& objs );
+
+  /**
+   * Drops the baselines of objects that are no longer registered, and of
+   * those not in keep if it is not NULL.  The "sync" mutex must be locked.
+   */
+  void forgetBaselines( ObjectBaselines& baselines,
+                        const std::set<int>* keep );
+
+  /**
+   * Makes the delta packets for the given objects, in order, up to budget
+   * bytes if it is not negative, and tells scheduler, if not NULL, which
+   * objects the client will be up to date with.  The "sync" mutex must be
+   * locked.
+   */
+  std::vector<ObjectDeltaPacket::sptr> writeDeltas(
+      ObjectBaselines& baselines, const std::vector<NetworkObject*>& objs,
+      UpdateScheduler* scheduler, int budget );
+
+  /**
+   * Writes the fields of obj into state, using raw.  The "sync" mutex must
+   * be locked.
+   */
+  static void writeState( NetworkObject& obj, Buffer& raw,
+                          ObjectBaselines::State& state );
   
 private:
   ObjectBrokerServer( const ObjectBrokerServer& );
   ObjectBrokerServer& operator=( const ObjectBrokerServer& rhs );
 
-  int nextId;
+  /**
+   * The IDs of the objects marked as changed, in order.  An ID may be here
+   * for an object that has since been deregistered.
+   */
+  std::vector<int> dirtyIds;
+
+  /**
+   * The last serial given to a registered object.
+   */
+  int lastSerial;
 };
 
 } //namespace GNE
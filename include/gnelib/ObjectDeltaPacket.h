@@ -0,0 +1,171 @@
+#ifndef OBJECTDELTAPACKET_H_INCLUDED_7A0E93C5
+#define OBJECTDELTAPACKET_H_INCLUDED_7A0E93C5
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Packet.h>
+#include <gnelib/Buffer.h>
+#include <vector>
+
+namespace GNE {
+
+/**
+ * @ingroup highlevel
+ *
+ * Carries field level object updates made by
+ * ObjectBrokerServer::getDeltaPackets, and the acknowledgements the client
+ * sends back for them, a bit like PingPacket is used for both a request
+ * and its reply.
+ *
+ * An update packet has a sequence number and, for each object, its ID, a
+ * mask of the fields sent, and the bytes written for those fields by
+ * NetworkObject::writeField.  An acknowledgement packet, from
+ * ObjectBrokerClient::getDeltaAck, holds only the sequence numbers of the
+ * update packets the client has applied, which ObjectBrokerServer::useDeltaAck
+ * uses to pick the baselines the next updates are made against.
+ *
+ * These packets are meant to be sent unreliably.
+ */
+class ObjectDeltaPacket : public Packet {
+public: //typedefs
+  typedef SmartPtr<ObjectDeltaPacket> sptr;
+  typedef WeakPtr<ObjectDeltaPacket> wptr;
+
+public:
+  ObjectDeltaPacket();
+
+  ObjectDeltaPacket( const ObjectDeltaPacket& o );
+
+  virtual ~ObjectDeltaPacket();
+
+  /**
+   * The ID for this type of packet.
+   */
+  static const int ID;
+
+  /**
+   * The most fields an object can have, which is the number of bits in the
+   * field mask.
+   */
+  static const int MAX_FIELDS;
+
+  /**
+   * The most acknowledgements in one packet.
+   */
+  static const int MAX_ACKS;
+
+  /**
+   * Returns the most bytes of updates, with their headers, that fit in a
+   * packet small enough to be sent in one frame.
+   */
+  static int getMaxDataSize();
+
+  /**
+   * Returns the size of a packet with no updates or acknowledgements.
+   */
+  static int getEmptySize();
+
+  /**
+   * Returns the bytes an update added with add takes in a packet.
+   */
+  static int getEntrySize( int objectId, int fieldCount, int fieldsLength );
+
+  /**
+   * Returns true if the update would fit in this packet.
+   */
+  bool canAdd( int objectId, int fieldCount, int fieldsLength ) const;
+
+  /**
+   * Returns true if sequence number a comes after b, allowing for the
+   * numbers wrapping around.
+   */
+  static bool isNewer( guint16 a, guint16 b );
+
+  /**
+   * Returns the sequence number of this update packet.
+   */
+  guint16 getSequence() const;
+
+  /**
+   * Returns the number of object updates in this packet.
+   */
+  int getCount() const;
+
+  /**
+   * Returns the sequence numbers acknowledged by this packet, which is empty
+   * for an update packet.
+   */
+  const std::vector<guint16>& getAcks() const;
+
+  /**
+   * Adds the update for an object with fieldCount fields.  mask has a bit
+   * set for each field sent, and fields holds those fields in order, from 0
+   * to its position.  Returns false and leaves this packet unchanged if it
+   * does not fit.
+   */
+  bool add( int objectId, guint32 mask, int fieldCount,
+            const Buffer& fields );
+
+  /**
+   * Adds an acknowledgement for the given sequence number.  Returns false if
+   * this packet already holds MAX_ACKS of them.
+   */
+  bool addAck( guint16 sequence );
+
+  /**
+   * @see Packet::getSize()
+   */
+  virtual int getSize() const;
+
+  /**
+   * @see Packet::writePacket()
+   */
+  virtual void writePacket( Buffer& raw ) const;
+
+  /**
+   * @see Packet::readPacket()
+   */
+  virtual void readPacket( Buffer& raw );
+
+  /**
+   * Returns a new instance of this class using the constructor to fit the
+   * PacketCreateFunc signature.
+   */
+  static Packet* create();
+
+private:
+  friend class ObjectBaselines;
+  friend class ObjectBrokerClient;
+
+  guint16 sequence;
+
+  guint16 count;
+
+  std::vector<guint16> acks;
+
+  /**
+   * The updates, from 0 to the position.
+   */
+  Buffer data;
+};
+
+} //namespace GNE
+
+#endif
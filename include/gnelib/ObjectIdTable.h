@@ -0,0 +1,143 @@
+#ifndef OBJECTIDTABLE_H_INCLUDED_6D2A8F31
+#define OBJECTIDTABLE_H_INCLUDED_6D2A8F31
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <deque>
+#include <vector>
+
+namespace GNE {
+  class NetworkObject;
+
+/**
+ * @ingroup internal
+ *
+ * Maps object IDs to objects for ObjectBroker with an array of slots, so
+ * that finding, adding, and removing an object takes constant time.  The
+ * slot of an object is found from its ID, and the ID kept in the slot is
+ * checked to make sure it really is that object.
+ *
+ * With 16 bit IDs, an ID is its slot, and new slots are used before freed
+ * ones so that an ID is reused as late as possible, as the broker always
+ * did.  With wide IDs the low GEN_BITS of an ID are a generation count that
+ * goes up each time a slot is freed, so freed slots are reused first, while
+ * packets for the old object don't match the new one.
+ *
+ * The server side uses allocate to pick IDs, and the client side uses add
+ * with the IDs the server picked.  This class is not thread safe.
+ */
+class ObjectIdTable {
+public:
+  /**
+   * Creates an empty table for 16 bit IDs, or wide IDs if wide is true.
+   */
+  explicit ObjectIdTable( bool wide );
+
+  ~ObjectIdTable();
+
+  /**
+   * The number of bits of a wide ID used for the generation.
+   */
+  static const int GEN_BITS;
+
+  /**
+   * Returns the largest ID, which is 65535 for 16 bit IDs.
+   */
+  static int getMaxId( bool wide );
+
+  /**
+   * Returns true if id is in the range of IDs an object can have.
+   */
+  bool isValid( int id ) const;
+
+  /**
+   * Returns the number of objects in the table.
+   */
+  int size() const;
+
+  /**
+   * Returns the object with the given ID, or NULL if there is none.
+   */
+  NetworkObject* find( int id ) const;
+
+  /**
+   * Appends every object in the table to out, in the order of their slots.
+   */
+  void getObjects( std::vector<NetworkObject*>& out ) const;
+
+  /**
+   * Adds obj with the given ID.  Returns false if the ID is not valid or its
+   * slot is taken.
+   */
+  bool add( int id, NetworkObject* obj );
+
+  /**
+   * Picks a free ID for obj and adds it.  Returns -1 if there are no IDs
+   * left.
+   */
+  int allocate( NetworkObject* obj );
+
+  /**
+   * Removes the object with the given ID, which must be in the table.
+   */
+  void remove( int id );
+
+private:
+  struct Slot {
+    Slot() : obj( 0 ), id( -1 ), gen( 0 ) {}
+
+    NetworkObject* obj;
+
+    /**
+     * The full ID of obj, or -1 if the slot is free.
+     */
+    int id;
+
+    /**
+     * The generation the next object in this slot gets.
+     */
+    int gen;
+  };
+
+  int getSlot( int id ) const;
+
+  bool wide;
+
+  /**
+   * True once allocate is used, so freed slots need to be kept.
+   */
+  bool allocating;
+
+  int count;
+
+  /**
+   * The slots, indexed by getSlot.  Slot 0 is never used.
+   */
+  std::vector<Slot> slots;
+
+  /**
+   * The slots freed by remove, oldest first.
+   */
+  std::deque<int> freeSlots;
+};
+
+} //namespace GNE
+
+#endif
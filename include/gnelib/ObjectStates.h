@@ -0,0 +1,116 @@
+#ifndef OBJECTSTATES_H_INCLUDED_91D4C7E0
+#define OBJECTSTATES_H_INCLUDED_91D4C7E0
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/ObjectBaselines.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/WeakPtr.h>
+#include <set>
+#include <vector>
+
+namespace GNE {
+  class UpdateScheduler;
+
+/**
+ * @ingroup highlevel
+ *
+ * The fields of all objects in an ObjectBrokerServer at one time, from
+ * ObjectBrokerServer::captureStates.  The getDeltaPackets methods work the
+ * same as those of ObjectBrokerServer, but with the fields captured, and
+ * without locking anything, so that the packets for many clients can be
+ * made at the same time on many threads.
+ *
+ * An ObjectStates never changes once made, so it may be used by many threads
+ * at once, but each ObjectBaselines and UpdateScheduler passed to it must
+ * only be used by one thread at a time.
+ */
+class ObjectStates {
+public: //typedefs
+  typedef SmartPtr<ObjectStates> sptr;
+  typedef WeakPtr<ObjectStates> wptr;
+
+public:
+  ~ObjectStates();
+
+  /**
+   * Returns the number of objects captured.
+   */
+  int getObjectCount() const;
+
+  /**
+   * @see ObjectBrokerServer::getDeltaPackets( ObjectBaselines& )
+   */
+  std::vector<ObjectDeltaPacket::sptr> getDeltaPackets(
+      ObjectBaselines& baselines ) const;
+
+  /**
+   * @see ObjectBrokerServer::getDeltaPackets( ObjectBaselines&, const std::set<int>& )
+   */
+  std::vector<ObjectDeltaPacket::sptr> getDeltaPackets(
+      ObjectBaselines& baselines, const std::set<int>& objectIds ) const;
+
+  /**
+   * @see ObjectBrokerServer::getDeltaPackets( ObjectBaselines&, const std::set<int>&, UpdateScheduler&, int )
+   */
+  std::vector<ObjectDeltaPacket::sptr> getDeltaPackets(
+      ObjectBaselines& baselines, const std::set<int>& objectIds,
+      UpdateScheduler& scheduler, int budget ) const;
+
+private:
+  friend class ObjectBrokerServer;
+
+  ObjectStates();
+
+  ObjectStates( const ObjectStates& );
+  ObjectStates& operator=( const ObjectStates& );
+
+  struct Entry {
+    int id;
+    int serial;
+    ObjectBaselines::StatePtr state;
+  };
+
+  /**
+   * Returns the entry for the object with the given ID, or NULL.
+   */
+  const Entry* find( int id ) const;
+
+  /**
+   * Drops the baselines of objects not captured, and of those not in keep
+   * if it is not NULL.
+   */
+  void forgetBaselines( ObjectBaselines& baselines,
+                        const std::set<int>* keep ) const;
+
+  std::vector<ObjectDeltaPacket::sptr> writeDeltas(
+      ObjectBaselines& baselines, const std::vector<const Entry*>& objs,
+      UpdateScheduler* scheduler, int budget ) const;
+
+  /**
+   * Sorted by ID, which is the order ObjectIdTable::getObjects gives.
+   */
+  std::vector<Entry> entries;
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef OBJECTUPDATEBATCHPACKET_H_INCLUDED_41C7B2E9
+#define OBJECTUPDATEBATCHPACKET_H_INCLUDED_41C7B2E9
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Packet.h>
+#include <gnelib/Buffer.h>
+
+namespace GNE {
+
+/**
+ * @ingroup highlevel
+ *
+ * Holds the updates for many objects, as made by
+ * ObjectBrokerServer::flushUpdates and used by
+ * ObjectBrokerClient::useUpdateBatch.  Each update is the object ID,
+ * followed by its length and the data written by
+ * NetworkObject::writeUpdate, so the objects share one packet header.
+ */
+class ObjectUpdateBatchPacket : public Packet {
+public: //typedefs
+  typedef SmartPtr<ObjectUpdateBatchPacket> sptr;
+  typedef WeakPtr<ObjectUpdateBatchPacket> wptr;
+
+public:
+  ObjectUpdateBatchPacket();
+
+  ObjectUpdateBatchPacket( const ObjectUpdateBatchPacket& o );
+
+  virtual ~ObjectUpdateBatchPacket();
+
+  /**
+   * The ID for this type of packet.
+   */
+  static const int ID;
+
+  /**
+   * Returns the most bytes of updates, with their headers, that fit in a
+   * packet small enough to be sent in one frame.
+   */
+  static int getMaxDataSize();
+
+  /**
+   * Returns the number of updates in this packet.
+   */
+  int getCount() const;
+
+  /**
+   * Adds the update in the given Buffer, from 0 to its position, for the
+   * object with the given ID.  Returns false and leaves this packet
+   * unchanged if it does not fit.
+   */
+  bool add( int objectId, const Buffer& update );
+
+  /**
+   * @see Packet::getSize()
+   */
+  virtual int getSize() const;
+
+  /**
+   * @see Packet::writePacket()
+   */
+  virtual void writePacket( Buffer& raw ) const;
+
+  /**
+   * @see Packet::readPacket()
+   */
+  virtual void readPacket( Buffer& raw );
+
+  /**
+   * Returns a new instance of this class using the constructor to fit the
+   * PacketCreateFunc signature.
+   */
+  static Packet* create();
+
+private:
+  friend class ObjectBrokerClient;
+
+  guint16 count;
+
+  /**
+   * The updates, from 0 to the position.
+   */
+  Buffer data;
+};
+
+} //namespace GNE
+
+#endif
@@ -21,6 +21,7 @@
  */
 
 #include <gnelib/gnetypes.h>
+#include <gnelib/Error.h>
 
 namespace GNE {
 class Packet;
@@ -143,6 +144,12 @@ void defaultRegisterPacket() {
  */
 Packet* createPacket( guint8 id );
 
+/**
+ * Like createPacket, but returns NULL if no packet is registered for the
+ * given ID, for IDs that come from the network.
+ */
+Packet* tryCreatePacket( guint8 id );
+
 /**
  * Calls the packet clone function registered for the passed packet type.
  * This is based on the Packet::getType() method.
@@ -167,6 +174,32 @@ void destroyPacket( Packet* p );
  */
 Packet* parseNextPacket( Buffer& raw );
 
+/**
+ * Parses the next packet from the given Buffer like parseNextPacket, but
+ * reports malformed data through the return value instead of by throwing.
+ * This is the path used by %GNE when reading from the network, so that a
+ * remote host sending garbage does not cost an exception per packet.
+ *
+ * The read exceptions of raw are turned off while parsing, and restored
+ * before returning (see Buffer::setReadExceptions).  Packets that throw an
+ * Error themselves from readPacket for reasons other than Buffer access
+ * still throw out of this function, but the %GNE packets never do so.  If
+ * raw already has a read error recorded when this is called, that error is
+ * returned right away.
+ *
+ * @param raw the Buffer to parse from.
+ * @param packet set to the newly allocated Packet on success, or NULL at the
+ *               end of the Buffer or on error.
+ * @param packetId set to the ID of the packet read, so that the caller can
+ *                 report which ID was unknown.  If the unknown packet was
+ *                 inside the one read, such as a WrapperPacket, this is
+ *                 the ID of the inner packet.
+ * @return Error::NoError on success or at the end of the Buffer, else
+ *         Error::UnknownPacket or the Buffer's read error.
+ */
+Error::ErrorCode tryParseNextPacket( Buffer& raw, Packet*& packet,
+                                     int& packetId );
+
 } //namespace PacketParser
 } //namespace GNE
 
@@ -25,6 +25,9 @@
 #include <gnelib/Thread.h>
 #include <gnelib/Time.h>
 #include <gnelib/SmartPointers.h>
+#include <gnelib/ReliableStreams.h>
+#include <gnelib/ParityFec.h>
+#include <gnelib/MessageFragmenter.h>
 
 #include <queue>
 
@@ -33,6 +36,9 @@ class Packet;
 class Connection;
 class Buffer;
 class PacketFeeder;
+class ReliablePacket;
+class MessagePacket;
+class MessageListener;
 
 /**
  * @ingroup midlevel
@@ -51,7 +57,8 @@ protected:
   /**
    * @see create
    */
-  PacketStream(int reqOutRate, int maxOutRate, Connection& ourOwner);
+  PacketStream(int reqOutRate, int maxOutRate, Connection& ourOwner,
+               int maxInRate);
 
 public:
   typedef SmartPtr<PacketStream> sptr;
@@ -69,8 +76,11 @@ public:
    * @param maxOutRate The maximum rate the remote machine is letting us
    *                   send.  The actual outgoing rate, therefore, is the
    *                   minimum of the two outgoing rate values.
+   * @param maxInRate The maximum rate we have told the remote machine it
+   *                  may send to us, which is enforced on incoming data.
    */
-  static sptr create(int reqOutRate, int maxOutRate, Connection& ourOwner);
+  static sptr create(int reqOutRate, int maxOutRate, Connection& ourOwner,
+                     int maxInRate = 0);
 
   /**
    * Destroys this object.  Any data left remaining in the in or out queues
@@ -83,6 +93,32 @@ public:
    */
   int getInLength() const;
 
+  /**
+   * Returns the maximum number of packets allowed in the incoming queue, or
+   * 0 if there is no limit.
+   *
+   * @see setInQueueLimit
+   */
+  int getInQueueLimit() const;
+
+  /**
+   * Sets the maximum number of packets allowed in the incoming queue before
+   * %GNE stops reading from the network.  When the limit is reached, the
+   * reliable socket is no longer read from, so the operating system's flow
+   * control slows down the sender, and unreliable packets are dropped as
+   * they arrive.  Reading resumes once the application has removed enough
+   * packets that the queue is at half of the limit.  On a loopback
+   * connection the other end stops giving us reliable packets instead, and
+   * gives us no more than fill the queue once it starts again.  Unreliable
+   * loopback packets are dropped like those from the network.  The value 0
+   * means that
+   * the queue has no limit, which is the default.  A value less than 0 is
+   * invalid.
+   *
+   * Packets added with addIncomingPacket are never refused.
+   */
+  void setInQueueLimit(int limit);
+
   /**
    * Returns the current outgoing queue length in packets.  This is meant
    * as a possible hint for your application to tune its performance by
@@ -199,6 +235,142 @@ public:
    */
   void writePacket(const SmartPtr<Packet>& packet, bool reliable);
 
+  /**
+   * Adds a packet to be sent reliably on one of several independent streams
+   * over the unreliable connection.  The packet given will be copied.
+   *
+   * Packets sent this way are numbered, acknowledged by the remote side, and
+   * sent again if they are lost, so they always arrive exactly once.  Unlike
+   * packets sent on the reliable connection, a lost packet only delays the
+   * packets after it on the same stream, and only if the stream is ordered.
+   * Unordered packets are given to the remote side as soon as they arrive.
+   * A stream should be used either ordered or unordered, but not both.
+   *
+   * These packets are counted as unreliable data for the rate limits and
+   * getOutLength, and each adds 6 to 8 bytes of overhead.  If the
+   * connection has no unreliable connection, or the remote side is using a
+   * version of %GNE before this method was added, use writePacket instead.
+   * If there is no unreliable connection, the packet is sent on the
+   * reliable connection, which is always ordered.
+   *
+   * @param packet the packet to send.
+   * @param stream the stream to send it on, in the range of [0..255].
+   * @param ordered true if the packet must be received after the packets
+   *                written before it on the same stream.
+   */
+  void writeStreamPacket(const Packet& packet, int stream, bool ordered = true);
+
+  /**
+   * Returns the smoothed round-trip time measured for packets sent with
+   * writeStreamPacket, in milliseconds, or 0 if no measurement has been made
+   * yet.
+   */
+  int getStreamRtt() const;
+
+  /**
+   * Returns the number of packets sent with writeStreamPacket that have not
+   * yet been acknowledged.
+   */
+  int getStreamUnackedCount() const;
+
+  /**
+   * Adds a message of any size to be sent on the reliable connection.  The
+   * message is the data in the given Buffer from 0 to its position, which
+   * is copied.  It is split into fragments that fit in a frame, and the
+   * remote side gets it as a single MessagePacket once all of it arrives.
+   * Messages are sent one after another in the order they are written.
+   *
+   * While other packets are waiting to be sent, messages only get their
+   * share of the bandwidth, set with setMessageShare, so a large transfer
+   * such as a map download does not hold up game packets.  Use
+   * setMessageListener to follow the progress.
+   *
+   * The remote side must be using a version of %GNE that supports this.
+   *
+   * @return the ID of the message, which is also returned by
+   *         MessagePacket::getMessageId on the remote side.
+   */
+  int writeMessage(const Buffer& data);
+
+  /**
+   * Sends length bytes of the named file starting at offset, or the rest of
+   * the file if length is -1, as a message in the same way as writeMessage.
+   * The file is read as it is sent, straight into the frames written to the
+   * network, so it is never all held in memory by the sender.  The remote
+   * side gets all of it as one MessagePacket, so it must be no larger than
+   * the remote side's setMaxMessageSize.
+   *
+   * If the file cannot be read while it is being sent, the connection is
+   * closed with an Error::Read, since the message cannot be finished.
+   *
+   * @return the ID of the message, or -1 if the file could not be opened or
+   *         does not hold the given range.
+   */
+  int writeFile(const std::string& fileName, long offset = 0,
+                long length = -1);
+
+  /**
+   * Returns the number of messages written with writeMessage or writeFile
+   * that have not been completely sent.
+   */
+  int getOutMessageCount() const;
+
+  /**
+   * Sets the percent of the outgoing bandwidth that messages written with
+   * writeMessage get when other packets are also waiting to be sent, from 1
+   * to 100.  When nothing else is waiting messages use all of it.  The
+   * default is 50.
+   */
+  void setMessageShare(int percent);
+
+  /**
+   * Returns the share set by setMessageShare.
+   */
+  int getMessageShare() const;
+
+  /**
+   * Sets the largest message the remote side may send us with
+   * writeMessage, in bytes.  A larger message is a protocol violation.  The
+   * memory for a message is allocated when it starts arriving, so this
+   * bounds how much the remote side can make us use.  The default is 16MB.
+   */
+  void setMaxMessageSize(int bytes);
+
+  /**
+   * Returns the size set by setMaxMessageSize.
+   */
+  int getMaxMessageSize() const;
+
+  /**
+   * Sets the listener told about the progress of messages sent and
+   * received.  It may be NULL, which is the default.  Like the PacketFeeder,
+   * the reference is dropped after the connection is disconnected.
+   */
+  void setMessageListener(const SmartPtr<MessageListener>& listener);
+
+  /**
+   * Turns on forward error correction for unreliable data.  After every
+   * size frames of unreliable data, a parity frame is sent that lets the
+   * remote side rebuild any one of them that was lost, instead of waiting
+   * for the data to be sent again.  This is useful for state updates over
+   * lossy links, at the cost of about 1/size more bandwidth, which is
+   * counted towards the outgoing rate.  Each unreliable frame also gets 8
+   * bytes of overhead.
+   *
+   * The remote side must be using a version of %GNE that supports this.
+   * The value 0 turns parity off, which is the default.  Otherwise the size
+   * must be in the range [2..255].  Smaller groups can recover from more
+   * loss, but cost more bandwidth.
+   *
+   * @see ConnectionParams::setFecGroupSize
+   */
+  void setFecGroupSize(int size);
+
+  /**
+   * Returns the value set by setFecGroupSize.
+   */
+  int getFecGroupSize() const;
+
   /**
    * Returns the actual outgoing data rate, which may be the same or less
    * that what was originally requested on connection.  This value is the
@@ -230,6 +402,20 @@ public:
    */
   int getRemoteOutLimit() const;
 
+  /**
+   * Returns the maximum rate we have told the remote computer it may send to
+   * us.  The value 0 means there is no limit.
+   *
+   * Incoming data is held to this rate.  When the remote computer sends
+   * faster than this, the reliable socket is not read from until the rate
+   * has been met, and unreliable packets are dropped as they arrive.  A
+   * burst of up to one second's worth of data is allowed, which is the most
+   * that a %GNE PacketStream sending at this rate will ever send at once.
+   *
+   * @see setRates
+   */
+  int getMaxInRate() const;
+
   /**
    * Sets new values that we are willing to send or receive.  See the
    * constructor for more information.  Pass a value less than 0 to leave one
@@ -282,6 +468,101 @@ private:
 
   void prepareSend(std::queue<Packet*>& q, Buffer& raw);
 
+  /**
+   * Moves packets from q to batch for the other end of a loopback
+   * connection, all of them or as many as the outgoing rate allows, and
+   * returns their size.  No more than room packets are moved, unless room
+   * is less than 0.  outQCtrl must be acquired.
+   */
+  int prepareLoopback(std::queue<Packet*>& q, std::vector<Packet*>& batch,
+                      int room);
+
+  /**
+   * Adds the stream packets that are due to the unreliable queue.  Returns
+   * false if the remote side has stopped acknowledging them.  outQCtrl must
+   * be acquired.
+   */
+  bool pollStreams();
+
+  /**
+   * Called by Connection to handle a ReliablePacket it received.  Takes
+   * ownership of the packet.
+   */
+  void receiveStreamPacket(ReliablePacket* packet);
+
+  /**
+   * Called by Connection to handle a fragment of a message it received on
+   * the reliable connection.  Takes ownership of the packet.  Returns false
+   * if the fragment is not valid.
+   */
+  bool receiveMessagePacket(MessagePacket* packet);
+
+  /**
+   * Tells the listener about the progress of messages sent.
+   */
+  void onMessagesSent(const std::vector<MessageFragmenter::Progress>& progress);
+
+  //Connection calls the incoming limit functions below.
+  friend class Connection;
+
+  /**
+   * Adds the packets from the other end of a loopback connection to the
+   * incoming queue like addIncomingPacket, all under one lock.
+   */
+  void addIncomingPackets(const std::vector<Packet*>& packets);
+
+  /**
+   * Called by Connection when a frame of the given size has been read, and
+   * before it is parsed.  Returns true if the frame should be parsed, or
+   * false if it is unreliable and should be dropped because the incoming
+   * rate or queue limit is exceeded.
+   */
+  bool acceptInFrame(int bytes, bool reliable);
+
+  /**
+   * Called by Connection after the packets from a reliable frame have been
+   * added to the queue.  Pauses reading from the reliable socket if the
+   * incoming rate or queue limit is exceeded.
+   */
+  void throttleReliableIn();
+
+  /**
+   * Called for the other end of a loopback connection before it gives us
+   * reliable packets.  Returns how many more packets the in queue may hold,
+   * or -1 if it has no limit.  If it returns 0, the in queue is paused as
+   * throttleReliableIn does, and the other end is woken with wakeWriter
+   * once there is room again.
+   */
+  int getInQueueRoom();
+
+  /**
+   * Wakes the writer thread if it is waiting for room in the in queue of the
+   * other end of a loopback connection.
+   */
+  void wakeWriter();
+
+  /**
+   * Sets maxInRate and resets the incoming rate control to match.  inQCtrl
+   * must be acquired.
+   */
+  void setupInRate(int newRate);
+
+  /**
+   * The largest value inRemain can reach.
+   */
+  int getInBurst() const;
+
+  /**
+   * Refills inRemain for the time passed.  inQCtrl must be acquired.
+   */
+  void updateInRates();
+
+  /**
+   * Returns how long in milliseconds until inRemain is no longer negative.
+   * inQCtrl must be acquired.
+   */
+  int getInWaitTime() const;
+
   Connection& owner;
 
   std::queue<Packet*> in;
@@ -315,6 +596,68 @@ private:
    */
   Time lastTime;
 
+  /**
+   * The rate that the remote computer is allowed to send to us, or 0 if
+   * unlimited.  This and the incoming variables below are protected by
+   * inQCtrl.
+   */
+  int maxInRate;
+
+  /**
+   * Like outRemain, the bytes we will accept before the remote computer is
+   * over its rate.
+   */
+  int inRemain;
+
+  /**
+   * Like outRateStep, for inRemain.
+   */
+  int inRateStep;
+
+  /**
+   * The last time inRemain was calculated.
+   */
+  Time lastInTime;
+
+  /**
+   * The maximum length of the in queue, or 0 if unlimited.
+   */
+  int inQueueLimit;
+
+  /**
+   * True while reading from the reliable socket is paused because the in
+   * queue is full.
+   */
+  bool inQueuePaused;
+
+  /**
+   * The state of the streams used by writeStreamPacket.
+   */
+  ReliableStreams streams;
+
+  /**
+   * Adds parity to unreliable frames.  Protected by outQCtrl.
+   */
+  ParityFecEncoder fecEncoder;
+
+  /**
+   * The messages written with writeMessage and being received.
+   */
+  MessageFragmenter messages;
+
+  /**
+   * The share of the bandwidth for messages, in percent, and the bytes they
+   * may still send ahead of other packets.  The allowance grows as frames of
+   * other packets are sent while messages wait.  Protected by outQCtrl.
+   */
+  int messageShare;
+  int messageAllowance;
+
+  /**
+   * Protected by outQCtrl.
+   */
+  SmartPtr<MessageListener> messageListener;
+
   /**
    * Calculates the current rate and step based on the current values for
    * maxOutRate and reqOutRate.
@@ -0,0 +1,186 @@
+#ifndef PARITYFEC_H_INCLUDED_0D6E4A19
+#define PARITYFEC_H_INCLUDED_0D6E4A19
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Buffer.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/gnetypes.h>
+#include <map>
+#include <vector>
+
+namespace GNE {
+
+/**
+ * @ingroup internal
+ *
+ * Adds XOR parity to the unreliable frames sent by a PacketStream, so that
+ * the receiver can rebuild one lost frame out of each group.  After every N
+ * data frames, a parity frame is sent holding the XOR of their contents.
+ * If one frame of the group is lost, XORing the parity with the frames that
+ * did arrive gives back the lost one, without waiting for the next update.
+ *
+ * Each frame sent with parity starts with a header of HEADER_LEN bytes,
+ * marked with FRAME_ID, which is reserved from the range of %GNE packet IDs
+ * and never registered with the PacketParser.  The rest of a data frame is
+ * parsed normally.
+ *
+ * This class is not thread safe; PacketStream uses it while holding its
+ * outgoing queue lock.
+ */
+class ParityFecEncoder {
+public:
+  /**
+   * Creates an encoder with parity turned off.
+   */
+  ParityFecEncoder();
+
+  /**
+   * The ID that marks the start of a frame with parity information.
+   */
+  static const int FRAME_ID;
+
+  /**
+   * The length of the header in front of each frame.
+   */
+  static const int HEADER_LEN;
+
+  /**
+   * The most data that can follow the header in a frame.
+   */
+  static const int MAX_PAYLOAD;
+
+  /**
+   * Sets how many data frames are sent for each parity frame.  0 turns
+   * parity off, otherwise the size must be in the range [2..255].  The
+   * current group is dropped.
+   */
+  void setGroupSize(int size);
+
+  /**
+   * Returns the value set by setGroupSize.
+   */
+  int getGroupSize() const;
+
+  /**
+   * Writes the header for the next data frame into raw, which must be
+   * empty.
+   */
+  void beginFrame(Buffer& raw);
+
+  /**
+   * Adds a data frame that was started with beginFrame and is now complete
+   * to the parity.  If this completes the group, the parity frame is
+   * written to parity, and true is returned.
+   */
+  bool endFrame(const Buffer& raw, Buffer& parity);
+
+private:
+  int groupSize;
+  guint16 group;
+  int index;
+  guint16 lenXor;
+  int maxLen;
+  std::vector<gbyte> data;
+};
+
+/**
+ * @ingroup internal
+ *
+ * Receives the frames made by ParityFecEncoder, and rebuilds lost frames
+ * when it can.  The last few groups are remembered, so frames may arrive
+ * out of order.  All methods are thread safe.
+ */
+class ParityFecDecoder {
+public:
+  ParityFecDecoder();
+
+  /**
+   * The results of receive.
+   */
+  enum Result {
+    /**
+     * The frame was not valid, or was a duplicate, and should be dropped.
+     */
+    Invalid,
+    /**
+     * The frame is data, and the Buffer is now at the start of its packets.
+     */
+    Data,
+    /**
+     * The frame was parity and there is nothing to parse.
+     */
+    Parity,
+    /**
+     * The frame was parity, and a lost frame was rebuilt in recovered.
+     */
+    Recovered,
+    /**
+     * The frame is data, and the Buffer is now at the start of its packets,
+     * and it also let a lost frame be rebuilt in recovered.
+     */
+    DataRecovered
+  };
+
+  /**
+   * Handles a frame starting with ParityFecEncoder::FRAME_ID, positioned at
+   * its start.  If a frame is rebuilt, recovered is cleared and filled with
+   * it, then flipped to be parsed.
+   */
+  Result receive(Buffer& frame, Buffer& recovered);
+
+  /**
+   * Returns the number of frames that have been rebuilt.
+   */
+  int getRecoveredCount() const;
+
+private:
+  struct Group {
+    Group() : count(0), received(0), lenXor(0), hasParity(false),
+      done(false) {}
+    int count;
+    int received;
+    std::vector<bool> have;
+    guint16 lenXor;
+    std::vector<gbyte> data;
+    bool hasParity;
+    bool done;
+  };
+
+  /**
+   * XORs len bytes of src into dest, growing dest as needed.
+   */
+  static void addXor(std::vector<gbyte>& dest, const gbyte* src, int len);
+
+  /**
+   * Rebuilds the missing frame of g if it is possible.
+   */
+  bool tryRecover(Group& g, Buffer& recovered);
+
+  std::map<guint16, Group> groups;
+  guint16 newest;
+  bool haveNewest;
+  int recoveredCount;
+  mutable Mutex sync;
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef RELIABLEPACKET_H_INCLUDED_3F0C92B4
+#define RELIABLEPACKET_H_INCLUDED_3F0C92B4
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/WrapperPacket.h>
+#include <gnelib/gnetypes.h>
+
+namespace GNE {
+
+/**
+ * @ingroup internal
+ *
+ * The ReliablePacket is sent by the PacketStream to carry packets written
+ * with PacketStream::writeStreamPacket over the unreliable connection, and
+ * to acknowledge them.  It is not a packet that you send, or that you will
+ * see -- it is used only internally by GNE.
+ *
+ * A data packet holds a sequence number that is unique across the
+ * connection, the stream the packet was written to, and for ordered streams
+ * a sequence number within that stream.  An acknowledgement holds the next
+ * sequence number the receiver expects, and a bit for each of the 32
+ * sequence numbers after it, set if that one was also received.
+ */
+class ReliablePacket : public WrapperPacket {
+public: //typedefs
+  typedef SmartPtr<ReliablePacket> sptr;
+  typedef WeakPtr<ReliablePacket> wptr;
+
+public:
+  /**
+   * Creates an acknowledgement of nothing, which is also suitable to call
+   * readPacket on.
+   */
+  ReliablePacket();
+
+  /**
+   * Creates a data packet for the given stream, holding a copy of packet.
+   * The sequence numbers start at 0.
+   *
+   * @param stream the stream in the range of [0..255]
+   */
+  ReliablePacket( const Packet& packet, int stream, bool ordered );
+
+  virtual ~ReliablePacket();
+
+  /**
+   * The ID for this type of packet.
+   */
+  static const int ID;
+
+  /**
+   * Returns true if this is an acknowledgement rather than data.
+   */
+  bool isAck() const;
+
+  /**
+   * Returns true if the data is for an ordered stream.
+   */
+  bool isOrdered() const;
+
+  /**
+   * Returns the stream the data was written to.
+   */
+  int getStream() const;
+
+  /**
+   * Returns the sequence number of the data, unique across the connection.
+   */
+  guint16 getSequence() const;
+
+  /**
+   * Sets the sequence number of the data.
+   */
+  void setSequence( guint16 seq );
+
+  /**
+   * Returns the sequence number of the data within its ordered stream.
+   */
+  guint16 getStreamSequence() const;
+
+  /**
+   * Sets the sequence number of the data within its ordered stream.
+   */
+  void setStreamSequence( guint16 seq );
+
+  /**
+   * Makes this packet an acknowledgement.
+   *
+   * @param next the next sequence number expected.
+   * @param bits bit i is set if next + 1 + i was received.
+   */
+  void setAck( guint16 next, guint32 bits );
+
+  /**
+   * Returns the next sequence number expected by the acknowledging side.
+   */
+  guint16 getAckNext() const;
+
+  /**
+   * Returns the bits of sequence numbers received after getAckNext.
+   */
+  guint32 getAckBits() const;
+
+  /**
+   * Returns the current size of this packet in bytes.
+   */
+  virtual int getSize() const;
+
+  /**
+   * Writes the packet to the given Buffer. 
+   */
+  virtual void writePacket(Buffer& raw) const;
+
+  /**
+   * Reads this packet from the given Buffer.
+   */
+  virtual void readPacket(Buffer& raw);
+
+  /**
+   * Returns a new instance of this class suitable only to call readPacket on.
+   */
+  static Packet* create();
+
+private:
+  enum Flags {
+    AckFlag = 0x01,
+    OrderedFlag = 0x02
+  };
+
+  guint8 flags;
+  guint8 stream;
+
+  /**
+   * The sequence number of the data, or the next expected number for an
+   * acknowledgement.
+   */
+  guint16 seq;
+  guint16 streamSeq;
+  guint32 ackBits;
+};
+
+} //namespace GNE
+
+#endif
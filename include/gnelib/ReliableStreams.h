@@ -0,0 +1,175 @@
+#ifndef RELIABLESTREAMS_H_INCLUDED_5B8E61AF
+#define RELIABLESTREAMS_H_INCLUDED_5B8E61AF
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Mutex.h>
+#include <gnelib/Time.h>
+#include <gnelib/gnetypes.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace GNE {
+class Packet;
+class ReliablePacket;
+
+/**
+ * @ingroup internal
+ *
+ * Keeps the state for the reliable streams that PacketStream sends over the
+ * unreliable connection.  Each packet gets a sequence number, and is sent
+ * again if it is not acknowledged in time.  The retransmission timeout is
+ * found from the measured round-trip time, like TCP does.  The receiver
+ * acknowledges each sequence number it has, not just the ones up to the
+ * first missing one, so only the lost packets are sent again.
+ *
+ * Packets on an ordered stream are held by the receiver until the packets
+ * before them on the same stream arrive, but a lost packet does not hold up
+ * any other stream.  Packets on unordered streams are delivered as soon as
+ * they arrive, but still only once.
+ *
+ * This class only keeps the state, and it is up to PacketStream to send the
+ * packets it returns.  All methods are thread safe.
+ */
+class ReliableStreams {
+public:
+  ReliableStreams();
+
+  /**
+   * Destroys any packets not yet sent, acknowledged, or delivered.
+   */
+  ~ReliableStreams();
+
+  /**
+   * The number of streams, each of which may be used ordered or unordered.
+   */
+  static const int NUM_STREAMS;
+
+  /**
+   * The most packets that can be waiting to be acknowledged.  Packets
+   * written after this are sent once others are acknowledged.
+   */
+  static const int MAX_UNACKED;
+
+  /**
+   * The number of times a packet is sent again before the connection is
+   * considered dropped.
+   */
+  static const int MAX_RETRIES;
+
+  /**
+   * Adds a packet to be sent on the given stream.  The packet is copied.
+   */
+  void write(const Packet& packet, int stream, bool ordered);
+
+  /**
+   * Adds the packets that need to be sent now to toSend: new packets,
+   * packets that were not acknowledged in time, and an acknowledgement if
+   * data was received since the last one.  The caller owns the packets.
+   *
+   * @return false if a packet has been sent MAX_RETRIES times without being
+   *         acknowledged, meaning the remote side is gone.
+   */
+  bool poll(const Time& now, std::vector<Packet*>& toSend);
+
+  /**
+   * Returns the time in milliseconds until poll should be called again, or
+   * -1 if there is nothing to wait for.
+   */
+  int getWaitTime(const Time& now) const;
+
+  /**
+   * Handles a received ReliablePacket, taking ownership of it.  The packets
+   * that are ready to be delivered, in order, are added to deliver, and the
+   * caller owns them.
+   *
+   * @return true if poll should be called because there is something new to
+   *         send.
+   */
+  bool receive(ReliablePacket* packet, const Time& now,
+               std::vector<Packet*>& deliver);
+
+  /**
+   * Returns the smoothed round-trip time in milliseconds, or 0 if it has not
+   * been measured yet.
+   */
+  int getRtt() const;
+
+  /**
+   * Returns the number of packets written but not yet acknowledged.
+   */
+  int getUnackedCount() const;
+
+private:
+  struct Sent {
+    ReliablePacket* packet;
+    Time sendTime;
+    Time due;
+    int retries;
+  };
+
+  struct InStream {
+    InStream() : next(0) {}
+    guint16 next;
+    std::map<guint16, Packet*> pending;
+  };
+
+  typedef std::map<guint16, Sent> SentMap;
+
+  /**
+   * Updates the round-trip estimates with a new sample, in microseconds.
+   */
+  void addRttSample(int sample);
+
+  /**
+   * Handles an acknowledgement.
+   */
+  void processAck(const ReliablePacket& ack, const Time& now);
+
+  /**
+   * Handles data, adding what can be delivered to deliver.
+   */
+  void processData(ReliablePacket* packet, std::vector<Packet*>& deliver);
+
+  //Sending side
+  std::deque<ReliablePacket*> waiting;
+  SentMap unacked;
+  guint16 nextSeq;
+  std::vector<guint16> nextStreamSeq;
+
+  //Round trip estimates in microseconds
+  int srtt;
+  int rttVar;
+  int rto;
+
+  //Receiving side
+  guint16 recvNext;
+  std::set<guint16> recvAhead;
+  bool ackPending;
+  std::vector<InStream> inStreams;
+
+  mutable Mutex sync;
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef REPLICATIONFANOUT_H_INCLUDED_9B3D62F1
+#define REPLICATIONFANOUT_H_INCLUDED_9B3D62F1
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Connection.h>
+#include <gnelib/ObjectBaselines.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <gnelib/UpdateScheduler.h>
+#include <gnelib/WorkerPool.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/SmartPtr.h>
+#include <map>
+
+namespace GNE {
+  class ObjectBrokerServer;
+  class InterestGrid;
+  class ObjectStates;
+  class Packet;
+
+/**
+ * @ingroup highlevel
+ *
+ * Sends each tick of an ObjectBrokerServer to many clients, making the
+ * packets for the clients at once on a WorkerPool.  Each client has its own
+ * ObjectBaselines and UpdateScheduler, and may have a viewer in an
+ * InterestGrid.
+ *
+ * Each tick captures the fields of every object once with
+ * ObjectBrokerServer::captureStates, then for each client:
+ *
+ *   - sends an ObjectCreationPacket reliably for each object that came into
+ *     its view, and an ObjectDeathPacket (without data) for each object that
+ *     left it,
+ *   - and sends the ObjectDeltaPacket packets for the objects it sees
+ *     unreliably, as much as fits in its outgoing rate for one tick.
+ *
+ * Without an InterestGrid every client is sent deltas for every object, and
+ * creating and destroying objects on the clients is left to the user.
+ *
+ * tick, addClient, removeClient and setWeight must be called from one thread,
+ * usually the game thread, and the broker, the grid and the objects must
+ * not be changed while tick runs.  useDeltaAck may be called at any time,
+ * such as from PacketFeeder or onReceive of the client's connection.
+ */
+class ReplicationFanout {
+public:
+  /**
+   * Creates a fanout for the given broker with the given number of worker
+   * threads, for a game running ticksPerSecond ticks each second.  The
+   * grid may be NULL.  The broker and grid must outlive the fanout.
+   */
+  ReplicationFanout( ObjectBrokerServer& server, InterestGrid* grid,
+                     int threads, int ticksPerSecond );
+
+  virtual ~ReplicationFanout();
+
+  /**
+   * Adds a client on the given connection, which sees the objects of the
+   * given viewer of the grid, and returns its ID.  The viewer is ignored if
+   * there is no grid.
+   */
+  int addClient( const Connection::sptr& conn, int viewer = -1 );
+
+  /**
+   * Removes a client.  The viewer is not removed from the grid.
+   */
+  void removeClient( int client );
+
+  /**
+   * Returns the number of clients.
+   */
+  int getClientCount() const;
+
+  /**
+   * @see UpdateScheduler::setWeight
+   */
+  void setWeight( int client, int objectId, float weight );
+
+  /**
+   * Passes an acknowledgement from the given client to
+   * ObjectBrokerServer::useDeltaAck.  Acknowledgements for clients that
+   * were removed are ignored.
+   */
+  void useDeltaAck( int client, const ObjectDeltaPacket& packet );
+
+  /**
+   * Sends one tick to every client, returning once every packet is written.
+   *
+   * @throw Error if the fields of an object are too large for a packet.
+   */
+  void tick();
+
+protected:
+  /**
+   * Writes a packet to the given client.  This writes it to the client's
+   * connection, and may be overridden, such as to send it elsewhere or count
+   * it instead.  It is called from the worker threads, but never for the
+   * same client at once.
+   */
+  virtual void send( int client, const Connection::sptr& conn,
+                     const Packet& packet, bool reliable );
+
+private:
+  ReplicationFanout( const ReplicationFanout& );
+  ReplicationFanout& operator=( const ReplicationFanout& );
+
+  struct Client {
+    Client( int id, const Connection::sptr& conn, int viewer );
+
+    int id;
+    Connection::sptr conn;
+    int viewer;
+
+    /**
+     * Guards baselines, so useDeltaAck may be called while a tick runs.
+     */
+    Mutex sync;
+    ObjectBaselines baselines;
+    UpdateScheduler scheduler;
+  };
+
+  class ClientJob;
+  friend class ClientJob;
+
+  /**
+   * Sends the tick to one client.  Runs on the worker threads.
+   */
+  void sendTick( Client& client, const ObjectStates& states );
+
+  Client& getClient( int client );
+
+  ObjectBrokerServer& server;
+  InterestGrid* grid;
+  int ticksPerSecond;
+
+  WorkerPool pool;
+
+  /**
+   * Guards clients, for useDeltaAck.
+   */
+  mutable Mutex sync;
+  std::map<int, Client*> clients;
+  int nextId;
+};
+
+} //namespace GNE
+
+#endif
@@ -87,6 +87,22 @@ public:
    */
   using Thread::start;
 
+  /**
+   * Starts the connection process without a thread of its own, on the
+   * threads shared by all connecting connections, waiting for the client
+   * through the event generator.  Used instead of start when
+   * ConnectionParams::setAsyncConnect was set.
+   */
+  void startHandshake();
+
+  /**
+   * Starts a loopback connection from client, a ClientConnection in this
+   * process, without any handshake.  Both PacketStreams are created, then
+   * onNewConn is called on our own thread, or on our event thread if
+   * ConnectionParams::setAsyncConnect was set.
+   */
+  void startLoopback(Connection& client, const ConnectionParams& clientParams);
+
 protected:
   /**
    * This thread performs the connection process.  If an error occurs:
@@ -108,15 +124,44 @@ protected:
   void shutDown();
 
 private:
+  class HandshakeStep;
+  friend class HandshakeStep;
+
   /**
    * @throw Error if an error occurs.
    */
   void doHandshake();
 
   /**
+   * Checks the CRP read into crp, where check is what rawRead returned, and
+   * answers it with the CAP, or with a refusal if the versions don't match.
+   *
    * @throw Error if an error occurs.
    */
-  void getCRP();
+  void answerCRP(Buffer& crp, int check);
+
+  /**
+   * Starts the connection's threads once the handshake succeeded, then
+   * calls callOnNewConn.  If step is given, the EventThread runs it to call
+   * callOnNewConn instead of this thread.
+   */
+  void finishConnect( const Address& rAddr,
+                      const SmartPtr< ConnectionListener >& origListener,
+                      const SmartPtr< HandshakeStep >& step );
+
+  /**
+   * Calls onNewConn, finishing the connection if it succeeded, then
+   * releases params.
+   */
+  void callOnNewConn( const Address& rAddr,
+                      const SmartPtr< ConnectionListener >& origListener );
+
+  /**
+   * Parses the CRP, like answerCRP.
+   *
+   * @throw Error if an error occurs.
+   */
+  void getCRP(Buffer& crp, int check);
 
   /**
    * @throw Error if an error occurs.
@@ -129,9 +174,20 @@ private:
   void sendCAP();
 
   /**
+   * Parses the client's dictionary hash read into raw, where check is what
+   * rawRead returned.
+   *
+   * @throw Error if an error occurs.
+   */
+  void getCompressionInfo(Buffer& raw, int check);
+
+  /**
+   * Parses the client's unreliable port read into raw, where check is what
+   * rawRead returned.
+   *
    * @throw Error if an error occurs.
    */
-  void getUnreliableInfo();
+  void getUnreliableInfo(Buffer& raw, int check);
 
   /**
    * calls onConnectFailure, checking shutdown
@@ -31,6 +31,8 @@ class Address;
 class ConnectionListener;
 class ServerConnection;
 class ConnectionParams;
+class SharedUnreliableSocket;
+class SessionTable;
 
 /**
  * @ingroup midlevel
@@ -110,7 +112,10 @@ public:
 
   /**
    * Starts this socket listening.  onNewConn will be called when a new
-   * connection has been negotiated and error checked.
+   * connection has been negotiated and error checked.  When connections
+   * arrive, all of those waiting are accepted at once.  Each does its
+   * handshake on a thread of its own, or without one if
+   * ConnectionParams::setAsyncConnect is set in getNewConnectionParams.
    *
    * This method also registers the listener into the master list, so you after
    * this method is called you no longer need to keep the reference.
@@ -145,6 +150,35 @@ public:
    */
   Address getLocalAddress() const;
 
+  /**
+   * Sets the SharedUnreliableSocket that new connections use for their
+   * unreliable data, instead of each opening its own UDP socket.  Only
+   * clients that support shared sockets use it; the others still get their
+   * own socket.  Pass an empty pointer to stop using a shared socket.
+   * Connections already made are not affected.
+   */
+  void setSharedUnreliableSocket(const SmartPtr<SharedUnreliableSocket>& s);
+
+  /**
+   * Returns the SharedUnreliableSocket set by setSharedUnreliableSocket, or
+   * an empty pointer if there is none.
+   */
+  SmartPtr<SharedUnreliableSocket> getSharedUnreliableSocket() const;
+
+  /**
+   * Sets the SessionTable that new connections start their sessions in, so
+   * that clients can resume them after losing their connection.  Only
+   * clients that support sessions get one.  Pass an empty pointer to stop
+   * giving sessions.
+   */
+  void setSessionTable(const SmartPtr<SessionTable>& table);
+
+  /**
+   * Returns the SessionTable set by setSessionTable, or an empty pointer if
+   * there is none.
+   */
+  SmartPtr<SessionTable> getSessionTable() const;
+
 protected:
   /**
    * You must call this from your create function BEFORE exiting it.
@@ -208,6 +242,9 @@ private:
   //interface functions solely for ServerConnection
   friend class ServerConnection;
 
+  //ClientConnection makes loopback connections with newLoopbackConnection.
+  friend class ClientConnection;
+
   //performs the actual close operation w/o removing from list.
   void rawClose();
 
@@ -238,12 +275,34 @@ private:
 
   void onReceive();
 
+  /**
+   * Makes a ServerConnection for an accepted socket and starts it.
+   */
+  void newConnection( NLsocket sock );
+
+  /**
+   * Makes a ServerConnection without sockets for a loopback connection,
+   * or calls onListenFailure and returns an empty pointer if the params
+   * from getNewConnectionParams are invalid.
+   */
+  SmartPtr<ServerConnection> newLoopbackConnection();
+
   wptr this_;
 
   bool listening;
 
   NLsocket socket;
 
+  /**
+   * A group with only the listening socket, polled to see if another
+   * connection is waiting to be accepted.
+   */
+  NLint acceptGroup;
+
+  SmartPtr<SharedUnreliableSocket> sharedSocket;
+
+  SmartPtr<SessionTable> sessions;
+
   mutable Mutex sync;
 };
 
@@ -0,0 +1,200 @@
+#ifndef SESSIONTABLE_H_INCLUDED_2E6A09C3
+#define SESSIONTABLE_H_INCLUDED_2E6A09C3
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/SessionToken.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/Time.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/WeakPtr.h>
+#include <map>
+#include <vector>
+
+namespace GNE {
+class Connection;
+
+/**
+ * @ingroup highlevel
+ *
+ * Keeps the state of each client's session on a server, and holds it for a
+ * grace period after the client's connection is lost, so that a client
+ * reconnecting after a brief network drop gets its state back instead of
+ * starting over.  Set one with ServerConnectionListener::setSessionTable.
+ *
+ * Each client that supports sessions gets a SessionToken in the CAP, found
+ * with Connection::getSessionToken.  In onNewConn, if
+ * Connection::isResumed, getSession returns the state the client had,
+ * such as its ObjectBaselines and channels, and the snapshot of the world
+ * does not need to be sent again.  Otherwise give the new client its state
+ * with setSession.  When the connection is lost, the session is held, and is
+ * kept until the grace period ends.  Call expire from time to time to get
+ * the sessions whose clients did not come back, and end them, for example
+ * by removing their players.  Call close when a client leaves on purpose.
+ *
+ * A client may reconnect before the server notices its old connection is
+ * lost.  Its token then takes the session over from the old connection,
+ * which is disconnected.
+ *
+ * Only the state put in the Session is kept.  The packets that were still
+ * queued on the lost connection are gone, since it is not known which of
+ * them arrived.
+ *
+ * All of the methods in this class are safe to call from multiple threads at
+ * the same time.
+ */
+class SessionTable {
+public:
+  typedef SmartPtr<SessionTable> sptr;
+  typedef WeakPtr<SessionTable> wptr;
+
+  /**
+   * The state of one client's session.  Inherit from this class to hold
+   * what the server keeps for the client.
+   */
+  class Session {
+  public:
+    typedef SmartPtr<Session> sptr;
+
+    virtual ~Session();
+  };
+
+  /**
+   * Creates a table that holds sessions for graceMs milliseconds after hold
+   * is called for them.
+   */
+  static sptr create( int graceMs = 30000 );
+
+  ~SessionTable();
+
+  /**
+   * Returns the grace period in milliseconds.
+   */
+  int getGracePeriod() const;
+
+  /**
+   * Sets the grace period in milliseconds for sessions held from now on.
+   */
+  void setGracePeriod( int ms );
+
+  /**
+   * Starts a session for a connecting client on conn.  If requested names a
+   * held session that has not expired, it is taken out of hold, resumed is
+   * set to true, and requested is returned.  If it names a session that is
+   * not held, the client is taking it over from its old connection, so
+   * replaced is also set to that connection, if it still exists, which the
+   * caller should disconnect.  Otherwise a new session with no Session is
+   * started, resumed is set to false, and its token is returned.
+   *
+   * This is called by the server's side of the handshake.  A session
+   * started for a handshake that fails is held.
+   *
+   * @throw Error if the system's secure random source could not be read
+   *              for the secret of a new session.
+   */
+  SessionToken startSession( const SessionToken& requested,
+                             const SmartPtr<Connection>& conn, bool& resumed,
+                             SmartPtr<Connection>& replaced );
+
+  /**
+   * Sets the state of a session.  Has no effect if there is no such session.
+   */
+  void setSession( const SessionToken& token, const Session::sptr& session );
+
+  /**
+   * Returns the state of a session, or an empty pointer if there is no such
+   * session or it has no state.
+   */
+  Session::sptr getSession( const SessionToken& token ) const;
+
+  /**
+   * Holds a session for the grace period, so that its client can resume it.
+   * Has no effect if there is no such session or it is already held.
+   */
+  void hold( const SessionToken& token );
+
+  /**
+   * Holds a session like hold, but only if conn is still the connection it
+   * was started or taken over on.  This is called by a Connection with a
+   * session when it disconnects, so that a connection that lost its
+   * session to a newer one does not hold it.
+   */
+  void hold( const SessionToken& token, const Connection& conn );
+
+  /**
+   * Ends a session now, so that it cannot be resumed.
+   */
+  void close( const SessionToken& token );
+
+  /**
+   * Ends the held sessions whose grace period is over, and adds those with
+   * a Session to expired.
+   */
+  void expire( std::vector<Session::sptr>& expired );
+
+  /**
+   * Returns the number of sessions, held or not.
+   */
+  int getSessionCount() const;
+
+  /**
+   * Returns the number of sessions held.
+   */
+  int getHeldCount() const;
+
+private:
+  explicit SessionTable( int graceMs );
+
+  struct Entry {
+    SessionToken token;
+    Session::sptr session;
+    bool held;
+    Time deadline;
+
+    /**
+     * The connection using the session, which owner points to.  owner is
+     * only compared, so it is kept even after the connection is gone.
+     */
+    WeakPtr<Connection> conn;
+    const Connection* owner;
+  };
+
+  typedef std::map<guint32, Entry> Entries;
+
+  /**
+   * Returns the entry for the token, or NULL.  sync must be locked.
+   */
+  Entry* find( const SessionToken& token );
+  const Entry* find( const SessionToken& token ) const;
+
+  int graceMs;
+
+  Entries entries;
+
+  int heldCount;
+
+  guint32 nextId;
+
+  mutable Mutex sync;
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SESSIONTOKEN_H_INCLUDED_7B21D94E
+#define SESSIONTOKEN_H_INCLUDED_7B21D94E
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/gnetypes.h>
+
+namespace GNE {
+
+/**
+ * @ingroup midlevel
+ *
+ * Names a session held by a server's SessionTable.  A server with a
+ * SessionTable gives one to each client when it connects, and a client that
+ * loses its connection can pass it to ConnectionParams::setResumeToken to
+ * get its session back.  The secret is 64 bits from the system's secure
+ * random source, so that a client cannot resume the session of another by
+ * guessing, even from its own token.  A token with an id of 0 is invalid,
+ * and is the default.
+ */
+struct SessionToken {
+  /**
+   * The number of 32-bit words in the secret.
+   */
+  enum { SECRET_WORDS = 2 };
+
+  SessionToken() : id( 0 ) {
+    for ( int i = 0; i < SECRET_WORDS; ++i )
+      secret[i] = 0;
+  }
+
+  SessionToken( guint32 id, const guint32* secret ) : id( id ) {
+    for ( int i = 0; i < SECRET_WORDS; ++i )
+      this->secret[i] = secret[i];
+  }
+
+  /**
+   * Returns true if this token names a session.
+   */
+  bool isValid() const {
+    return id != 0;
+  }
+
+  bool operator==( const SessionToken& rhs ) const {
+    return id == rhs.id && sameSecret( rhs );
+  }
+
+  /**
+   * Returns true if rhs has the same secret.  Every word is compared, so
+   * the time taken does not tell how much of a guess was right.
+   */
+  bool sameSecret( const SessionToken& rhs ) const {
+    guint32 diff = 0;
+    for ( int i = 0; i < SECRET_WORDS; ++i )
+      diff |= secret[i] ^ rhs.secret[i];
+    return diff == 0;
+  }
+
+  bool operator!=( const SessionToken& rhs ) const {
+    return !( *this == rhs );
+  }
+
+  guint32 id;
+  guint32 secret[SECRET_WORDS];
+};
+
+} //namespace GNE
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef SHAREDUNRELIABLESOCKET_H_INCLUDED_7A21D0E3
+#define SHAREDUNRELIABLESOCKET_H_INCLUDED_7A21D0E3
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/ReceiveEventListener.h>
+#include <gnelib/Address.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/SmartPtr.h>
+#include <gnelib/WeakPtr.h>
+#include <gnelib/gnetypes.h>
+#include <nl.h>
+#include <map>
+#include <vector>
+
+namespace GNE {
+class Connection;
+
+/**
+ * @ingroup midlevel
+ *
+ * A single bound UDP socket that carries the unreliable data for many
+ * ServerConnections, instead of each ServerConnection opening its own UDP
+ * socket.  This saves a socket and a poll entry per client on servers with
+ * many clients.
+ *
+ * To use it, create and open a SharedUnreliableSocket and pass it to
+ * ServerConnectionListener::setSharedUnreliableSocket.  More than one
+ * listener may use the same socket, and a server may also split its clients
+ * between several sockets by giving each listener its own.
+ *
+ * During the connection handshake, the server gives each client that
+ * supports this mode a connection token from the system's secure random
+ * source.  The client puts the token
+ * in front of every datagram it sends, and the SharedUnreliableSocket uses
+ * it to find the right Connection.  Datagrams with an unknown token, or that
+ * do not come from the IP address of the client's reliable connection, are
+ * dropped.  Clients from older versions of %GNE that do not support tokens
+ * get their own UDP socket as before.
+ *
+ * Datagrams written by the connections are queued, and whichever thread
+ * finds the queue idle sends everything in it, so that many connections
+ * writing at once share a single pass over the socket.
+ *
+ * The unreliable ConnectionStats are not available for connections using a
+ * shared socket, since HawkNL only keeps the stats per socket.
+ */
+class SharedUnreliableSocket {
+public:
+  typedef SmartPtr<SharedUnreliableSocket> sptr;
+  typedef WeakPtr<SharedUnreliableSocket> wptr;
+
+  /**
+   * The number of bytes the token adds to the front of every datagram sent
+   * to a shared socket.
+   */
+  static const int TOKEN_LEN;
+
+  /**
+   * Creates a new, unopened, SharedUnreliableSocket.
+   */
+  static sptr create();
+
+  /**
+   * Closes the socket if it is open.
+   */
+  virtual ~SharedUnreliableSocket();
+
+  /**
+   * Opens the socket on the given port and starts receiving on it.  Pass 0
+   * to let the system pick a port.  If the socket is already open, this
+   * method has no effect and returns false.
+   *
+   * @return true if the socket could not be opened.
+   */
+  bool open(int port);
+
+  /**
+   * Closes the socket.  Connections still using it can no longer send or
+   * receive unreliable data.  It is OK to call this even if not open.
+   */
+  void close();
+
+  /**
+   * Returns true if the socket is open.
+   */
+  bool isOpen() const;
+
+  /**
+   * Returns the local address of the socket, or an invalid Address if the
+   * socket is not open.
+   */
+  Address getLocalAddress() const;
+
+  /**
+   * Returns the number of connections using this socket.
+   */
+  int getConnectionCount() const;
+
+  /**
+   * Handles a datagram received from the given address, as if it came in
+   * on the socket.  The datagram, starting with its token, is read from
+   * buf's position to its limit.  Returns the connection it was passed to,
+   * or an empty pointer if it was dropped.
+   */
+  SmartPtr<Connection> process(Buffer& buf, const Address& from);
+
+protected:
+  SharedUnreliableSocket();
+
+  /**
+   * Classes inheriting SharedUnreliableSocket must call this from their
+   * create function before using open.
+   */
+  void setThisPointer(const sptr& thisPointer);
+
+  /**
+   * Sends one datagram of the queue.  This sends it on the socket, if it is
+   * open, but can be overridden, for example to test the socket without a
+   * network.  sockSync is held while the queue is sent.
+   */
+  virtual void send(const NLaddress& dest, const gbyte* data, int length);
+
+  //ServerConnection adds and removes itself, and SocketPair writes.
+  friend class ServerConnection;
+  friend class SocketPair;
+
+  /**
+   * Adds a connection, returning the token the client must use.  Datagrams
+   * are only accepted from the IP of remote, and are sent to remote until a
+   * datagram is received, after which they are sent to where that datagram
+   * came from.
+   *
+   * @throw Error if the system's secure random source could not be read
+   *              for the token.
+   */
+  guint32 addConnection(const SmartPtr<Connection>& conn,
+                        const Address& remote);
+
+  /**
+   * Changes the address data is sent to for the given token.
+   */
+  void setRemoteAddress(guint32 token, const Address& remote);
+
+  /**
+   * Returns the address data is sent to for the given token.
+   */
+  Address getRemoteAddress(guint32 token) const;
+
+  /**
+   * Removes the connection with the given token.  Does nothing if there is
+   * no such token.
+   */
+  void removeConnection(guint32 token);
+
+  /**
+   * Queues the data in buf, from 0 to its position, to be sent to the
+   * connection with the given token, and sends the queue if no other thread
+   * is already sending it.  Returns the number of bytes queued, or
+   * NL_INVALID if the socket or token is not valid.
+   */
+  int write(guint32 token, const Buffer& buf);
+
+private:
+  /**
+   * Reads one datagram and passes it to process.
+   */
+  void onReceive();
+
+  /**
+   * Closes the socket.  sockSync must be held.
+   */
+  void rawClose();
+
+  class Listener : public ReceiveEventListener {
+  public:
+    Listener(const SharedUnreliableSocket::sptr& owner) : owner(owner) {}
+
+    void onReceive() {
+      SharedUnreliableSocket::sptr o = owner.lock();
+      if (o)
+        o->onReceive();
+    }
+
+  private:
+    SharedUnreliableSocket::wptr owner;
+  };
+
+  struct Entry {
+    WeakPtr<Connection> conn;
+    Address remote;
+  };
+
+  typedef std::map<guint32, Entry> ConnMap;
+  typedef ConnMap::iterator ConnMapIter;
+
+  struct Outgoing {
+    NLaddress dest;
+    std::vector<gbyte> data;
+  };
+
+  wptr this_;
+
+  /**
+   * The connections, guarded by connSync.
+   */
+  ConnMap conns;
+  mutable Mutex connSync;
+
+  /**
+   * The socket, guarded by sockSync.  All reads and writes are done while
+   * holding sockSync because HawkNL uses the remote address of the socket
+   * for both.
+   */
+  NLsocket socket;
+  mutable Mutex sockSync;
+
+  /**
+   * Datagrams waiting to be sent, guarded by queueSync.  sending is true
+   * while a thread is sending the queue.
+   */
+  std::vector<Outgoing> queue;
+  bool sending;
+  Mutex queueSync;
+};
+
+} //namespace GNE
+
+#endif
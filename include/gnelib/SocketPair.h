@@ -24,9 +24,11 @@
 #include <nl.h>
 #include <gnelib/gnetypes.h>
 #include <gnelib/Buffer.h>
+#include <gnelib/SmartPtr.h>
 
 namespace GNE {
 class Address;
+class SharedUnreliableSocket;
 
 /**
  * @ingroup internal
@@ -53,7 +55,8 @@ public:
 
   /**
    * Calls a low-level disconnect (nlClose) on both sockets, if they are not
-   * NL_INVALID, and then sets them to NL_INVALID.
+   * NL_INVALID, and then sets them to NL_INVALID.  If a shared unreliable
+   * socket is used, the connection is removed from it instead.
    */
   void disconnect();
 
@@ -106,7 +109,9 @@ public:
    *
    * @param reliable select which socket to perform the write on.  If their
    *                 is no unreliable socket, it is sent on the reliable one
-   *                 instead.
+   *                 instead.  If there is a token, unreliable data is sent
+   *                 with the token in front of it, or through the shared
+   *                 socket if there is one.
    * @param buf data to be sent.  The data from the Buffer's 0 position to the
    *  Buffer's current position is sent.
    * @return number of bytes read.
@@ -122,6 +127,19 @@ public:
    * The unreliable socket.
    */
   NLsocket u;
+
+  /**
+   * On the server side, the shared socket that carries the unreliable data
+   * instead of u, if any.
+   */
+  SmartPtr<SharedUnreliableSocket> shared;
+
+  /**
+   * The SharedUnreliableSocket token for this connection, or 0 if a shared
+   * socket is not used.  On the client side, this token is written in front
+   * of each datagram sent over u.
+   */
+  guint32 token;
 };
 
 } // namespace GNE
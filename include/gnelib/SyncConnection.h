@@ -24,6 +24,7 @@
 #include <gnelib/ConnectionListener.h>
 #include <gnelib/ConditionVariable.h>
 #include <gnelib/Mutex.h>
+#include <gnelib/SmartPtr.h>
 
 namespace GNE {
 class Address;
@@ -175,6 +176,38 @@ public:
    *              since the last interaction with this object.
    */
   SyncConnection& operator >> (Packet& packet);
+
+  /**
+   * Receives the next packet from the connection, of whatever type it is.
+   * This returns the packet exactly as it was parsed from the network, so
+   * unlike operator >> no copy of the packet is made.  The returned
+   * SmartPtr will destroy the packet through PacketParser::destroyPacket.
+   *
+   * @throw Error if an error occurred while reading, or an error occurred
+   *              since the last interaction with this object.
+   * @see receive
+   */
+  SmartPtr<Packet> receivePacket();
+
+  /**
+   * Receives the next packet, which must be of type T, and returns it without
+   * copying it.  T must be a Packet type with a static ID member, like all of
+   * the %GNE packets.  If the packet received is of a different type, the
+   * behavior is the same as with operator >>: PacketTypeMismatch is thrown
+   * and the received packet is lost.
+   *
+   * <pre>CustomPacket::sptr cp = conn.receive<CustomPacket>();</pre>
+   *
+   * @throw PacketTypeMismatch if the read packet was of the wrong type.
+   * @throw Error if an error occurred while reading, or an error occurred
+   *              since the last interaction with this object.
+   */
+  template <class T>
+  SmartPtr<T> receive() {
+    SmartPtr<Packet> ret = receivePacket();
+    checkPacketType( *ret, T::ID );
+    return static_pointer_cast<T>( ret );
+  }
   
   /**
    * Writes a Packet to the connection by placing it in the outgoing queue.
@@ -228,6 +261,9 @@ private:
   //Make friends so they can use startConnect and endConnect.
   friend class ServerConnection;
   friend class ClientConnection;
+
+  //EventThread wakes us while onConnect or onNewConn runs on it.
+  friend class EventThread;
   
   /**
    * The actual releasing functionality, but in a separate function so that
@@ -239,6 +275,19 @@ private:
    */
   void doRelease();
 
+  /**
+   * Blocks until a packet is available, then removes it from the incoming
+   * queue and returns it.
+   *
+   * @throw Error if an error occurred while waiting.
+   */
+  SmartPtr<Packet> waitForPacket();
+
+  /**
+   * Throws PacketTypeMismatch if the type of packet is not expectedType.
+   */
+  void checkPacketType( const Packet& packet, int expectedType );
+
   /**
    * The event listeners for SyncConnection that will override the current
    * listener our connection has.
@@ -0,0 +1,111 @@
+#ifndef UPDATESCHEDULER_H_INCLUDED_C83F15A2
+#define UPDATESCHEDULER_H_INCLUDED_C83F15A2
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace GNE {
+  class PacketStream;
+
+/**
+ * @ingroup highlevel
+ *
+ * Decides which objects a client gets updates for when its connection
+ * cannot carry all of them in a tick.  Make one for each client and pass it
+ * to ObjectBrokerServer::getDeltaPackets with the budget from
+ * getTickBudget.
+ *
+ * Every tick each object the client sees gains priority equal to its
+ * weight, which defaults to 1 and can be set from how near or important the
+ * object is to that client.  The objects are then tried from the highest
+ * priority down until the budget is spent, and an object's priority goes
+ * back to 0 once the client is up to date with it.  So objects that are not
+ * sent gain priority until they are, and no object starves, while objects
+ * with higher weights are sent more often.
+ *
+ * This class is not thread safe on its own, but ObjectBrokerServer locks its
+ * mutex while using it.
+ */
+class UpdateScheduler {
+public:
+  UpdateScheduler();
+
+  ~UpdateScheduler();
+
+  /**
+   * Returns the bytes a client can be sent each tick, if there are
+   * ticksPerSecond ticks each second, from PacketStream::getCurrOutRate, or
+   * -1 if the rate is not limited.
+   */
+  static int getTickBudget( const PacketStream& ps, int ticksPerSecond );
+
+  /**
+   * Sets the priority the object gains each tick.  The weight is kept until
+   * the object is no longer seen by the client.
+   */
+  void setWeight( int objectId, float weight );
+
+  /**
+   * Returns the current priority of the object, or 0 if it is not known.
+   */
+  float getPriority( int objectId ) const;
+
+  /**
+   * Returns the number of objects known.
+   */
+  int getObjectCount() const;
+
+private:
+  friend class ObjectBrokerServer;
+  friend class ObjectBaselines;
+  friend class ObjectStates;
+
+  struct Entry {
+    Entry() : weight( 1.0f ), priority( 0.0f ) {}
+
+    float weight;
+    float priority;
+  };
+
+  /**
+   * Adds the weight of each object to its priority, and forgets the objects
+   * not in objectIds.
+   */
+  void accumulate( const std::set<int>& objectIds );
+
+  /**
+   * Gets the IDs of the objects with some priority, highest first.
+   */
+  void getOrder( std::vector<int>& out ) const;
+
+  /**
+   * Called when the client is up to date with the object.
+   */
+  void sent( int objectId );
+
+  std::map<int, Entry> entries;
+};
+
+} //namespace GNE
+
+#endif
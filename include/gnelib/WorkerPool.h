@@ -0,0 +1,151 @@
+#ifndef WORKERPOOL_H_INCLUDED_E4A71B38
+#define WORKERPOOL_H_INCLUDED_E4A71B38
+
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <gnelib/Thread.h>
+#include <gnelib/Mutex.h>
+#include <gnelib/ConditionVariable.h>
+#include <gnelib/Error.h>
+#include <deque>
+#include <vector>
+
+namespace GNE {
+
+/**
+ * @ingroup midlevel
+ *
+ * A set of threads that run many small jobs at once, such as making the
+ * packets for each client in a game tick.  runAll gives out the jobs and
+ * waits for them, with the calling thread running jobs as well.
+ *
+ * Each thread has its own queue of jobs, and takes from the back of it.  A
+ * thread whose queue is empty takes from the front of another thread's
+ * queue, so that no thread sits idle while others have several jobs left,
+ * even if the jobs take very different times.
+ *
+ * The threads are made when the pool is, and wait for jobs until the pool
+ * is destroyed.
+ */
+class WorkerPool {
+public:
+  /**
+   * A job run by runAll.
+   */
+  class Job {
+  public:
+    virtual ~Job();
+
+    /**
+     * Does the job.  This may be called on any of the pool's threads, or
+     * the one calling runAll.  An Error thrown is passed on by runAll, and
+     * anything else thrown is passed on as an Error with the code
+     * Error::OtherGNELevelError.
+     */
+    virtual void run() = 0;
+  };
+
+  /**
+   * Makes a pool with the given number of threads besides the one calling
+   * runAll.  0 means all jobs are run by the caller.  The threads stop when
+   * USER threads are asked to, as in GNE::shutdownGNE, and after that the
+   * caller runs all of the jobs.
+   */
+  explicit WorkerPool( int threads );
+
+  /**
+   * Stops and waits for the threads.  runAll must not be running.
+   */
+  ~WorkerPool();
+
+  /**
+   * Returns the number of threads in the pool, not counting the one calling
+   * runAll.
+   */
+  int getThreadCount() const;
+
+  /**
+   * Runs every job, returning once they are all done.  Only one thread may
+   * call this at a time.
+   *
+   * @throw Error the first Error thrown by a job, or
+   *              Error::OtherGNELevelError if the first failed job threw
+   *              something else, once all of them are done.
+   */
+  void runAll( const std::vector<Job*>& jobs );
+
+private:
+  WorkerPool( const WorkerPool& );
+  WorkerPool& operator=( const WorkerPool& );
+
+  class Worker;
+  friend class Worker;
+
+  struct Queue {
+    Mutex sync;
+    std::deque<Job*> jobs;
+  };
+
+  /**
+   * Takes a job from the given queue, or from another if it is empty, and
+   * runs it.  Returns false if there were no jobs left.
+   */
+  bool runOne( int queue );
+
+  /**
+   * The loop of each worker thread, using the given queue.
+   */
+  void work( int queue );
+
+  /**
+   * One for each thread, and the last for the thread calling runAll.
+   */
+  std::vector<Queue*> queues;
+
+  std::vector<Thread::sptr> workers;
+
+  /**
+   * Guards the members below, and is signaled when a run starts, when the
+   * last job of a run is done, and when the pool is destroyed.
+   */
+  ConditionVariable runSync;
+
+  /**
+   * Counts up each time runAll gives out jobs.
+   */
+  int run;
+
+  /**
+   * The number of jobs of the current run not done yet.
+   */
+  int remaining;
+
+  bool stopping;
+
+  /**
+   * The first Error of the current run, if failed is true.
+   */
+  Error error;
+  bool failed;
+};
+
+} //namespace GNE
+
+#endif
@@ -21,6 +21,8 @@
  */
 
 #include <gnelib/Packet.h>
+#include <gnelib/gnetypes.h>
+#include <vector>
 
 namespace GNE {
   
@@ -31,6 +33,16 @@ namespace GNE {
  * of adding information to that packet.  A WrapperPacket on its own has no
  * identity; it is meant only to be used as a base class for the real packet
  * types that perform this common functionality.
+ *
+ * A WrapperPacket can be put into opaque mode with setOpaque.  In this mode
+ * the encapsulated packet is written with a length prefix, which allows the
+ * receiver to keep the encapsulated packet as raw bytes rather than parsing
+ * it.  The raw bytes are only parsed on the first call to getData, and if the
+ * WrapperPacket is sent on again without the data being modified, the
+ * original bytes are written verbatim.  This lets a relay forward packets
+ * without knowing their contents, and without having the encapsulated packet
+ * types registered with the PacketParser.  A WrapperPacket read in opaque
+ * form stays in opaque mode, so it is forwarded the same way it came in.
  */
 class WrapperPacket : public Packet {
 public: //typedefs
@@ -40,23 +52,59 @@ public: //typedefs
 public:
   virtual ~WrapperPacket();
 
+  /**
+   * The ID used in the stream to mark encapsulated data that was written in
+   * opaque mode.  This ID is reserved from the range of %GNE packet IDs and
+   * is never registered with the PacketParser.
+   */
+  static const int OPAQUE_ID;
+
   /**
    * Returns the current size of this packet in bytes.
    */
   virtual int getSize() const;
 
+  /**
+   * Returns true if this WrapperPacket encapsulates a packet, whether or not
+   * that packet has been parsed yet.  Unlike getData, this method never
+   * parses the encapsulated data.
+   */
+  bool hasData() const;
+
   /**
    * Returns the encapsulated data in this WrapperPacket.  There may not
    * currently be an encapsulated Packet, so this method may return NULL.
+   *
+   * If the encapsulated packet was received in opaque mode and has not yet
+   * been parsed, it is parsed now.  The raw bytes are kept, so forwarding
+   * this packet still writes them verbatim.
+   *
+   * @throw Error if the encapsulated data could not be parsed.
    */
   const Packet* getData() const;
 
   /**
    * Returns the encapsulated data in this WrapperPacket.  There may not
    * currently be an encapsulated Packet, so this method may return NULL.
+   *
+   * Since the returned packet may be modified, calling this method discards
+   * any raw bytes read in opaque mode, and the packet will be reserialized
+   * when written.
+   *
+   * @throw Error if the encapsulated data could not be parsed.
    */
   Packet* getData();
 
+  /**
+   * Removes the encapsulated Packet from this WrapperPacket and returns it,
+   * parsing it first if needed.  The caller becomes responsible for
+   * destroying the returned packet, which may be NULL.  Afterwards this
+   * WrapperPacket has no data.
+   *
+   * @throw Error if the encapsulated data could not be parsed.
+   */
+  Packet* releaseData();
+
   /**
    * Replaces the given packet with the current packet as this WrapperPacket's
    * data.  The given packet is copied with the Packet::makeClone method, if
@@ -64,6 +112,18 @@ public:
    */
   void setData( const Packet* packet );
 
+  /**
+   * Returns true if this WrapperPacket writes its data in opaque mode.
+   */
+  bool isOpaque() const;
+
+  /**
+   * Sets whether or not this WrapperPacket writes its data in opaque mode.
+   * Opaque mode adds 3 bytes of overhead to the packet, and is needed only
+   * when the receiver may want to forward the data without parsing it.
+   */
+  void setOpaque( bool opaque );
+
   /**
    * Writes the packet to the given Buffer. 
    */
@@ -94,15 +154,33 @@ protected:
   WrapperPacket( int id, const Packet* packet );
 
   /**
-   * Initializes this WrapperPacket with the given WrapperPacket.
+   * Initializes this WrapperPacket with the given WrapperPacket.  If o holds
+   * unparsed opaque data, only the raw bytes are copied.
    */
   WrapperPacket( const WrapperPacket& o );
 
 private:
   /**
-   * The encapsulated Packet.
+   * Parses rawData into packet, if it has not been already.
+   */
+  void parseData() const;
+
+  /**
+   * The encapsulated Packet.  This may be NULL while rawData holds an
+   * unparsed packet.
+   */
+  mutable Packet* packet;
+
+  /**
+   * The serialized form of the encapsulated Packet as it was read in opaque
+   * mode, including its ID.  Empty if there is no raw form.
+   */
+  std::vector<gbyte> rawData;
+
+  /**
+   * Whether the data is written in opaque mode.
    */
-  Packet* packet;
+  bool opaque;
 };
 
 } //namespace GNE
@@ -0,0 +1,196 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/AsyncConnection.h>
+#include <gnelib/ClientConnection.h>
+#include <gnelib/Connection.h>
+#include <gnelib/SyncConnection.h>
+#include <gnelib/PacketStream.h>
+#include <gnelib/Packet.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+AsyncConnection::Handler::~Handler() {
+}
+
+AsyncConnection::AsyncConnection( const SmartPtr<ConnectionListener>& next )
+: next( next ), waiting( NULL ), receiving( false ) {
+}
+
+AsyncConnection::sptr AsyncConnection::create(
+    const SmartPtr<ConnectionListener>& next ) {
+  return sptr( new AsyncConnection( next ) );
+}
+
+AsyncConnection::~AsyncConnection() {
+}
+
+Connection::sptr AsyncConnection::getConnection() const {
+  LockMutex lock( sync );
+  return conn;
+}
+
+void AsyncConnection::connect( const ClientConnection::sptr& cliConn,
+                               Handler& handler ) {
+  {
+    LockMutex lock( sync );
+    assert( waiting == NULL );
+    assert( cliConn->getListener().get() == this );
+    waiting = &handler;
+    receiving = false;
+  }
+  cliConn->connect();
+}
+
+void AsyncConnection::receive( Handler& handler ) {
+  {
+    LockMutex lock( sync );
+    assert( waiting == NULL );
+    waiting = &handler;
+    receiving = true;
+  }
+  completeReceive();
+}
+
+Packet::sptr AsyncConnection::tryReceive() {
+  LockMutex lock( sync );
+  assert( waiting == NULL );
+  if ( error.getCode() != Error::NoError )
+    throw error;
+  if ( !conn || !conn->stream().isNextPacket() )
+    return Packet::sptr();
+  return conn->stream().getNextPacketSp();
+}
+
+void AsyncConnection::write( const Packet& packet, bool reliable ) {
+  LockMutex lock( sync );
+  if ( error.getCode() != Error::NoError )
+    throw error;
+  assert( conn );
+  conn->stream().writePacket( packet, reliable );
+}
+
+Error AsyncConnection::getError() const {
+  LockMutex lock( sync );
+  return error;
+}
+
+void AsyncConnection::fail( const Error& err ) {
+  Handler* handler;
+  {
+    LockMutex lock( sync );
+    if ( error.getCode() == Error::NoError )
+      error = err;
+    handler = waiting;
+    waiting = NULL;
+  }
+  if ( handler != NULL )
+    handler->onComplete( Packet::sptr(), err );
+}
+
+void AsyncConnection::completeReceive() {
+  Handler* handler;
+  Packet::sptr packet;
+  Error result;
+  {
+    LockMutex lock( sync );
+    if ( waiting == NULL || !receiving )
+      return;
+    if ( error.getCode() != Error::NoError ) {
+      result = error;
+    } else if ( conn && conn->stream().isNextPacket() ) {
+      packet = conn->stream().getNextPacketSp();
+    } else {
+      return;
+    }
+    handler = waiting;
+    waiting = NULL;
+  }
+  //Called without the lock, so the handler may start the next receive.
+  handler->onComplete( packet, result );
+}
+
+void AsyncConnection::onConnect( SyncConnection& newConn ) {
+  {
+    LockMutex lock( sync );
+    conn = newConn.getConnection();
+  }
+  if ( next )
+    next->onConnect( newConn );
+
+  Handler* handler;
+  {
+    LockMutex lock( sync );
+    handler = waiting;
+    waiting = NULL;
+  }
+  if ( handler != NULL )
+    handler->onComplete( Packet::sptr(), Error() );
+}
+
+void AsyncConnection::onConnectFailure( Connection& conn2, const Error& err ) {
+  if ( next )
+    next->onConnectFailure( conn2, err );
+  fail( err );
+}
+
+void AsyncConnection::onNewConn( SyncConnection& newConn ) {
+  {
+    LockMutex lock( sync );
+    conn = newConn.getConnection();
+  }
+  if ( next )
+    next->onNewConn( newConn );
+}
+
+void AsyncConnection::onDisconnect( Connection& conn2 ) {
+  fail( Error( Error::ConnectionDropped ) );
+  if ( next )
+    next->onDisconnect( conn2 );
+}
+
+void AsyncConnection::onExit( Connection& conn2 ) {
+  fail( Error( Error::ExitNoticeReceived ) );
+  if ( next )
+    next->onExit( conn2 );
+}
+
+void AsyncConnection::onTimeout( Connection& conn2 ) {
+  if ( next )
+    next->onTimeout( conn2 );
+}
+
+void AsyncConnection::onError( Connection& conn2, const Error& err ) {
+  if ( next )
+    next->onError( conn2, err );
+}
+
+void AsyncConnection::onFailure( Connection& conn2, const Error& err ) {
+  fail( err );
+  if ( next )
+    next->onFailure( conn2, err );
+}
+
+void AsyncConnection::onReceive( Connection& conn2 ) {
+  completeReceive();
+}
+
+} //namespace GNE
@@ -28,17 +28,21 @@ namespace GNE {
 const int Buffer::RAW_PACKET_LEN = 512;
 
 Buffer::Buffer() : position( 0 ), limit( RAW_PACKET_LEN ),
-capacity( RAW_PACKET_LEN ), data( new gbyte[ RAW_PACKET_LEN ] ) {
+capacity( RAW_PACKET_LEN ), data( new gbyte[ RAW_PACKET_LEN ] ),
+readExceptions( true ), readError( Error::NoError ), unknownPacketId( 0 ) {
   assert( data );
 }
 
 Buffer::Buffer( int size ) : position( 0 ), limit( size ),
-capacity( size ), data( new gbyte[ size ] ) {
+capacity( size ), data( new gbyte[ size ] ),
+readExceptions( true ), readError( Error::NoError ), unknownPacketId( 0 ) {
   assert( data );
 }
 
 Buffer::Buffer( const Buffer& o ) : position( o.position ), limit( o.limit ),
-capacity( o.capacity ), data( new gbyte[ capacity ] ) {
+capacity( o.capacity ), data( new gbyte[ capacity ] ),
+readExceptions( o.readExceptions ), readError( o.readError ),
+unknownPacketId( o.unknownPacketId ) {
   memcpy( data, o.data, capacity );
 }
 
@@ -57,6 +61,9 @@ Buffer& Buffer::operator = ( const Buffer& rhs ) {
 
   position = rhs.position;
   limit = rhs.limit;
+  readExceptions = rhs.readExceptions;
+  readError = rhs.readError;
+  unknownPacketId = rhs.unknownPacketId;
 
   memcpy( data, rhs.data, rhs.capacity );
 
@@ -115,6 +122,55 @@ void Buffer::flip() {
   position = 0;
 }
 
+bool Buffer::getReadExceptions() const {
+  return readExceptions;
+}
+
+void Buffer::setReadExceptions( bool enabled ) {
+  readExceptions = enabled;
+}
+
+Error::ErrorCode Buffer::getReadError() const {
+  return readError;
+}
+
+void Buffer::clearReadError() {
+  readError = Error::NoError;
+  unknownPacketId = 0;
+}
+
+void Buffer::failRead( Error::ErrorCode code ) {
+  if ( readExceptions )
+    throw BufferError( code );
+
+  if ( readError == Error::NoError )
+    readError = code;
+  position = limit;
+}
+
+void Buffer::failUnknownPacket( int id ) {
+  if ( readExceptions )
+    throw UnknownPacket( id );
+
+  if ( readError == Error::NoError ) {
+    readError = Error::UnknownPacket;
+    unknownPacketId = id;
+  }
+  position = limit;
+}
+
+int Buffer::getUnknownPacketId() const {
+  return unknownPacketId;
+}
+
+bool Buffer::checkRead( int size ) {
+  if ( position + size <= limit )
+    return true;
+
+  failRead( Error::BufferUnderflow );
+  return false;
+}
+
 //START OF RAW OPERATIONS
 
 void Buffer::writeBuffer( Buffer& src ) {
@@ -122,8 +178,8 @@ void Buffer::writeBuffer( Buffer& src ) {
 }
 
 void Buffer::writeBuffer( Buffer& src, int length ) {
-  if ( src.getRemaining() < length )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !src.checkRead( length ) )
+    return;
   if ( getRemaining() < length )
     throw BufferError( Error::BufferOverflow );
 
@@ -141,15 +197,17 @@ void Buffer::writeRaw(const gbyte* block, int length) {
     throw BufferError( Error::BufferOverflow );
 
   writeBlock(data, position, block, length);
-  assert(position <= RAW_PACKET_LEN);
+  assert(position <= limit);
 }
 
 void Buffer::readRaw(gbyte* block, int length) {
-  if ( position + length > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( length ) ) {
+    memset( block, 0, length );
+    return;
+  }
 
   readBlock(data, position, block, length);
-  assert(position <= RAW_PACKET_LEN);
+  assert(position <= limit);
 }
 
 //START OF WRITING OPERATORS
@@ -260,64 +318,80 @@ Buffer& Buffer::operator << (const Time& x) {
 //START OF READING OPERATORS
 
 Buffer& Buffer::operator >> (gint8& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readByte(data, position, x);
   return *this;
 }
 
 Buffer& Buffer::operator >> (guint8& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readByte(data, position, x);
   return *this;
 }
 
 Buffer& Buffer::operator >> (gint16& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readShort(data, position, x);
   return *this;
 }
 
 Buffer& Buffer::operator >> (guint16& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readShort(data, position, x);
   return *this;
 }
 
 Buffer& Buffer::operator >> (gint32& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readLong(data, position, x);
   return *this;
 }
 
 Buffer& Buffer::operator >> (guint32& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readLong(data, position, x);
   return *this;
 }
 
 Buffer& Buffer::operator >> (gsingle& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readFloat(data, position, x);
   return *this;
 }
 
 Buffer& Buffer::operator >> (gdouble& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = 0;
+    return *this;
+  }
 
   readDouble(data, position, x);
   return *this;
@@ -333,7 +407,9 @@ Buffer& Buffer::operator >> (std::string& x) {
   if (length) {
     if ( position + (int)length > limit ) {
       position = oldPos;
-      throw BufferError( Error::BufferUnderflow );
+      x = "";
+      failRead( Error::BufferUnderflow );
+      return *this;
     }
 
     //If the string has a non-zero length, create a new string.
@@ -354,8 +430,10 @@ Buffer& Buffer::operator >> (Packet& x) {
 }
 
 Buffer& Buffer::operator >> (Time& x) {
-  if ( position + getSizeOf( x ) > limit )
-    throw BufferError( Error::BufferUnderflow );
+  if ( !checkRead( getSizeOf( x ) ) ) {
+    x = Time();
+    return *this;
+  }
 
   gint32 val;
 
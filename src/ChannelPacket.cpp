@@ -55,8 +55,8 @@ void ChannelPacket::setSource( int source ) {
 }
 
 Packet* ChannelPacket::makeClone() const {
-  assert( getData() != NULL );
-  return new ChannelPacket( channel, from, *getData() );
+  assert( hasData() );
+  return new ChannelPacket( *this );
 }
 
 int ChannelPacket::getSize() const {
@@ -72,7 +72,7 @@ void ChannelPacket::writePacket(Buffer& raw) const {
 void ChannelPacket::readPacket(Buffer& raw) {
   WrapperPacket::readPacket( raw );
   raw >> channel >> from;
-  assert( getData() != NULL );
+  assert( hasData() );
 }
 
 Packet* ChannelPacket::create() {
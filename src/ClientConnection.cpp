@@ -20,6 +20,8 @@
 #include "gneintern.h"
 #include <gnelib/GNE.h>
 #include <gnelib/ClientConnection.h>
+#include <gnelib/ServerConnection.h>
+#include <gnelib/ServerConnectionListener.h>
 #include <gnelib/ConnectionParams.h>
 #include <gnelib/ConnectionListener.h>
 #include <gnelib/Error.h>
@@ -29,6 +31,9 @@
 #include <gnelib/EventThread.h>
 #include <gnelib/Buffer.h>
 #include <gnelib/PacketParser.h>
+#include <gnelib/HandshakeQueue.h>
+#include <gnelib/Timer.h>
+#include <gnelib/Lock.h>
 
 namespace GNE {
 
@@ -39,11 +44,164 @@ namespace GNE {
 class ClientConnectionParams {
 public:
   Address dest;
+  //The listener of a loopback connection, used instead of dest.
+  ServerConnectionListener::sptr server;
   ConnectionParams cp;
   SmartPtr<SyncConnection> sConnPtr;
+  //Whether sConnPtr was made by us rather than passed to connect.
+  bool ourSConn;
+  bool compress;
+  guint32 remoteDictHash;
 };
 
-ClientConnection::ClientConnection() : Thread("CliConn", Thread::HIGH_PRI) {
+/**
+ * The steps of an event driven connect.  The first starts connecting the
+ * socket on the connects queue.  The socket does not block until the
+ * handshake is done, so the wait for the connect and for the CAP, which
+ * may arrive in parts, holds no thread.  Once the socket can be written to
+ * the next step sends the CRP, and once the CAP arrives the next finishes
+ * the handshake, both on handshakes.  Each wait has the handshake timeout.
+ * The last step calls onConnect as the first event of the EventThread.
+ */
+class ClientConnection::ConnectStep : public HandshakeQueue::Step {
+public:
+  typedef SmartPtr<ConnectStep> sptr;
+
+  enum Stage { Connect, CRP, CAP, OnConnect };
+
+  ConnectStep( const ClientConnection::sptr& conn )
+    : conn( conn ), stage( Connect ), origListener( conn->getListener() ) {
+  }
+
+  void run();
+
+  void cancel( const Error& error );
+
+  /**
+   * Weak pointer to this, set when created.
+   */
+  WeakPtr<ConnectStep> thisPtr;
+
+private:
+  /**
+   * Moves to the given stage, which has the handshake timeout to wait for
+   * the socket.
+   */
+  void startStage( Stage next ) {
+    stage = next;
+    int timeout = conn->params->cp.getHandshakeTimeout();
+    if ( timeout > 0 )
+      deadline = Timer::getCurrentTime() + timeout * 1000;
+    else
+      deadline = Time();
+  }
+
+  /**
+   * Waits without holding a thread, for the time left in the stage, for the
+   * connect to finish in the CRP stage, or else for the CAP or the rest of
+   * it.
+   */
+  void wait() {
+    int ms = 0;
+    if ( deadline != Time() ) {
+      ms = ( deadline - Timer::getCurrentTime() ).getTotalmSec();
+      if ( ms <= 0 ) {
+        cancel( Error( Error::ConnectionTimeOut ) );
+        return;
+      }
+    }
+    if ( stage == CRP )
+      handshakes->waitForWrite( sptr( thisPtr.lock() ), conn->sockets.r, ms );
+    else
+      handshakes->waitForData( sptr( thisPtr.lock() ), conn->sockets.r, ms );
+  }
+
+  ClientConnection::sptr conn;
+  Stage stage;
+  //When the stage times out, or 0 for never.
+  Time deadline;
+  ConnectionListener::sptr origListener;
+};
+
+void ClientConnection::ConnectStep::run() {
+  switch ( stage ) {
+  case Connect:
+    try {
+      if ( conn->params->server )
+        conn->connectLoopback();
+      else
+        conn->beginConnect();
+    } catch ( Error& e ) {
+      cancel( e );
+      return;
+    }
+
+    if ( conn->params->server ) {
+      //A loopback connection has nothing to wait for.
+      stage = OnConnect;
+      conn->finishConnect( origListener, sptr( thisPtr.lock() ) );
+      return;
+    }
+
+    startStage( CRP );
+    wait();
+    break;
+
+  case CRP:
+    try {
+      if ( !conn->sendCRP() ) {
+        //The socket is still connecting.
+        wait();
+        return;
+      }
+    } catch ( Error& e ) {
+      cancel( e );
+      return;
+    }
+    startStage( CAP );
+    wait();
+    break;
+
+  case CAP:
+    {
+      Buffer raw( 64 );
+      int check = conn->sockets.rawRead( true, raw );
+      if ( check == 0 ) {
+        //Only part of the CAP has arrived.
+        wait();
+        return;
+      }
+
+      try {
+        conn->answerCAP( raw, check );
+      } catch ( Error& e ) {
+        cancel( e );
+        return;
+      }
+    }
+    //The connection's threads expect the socket to block.
+    if ( !nlSetSocketOpt( conn->sockets.r, NL_BLOCKING_IO, NL_TRUE ) ) {
+      cancel( LowLevelError() );
+      return;
+    }
+    stage = OnConnect;
+    conn->finishConnect( origListener, sptr( thisPtr.lock() ) );
+    break;
+
+  case OnConnect:
+    conn->callOnConnect( origListener );
+    break;
+  }
+}
+
+void ClientConnection::ConnectStep::cancel( const Error& error ) {
+  gnedbgo1(1, "Connection failure during GNE handshake: %s", error.toString().c_str());
+  conn->doFailure( origListener, error );
+  conn->connectDone();
+}
+
+ClientConnection::ClientConnection()
+: Thread("CliConn", Thread::HIGH_PRI), connectFinished(false) {
   gnedbgo(5, "created");
   setType( CONNECTION );
 }
@@ -69,6 +227,9 @@ bool ClientConnection::open(const Address& dest,
     params = ParamsSPtr( new ClientConnectionParams );
     params->dest = dest;
     params->cp = p;
+    params->ourSConn = false;
+    params->compress = false;
+    params->remoteDictHash = 0;
     setListener(p.getListener());
     setTimeout(p.getTimeout());
 
@@ -82,24 +243,59 @@ bool ClientConnection::open(const Address& dest,
   }
 }
 
+bool ClientConnection::open(const ServerConnectionListener::sptr& server,
+                            const ConnectionParams& p) {
+  assert( getState() == NeedsInitialization );
+
+  if (!server || p)
+    return true;
+
+  params = ParamsSPtr( new ClientConnectionParams );
+  params->server = server;
+  params->cp = p;
+  params->ourSConn = false;
+  params->compress = false;
+  params->remoteDictHash = 0;
+  setListener(p.getListener());
+  setTimeout(p.getTimeout());
+
+  finishedInit();
+  return false;
+}
+
 void ClientConnection::connect() {
   connect( SyncConnection::sptr() );
 }
 
 void ClientConnection::connect( const SyncConnection::sptr& wrapped ) {
-  assert( sockets.r != NL_INVALID );
   assert( params );
-  assert( params->dest );
+  assert( sockets.r != NL_INVALID || params->server );
+  assert( params->dest || params->server );
   assert( !params->cp );
   assert( getState() == ReadyToConnect );
 
   params->sConnPtr = wrapped;
   startConnecting();
-  start();
+  //Without a network, a loopback connection has no shared handshake
+  //threads to use.
+  if ( params->cp.getAsyncConnect() && handshakes ) {
+    ConnectStep::sptr step( new ConnectStep(
+      static_pointer_cast<ClientConnection>( this_.lock() ) ) );
+    step->thisPtr = step;
+    //A loopback connection has no socket to connect.
+    if ( params->server )
+      handshakes->post( step );
+    else
+      connects->post( step );
+  } else {
+    start();
+  }
 }
 
 Error ClientConnection::waitForConnect() {
-  join();
+  LockCV lock( connectSync );
+  while ( !connectFinished )
+    connectSync.wait();
   return connError;
 }
 
@@ -115,82 +311,101 @@ Error ClientConnection::waitForConnect() {
  */
 void ClientConnection::run() {
   assert( getListener() );
-  gnedbgo1(1, "Trying to connect to %s", params->dest.toString().c_str());
   //endConnect will set the null listener to discard the events, so we
   //have to cache the current listener.
   ConnectionListener::sptr origListener = getListener();
 
-  NLaddress temp = params->dest.getAddress();
-  NLboolean check = nlConnect(sockets.r, &temp);
+  //Try to connect using the GNE protocol before we mess with any of the
+  //user stuff.
+  try {
+    beginHandshake();
+    finishHandshake();
+  } catch (Error& e) {
+    gnedbgo1(1, "Connection failure during GNE handshake: %s", e.toString().c_str());
+    doFailure( origListener, e );
+    connectDone();
+    return;
+  }
 
-  if (check == NL_TRUE) {
-    //Try to connect using the GNE protocol before we mess with any of the
-    //user stuff.
-    try {
-      doHandshake();
-    } catch (Error& e) {
-      gnedbgo1(1, "Connection failure during GNE handshake: %s", e.toString().c_str());
-      doFailure( origListener, e );
-      return;
-    }
-    gnedbgo(2, "GNE Protocol Handshake Successful.");
-
-    //We don't want to doubly-wrap SyncConnections, so we check for a wrapped
-    //one here and else make our own.
-    bool ourSConn = false;
-    if (!params->sConnPtr) {
-      params->sConnPtr = SyncConnection::create( this_.lock() );
-      ourSConn = true;
-    } else
-      assert(params->sConnPtr == getListener());
-    //The sConn reference variable is used only for syntactical convienence.
-    SyncConnection& sConn = *params->sConnPtr;
-    
-    bool onConnectFinished = false;
-    try {
-      //We only want to hold events on our own SyncConnection.  On a user
-      //supplied SyncConnection, when it fails we will fail, and
-      //SyncConnection::connect() will throw an error.
-      if (ourSConn)
-        sConn.startConnect();
-      startThreads();
-      reg(true, (sockets.u != NL_INVALID));
-
-      //Setup the packet feeder
-      ps->setFeederTimeout( params->cp.getFeederTimeout() );
-      ps->setLowPacketThreshold( params->cp.getLowPacketThreshold() );
-
-      gnedbgo2(2, "Starting onConnect r: %i, u: %i", sockets.r, sockets.u);
-      getListener()->onConnect(sConn); //SyncConnection will relay this
-      onConnectFinished = true;
-      finishedConnecting();
-
-      if (ourSConn) {
-        sConn.endConnect(true);
-        sConn.release();
-      }
+  finishConnect( origListener, ConnectStep::sptr() );
+}
 
-      //Setup the packet feeder
-      if ( params->cp.getFeeder() )
-        ps->setFeeder( params->cp.getFeeder() );
+void ClientConnection::finishConnect( const ConnectionListener::sptr& origListener,
+                                      const ConnectStep::sptr& step ) {
+  gnedbgo(2, "GNE Protocol Handshake Successful.");
+
+  //We don't want to doubly-wrap SyncConnections, so we check for a wrapped
+  //one here and else make our own.
+  if (!params->sConnPtr) {
+    params->sConnPtr = SyncConnection::create( this_.lock() );
+    params->ourSConn = true;
+  } else
+    assert(params->sConnPtr == getListener());
+
+  //We only want to hold events on our own SyncConnection.  On a user
+  //supplied SyncConnection, when it fails we will fail, and
+  //SyncConnection::connect() will throw an error.
+  if (params->ourSConn)
+    params->sConnPtr->startConnect();
+
+  //Setup the packet feeder
+  ps->setFeederTimeout( params->cp.getFeederTimeout() );
+  ps->setLowPacketThreshold( params->cp.getLowPacketThreshold() );
+
+  //Once the threads start, the EventThread may run the step and release
+  //params, so they are not used after this unless there is no step.
+  if (step) {
+    startThreads( step, params->sConnPtr );
+    reg(true, (sockets.u != NL_INVALID));
+  } else {
+    startThreads();
+    reg(true, (sockets.u != NL_INVALID));
+    callOnConnect( origListener );
+  }
+}
 
-    } catch (Error& e) {
-      if (!onConnectFinished) {
-        if (ourSConn)
-          sConn.endConnect(false);
-        
-        doFailure( origListener, e );
-      }
+void ClientConnection::callOnConnect( const ConnectionListener::sptr& origListener ) {
+  bool ourSConn = params->ourSConn;
+  //The sConn reference variable is used only for syntactical convienence.
+  SyncConnection& sConn = *params->sConnPtr;
+
+  bool onConnectFinished = false;
+  try {
+    gnedbgo2(2, "Starting onConnect r: %i, u: %i", sockets.r, sockets.u);
+    //SyncConnection will relay this.  It is called directly, since the
+    //listener is cleared if the other end fails or exits first.
+    sConn.onConnect(sConn);
+    onConnectFinished = true;
+    finishedConnecting();
+
+    if (ourSConn) {
+      sConn.endConnect(true);
+      sConn.release();
     }
 
-  } else { //nlConnect failed
-    LowLevelError err = LowLevelError(Error::ConnectionTimeOut);
-    gnedbgo1(1, "Connection failure: %s", err.toString().c_str());
-    doFailure( origListener, err );
+    //Setup the packet feeder
+    if ( params->cp.getFeeder() )
+      ps->setFeeder( params->cp.getFeeder() );
+
+  } catch (Error& e) {
+    if (!onConnectFinished) {
+      if (ourSConn)
+        sConn.endConnect(false);
+      
+      doFailure( origListener, e );
+    }
   }
 
+  connectDone();
+}
+
+void ClientConnection::connectDone() {
   //Save some memory by doing an early explicit reset.
   params.reset();
+
+  LockCV lock( connectSync );
+  connectFinished = true;
+  connectSync.broadcast();
 }
 
 void ClientConnection::shutDown() {
@@ -198,19 +413,53 @@ void ClientConnection::shutDown() {
   disconnect();
 }
 
-void ClientConnection::doHandshake() {
+void ClientConnection::beginHandshake() {
+  if (params->server) {
+    connectLoopback();
+    return;
+  }
+
+  gnedbgo1(1, "Trying to connect to %s", params->dest.toString().c_str());
+  NLaddress temp = params->dest.getAddress();
+  if (nlConnect(sockets.r, &temp) != NL_TRUE)
+    throw LowLevelError(Error::ConnectionTimeOut);
+
   //Start the GNE protocol connection process.
   //The first packet is from client to server, and is the connection
   //request packet (CRP).
   gnedbgo(2, "Sending the CRP.");
   sendCRP();
-  
+}
+
+void ClientConnection::beginConnect() {
+  gnedbgo1(1, "Trying to connect to %s", params->dest.toString().c_str());
+  if (!nlSetSocketOpt(sockets.r, NL_BLOCKING_IO, NL_FALSE))
+    throw LowLevelError();
+  NLaddress temp = params->dest.getAddress();
+  if (nlConnect(sockets.r, &temp) != NL_TRUE)
+    throw LowLevelError(Error::ConnectionTimeOut);
+}
+
+void ClientConnection::finishHandshake() {
+  if (params->server) //A loopback connection has no more handshake.
+    return;
+
   //Now we expect to receive the connection accepted packet (CAP) or the
-  //refused connection packet, and then based on that set up the
-  //unreliable connection.
+  //refused connection packet.
   gnedbgo(2, "Waiting for the CAP.");
-  Address temp = getCAP();
-  
+  Buffer cap( 64 );
+  answerCAP(cap, sockets.rawRead(true, cap));
+}
+
+void ClientConnection::answerCAP(Buffer& cap, int check) {
+  //Based on the CAP we set up the unreliable connection.
+  Address temp = getCAP(cap, check);
+
+  if (params->compress) {
+    gnedbgo(2, "Compression accepted, sending our dictionary.");
+    sendCompressionInfo();
+  }
+
   if (params->cp.getUnrel()) {
     gnedbgo(2, "Setting up the unreliable connection");
     setupUnreliable(temp);
@@ -219,26 +468,50 @@ void ClientConnection::doHandshake() {
   }
 }
 
-void ClientConnection::sendCRP() {
+void ClientConnection::connectLoopback() {
+  gnedbgo(1, "Trying to connect to a listener in this process");
+  ServerConnection::sptr server = params->server->newLoopbackConnection();
+  if (!server)
+    throw Error(Error::ConnectionRefused);
+
+  server->startLoopback( *this, params->cp );
+}
+
+bool ClientConnection::sendCRP() {
   Buffer crp;
   addHeader(crp);
-  addVersions(crp);
+  //We can always take a session token.
+  addVersions(crp, (params->cp.getCompression() ? CompressFlag : 0) | ResumeFlag);
   crp << (guint32)params->cp.getInRate();
-  crp << ((params->cp.getUnrel()) ? gTrue : gFalse);
+  //We can always use a token, so ask for a shared socket if the server has
+  //one.
+  crp << ((params->cp.getUnrel()) ? (gbool)(gTrue | SharedUnrelFlag) : gFalse);
+  //Only servers with sessions give tokens, so only they get a longer CRP.
+  if (params->cp.getResumeToken().isValid())
+    writeToken(crp, params->cp.getResumeToken());
 
   int check = sockets.rawWrite(true, crp);
+  //HawkNL tells how a non-blocking connect went on the first write.
+  if (check == NL_INVALID && nlGetError() == NL_CON_PENDING)
+    return false;
+  if (check == NL_INVALID && nlGetError() == NL_CON_REFUSED)
+    throw LowLevelError(Error::ConnectionRefused);
   //The write should succeed and have sent all of our data.
   if (check != crp.getPosition())
     throw LowLevelError(Error::Write);
+  return true;
 }
 
 const int MINLEN = 8;
 const int REFLEN = 44;
 const int CAPLEN = 12;
+//The token for a shared unreliable socket and the dictionary hash for
+//compression are each added to the CAP if used.
+const int CAPEXTRALEN = 4;
+//The length of a SessionToken, added to the CAP by servers with sessions.
+const int CAPTOKENLEN = 4 + 4 * SessionToken::SECRET_WORDS;
 
-Address ClientConnection::getCAP() {
-  Buffer cap( 64 );
-  int check = sockets.rawRead(true, cap);
+Address ClientConnection::getCAP(Buffer& cap, int check) {
   if (check == NL_INVALID)
     throw LowLevelError(Error::Read);
 
@@ -256,10 +529,17 @@ Address ClientConnection::getCAP() {
   cap >> isCAP;
 
   if (isCAP) {
-    //Check to make sure packet sizes match.
-    if (check != CAPLEN){
+    //Check to make sure packet sizes match.  A token for a shared unreliable
+    //socket follows the port if the server uses one.
+    bool shared = (isCAP & SharedUnrelFlag) != 0;
+    params->compress = (isCAP & CompressFlag) != 0;
+    bool session = (isCAP & ResumeFlag) != 0;
+    int expected = CAPLEN + (shared ? CAPEXTRALEN : 0) +
+      (params->compress ? CAPEXTRALEN : 0) + (session ? CAPTOKENLEN : 0);
+    if (check != expected || (shared && !params->cp.getUnrel()) ||
+        (params->compress && !params->cp.getCompression())) {
       gnedbgo2(1, "Expected a CAP of size %d but got %d bytes instead.",
-        CAPLEN, check);
+        expected, check);
       throw ProtocolViolation(ProtocolViolation::InvalidCAP);
     }
 
@@ -268,7 +548,10 @@ Address ClientConnection::getCAP() {
     cap >> maxOutRate;
 
     //Now we have enough info to create our PacketStream.
-    ps = PacketStream::create(params->cp.getOutRate(), maxOutRate, *this);
+    ps = PacketStream::create(params->cp.getOutRate(), maxOutRate, *this,
+                              params->cp.getInRate());
+    ps->setInQueueLimit(params->cp.getInQueueLimit());
+    ps->setFecGroupSize(params->cp.getFecGroupSize());
 
     //Get the unreliable connection information.  A port of less than 0 means
     //we didn't request an unreliable conn, or it we refused to us.
@@ -282,6 +565,12 @@ Address ClientConnection::getCAP() {
 
     } else if (portNum > 0) {
       ret.setPort((int)portNum);
+      if (shared) {
+        //setupUnreliable will send the token with each datagram.
+        cap >> sockets.token;
+        gnedbgo1(2, "Using a shared unreliable socket with token %x",
+                 sockets.token);
+      }
 
     } else {
       if (params->cp.getUnrel()) {
@@ -290,6 +579,17 @@ Address ClientConnection::getCAP() {
       }
     }
 
+    if (params->compress)
+      cap >> params->remoteDictHash;
+
+    if (session) {
+      sessionToken = readToken(cap);
+      resumed = params->cp.getResumeToken().isValid() &&
+        sessionToken == params->cp.getResumeToken();
+      gnedbgo2(2, "Got session token %x, %s", sessionToken.id,
+               resumed ? "resumed" : "new");
+    }
+
     return ret;
   }
 
@@ -312,6 +612,16 @@ Address ClientConnection::getCAP() {
   return Address();
 }
 
+void ClientConnection::sendCompressionInfo() {
+  Buffer info;
+  info << FrameCompressor::getDictionaryHash();
+  int check = sockets.rawWrite(true, info);
+  if (check != info.getPosition())
+    throw LowLevelError(Error::Write);
+
+  startCompression(params->remoteDictHash);
+}
+
 void ClientConnection::setupUnreliable(const Address& dest) {
   assert(dest);
   sockets.u = nlOpen(0, NL_UNRELIABLE);
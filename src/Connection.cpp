@@ -21,9 +21,13 @@
 #include <gnelib/Connection.h>
 #include <gnelib/ConnectionStats.h>
 #include <gnelib/ConnectionListener.h>
+#include <gnelib/ConnectionParams.h>
 #include <gnelib/Buffer.h>
 #include <gnelib/Packet.h>
 #include <gnelib/ExitPacket.h>
+#include <gnelib/ReliablePacket.h>
+#include <gnelib/MessagePacket.h>
+#include <gnelib/ParityFec.h>
 #include <gnelib/PacketParser.h>
 #include <gnelib/ConnectionEventGenerator.h>
 #include <gnelib/Error.h>
@@ -32,12 +36,14 @@
 #include <gnelib/Address.h>
 #include <gnelib/GNE.h>
 #include <gnelib/EventThread.h>
+#include <gnelib/SessionTable.h>
 #include <gnelib/Lock.h>
 
 namespace GNE {
 
 Connection::Connection()
-: state( NeedsInitialization ), timeout_copy( 0 ) {
+: resumed( false ), sharedRegistered( false ), state( NeedsInitialization ),
+  timeout_copy( 0 ), loopback( false ), compressOut( false ) {
 }
 
 void Connection::disconnectAll() {
@@ -122,6 +128,10 @@ void Connection::disconnect() {
 
     gnedbgo2(2, "disconnecting r: %i, u: %i", sockets.r, sockets.u);
 
+    //Hold our session so the client can come back for it.
+    if ( sessionTable )
+      sessionTable->hold( sessionToken, *this );
+
     if ( ps && ps->hasStarted() ) {
       ps->shutDown(); //PacketStream will try to send the required ExitPacket.
 
@@ -130,6 +140,13 @@ void Connection::disconnect() {
       sync.release();
       ps->join(); //we have to join to wait for the ExitPacket to go out.
       sync.acquire();
+
+    } else if ( loopback ) {
+      //No PacketStream will tell the other end, so we do.  sync is released
+      //in case the other end is disconnecting in the same way.
+      sync.release();
+      exitLoopback();
+      sync.acquire();
     }
   }
 
@@ -163,13 +180,14 @@ void Connection::addHeader(Buffer& raw) {
   raw << (gbyte)'G' << (gbyte)'N' << (gbyte)'E';
 }
 
-void Connection::addVersions(Buffer& raw) {
+void Connection::addVersions(Buffer& raw, gbyte features) {
   GNEProtocolVersionNumber us = GNE::getGNEProtocolVersion();
   //Write the GNE version numbers.
   raw << us.version << us.subVersion << us.build;
 
-  //Write the whole game name buffer
-  raw.writeRaw((const gbyte*)GNE::getGameName(), GNE::MAX_GAME_NAME_LEN + 1);
+  //Write the game name buffer, with the features in place of the last null.
+  raw.writeRaw((const gbyte*)GNE::getGameName(), GNE::MAX_GAME_NAME_LEN);
+  raw << features;
 
   //Write the user version
   raw << GNE::getUserVersion();
@@ -184,7 +202,7 @@ void Connection::checkHeader(Buffer& raw,
     throw ProtocolViolation(t);
 }
 
-void Connection::checkVersions(Buffer& raw) {
+gbyte Connection::checkVersions(Buffer& raw) {
   //Get the version numbers
   GNEProtocolVersionNumber them;
   raw >> them.version >> them.subVersion >> them.build;
@@ -204,6 +222,132 @@ void Connection::checkVersions(Buffer& raw) {
 
   //This will throw an Error of the versions are wrong.
   GNE::checkVersions(them, gameName, themUser);
+
+  return rawName[GNE::MAX_GAME_NAME_LEN];
+}
+
+void Connection::startCompression(guint32 remoteDictHash) {
+  guint32 ours = FrameCompressor::getDictionaryHash();
+  compressor.setUseDictionary(ours != 0 && ours == remoteDictHash);
+  compressOut = true;
+  gnedbgo1(2, "Compressing reliable frames, dictionary %s",
+           (ours != 0 && ours == remoteDictHash) ? "used" : "not used");
+}
+
+void Connection::writeToken(Buffer& raw, const SessionToken& token) {
+  raw << token.id;
+  for (int i = 0; i < SessionToken::SECRET_WORDS; ++i)
+    raw << token.secret[i];
+}
+
+SessionToken Connection::readToken(Buffer& raw) {
+  SessionToken ret;
+  raw >> ret.id;
+  for (int i = 0; i < SessionToken::SECRET_WORDS; ++i)
+    raw >> ret.secret[i];
+  return ret;
+}
+
+CompressionStats Connection::getCompressionStats() const {
+  return compressor.getStats();
+}
+
+SessionToken Connection::getSessionToken() const {
+  return sessionToken;
+}
+
+bool Connection::isResumed() const {
+  return resumed;
+}
+
+bool Connection::isLoopback() const {
+  return loopback;
+}
+
+void Connection::linkLoopback(Connection& a, const ConnectionParams& ap,
+                              Connection& b, const ConnectionParams& bp) {
+  //Each end may send as fast as the other allows it to receive.
+  a.ps = PacketStream::create(ap.getOutRate(), bp.getInRate(), a,
+                              ap.getInRate());
+  a.ps->setInQueueLimit(ap.getInQueueLimit());
+  b.ps = PacketStream::create(bp.getOutRate(), ap.getInRate(), b,
+                              bp.getInRate());
+  b.ps->setInQueueLimit(bp.getInQueueLimit());
+
+  a.loopbackPeer = b.this_;
+  a.loopback = true;
+  b.loopbackPeer = a.this_;
+  b.loopback = true;
+}
+
+bool Connection::writeLoopback(std::vector<Packet*>& packets, bool reliable) {
+  sptr peer = loopbackPeer.lock();
+  if (!peer) {
+    for (size_t i = 0; i < packets.size(); ++i)
+      PacketParser::destroyPacket( packets[i] );
+    return false;
+  }
+  peer->onReceiveLoopback(packets, reliable);
+  return true;
+}
+
+bool Connection::writeLoopbackFrame(Buffer& raw) {
+  sptr peer = loopbackPeer.lock();
+  if (!peer)
+    return false;
+
+  {
+    LockMutex lock( peer->sync );
+    if ( peer->state != Connected && peer->state != Connecting )
+      return true; //the frame is lost, as it would be on a socket.
+  }
+  raw.flip();
+  peer->onReceiveFrame(raw, raw.getRemaining(), true);
+  return true;
+}
+
+void Connection::exitLoopback() {
+  sptr peer = loopbackPeer.lock();
+  if (peer) {
+    LockMutex lock( peer->sync ); //protect on eventThread
+    if( peer->eventThread )       //has it not disconnected?
+      peer->eventThread->onExit();
+  }
+}
+
+void Connection::onReceiveLoopback(std::vector<Packet*>& packets,
+                                   bool reliable) {
+  bool active;
+  {
+    LockMutex lock( sync );
+    active = ( state == Connected || state == Connecting );
+  }
+
+  //The packets are held to the same limits as the frame they would have
+  //been sent in.
+  int bytes = 0;
+  for (size_t i = 0; i < packets.size(); ++i)
+    bytes += packets[i]->getSize();
+
+  if (!active || !ps->acceptInFrame(bytes, reliable)) {
+    for (size_t i = 0; i < packets.size(); ++i)
+      PacketParser::destroyPacket( packets[i] );
+    return;
+  }
+
+  ps->addIncomingPackets(packets);
+  onReceive();
+}
+
+int Connection::getLoopbackPeerRoom() {
+  sptr peer = loopbackPeer.lock();
+  return (peer) ? peer->ps->getInQueueRoom() : -1;
+}
+
+void Connection::wakeLoopbackPeer() {
+  sptr peer = loopbackPeer.lock();
+  if (peer)
+    peer->ps->wakeWriter();
 }
 
 void Connection::onReceive() {
@@ -231,6 +375,16 @@ void Connection::startThreads() {
   eventThread->start();
 }
 
+void Connection::startThreads( const HandshakeQueue::Step::sptr& connectStep,
+                               const SmartPtr<SyncConnection>& sConn ) {
+  LockMutex lock( sync );
+
+  assert( state == Connecting );
+  eventThread->onConnect( connectStep, sConn );
+  ps->start();
+  eventThread->start();
+}
+
 void Connection::finishedConnecting() {
   LockMutex lock( sync );
 
@@ -273,34 +427,129 @@ void Connection::onReceive(bool reliable) {
     processError(Error::ConnectionDropped);
 
   } else {
-    //Stream read success
-    //parse the packets and add them to the PacketStream
-    try {
-      Packet* next = NULL;
-      while ((next = PacketParser::parseNextPacket(buf)) != NULL) {
-        //We want to intercept ExitPackets, else we just add it.
-        if (next->getType() == ExitPacket::ID) {
-          //All further errors will be ignored after we call onExit, due to
-          //contract of EventThread.
-          {
-            LockMutex lock( sync ); //protect on eventThread
-            if( eventThread )       //have we not disconnected?
-              eventThread->onExit();
-          }
+    onReceiveFrame(buf, temp, reliable);
+  }
+}
 
-          PacketParser::destroyPacket( next );
+void Connection::onReceiveShared(Buffer& buf, int bytes) {
+  //We have to assert that the connection is still active, since we can be
+  //disconnected at any time.
+  {
+    LockMutex lock( sync );
+    if ( !sharedRegistered || ( state != Connected && state != Connecting ) )
+      return; //ignore the event.
+  }
+  onReceiveFrame(buf, bytes, false);
+}
 
-        } else
-          ps->addIncomingPacket(next);
-      }
+void Connection::onReceiveFrame(Buffer& buf, int bytes, bool reliable) {
+  if (!ps->acceptInFrame(bytes, reliable)) {
+    //The remote side is sending unreliable data faster than we allow, or
+    //faster than the application reads it, so we drop the frame unparsed.
+    return;
+  }
 
-      //Notify that packets were received.
+  if (reliable && buf.getRemaining() > 0 &&
+      buf.getData()[buf.getPosition()] == FrameCompressor::FRAME_ID) {
+    Buffer unpacked;
+    if (!compressor.decompress(buf, unpacked))
+      processError( ProtocolViolation() );
+    else if (parseFrame(unpacked, true))
       onReceive();
+    return;
+  }
 
-    } catch ( Error& err ) {
-      //if PacketParser fails or readPacket fails.
-      processError( err );
+  if (!reliable && buf.getRemaining() > 0 &&
+      buf.getData()[buf.getPosition()] == ParityFecEncoder::FRAME_ID) {
+    //The frame carries parity, and may let us rebuild a lost frame.
+    Buffer recovered;
+    ParityFecDecoder::Result res = fecDecoder.receive(buf, recovered);
+    bool ok = true;
+    //The rebuilt frame was sent first, so it is parsed first.
+    if (res == ParityFecDecoder::Recovered ||
+        res == ParityFecDecoder::DataRecovered) {
+      gnedbgo(4, "Rebuilt a lost unreliable frame from parity.");
+      ok = parseFrame(recovered, false);
     }
+    if (ok && (res == ParityFecDecoder::Data ||
+               res == ParityFecDecoder::DataRecovered))
+      ok = parseFrame(buf, false);
+
+    if (ok && res != ParityFecDecoder::Invalid &&
+        res != ParityFecDecoder::Parity)
+      onReceive();
+    return;
+  }
+
+  if (parseFrame(buf, reliable)) {
+    //Notify that packets were received.
+    onReceive();
+  }
+}
+
+bool Connection::parseFrame(Buffer& buf, bool reliable) {
+  //Stream read success
+  //parse the packets and add them to the PacketStream
+  //Malformed data is reported through the return code rather than by an
+  //exception, so a host sending us garbage is cheap to reject.
+  try {
+    Packet* next = NULL;
+    int nextId;
+    Error::ErrorCode code;
+    while ((code = PacketParser::tryParseNextPacket(buf, next, nextId))
+           == Error::NoError && next != NULL) {
+      //We want to intercept ExitPackets, else we just add it.
+      if (next->getType() == ExitPacket::ID) {
+        //All further errors will be ignored after we call onExit, due to
+        //contract of EventThread.
+        {
+          LockMutex lock( sync ); //protect on eventThread
+          if( eventThread )       //have we not disconnected?
+            eventThread->onExit();
+        }
+
+        PacketParser::destroyPacket( next );
+
+      } else if (next->getType() == ReliablePacket::ID) {
+        //Stream packets are delivered by the PacketStream once they are in
+        //order.
+        ps->receiveStreamPacket( (ReliablePacket*)next );
+
+      } else if (next->getType() == MessagePacket::ID) {
+        //Messages are delivered by the PacketStream once all of their
+        //fragments have arrived, which is only done on the reliable
+        //connection.
+        if (!reliable) {
+          PacketParser::destroyPacket( next );
+          processError( ProtocolViolation() );
+          return false;
+        }
+        if (!ps->receiveMessagePacket( (MessagePacket*)next )) {
+          processError( ProtocolViolation() );
+          return false;
+        }
+
+      } else
+        ps->addIncomingPacket(next);
+    }
+
+    //Stop reading if we are receiving faster than we allow.
+    if (reliable)
+      ps->throttleReliableIn();
+
+    if (code == Error::UnknownPacket) {
+      processError( UnknownPacket( nextId ) );
+      return false;
+    } else if (code != Error::NoError) {
+      processError( BufferError( code ) );
+      return false;
+    }
+    return true;
+
+  } catch ( Error& err ) {
+    //if PacketParser fails or readPacket fails.
+    processError( err );
+    return false;
   }
 }
 
@@ -352,6 +601,10 @@ void Connection::reg(bool reliable, bool unreliable) {
     eGen->reg( sockets.u, Listener::sptr( new Listener( this_.lock(), false ) ) );
     gnedbgo1(3, "Registered unreliable socket %i", sockets.u);
   }
+  if ( unreliable && sockets.shared ) {
+    sharedRegistered = true;
+    gnedbgo(3, "Registered with shared unreliable socket");
+  }
 }
 
 void Connection::unreg(bool reliable, bool unreliable) {
@@ -365,6 +618,8 @@ void Connection::unreg(bool reliable, bool unreliable) {
     eGen->unreg(sockets.u);
     gnedbgo1(3, "Unregistered unreliable socket %i", sockets.u);
   }
+  if ( unreliable )
+    sharedRegistered = false;
 }
 
 } //Namespace GNE
@@ -24,13 +24,21 @@
 #include <gnelib/Connection.h>
 #include <gnelib/Errors.h>
 #include <gnelib/Lock.h>
+#include <gnelib/Timer.h>
+#include <algorithm>
+#include <vector>
 
 namespace GNE {
 
+const int ConnectionEventGenerator::WRITE_POLL_TIME = 10;
+
 ConnectionEventGenerator::ConnectionEventGenerator() 
-: Thread("EventGen", Thread::HIGH_PRI), group(NL_INVALID) {
+: Thread("EventGen", Thread::HIGH_PRI), group(NL_INVALID),
+  writeGroup(NL_INVALID) {
   group = nlGroupCreate();
   assert(group != NL_INVALID);
+  writeGroup = nlGroupCreate();
+  assert(writeGroup != NL_INVALID);
   sockBuf = new NLsocket[NL_MAX_GROUP_SOCKETS];
   setType( SYSTEM );
   gnedbgo(5, "created");
@@ -44,6 +52,7 @@ ConnectionEventGenerator::sptr ConnectionEventGenerator::create() {
 
 ConnectionEventGenerator::~ConnectionEventGenerator() {
   nlGroupDestroy(group);
+  nlGroupDestroy(writeGroup);
   delete[] sockBuf;
   gnedbgo(5, "destroyed");
 }
@@ -56,43 +65,71 @@ ConnectionEventGenerator::~ConnectionEventGenerator() {
 void ConnectionEventGenerator::run() {
   while (!shutdown) {
     mapCtrl.acquire();
-    while (connections.empty() && !shutdown) {
+    while (connections.empty() && writers.empty() && !shutdown) {
       mapCtrl.wait();
     }
     mapCtrl.release();
 
     if (!shutdown) {
-      int numsockets = nlPollGroup(group, NL_READ_STATUS, sockBuf, NL_MAX_GROUP_SOCKETS, 250);
+      //Wake up in time to resume any paused sockets, and to check the
+      //sockets waiting to be written to.
+      int waitTime;
+      bool reading;
+      bool writing;
+      {
+        LockCV lock( mapCtrl );
+        waitTime = resumeExpired( 250 );
+        writing = !writers.empty();
+        if ( writing && waitTime > WRITE_POLL_TIME )
+          waitTime = WRITE_POLL_TIME;
+        reading = paused.size() < connections.size();
+        if ( !reading ) {
+          //Every socket is paused, so there is nothing to poll.
+          mapCtrl.timedWait( waitTime );
+          if ( !writing )
+            continue;
+        }
+      }
 
-      if (numsockets != NL_INVALID) {
-        numsockets--;
-        for (; numsockets >= 0; numsockets--) {
-          LockCVEx lock( mapCtrl );
-          ConnectionsMapIter iter = connections.find(sockBuf[numsockets]);
-          ReceiveEventListener::sptr listener;
+      if (reading)
+        poll(group, NL_READ_STATUS, connections, waitTime);
+      if (writing)
+        poll(writeGroup, NL_WRITE_STATUS, writers, 0);
+    }
+  }
+}
 
-          //Check to make sure the listener didn't unregister while we were waiting.
-          if (iter != connections.end())
-            listener = iter->second;
+void ConnectionEventGenerator::poll(NLint pollGroup, NLenum status,
+                                    ConnectionsMap& listeners, int ms) {
+  int numsockets = nlPollGroup(pollGroup, status, sockBuf, NL_MAX_GROUP_SOCKETS, ms);
 
-          //Release mapCtrl, so we don't cause any deadlocks
-          lock.release();
+  if (numsockets != NL_INVALID) {
+    numsockets--;
+    for (; numsockets >= 0; numsockets--) {
+      LockCVEx lock( mapCtrl );
+      ConnectionsMapIter iter = listeners.find(sockBuf[numsockets]);
+      ReceiveEventListener::sptr listener;
 
-          if ( listener )
-            listener->onReceive();
-        }
+      //Check to make sure the listener didn't unregister while we were waiting.
+      if (iter != listeners.end())
+        listener = iter->second;
 
-      } else {
-        //The only valid error is NL_INVALID_SOCKET which happens if we close
-        //a socket while nlPollGroup is using it.
-        // The system error 9 (bad file descriptor) should be flagged as NL_INVALID_SOCKET in hawknl, but it's not.
-        if (nlGetError() != NL_INVALID_SOCKET &&
-            !(nlGetError() == NL_SYSTEM_ERROR && nlGetSystemError() == 9)) {
-          const std::string error = LowLevelError().toString();
-          gnedbgo1(1, "%s", error.c_str());
-          assert(false);
-        }
-      }
+      //Release mapCtrl, so we don't cause any deadlocks
+      lock.release();
+
+      if ( listener )
+        listener->onReceive();
+    }
+
+  } else {
+    //The only valid error is NL_INVALID_SOCKET which happens if we close
+    //a socket while nlPollGroup is using it.
+    // The system error 9 (bad file descriptor) should be flagged as NL_INVALID_SOCKET in hawknl, but it's not.
+    if (nlGetError() != NL_INVALID_SOCKET &&
+        !(nlGetError() == NL_SYSTEM_ERROR && nlGetSystemError() == 9)) {
+      const std::string error = LowLevelError().toString();
+      gnedbgo1(1, "%s", error.c_str());
+      assert(false);
     }
   }
 }
@@ -109,14 +146,93 @@ void ConnectionEventGenerator::reg(NLsocket socket, const ReceiveEventListener::
                     // registered, and it is sleeping.
 }
 
+void ConnectionEventGenerator::regWrite(NLsocket socket, const ReceiveEventListener::sptr& listener) {
+  assert(socket != NL_INVALID);
+
+  LockCV lock( mapCtrl );
+  if ( writers.find(socket) == writers.end() ) {
+    nlGroupAddSocket(writeGroup, socket);
+    writers[socket] = listener;
+  }
+  mapCtrl.signal();
+}
+
 void ConnectionEventGenerator::unreg(NLsocket socket) {
   assert(socket != NL_INVALID);
 
   LockCV lock( mapCtrl );
   if(connections.find(socket) != connections.end()) {
-    nlGroupDeleteSocket(group, socket);
+    //Paused sockets were already removed from the group.
+    if ( paused.erase( socket ) == 0 )
+      nlGroupDeleteSocket(group, socket);
     connections.erase(socket);
   }
+  if ( writers.erase(socket) > 0 )
+    nlGroupDeleteSocket(writeGroup, socket);
+}
+
+void ConnectionEventGenerator::pause(NLsocket socket, int ms) {
+  assert(socket != NL_INVALID);
+  assert(ms >= 0);
+
+  LockCV lock( mapCtrl );
+  if ( connections.find(socket) == connections.end() )
+    return;
+
+  if ( paused.find(socket) == paused.end() )
+    nlGroupDeleteSocket(group, socket);
+
+  if ( ms > 0 )
+    paused[socket] = Timer::getCurrentTime() + ms * 1000;
+  else
+    paused[socket] = Time();
+
+  gnedbgo2(4, "Paused socket %i for %i ms", socket, ms);
+}
+
+void ConnectionEventGenerator::resume(NLsocket socket) {
+  assert(socket != NL_INVALID);
+
+  LockCV lock( mapCtrl );
+  if ( paused.erase(socket) > 0 ) {
+    nlGroupAddSocket(group, socket);
+    gnedbgo1(4, "Resumed socket %i", socket);
+    mapCtrl.signal(); //In case every other socket is paused.
+  }
+}
+
+bool ConnectionEventGenerator::isPolled(NLsocket socket) {
+  //sockBuf belongs to the event thread, which uses it without the lock.
+  std::vector<NLsocket> sockets( NL_MAX_GROUP_SOCKETS );
+  NLint count = NL_MAX_GROUP_SOCKETS;
+  LockCV lock( mapCtrl );
+  if ( !nlGroupGetSockets(group, &sockets[0], &count) )
+    return false;
+  return std::find( sockets.begin(), sockets.begin() + count, socket ) !=
+    sockets.begin() + count;
+}
+
+int ConnectionEventGenerator::resumeExpired( int maxWait ) {
+  if ( paused.empty() )
+    return maxWait;
+
+  Time now = Timer::getCurrentTime();
+  int ret = maxWait;
+  PausedMapIter iter = paused.begin();
+  while ( iter != paused.end() ) {
+    if ( iter->second == Time() ) {
+      ++iter;
+    } else if ( iter->second <= now ) {
+      nlGroupAddSocket(group, iter->first);
+      paused.erase( iter++ );
+    } else {
+      int ms = ( iter->second - now ).getTotalmSec() + 1;
+      if ( ms < ret )
+        ret = ms;
+      ++iter;
+    }
+  }
+  return ret;
 }
 
 void ConnectionEventGenerator::shutDown() {
@@ -26,18 +26,23 @@ namespace GNE {
 
 ConnectionParams::ConnectionParams()
 : feederTimeout(0), feederThresh(0),
-timeout(0), outRate(0), inRate(0), localPort(0), unrel(false) {
+timeout(0), outRate(0), inRate(0), inQueueLimit(0), fecGroupSize(0),
+localPort(0), unrel(false), compression(false), asyncConnect(false),
+handshakeTimeout(10000) {
 }
 
 ConnectionParams::ConnectionParams(const ConnectionListener::sptr& Listener)
 : listener(Listener), feederTimeout(0), feederThresh(0),
-timeout(0), outRate(0), inRate(0), localPort(0), unrel(false) {
+timeout(0), outRate(0), inRate(0), inQueueLimit(0), fecGroupSize(0),
+localPort(0), unrel(false), compression(false), asyncConnect(false),
+handshakeTimeout(10000) {
 }
 
 bool ConnectionParams::checkParams() const {
-  return (outRate < 0 || inRate < 0 || localPort < 0 || localPort > 65535
-    || !listener || timeout < 0 || feederTimeout < 0
-    || feederThresh < 0);
+  return (outRate < 0 || inRate < 0 || inQueueLimit < 0 || localPort < 0
+    || localPort > 65535 || !listener || timeout < 0 || feederTimeout < 0
+    || feederThresh < 0 || fecGroupSize < 0 || fecGroupSize == 1
+    || fecGroupSize > 255 || handshakeTimeout < 0);
 }
 
 void ConnectionParams::setListener( const ConnectionListener::sptr& Listener ) {
@@ -101,6 +106,30 @@ void ConnectionParams::setRates(int OutRate, int InRate) {
   setInRate(InRate);
 }
 
+void ConnectionParams::setInQueueLimit(int limit) {
+  inQueueLimit = limit;
+}
+
+int ConnectionParams::getInQueueLimit() const {
+  return inQueueLimit;
+}
+
+void ConnectionParams::setFecGroupSize(int size) {
+  fecGroupSize = size;
+}
+
+int ConnectionParams::getFecGroupSize() const {
+  return fecGroupSize;
+}
+
+void ConnectionParams::setCompression(bool set) {
+  compression = set;
+}
+
+bool ConnectionParams::getCompression() const {
+  return compression;
+}
+
 void ConnectionParams::setLocalPort(int LocalPort) {
   localPort = LocalPort;
 }
@@ -109,6 +138,30 @@ int ConnectionParams::getLocalPort() const {
   return localPort;
 }
 
+void ConnectionParams::setAsyncConnect(bool set) {
+  asyncConnect = set;
+}
+
+bool ConnectionParams::getAsyncConnect() const {
+  return asyncConnect;
+}
+
+void ConnectionParams::setHandshakeTimeout(int ms) {
+  handshakeTimeout = ms;
+}
+
+int ConnectionParams::getHandshakeTimeout() const {
+  return handshakeTimeout;
+}
+
+void ConnectionParams::setResumeToken(const SessionToken& token) {
+  resumeToken = token;
+}
+
+SessionToken ConnectionParams::getResumeToken() const {
+  return resumeToken;
+}
+
 void ConnectionParams::setUnrel(bool set) {
   unrel = set;
 }
@@ -71,6 +71,10 @@ void CustomPacket::readPacket( Buffer& raw ) {
   
   guint16 temp;
   raw >> temp;
+  if ( (int)temp > buf.getCapacity() ) {
+    raw.failRead( Error::BufferUnderflow );
+    return;
+  }
 
   buf.writeBuffer( raw, (int)temp );
   buf.setLimit( temp );
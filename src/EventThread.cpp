@@ -21,6 +21,7 @@
 #include <gnelib/EventThread.h>
 #include <gnelib/ConnectionListener.h>
 #include <gnelib/Connection.h>
+#include <gnelib/SyncConnection.h>
 #include <gnelib/Thread.h>
 #include <gnelib/Timer.h>
 #include <gnelib/Time.h>
@@ -103,43 +104,65 @@ void EventThread::onDisconnect() {
   gnedbgo(1, "onDisconnect Event triggered.");
   //We acquire the mutex to avoid the possiblity of a deadlock between the
   // test for the shutdown variable and the wait.
-  LockCV lock( eventSync );
+  LockCVEx lock( eventSync );
   onDisconnectEvent = true;
   eventSync.signal();
+  SyncConnection::sptr sConn = connectSConn;
+  lock.release();
+
+  //onConnect may be waiting for packets that will never come.
+  if ( sConn )
+    sConn->setError( Error( Error::ConnectionAborted ) );
 }
 
 void EventThread::onExit() {
   gnedbgo(1, "onExit Event triggered.");
 
   //Guarantee that either onExit or onFailure will be called, never both.
-  LockCV lock( eventSync );
+  LockCVEx lock( eventSync );
   if ( !failure && !onDisconnectEvent ) {
     onExitEvent = true;
     eventSync.signal();
   } else {
     gnedbgo(1, "onExit event ignored due to failure or disconnect.");
   }
+  SyncConnection::sptr sConn = connectSConn;
+  lock.release();
+
+  if ( sConn )
+    sConn->setError( Error( Error::ExitNoticeReceived ) );
 }
 
 void EventThread::onFailure(const Error& error) {
   gnedbgo1(1, "onFailure Event: %s", error.toString().c_str());
 
   //Guarantee that either onExit or onFailure will be called, never both.
-  LockCV lock( eventSync );
+  LockCVEx lock( eventSync );
   if ( !onExitEvent && !onDisconnectEvent ) {
     failure = new Error(error);
     eventSync.signal();
   } else {
     gnedbgo(1, "onFailure event ignored due to onExit or disconnect.");
   }
+  SyncConnection::sptr sConn = connectSConn;
+  lock.release();
+
+  if ( sConn )
+    sConn->setError( error );
 }
 
 void EventThread::onError(const Error& error) {
   gnedbgo1(1, "onError Event: %s", error.toString().c_str());
 
-  LockCV lock( eventSync );
+  LockCVEx lock( eventSync );
   eventQueue.push(new Error(error));
   eventSync.signal();
+  SyncConnection::sptr sConn = connectSConn;
+  lock.release();
+
+  //A SyncConnection turns errors into failures.
+  if ( sConn )
+    sConn->setError( error );
 }
 
 void EventThread::onReceive() {
@@ -148,9 +171,24 @@ void EventThread::onReceive() {
   //reset the timeout counter
   resetTimeout();
 
-  LockCV lock( eventSync );
+  LockCVEx lock( eventSync );
   onReceiveEvent = true;
   eventSync.signal();
+  SyncConnection::sptr sConn = connectSConn;
+  lock.release();
+
+  if ( sConn )
+    sConn->onReceive( *ourConn );
+}
+
+void EventThread::onConnect( const HandshakeQueue::Step::sptr& step,
+                             const SyncConnection::sptr& sConn ) {
+  gnedbgo(4, "onConnect event triggered.");
+
+  LockCV lock( eventSync );
+  connectStep = step;
+  connectSConn = sConn;
+  eventSync.signal();
 }
 
 void EventThread::shutDown() {
@@ -168,7 +206,7 @@ void EventThread::run() {
     //on our connection, which should lead to a graceful shutdown.
     LockCVEx eventLock( eventSync );
     //Wait while we have no listener and/or we have no events.
-    while (!eventListener || (!onReceiveEvent && !failure &&
+    while (!eventListener || (!connectStep && !onReceiveEvent && !failure &&
            !onDisconnectEvent && eventQueue.empty() &&
            !onExitEvent && !onTimeoutEvent) ) {
       //Calculate the time to wait
@@ -192,7 +230,14 @@ void EventThread::run() {
     listenLock.release();
 
     //Check for events, processing them if events are pending
-    if (onExitEvent) {
+    if (connectStep) {
+      //The step calls the listener itself, and is always the first event.
+      connectStep->run();
+      LockCV lock( eventSync );
+      connectStep.reset();
+      connectSConn.reset();
+
+    } else if (onExitEvent) {
       listener->onExit( *ourConn );
       ourConn->disconnect();
       onExitEvent = false; //set this after onDisconnectEvent is set
@@ -0,0 +1,308 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/FrameCompressor.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Timer.h>
+#include <gnelib/Lock.h>
+#include <vector>
+
+namespace GNE {
+
+const int FrameCompressor::FRAME_ID = 11;
+const int FrameCompressor::MAX_DICTIONARY_LEN = 32768;
+
+//The frame header: FRAME_ID, flags, and the uncompressed length.
+const int HEADER_LEN = 4;
+const guint8 DICT_FLAG = 0x01;
+
+//Matches must be at least this long, and this is also the hashed length.
+const int MIN_MATCH = 4;
+
+//The hash tables for the frame being compressed and for the dictionary.
+const int FRAME_HASH_BITS = 10;
+const int DICT_HASH_BITS = 14;
+
+//The dictionary is shared by all connections, and is only set before any
+//connections are made.
+static std::vector<gbyte> dict;
+static std::vector<int> dictTable;
+static guint32 dictHash = 0;
+
+static inline guint32 read32(const gbyte* p) {
+  guint32 ret;
+  memcpy(&ret, p, sizeof(ret));
+  return ret;
+}
+
+static inline int hashOf(guint32 v, int bits) {
+  return (int)((v * 2654435761u) >> (32 - bits));
+}
+
+//Writes the rest of a length that did not fit in its 4 bits of the token.
+static inline bool writeLength(gbyte* dst, int& op, int cap, int len) {
+  while (len >= 255) {
+    if (op >= cap)
+      return false;
+    dst[op++] = 255;
+    len -= 255;
+  }
+  if (op >= cap)
+    return false;
+  dst[op++] = (gbyte)len;
+  return true;
+}
+
+static inline bool readLength(const gbyte* src, int& ip, int len, int& ret) {
+  gbyte b;
+  do {
+    if (ip >= len)
+      return false;
+    b = src[ip++];
+    ret += b;
+  } while (b == 255);
+  return true;
+}
+
+//Writes a run of literals followed by a match, or just the literals if
+//matchLen is 0.
+static bool writeSequence(gbyte* dst, int& op, int cap, const gbyte* lit,
+                          int litLen, int offset, int matchLen) {
+  if (op >= cap)
+    return false;
+  int ml = (matchLen > 0) ? matchLen - MIN_MATCH : 0;
+  dst[op++] = (gbyte)(((litLen < 15 ? litLen : 15) << 4) | (ml < 15 ? ml : 15));
+  if (litLen >= 15 && !writeLength(dst, op, cap, litLen - 15))
+    return false;
+
+  if (op + litLen > cap)
+    return false;
+  memcpy(dst + op, lit, litLen);
+  op += litLen;
+
+  if (matchLen > 0) {
+    if (op + 2 > cap)
+      return false;
+    dst[op++] = (gbyte)(offset & 0xFF);
+    dst[op++] = (gbyte)(offset >> 8);
+    if (ml >= 15 && !writeLength(dst, op, cap, ml - 15))
+      return false;
+  }
+  return true;
+}
+
+FrameCompressor::FrameCompressor() : useDict(false) {
+}
+
+void FrameCompressor::setDictionary(const gbyte* data, int len) {
+  if (len > MAX_DICTIONARY_LEN) {
+    data += len - MAX_DICTIONARY_LEN;
+    len = MAX_DICTIONARY_LEN;
+  }
+  dict.assign(data, data + len);
+  dictTable.assign(1 << DICT_HASH_BITS, -1);
+  dictHash = 0;
+
+  if (len > 0) {
+    //Later positions replace earlier ones, giving shorter offsets.
+    for (int p = 0; p + MIN_MATCH <= len; ++p)
+      dictTable[hashOf(read32(&dict[p]), DICT_HASH_BITS)] = p;
+
+    //FNV-1a, avoiding 0 since it means no dictionary.
+    dictHash = 2166136261u;
+    for (int i = 0; i < len; ++i)
+      dictHash = (dictHash ^ dict[i]) * 16777619u;
+    if (dictHash == 0)
+      dictHash = 1;
+  }
+}
+
+guint32 FrameCompressor::getDictionaryHash() {
+  return dictHash;
+}
+
+void FrameCompressor::setUseDictionary(bool use) {
+  LockMutex lock( sync );
+  useDict = use && !dict.empty();
+}
+
+int FrameCompressor::compressBlock(const gbyte* src, int len, gbyte* dst,
+                                   int cap, bool useDict) {
+  //Positions are "virtual": the dictionary comes first, then the frame.
+  int dlen = (useDict) ? (int)dict.size() : 0;
+
+  int table[1 << FRAME_HASH_BITS];
+  for (int i = 0; i < (1 << FRAME_HASH_BITS); ++i)
+    table[i] = -1;
+
+  int op = 0;
+  int anchor = 0;
+  int ip = 0;
+  while (ip + MIN_MATCH <= len) {
+    guint32 v = read32(src + ip);
+    int h = hashOf(v, FRAME_HASH_BITS);
+    int ref = table[h];
+    table[h] = ip;
+
+    int cand = -1;
+    if (ref >= 0 && read32(src + ref) == v) {
+      cand = dlen + ref;
+    } else if (dlen > 0) {
+      int dref = dictTable[hashOf(v, DICT_HASH_BITS)];
+      if (dref >= 0 && read32(&dict[dref]) == v)
+        cand = dref;
+    }
+
+    if (cand < 0) {
+      ++ip;
+      continue;
+    }
+
+    //Extend the match.  It may run from the dictionary into the frame, and
+    //may overlap the bytes it repeats.
+    int matchLen = MIN_MATCH;
+    while (ip + matchLen < len) {
+      int p = cand + matchLen;
+      gbyte b = (p < dlen) ? dict[p] : src[p - dlen];
+      if (b != src[ip + matchLen])
+        break;
+      ++matchLen;
+    }
+
+    if (!writeSequence(dst, op, cap, src + anchor, ip - anchor,
+                       dlen + ip - cand, matchLen))
+      return 0;
+    ip += matchLen;
+    anchor = ip;
+  }
+
+  if (!writeSequence(dst, op, cap, src + anchor, len - anchor, 0, 0))
+    return 0;
+  return op;
+}
+
+bool FrameCompressor::decompressBlock(const gbyte* src, int len, gbyte* dst,
+                                      int dstLen, bool useDict) {
+  int dlen = (useDict) ? (int)dict.size() : 0;
+  int ip = 0;
+  int op = 0;
+
+  while (ip < len) {
+    gbyte token = src[ip++];
+    int lit = token >> 4;
+    if (lit == 15 && !readLength(src, ip, len, lit))
+      return false;
+    if (ip + lit > len || op + lit > dstLen)
+      return false;
+    memcpy(dst + op, src + ip, lit);
+    ip += lit;
+    op += lit;
+
+    //The last sequence has only literals.
+    if (ip == len)
+      break;
+
+    if (ip + 2 > len)
+      return false;
+    int offset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
+    int matchLen = token & 15;
+    if (matchLen == 15 && !readLength(src, ip, len, matchLen))
+      return false;
+    matchLen += MIN_MATCH;
+
+    int s = op - offset;
+    if (offset == 0 || s < -dlen || op + matchLen > dstLen)
+      return false;
+    //Byte by byte, since the match may overlap what it writes.
+    for (int i = 0; i < matchLen; ++i, ++s)
+      dst[op++] = (s < 0) ? dict[dlen + s] : dst[s];
+  }
+
+  return op == dstLen;
+}
+
+bool FrameCompressor::compress(const Buffer& raw, Buffer& out) {
+  Time start = Timer::getCurrentTime();
+
+  bool dictUsed;
+  {
+    LockMutex lock( sync );
+    dictUsed = useDict;
+  }
+
+  int len = raw.getPosition();
+  gbyte temp[Buffer::RAW_PACKET_LEN];
+  int size = compressBlock(raw.getData(), len, temp,
+                           Buffer::RAW_PACKET_LEN - HEADER_LEN, dictUsed);
+  bool ret = (size > 0 && size + HEADER_LEN < len);
+  if (ret) {
+    out.clear();
+    out << (guint8)FRAME_ID << (guint8)(dictUsed ? DICT_FLAG : 0)
+        << (guint16)len;
+    out.writeRaw(temp, size);
+  }
+
+  Time taken = Timer::getCurrentTime() - start;
+  LockMutex lock( sync );
+  stats.framesSent++;
+  stats.bytesBefore += len;
+  if (ret) {
+    stats.framesCompressed++;
+    stats.bytesAfter += out.getPosition();
+  } else {
+    stats.bytesAfter += len;
+  }
+  stats.compressTime += taken;
+  return ret;
+}
+
+bool FrameCompressor::decompress(Buffer& in, Buffer& out) {
+  Time start = Timer::getCurrentTime();
+
+  if (in.getRemaining() < HEADER_LEN)
+    return false;
+  guint8 id, flags;
+  guint16 len;
+  in >> id >> flags >> len;
+  bool dictUsed = (flags & DICT_FLAG) != 0;
+  if (id != FRAME_ID || len > out.getCapacity() || (dictUsed && dict.empty()))
+    return false;
+
+  out.clear();
+  if (!decompressBlock(in.getData() + in.getPosition(), in.getRemaining(),
+                       out.getData(), len, dictUsed))
+    return false;
+  out.setPosition(len);
+  out.flip();
+
+  Time taken = Timer::getCurrentTime() - start;
+  LockMutex lock( sync );
+  stats.framesDecompressed++;
+  stats.decompressTime += taken;
+  return true;
+}
+
+CompressionStats FrameCompressor::getStats() const {
+  LockMutex lock( sync );
+  return stats;
+}
+
+} //namespace GNE
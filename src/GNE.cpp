@@ -19,6 +19,7 @@
 
 #include "gneintern.h"
 #include <gnelib/ConnectionEventGenerator.h>
+#include <gnelib/HandshakeQueue.h>
 #include <gnelib/ConnectionStats.h>
 #include <gnelib/PacketParser.h>
 #include <gnelib/GNE.h>
@@ -46,6 +47,16 @@ namespace GNE {
 char gameNameBuf[ MAX_GAME_NAME_LEN + 1 ] = {0};
 guint32 userVersion = 0;
 ConnectionEventGenerator::sptr eGen;
+HandshakeQueue::sptr handshakes;
+HandshakeQueue::sptr connects;
+HandshakeQueue::sptr serverHandshakes;
+
+/**
+ * The number of threads that run the steps of event driven handshakes on
+ * each side, and that connect their sockets.
+ */
+static int handshakeThreads = 4;
+static int connectThreads = 4;
 
 static bool initialized = false;
 static int timeToWait = 10000;
@@ -70,6 +81,9 @@ bool initGNE(NLenum networkType, int (*atexit_ptr)(void (*func)(void)), int time
       nlDisable(NL_SOCKET_STATS);
       eGen = ConnectionEventGenerator::create();
       eGen->start();
+      handshakes = HandshakeQueue::create( handshakeThreads );
+      connects = HandshakeQueue::create( connectThreads );
+      serverHandshakes = HandshakeQueue::create( handshakeThreads );
       initialized = true; //We need only to set this to true if we are using HawkNL
     } else {
       //This is a little hacky, but I checked the HawkNL source to make sure this
@@ -94,6 +108,16 @@ bool initGNE(NLenum networkType, int (*atexit_ptr)(void (*func)(void)), int time
   return false;
 }
 
+void setHandshakeThreads( int threads ) {
+  assert( threads > 0 );
+  handshakeThreads = threads;
+}
+
+void setConnectThreads( int threads ) {
+  assert( threads > 0 );
+  connectThreads = threads;
+}
+
 void shutdownGNE() {
   if ( eGen ) {
     gnedbg( 1, "Shutting down CEG." );
@@ -101,6 +125,12 @@ void shutdownGNE() {
     //I'd like to use a join because that's cleaner, but I want to make sure
     //the program does not block indefinitely when closing.
   }
+  if ( handshakes ) {
+    gnedbg( 1, "Cancelling handshakes in progress." );
+    handshakes->shutDown();
+    connects->shutDown();
+    serverHandshakes->shutDown();
+  }
 
   gnedbg( 1, "GNE Shutdown begin: Closing all listeners." );
   ServerConnectionListener::closeAllListeners();
@@ -121,6 +151,9 @@ void shutdownGNE() {
     gnedbg( 1, "CEG failed to shut down properly!  Please file a bug report." );
   }
   eGen.reset();
+  handshakes.reset();
+  connects.reset();
+  serverHandshakes.reset();
 
   if (initialized) {
     gnedbg( 1, "Shutting down HawkNL." );
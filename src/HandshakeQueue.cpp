@@ -0,0 +1,280 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/HandshakeQueue.h>
+#include <gnelib/ConnectionEventGenerator.h>
+#include <gnelib/ReceiveEventListener.h>
+#include <gnelib/Timer.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+class HandshakeQueue::Worker : public Thread {
+public:
+  typedef SmartPtr<Worker> sptr;
+
+  static sptr create( const HandshakeQueue::sptr& queue ) {
+    sptr ret( new Worker( queue ) );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void shutDown() {
+    Thread::shutDown();
+    LockCV lock( queue->sync );
+    queue->sync.broadcast();
+  }
+
+protected:
+  void run() {
+    queue->work();
+  }
+
+private:
+  Worker( const HandshakeQueue::sptr& queue )
+    : Thread( "Handshake", Thread::HIGH_PRI ), queue( queue ) {
+    setType( SYSTEM );
+  }
+
+  //Held so the queue outlives the thread, which uses it until it leaves
+  //work.
+  HandshakeQueue::sptr queue;
+};
+
+/**
+ * Posts a step again when the socket it waits on is ready.
+ */
+class HandshakeQueue::DataListener : public ReceiveEventListener {
+public:
+  DataListener( HandshakeQueue& queue, const Step::sptr& step, NLsocket socket )
+    : queue( queue ), step( step ), socket( socket ) {
+  }
+
+  void onReceive() {
+    //If the step expired, the socket was unregistered then, and may belong
+    //to another connection by now.
+    if ( queue.endWait( step ) ) {
+      eGen->unreg( socket );
+      queue.post( step );
+    }
+  }
+
+private:
+  HandshakeQueue& queue;
+  Step::sptr step;
+  NLsocket socket;
+};
+
+HandshakeQueue::Step::~Step() {
+}
+
+HandshakeQueue::HandshakeQueue( int threads )
+: threadCount( threads ), stopping( false ) {
+  assert( threads > 0 );
+}
+
+HandshakeQueue::sptr HandshakeQueue::create( int threads ) {
+  sptr ret( new HandshakeQueue( threads ) );
+  ret->thisPtr = ret;
+  return ret;
+}
+
+HandshakeQueue::~HandshakeQueue() {
+  shutDown();
+}
+
+void HandshakeQueue::post( const Step::sptr& step ) {
+  LockCVEx lock( sync );
+  if ( stopping ) {
+    lock.release();
+    step->cancel( Error( Error::ConnectionAborted ) );
+    return;
+  }
+
+  startWorkers();
+  ready.push_back( step );
+  sync.signal();
+}
+
+void HandshakeQueue::wait( const Step::sptr& step, int ms ) {
+  LockCVEx lock( sync );
+  if ( !addWaiting( step, NL_INVALID, ms ) ) {
+    lock.release();
+    step->cancel( Error( Error::ConnectionAborted ) );
+  }
+}
+
+bool HandshakeQueue::endWait( const Step::sptr& step ) {
+  LockCV lock( sync );
+  return removeWaiting( step.get() );
+}
+
+void HandshakeQueue::waitForData( const Step::sptr& step, NLsocket socket,
+                                  int ms ) {
+  waitForSocket( step, socket, ms, false );
+}
+
+void HandshakeQueue::waitForWrite( const Step::sptr& step, NLsocket socket,
+                                   int ms ) {
+  waitForSocket( step, socket, ms, true );
+}
+
+void HandshakeQueue::waitForSocket( const Step::sptr& step, NLsocket socket,
+                                    int ms, bool write ) {
+  assert( socket != NL_INVALID );
+
+  LockCVEx lock( sync );
+  if ( !addWaiting( step, socket, ms ) ) {
+    lock.release();
+    step->cancel( Error( Error::ConnectionAborted ) );
+    return;
+  }
+  //Registered with sync locked, so the step cannot expire and unregister
+  //the socket before it is registered.
+  ReceiveEventListener::sptr listener( new DataListener( *this, step, socket ) );
+  if ( write )
+    eGen->regWrite( socket, listener );
+  else
+    eGen->reg( socket, listener );
+}
+
+bool HandshakeQueue::addWaiting( const Step::sptr& step, NLsocket socket,
+                                 int ms ) {
+  if ( stopping )
+    return false;
+
+  Waiting& w = waiting[ step.get() ];
+  if ( ms > 0 )
+    w.deadline = Timer::getCurrentTime() + ms * 1000;
+  w.step = step;
+  w.socket = socket;
+  //A step may wait before any is posted, and still has to time out.
+  startWorkers();
+  if ( ms > 0 ) {
+    deadlines.insert( std::make_pair( w.deadline, step.get() ) );
+    //Wake a thread so it waits for the new deadline if it is the soonest.
+    sync.signal();
+  }
+  return true;
+}
+
+bool HandshakeQueue::removeWaiting( Step* step ) {
+  std::map<Step*, Waiting>::iterator iter = waiting.find( step );
+  if ( iter == waiting.end() )
+    return false;
+  if ( iter->second.deadline != Time() )
+    deadlines.erase( std::make_pair( iter->second.deadline, step ) );
+  waiting.erase( iter );
+  return true;
+}
+
+void HandshakeQueue::startWorkers() {
+  //The threads are started here so programs that never connect this way
+  //do not have them.
+  if ( workers.empty() ) {
+    for ( int i = 0; i < threadCount; ++i ) {
+      Worker::sptr worker = Worker::create( thisPtr.lock() );
+      workers.push_back( worker );
+      worker->start();
+    }
+  }
+}
+
+int HandshakeQueue::getWaitingCount() const {
+  LockCV lock( sync );
+  return (int)waiting.size();
+}
+
+void HandshakeQueue::shutDown() {
+  std::vector<Step::sptr> cancelled;
+  std::vector<Thread::sptr> stopped;
+  {
+    LockCV lock( sync );
+    if ( stopping )
+      return;
+    stopping = true;
+    cancelled.assign( ready.begin(), ready.end() );
+    ready.clear();
+    for ( std::map<Step*, Waiting>::iterator iter = waiting.begin();
+          iter != waiting.end(); ++iter ) {
+      if ( iter->second.socket != NL_INVALID )
+        eGen->unreg( iter->second.socket );
+      cancelled.push_back( iter->second.step );
+    }
+    waiting.clear();
+    deadlines.clear();
+    stopped.swap( workers );
+    sync.broadcast();
+  }
+
+  for ( size_t i = 0; i < stopped.size(); ++i )
+    stopped[i]->shutDown();
+  for ( size_t i = 0; i < cancelled.size(); ++i )
+    cancelled[i]->cancel( Error( Error::ConnectionAborted ) );
+}
+
+int HandshakeQueue::expire( std::vector<Step::sptr>& expired, int maxWait ) {
+  if ( deadlines.empty() )
+    return maxWait;
+
+  Time now = Timer::getCurrentTime();
+  while ( !deadlines.empty() && deadlines.begin()->first <= now ) {
+    Step* step = deadlines.begin()->second;
+    deadlines.erase( deadlines.begin() );
+    std::map<Step*, Waiting>::iterator iter = waiting.find( step );
+    if ( iter->second.socket != NL_INVALID )
+      eGen->unreg( iter->second.socket );
+    expired.push_back( iter->second.step );
+    waiting.erase( iter );
+  }
+
+  if ( deadlines.empty() )
+    return maxWait;
+  int ms = ( deadlines.begin()->first - now ).getTotalmSec() + 1;
+  return ( ms < maxWait ) ? ms : maxWait;
+}
+
+void HandshakeQueue::work() {
+  sync.acquire();
+  while ( !stopping ) {
+    std::vector<Step::sptr> expired;
+    int waitTime = expire( expired, 1000 );
+
+    Step::sptr step;
+    if ( !ready.empty() ) {
+      step = ready.front();
+      ready.pop_front();
+    } else if ( expired.empty() ) {
+      sync.timedWait( waitTime );
+      continue;
+    }
+
+    //Run the steps without the lock, so the others can post and wait.
+    sync.release();
+    for ( size_t i = 0; i < expired.size(); ++i )
+      expired[i]->cancel( Error( Error::ConnectionTimeOut ) );
+    if ( step )
+      step->run();
+    sync.acquire();
+  }
+  sync.release();
+}
+
+} //namespace GNE
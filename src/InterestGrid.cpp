@@ -0,0 +1,254 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/InterestGrid.h>
+#include <cmath>
+#include <algorithm>
+
+namespace GNE {
+
+static void eraseValue( std::vector<int>& v, int value ) {
+  std::vector<int>::iterator iter = std::find( v.begin(), v.end(), value );
+  assert( iter != v.end() );
+  *iter = v.back();
+  v.pop_back();
+}
+
+InterestGrid::InterestGrid( float cellSize )
+: cellSize( cellSize ), nextViewer( 0 ) {
+  assert( cellSize > 0.0f );
+}
+
+InterestGrid::~InterestGrid() {
+}
+
+float InterestGrid::getCellSize() const {
+  return cellSize;
+}
+
+int InterestGrid::getObjectCount() const {
+  return (int)objects.size();
+}
+
+int InterestGrid::getViewerCount() const {
+  return (int)viewers.size();
+}
+
+int InterestGrid::addViewer( float x, float y, float radius ) {
+  int id = nextViewer++;
+  Viewer& viewer = viewers[id];
+  viewer.radius = radius;
+  viewer.range = getRange( x, y, radius );
+  addView( viewer, viewer.range );
+  return id;
+}
+
+void InterestGrid::moveViewer( int id, float x, float y ) {
+  Viewer& viewer = getViewer( id );
+  CellRange old = viewer.range;
+  CellRange range = getRange( x, y, viewer.radius );
+  if ( range.minX == old.minX && range.minY == old.minY &&
+       range.maxX == old.maxX && range.maxY == old.maxY )
+    return;
+
+  //Only the cells that are in one range and not the other change.
+  viewer.range = range;
+  for ( int cx = old.minX; cx <= old.maxX; ++cx ) {
+    for ( int cy = old.minY; cy <= old.maxY; ++cy ) {
+      CellKey key( cx, cy );
+      if ( range.contains( key ) )
+        continue;
+      CellRange one = { cx, cy, cx, cy };
+      removeView( viewer, one );
+    }
+  }
+  for ( int cx = range.minX; cx <= range.maxX; ++cx ) {
+    for ( int cy = range.minY; cy <= range.maxY; ++cy ) {
+      CellKey key( cx, cy );
+      if ( old.contains( key ) )
+        continue;
+      CellRange one = { cx, cy, cx, cy };
+      addView( viewer, one );
+    }
+  }
+}
+
+void InterestGrid::removeViewer( int id ) {
+  Viewer& viewer = getViewer( id );
+  removeView( viewer, viewer.range );
+  viewers.erase( id );
+}
+
+void InterestGrid::moveObject( int objectId, float x, float y ) {
+  CellKey key = getCell( x, y );
+  std::map<int, CellKey>::iterator obj = objects.find( objectId );
+
+  if ( obj == objects.end() ) {
+    objects[objectId] = key;
+    Cell& cell = cells[key];
+    cell.objects.push_back( objectId );
+    for ( size_t i = 0; i < cell.viewers.size(); ++i )
+      enter( *cell.viewers[i], objectId );
+    return;
+  }
+
+  CellKey oldKey = obj->second;
+  if ( oldKey == key )
+    return;
+  obj->second = key;
+
+  std::map<CellKey, Cell>::iterator oldCell = cells.find( oldKey );
+  assert( oldCell != cells.end() );
+  eraseValue( oldCell->second.objects, objectId );
+  for ( size_t i = 0; i < oldCell->second.viewers.size(); ++i ) {
+    Viewer& viewer = *oldCell->second.viewers[i];
+    if ( !viewer.range.contains( key ) )
+      leave( viewer, objectId );
+  }
+  pruneCell( oldCell );
+
+  Cell& cell = cells[key];
+  cell.objects.push_back( objectId );
+  for ( size_t i = 0; i < cell.viewers.size(); ++i ) {
+    Viewer& viewer = *cell.viewers[i];
+    if ( !viewer.range.contains( oldKey ) )
+      enter( viewer, objectId );
+  }
+}
+
+void InterestGrid::removeObject( int objectId ) {
+  std::map<int, CellKey>::iterator obj = objects.find( objectId );
+  if ( obj == objects.end() )
+    return;
+
+  std::map<CellKey, Cell>::iterator cell = cells.find( obj->second );
+  assert( cell != cells.end() );
+  eraseValue( cell->second.objects, objectId );
+  for ( size_t i = 0; i < cell->second.viewers.size(); ++i )
+    leave( *cell->second.viewers[i], objectId );
+  pruneCell( cell );
+  objects.erase( obj );
+}
+
+bool InterestGrid::isInterested( int viewer, int objectId ) const {
+  const std::set<int>& interests = getViewer( viewer ).interests;
+  return interests.find( objectId ) != interests.end();
+}
+
+const std::set<int>& InterestGrid::getInterests( int viewer ) const {
+  return getViewer( viewer ).interests;
+}
+
+void InterestGrid::getChanges( int id, std::vector<int>& entered,
+                               std::vector<int>& left ) {
+  Viewer& viewer = getViewer( id );
+  for ( std::map<int, bool>::iterator iter = viewer.changes.begin();
+        iter != viewer.changes.end(); ++iter ) {
+    if ( iter->second )
+      entered.push_back( iter->first );
+    else
+      left.push_back( iter->first );
+  }
+  viewer.changes.clear();
+}
+
+bool InterestGrid::CellRange::contains( const CellKey& cell ) const {
+  return cell.first >= minX && cell.first <= maxX &&
+    cell.second >= minY && cell.second <= maxY;
+}
+
+InterestGrid::CellKey InterestGrid::getCell( float x, float y ) const {
+  return CellKey( (int)std::floor( x / cellSize ),
+                  (int)std::floor( y / cellSize ) );
+}
+
+InterestGrid::CellRange
+InterestGrid::getRange( float x, float y, float radius ) const {
+  CellKey min = getCell( x - radius, y - radius );
+  CellKey max = getCell( x + radius, y + radius );
+  CellRange ret = { min.first, min.second, max.first, max.second };
+  return ret;
+}
+
+void InterestGrid::addView( Viewer& viewer, const CellRange& range ) {
+  for ( int cx = range.minX; cx <= range.maxX; ++cx ) {
+    for ( int cy = range.minY; cy <= range.maxY; ++cy ) {
+      Cell& cell = cells[CellKey( cx, cy )];
+      cell.viewers.push_back( &viewer );
+      for ( size_t i = 0; i < cell.objects.size(); ++i )
+        enter( viewer, cell.objects[i] );
+    }
+  }
+}
+
+void InterestGrid::removeView( Viewer& viewer, const CellRange& range ) {
+  for ( int cx = range.minX; cx <= range.maxX; ++cx ) {
+    for ( int cy = range.minY; cy <= range.maxY; ++cy ) {
+      std::map<CellKey, Cell>::iterator cell = cells.find( CellKey( cx, cy ) );
+      assert( cell != cells.end() );
+      std::vector<Viewer*>& cellViewers = cell->second.viewers;
+      std::vector<Viewer*>::iterator iter =
+        std::find( cellViewers.begin(), cellViewers.end(), &viewer );
+      assert( iter != cellViewers.end() );
+      *iter = cellViewers.back();
+      cellViewers.pop_back();
+      for ( size_t i = 0; i < cell->second.objects.size(); ++i )
+        leave( viewer, cell->second.objects[i] );
+      pruneCell( cell );
+    }
+  }
+}
+
+void InterestGrid::pruneCell( std::map<CellKey, Cell>::iterator cell ) {
+  if ( cell->second.objects.empty() && cell->second.viewers.empty() )
+    cells.erase( cell );
+}
+
+void InterestGrid::enter( Viewer& viewer, int objectId ) {
+  viewer.interests.insert( objectId );
+  std::map<int, bool>::iterator iter = viewer.changes.find( objectId );
+  if ( iter != viewer.changes.end() && !iter->second )
+    viewer.changes.erase( iter );
+  else
+    viewer.changes[objectId] = true;
+}
+
+void InterestGrid::leave( Viewer& viewer, int objectId ) {
+  viewer.interests.erase( objectId );
+  std::map<int, bool>::iterator iter = viewer.changes.find( objectId );
+  if ( iter != viewer.changes.end() && iter->second )
+    viewer.changes.erase( iter );
+  else
+    viewer.changes[objectId] = false;
+}
+
+InterestGrid::Viewer& InterestGrid::getViewer( int viewer ) {
+  std::map<int, Viewer>::iterator iter = viewers.find( viewer );
+  assert( iter != viewers.end() );
+  return iter->second;
+}
+
+const InterestGrid::Viewer& InterestGrid::getViewer( int viewer ) const {
+  std::map<int, Viewer>::const_iterator iter = viewers.find( viewer );
+  assert( iter != viewers.end() );
+  return iter->second;
+}
+
+} //namespace GNE
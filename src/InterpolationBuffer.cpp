@@ -0,0 +1,190 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/InterpolationBuffer.h>
+#include <algorithm>
+
+namespace GNE {
+
+/**
+ * The number of ping replies useClockOffset chooses from.
+ */
+static const int PING_HISTORY = 8;
+
+InterpolationBuffer::InterpolationBuffer( int valueCount, int capacity )
+: valueCount( valueCount ), capacity( capacity ),
+  times( capacity ), values( capacity * valueCount ), start( 0 ), count( 0 ),
+  delay( 0, 100000 ), maxExtrapolation( 0, 250000 ) {
+  assert( valueCount > 0 );
+  assert( capacity >= 2 );
+}
+
+InterpolationBuffer::~InterpolationBuffer() {
+}
+
+int InterpolationBuffer::getValueCount() const {
+  return valueCount;
+}
+
+int InterpolationBuffer::getCapacity() const {
+  return capacity;
+}
+
+int InterpolationBuffer::getSampleCount() const {
+  return count;
+}
+
+Time InterpolationBuffer::getNewestTime() const {
+  if ( count == 0 )
+    return Time();
+  return times[ slot( count - 1 ) ];
+}
+
+void InterpolationBuffer::setDelay( const Time& delay ) {
+  this->delay = delay;
+}
+
+Time InterpolationBuffer::getDelay() const {
+  return delay;
+}
+
+void InterpolationBuffer::setMaxExtrapolation( const Time& limit ) {
+  maxExtrapolation = limit;
+}
+
+Time InterpolationBuffer::getMaxExtrapolation() const {
+  return maxExtrapolation;
+}
+
+void InterpolationBuffer::setClockOffset( const Time& offset ) {
+  clockOffset = offset;
+}
+
+void InterpolationBuffer::useClockOffset( const PingInformation& info ) {
+  if ( info.pingTime == Time() )
+    return;
+
+  if ( (int)pings.size() == PING_HISTORY )
+    pings.erase( pings.begin() );
+  pings.push_back( info );
+
+  const PingInformation* best = &pings[0];
+  for ( size_t i = 1; i < pings.size(); ++i )
+    if ( pings[i].pingTime < best->pingTime )
+      best = &pings[i];
+  clockOffset = best->clockOffset;
+}
+
+Time InterpolationBuffer::getClockOffset() const {
+  return clockOffset;
+}
+
+bool InterpolationBuffer::add( const Time& serverTime, const float* state ) {
+  //Find where the state goes, which is almost always at the end.
+  int pos = count;
+  while ( pos > 0 && serverTime < times[ slot( pos - 1 ) ] )
+    --pos;
+
+  if ( pos > 0 && times[ slot( pos - 1 ) ] == serverTime ) {
+    std::copy( state, state + valueCount,
+               values.begin() + slot( pos - 1 ) * valueCount );
+    return true;
+  }
+
+  if ( count == capacity ) {
+    if ( pos == 0 )
+      return false;
+    //Drop the oldest.
+    start = slot( 1 );
+    --count;
+    --pos;
+  }
+
+  //Move the newer states up one to make room.
+  for ( int i = count; i > pos; --i ) {
+    int to = slot( i ), from = slot( i - 1 );
+    times[to] = times[from];
+    std::copy( values.begin() + from * valueCount,
+               values.begin() + ( from + 1 ) * valueCount,
+               values.begin() + to * valueCount );
+  }
+  ++count;
+
+  int s = slot( pos );
+  times[s] = serverTime;
+  std::copy( state, state + valueCount, values.begin() + s * valueCount );
+  return true;
+}
+
+bool InterpolationBuffer::sample( const Time& localTime,
+                                  float* state ) const {
+  return sampleAt( localTime + clockOffset - delay, state );
+}
+
+bool InterpolationBuffer::sampleAt( const Time& serverTime,
+                                    float* state ) const {
+  if ( count == 0 )
+    return false;
+
+  int first = slot( 0 );
+  if ( count == 1 || serverTime <= times[first] ) {
+    blend( first, first, 0.0, state );
+    return true;
+  }
+
+  int last = slot( count - 1 );
+  if ( serverTime > times[last] ) {
+    //Extrapolate from the last two states.
+    int prev = slot( count - 2 );
+    Time past = serverTime - times[last];
+    if ( past > maxExtrapolation )
+      past = maxExtrapolation;
+    double span = ( times[last] - times[prev] ).getTotaluSec();
+    blend( prev, last, 1.0 + past.getTotaluSec() / span, state );
+    return true;
+  }
+
+  //Find the states around the time, searching from the newest.
+  int i = count - 1;
+  while ( serverTime < times[ slot( i - 1 ) ] )
+    --i;
+  int a = slot( i - 1 ), b = slot( i );
+  double span = ( times[b] - times[a] ).getTotaluSec();
+  blend( a, b, ( serverTime - times[a] ).getTotaluSec() / span, state );
+  return true;
+}
+
+void InterpolationBuffer::clear() {
+  start = 0;
+  count = 0;
+}
+
+int InterpolationBuffer::slot( int i ) const {
+  return ( start + i ) % capacity;
+}
+
+void InterpolationBuffer::blend( int a, int b, double t, float* state ) const {
+  const float* va = &values[a * valueCount];
+  const float* vb = &values[b * valueCount];
+  for ( int i = 0; i < valueCount; ++i )
+    state[i] = (float)( va[i] + ( vb[i] - va[i] ) * t );
+}
+
+} //namespace GNE
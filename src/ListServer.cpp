@@ -0,0 +1,401 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ListServer.h>
+#include <gnelib/ConnectionEventGenerator.h>
+#include <gnelib/Timer.h>
+#include <gnelib/Lock.h>
+#include <algorithm>
+
+namespace GNE {
+
+const guint32 ListServer::MAGIC = 0x474E454C; //"GNEL"
+const int ListServer::PAGE_LEN = 1024;
+const int ListServer::MAX_PAGES = 256;
+const int ListServer::MAX_NAME_LEN = 63;
+const int ListServer::MAX_INFO_LEN = 255;
+
+//The magic, type, query id, page, page count, and server count.
+static const int ANSWER_HEADER_LEN = 21;
+//The most filters of a game whose pages are kept, so that clients asking
+//for many mods that do not exist cannot use up the memory.
+static const int MAX_FILTERS = 64;
+
+ListServer::ListServer()
+: serverCount( 0 ), serverTimeout( 60000 ), refreshInterval( 1000 ),
+  socket( NL_INVALID ) {
+  gnedbgo(5, "created");
+}
+
+ListServer::sptr ListServer::create() {
+  sptr ret( new ListServer() );
+  ret->setThisPointer( ret );
+  return ret;
+}
+
+ListServer::~ListServer() {
+  close();
+  gnedbgo(5, "destroyed");
+}
+
+void ListServer::setThisPointer( const sptr& thisPointer ) {
+  this_ = thisPointer;
+}
+
+bool ListServer::open(int port) {
+  LockMutex lock( sockSync );
+
+  if ( socket != NL_INVALID )
+    return false;
+
+  socket = nlOpen( (NLushort)port, NL_UNRELIABLE );
+  if ( socket == NL_INVALID )
+    return true;
+
+  gnedbgo1(3, "Registering list server socket %i", socket);
+  assert( !this_.expired() );
+  eGen->reg( socket, ReceiveEventListener::sptr( new Listener( this_.lock() ) ) );
+  return false;
+}
+
+void ListServer::close() {
+  LockMutex lock( sockSync );
+  rawClose();
+}
+
+void ListServer::rawClose() {
+  if ( socket != NL_INVALID ) {
+    gnedbgo1(3, "Unregistering list server socket %i", socket);
+    if ( eGen )
+      eGen->unreg( socket );
+    nlClose( socket );
+    socket = NL_INVALID;
+  }
+}
+
+bool ListServer::isOpen() const {
+  LockMutex lock( sockSync );
+  return socket != NL_INVALID;
+}
+
+Address ListServer::getLocalAddress() const {
+  LockMutex lock( sockSync );
+
+  if ( socket != NL_INVALID ) {
+    NLaddress ret;
+    nlGetLocalAddr( socket, &ret );
+    return Address( ret );
+  } else {
+    return Address();
+  }
+}
+
+int ListServer::getServerTimeout() const {
+  LockMutex lock( sync );
+  return serverTimeout;
+}
+
+void ListServer::setServerTimeout(int ms) {
+  assert( ms > 0 );
+  LockMutex lock( sync );
+  serverTimeout = ms;
+}
+
+int ListServer::getRefreshInterval() const {
+  LockMutex lock( sync );
+  return refreshInterval;
+}
+
+void ListServer::setRefreshInterval(int ms) {
+  assert( ms >= 0 );
+  LockMutex lock( sync );
+  refreshInterval = ms;
+}
+
+int ListServer::getServerCount() const {
+  LockMutex lock( sync );
+  return serverCount;
+}
+
+int ListServer::getServerCount(const std::string& game) const {
+  LockMutex lock( sync );
+  Games::const_iterator iter = games.find( game );
+  return ( iter != games.end() ) ? (int)iter->second.servers.size() : 0;
+}
+
+void ListServer::process(const gbyte* data, int length, const Address& from) {
+  if ( length < (int)( sizeof( guint32 ) + sizeof( gbyte ) ) || length > PAGE_LEN )
+    return;
+
+  Buffer in( length );
+  in.writeRaw( data, length );
+  in.flip();
+  handle( in, from );
+}
+
+void ListServer::handle(Buffer& in, const Address& from) {
+  in.setReadExceptions( false );
+
+  guint32 magic;
+  gbyte type;
+  in >> magic >> type;
+  if ( magic != MAGIC )
+    return;
+
+  switch ( type ) {
+  case Heartbeat:
+    onHeartbeat( in, from );
+    break;
+  case Remove:
+    onRemove( in, from );
+    break;
+  case Query:
+    onQuery( in, from );
+    break;
+  default:
+    gnedbgo2(4, "Ignoring message %d from %s", (int)type,
+             from.toString().c_str());
+    break;
+  }
+}
+
+/**
+ * Returns the address of the game server that sent a datagram from the given
+ * address with the given port, or an invalid address if the port is not
+ * valid.  A port of 0 means the port the datagram came from.
+ */
+static Address getServerAddress( const Address& from, gint32 port ) {
+  if ( port < 0 || port > 65535 )
+    return Address();
+  Address ret = from;
+  if ( port != 0 )
+    ret.setPort( (int)port );
+  return ret;
+}
+
+void ListServer::onHeartbeat(Buffer& in, const Address& from) {
+  gint32 port, players, maxPlayers;
+  std::string game, mod, name, info;
+  in >> port >> game >> mod >> name >> players >> maxPlayers >> info;
+  Address addr = getServerAddress( from, port );
+  if ( in.getReadError() != Error::NoError || game.empty() || !addr ||
+       players < 0 || maxPlayers < 0 ) {
+    gnedbgo1(3, "Ignoring bad heartbeat from %s", from.toString().c_str());
+    return;
+  }
+  game = game.substr( 0, MAX_NAME_LEN );
+  mod = mod.substr( 0, MAX_NAME_LEN );
+  name = name.substr( 0, MAX_NAME_LEN );
+  info = info.substr( 0, MAX_INFO_LEN );
+
+  //The entry is written here, without the lock, and only replaces the one
+  //kept if it is different.
+  std::string key = addr.toString();
+  Buffer entry( PAGE_LEN );
+  entry << key << mod << name << players << maxPlayers << info;
+
+  LockMutex lock( sync );
+  Time now = Timer::getCurrentTime();
+  dropOldServers( now );
+
+  Game& g = games[game];
+  std::pair<Servers::iterator, bool> added =
+    g.servers.insert( std::make_pair( key, Server() ) );
+  Server& s = added.first->second;
+  s.lastHeard = now;
+  if ( added.second )
+    ++serverCount;
+
+  const gbyte* data = entry.getData();
+  int len = entry.getPosition();
+  if ( added.second || (int)s.entry.size() != len ||
+       !std::equal( data, data + len, s.entry.begin() ) ) {
+    s.mod = mod;
+    s.players = players;
+    s.maxPlayers = maxPlayers;
+    s.entry.assign( data, data + len );
+    ++g.version;
+  }
+}
+
+void ListServer::onRemove(Buffer& in, const Address& from) {
+  gint32 port;
+  in >> port;
+  Address addr = getServerAddress( from, port );
+  if ( in.getReadError() != Error::NoError || !addr )
+    return;
+  std::string key = addr.toString();
+
+  LockMutex lock( sync );
+  for ( Games::iterator iter = games.begin(); iter != games.end(); ++iter ) {
+    if ( iter->second.servers.erase( key ) > 0 ) {
+      --serverCount;
+      ++iter->second.version;
+      if ( iter->second.servers.empty() )
+        games.erase( iter );
+      return;
+    }
+  }
+}
+
+void ListServer::onQuery(Buffer& in, const Address& from) {
+  //Unpadded queries are refused so the answer is never larger.
+  if ( in.getLimit() < PAGE_LEN )
+    return;
+
+  guint32 id;
+  std::string game, mod;
+  gbyte flags;
+  gint32 page;
+  in >> id >> game >> mod >> flags >> page;
+  if ( in.getReadError() != Error::NoError || page < 0 )
+    return;
+  flags &= ( NotFull | NotEmpty );
+
+  Buffer out( PAGE_LEN );
+  out << MAGIC << (gbyte)QueryAnswer << id << page;
+  {
+    LockMutex lock( sync );
+    Time now = Timer::getCurrentTime();
+    dropOldServers( now );
+
+    Games::iterator gi = games.find( game );
+    if ( gi == games.end() ) {
+      out << (gint32)0 << (gint32)0;
+    } else {
+      Game& g = gi->second;
+      if ( (int)g.pages.size() >= MAX_FILTERS &&
+           g.pages.find( std::make_pair( mod, (int)flags ) ) == g.pages.end() )
+        g.pages.clear();
+      Pages& p = g.pages[ std::make_pair( mod, (int)flags ) ];
+
+      //Pages out of date are used until the refresh interval passes.
+      if ( p.version != g.version &&
+           ( p.version == 0 ||
+             ( now - p.made ).getTotalmSec() >= refreshInterval ) )
+        makePages( g, mod, flags, p );
+
+      out << (gint32)p.pages.size();
+      if ( page < (int)p.pages.size() && !p.pages[page].empty() ) {
+        out << (gint32)p.counts[page];
+        out.writeRaw( &p.pages[page][0], (int)p.pages[page].size() );
+      } else {
+        out << (gint32)0;
+      }
+    }
+  }
+
+  send( from, out );
+}
+
+void ListServer::makePages(const Game& game, const std::string& mod,
+                           int flags, Pages& pages) {
+  pages.pages.clear();
+  pages.counts.clear();
+
+  const size_t room = PAGE_LEN - ANSWER_HEADER_LEN;
+  for ( Servers::const_iterator iter = game.servers.begin();
+        iter != game.servers.end(); ++iter ) {
+    const Server& s = iter->second;
+    if ( ( !mod.empty() && s.mod != mod ) ||
+         ( ( flags & NotFull ) && s.players >= s.maxPlayers ) ||
+         ( ( flags & NotEmpty ) && s.players == 0 ) )
+      continue;
+
+    if ( pages.pages.empty() ||
+         pages.pages.back().size() + s.entry.size() > room ) {
+      if ( (int)pages.pages.size() == MAX_PAGES )
+        break;
+      pages.pages.push_back( std::vector<gbyte>() );
+      pages.pages.back().reserve( room );
+      pages.counts.push_back( 0 );
+    }
+    pages.pages.back().insert( pages.pages.back().end(),
+                               s.entry.begin(), s.entry.end() );
+    ++pages.counts.back();
+  }
+
+  pages.version = game.version;
+  pages.made = Timer::getCurrentTime();
+}
+
+void ListServer::dropOldServers(const Time& now) {
+  if ( ( now - lastDrop ).getTotalmSec() < 1000 )
+    return;
+  lastDrop = now;
+
+  Games::iterator gi = games.begin();
+  while ( gi != games.end() ) {
+    Game& g = gi->second;
+    Servers::iterator si = g.servers.begin();
+    while ( si != g.servers.end() ) {
+      if ( ( now - si->second.lastHeard ).getTotalmSec() > serverTimeout ) {
+        gnedbgo1(4, "Dropping server %s", si->first.c_str());
+        g.servers.erase( si++ );
+        --serverCount;
+        ++g.version;
+      } else {
+        ++si;
+      }
+    }
+
+    if ( g.servers.empty() )
+      games.erase( gi++ );
+    else
+      ++gi;
+  }
+}
+
+void ListServer::send(const Address& dest, const Buffer& data) {
+  LockMutex lock( sockSync );
+  if ( socket == NL_INVALID )
+    return;
+
+  NLaddress temp = dest.getAddress();
+  nlSetRemoteAddr( socket, &temp );
+  if ( nlWrite( socket, (const NLvoid*)data.getData(),
+                (NLint)data.getPosition() ) == NL_INVALID ) {
+    gnedbgo1(3, "Write on list server socket failed: %s",
+             LowLevelError().toString().c_str());
+  }
+}
+
+void ListServer::onReceive() {
+  Buffer buf( PAGE_LEN );
+  NLaddress from;
+  int read;
+  {
+    LockMutex lock( sockSync );
+    if ( socket == NL_INVALID )
+      return;
+    read = nlRead( socket, (NLvoid*)buf.getData(), (NLint)buf.getCapacity() );
+    if ( read != NL_INVALID )
+      nlGetRemoteAddr( socket, &from );
+  }
+
+  if ( read == NL_INVALID || read < (int)( sizeof( guint32 ) + sizeof( gbyte ) ) ) {
+    gnedbgo1(4, "Ignoring bad read of %d on list server socket", read);
+    return;
+  }
+  buf.setLimit( read );
+  handle( buf, Address( from ) );
+}
+
+} //namespace GNE
@@ -19,24 +19,251 @@
 
 #include "gneintern.h"
 #include <gnelib/ListServerConnection.h>
+#include <gnelib/ListServer.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Timer.h>
+#include <gnelib/Lock.h>
 
 namespace GNE {
 
-ListServerConnection::ListServerConnection(std::string address) {
+//The times each page is asked for before the timeout.
+static const int QUERY_TRIES = 3;
+
+ListServerConnection::ListServerConnection(const Address& listServer)
+: listServer( listServer ), socket( NL_INVALID ), group( NL_INVALID ) {
+  Time t = Timer::getAbsoluteTime();
+  nextQueryId = (guint32)t.getSec() * 1000003u ^ (guint32)t.getuSec();
+  gnedbgo(5, "created");
+}
+
+ListServerConnection::sptr
+ListServerConnection::create(const Address& listServer) {
+  return sptr( new ListServerConnection( listServer ) );
 }
 
 ListServerConnection::~ListServerConnection() {
+  close();
+  gnedbgo(5, "destroyed");
 }
 
-void ListServerConnection::setGame(std::string gameName) {
+bool ListServerConnection::open() {
+  LockMutex lock( sync );
+
+  if ( socket != NL_INVALID )
+    return false;
+
+  socket = nlOpen( 0, NL_UNRELIABLE );
+  if ( socket == NL_INVALID )
+    return true;
+
+  group = nlGroupCreate();
+  if ( group == NL_INVALID ) {
+    nlClose( socket );
+    socket = NL_INVALID;
+    return true;
+  }
+  nlGroupAddSocket( group, socket );
+
+  NLaddress temp = listServer.getAddress();
+  nlSetRemoteAddr( socket, &temp );
+  return false;
 }
 
-void ListServerConnection::getGameList() {
+void ListServerConnection::close() {
+  LockMutex lock( sync );
+
+  if ( group != NL_INVALID ) {
+    nlGroupDestroy( group );
+    group = NL_INVALID;
+  }
+  if ( socket != NL_INVALID ) {
+    nlClose( socket );
+    socket = NL_INVALID;
+  }
 }
 
+void ListServerConnection::setGame(const std::string& gameName) {
+  LockMutex lock( sync );
+  game = gameName;
 }
 
+std::string ListServerConnection::getGame() const {
+  LockMutex lock( sync );
+  return game;
+}
 
+/**
+ * Writes the data in buf to the socket, returning true on error.
+ */
+static bool writeDatagram( NLsocket socket, const Buffer& buf ) {
+  return socket == NL_INVALID ||
+    nlWrite( socket, (const NLvoid*)buf.getData(), (NLint)buf.getPosition() )
+      != buf.getPosition();
+}
+
+bool ListServerConnection::sendHeartbeat(const GameListData& server, int port) {
+  assert( port >= 0 && port <= 65535 );
+  LockMutex lock( sync );
+
+  Buffer out( ListServer::PAGE_LEN );
+  out << ListServer::MAGIC << (gbyte)ListServer::Heartbeat << (gint32)port
+      << game << server.modName.substr( 0, ListServer::MAX_NAME_LEN )
+      << server.serverName.substr( 0, ListServer::MAX_NAME_LEN )
+      << (gint32)server.numPlayers << (gint32)server.maxPlayers
+      << server.info.substr( 0, ListServer::MAX_INFO_LEN );
+  return writeDatagram( socket, out );
+}
+
+bool ListServerConnection::sendRemove(int port) {
+  assert( port >= 0 && port <= 65535 );
+  LockMutex lock( sync );
 
+  Buffer out( 16 );
+  out << ListServer::MAGIC << (gbyte)ListServer::Remove << (gint32)port;
+  return writeDatagram( socket, out );
+}
 
+bool ListServerConnection::sendQuery(guint32 id, const std::string& mod,
+                                     int flags, int page) {
+  Buffer out( ListServer::PAGE_LEN );
+  out << ListServer::MAGIC << (gbyte)ListServer::Query << id << game << mod
+      << (gbyte)flags << (gint32)page;
+  //The server only answers queries as large as the answer.
+  while ( out.getPosition() < ListServer::PAGE_LEN )
+    out << (gbyte)0;
+  return writeDatagram( socket, out );
+}
 
+bool ListServerConnection::getGameList(std::vector<GameListData>& list,
+                                       const std::string& mod, int flags,
+                                       int timeout) {
+  assert( timeout > 0 );
+  LockMutex qlock( querySync );
+
+  guint32 id;
+  std::string gameName;
+  NLint pollGroup;
+  {
+    LockMutex lock( sync );
+    if ( socket == NL_INVALID )
+      return true;
+    id = nextQueryId++;
+    gameName = game;
+    pollGroup = group;
+  }
+
+  Time now = Timer::getCurrentTime();
+  Time deadline = now + timeout * 1000;
+  int tryTime = timeout / QUERY_TRIES;
+  if ( tryTime < 1 )
+    tryTime = 1;
+  Time nextSend = now;
+
+  //The page count is not known until the first answer arrives.
+  int pageCount = -1;
+  int gotCount = 0;
+  std::vector<bool> got;
+  std::vector< std::vector<GameListData> > pages;
+  Buffer in( ListServer::PAGE_LEN );
+
+  while ( pageCount != gotCount && now < deadline ) {
+    if ( now >= nextSend ) {
+      LockMutex lock( sync );
+      if ( pageCount < 0 ) {
+        sendQuery( id, mod, flags, 0 );
+      } else {
+        for ( int i = 0; i < pageCount; ++i )
+          if ( !got[i] )
+            sendQuery( id, mod, flags, i );
+      }
+      nextSend = now + tryTime * 1000;
+    }
+
+    Time wakeUp = ( nextSend < deadline ) ? nextSend : deadline;
+    int wait = ( wakeUp - now ).getTotalmSec() + 1;
+    NLsocket ready;
+    int check;
+    {
+      LockMutex lock( sync );
+      if ( socket == NL_INVALID || group != pollGroup )
+        return true;
+    }
+    check = nlPollGroup( pollGroup, NL_READ_STATUS, &ready, 1, wait );
+    now = Timer::getCurrentTime();
+    if ( check != 1 )
+      continue;
+
+    int read;
+    {
+      LockMutex lock( sync );
+      if ( socket == NL_INVALID )
+        return true;
+      in.clear();
+      read = nlRead( socket, (NLvoid*)in.getData(), (NLint)in.getCapacity() );
+
+      //A datagram from anywhere else changes where HawkNL sends to.
+      NLaddress from;
+      nlGetRemoteAddr( socket, &from );
+      if ( !( Address( from ) == listServer ) ) {
+        NLaddress temp = listServer.getAddress();
+        nlSetRemoteAddr( socket, &temp );
+        continue;
+      }
+    }
+    if ( read == NL_INVALID || read <= 0 )
+      continue;
+
+    in.setLimit( read );
+    in.setReadExceptions( false );
+    guint32 magic, answerId;
+    gbyte type;
+    gint32 page, count, servers;
+    in >> magic >> type >> answerId >> page >> count >> servers;
+    if ( in.getReadError() != Error::NoError || magic != ListServer::MAGIC ||
+         type != ListServer::QueryAnswer || answerId != id || page < 0 ||
+         count < 0 || count > ListServer::MAX_PAGES )
+      continue;
+
+    if ( pageCount < 0 ) {
+      pageCount = count;
+      got.resize( pageCount, false );
+      pages.resize( pageCount );
+      //Ask for the rest of the pages now.
+      if ( pageCount > 1 ) {
+        LockMutex lock( sync );
+        for ( int i = 1; i < pageCount; ++i )
+          sendQuery( id, mod, flags, i );
+        nextSend = now + tryTime * 1000;
+      }
+    }
+    if ( page >= pageCount || got[page] )
+      continue;
+
+    std::vector<GameListData> entries;
+    for ( int i = 0; i < servers; ++i ) {
+      GameListData d;
+      d.gameName = gameName;
+      gint32 players, maxPlayers;
+      in >> d.address >> d.modName >> d.serverName >> players >> maxPlayers
+         >> d.info;
+      if ( in.getReadError() != Error::NoError )
+        break;
+      d.numPlayers = players;
+      d.maxPlayers = maxPlayers;
+      entries.push_back( d );
+    }
+    if ( in.getReadError() != Error::NoError )
+      continue;
+
+    pages[page].swap( entries );
+    got[page] = true;
+    ++gotCount;
+  }
+
+  for ( size_t i = 0; i < pages.size(); ++i )
+    list.insert( list.end(), pages[i].begin(), pages[i].end() );
+
+  return pageCount != gotCount;
+}
+
+}
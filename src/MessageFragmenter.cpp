@@ -0,0 +1,242 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/MessageFragmenter.h>
+#include <gnelib/MessagePacket.h>
+#include <gnelib/PacketParser.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+const int MessageFragmenter::MIN_FRAGMENT_LEN = 64;
+const int MessageFragmenter::DEFAULT_MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+
+MessageFragmenter::MessageFragmenter()
+: nextId(0), inId(0), maxMessageSize(DEFAULT_MAX_MESSAGE_SIZE) {
+}
+
+MessageFragmenter::~MessageFragmenter() {
+}
+
+int MessageFragmenter::write(const Buffer& data) {
+  OutMessage msg;
+  msg.data.reset( new Buffer( data.getPosition() ) );
+  msg.data->writeRaw( data.getData(), data.getPosition() );
+  msg.total = data.getPosition();
+  msg.sent = 0;
+  msg.readFailed = false;
+
+  LockMutex lock( sync );
+  msg.id = nextId++;
+  out.push_back( msg );
+  return msg.id;
+}
+
+int MessageFragmenter::writeFile(const std::string& fileName, long offset,
+                                 long length) {
+  FILE* f = fopen( fileName.c_str(), "rb" );
+  if ( f == NULL ) {
+    gnedbgo1(1, "Could not open %s to send.", fileName.c_str());
+    return -1;
+  }
+
+  OutMessage msg;
+  msg.file.reset( f, fclose );
+  if ( fseek( f, 0, SEEK_END ) != 0 )
+    return -1;
+  long size = ftell( f );
+  if ( length < 0 )
+    length = size - offset;
+  //The length of a message must fit in a MessagePacket.
+  if ( offset < 0 || length < 0 || length > size - offset ||
+       length > 0x7fffffffL || fseek( f, offset, SEEK_SET ) != 0 ) {
+    gnedbgo1(1, "Invalid range of %s to send.", fileName.c_str());
+    return -1;
+  }
+  msg.total = (int)length;
+  msg.sent = 0;
+  msg.readFailed = false;
+
+  LockMutex lock( sync );
+  msg.id = nextId++;
+  out.push_back( msg );
+  return msg.id;
+}
+
+int MessageFragmenter::getCount() const {
+  LockMutex lock( sync );
+  return (int)out.size();
+}
+
+void MessageFragmenter::prefetch() {
+  //Find which files need reading to fill a whole frame.
+  std::vector<FileRead> reads;
+  {
+    LockMutex lock( sync );
+    int needed = Buffer::RAW_PACKET_LEN;
+    for ( std::deque<OutMessage>::iterator iter = out.begin();
+          iter != out.end() && needed > 0; ++iter ) {
+      int remain = iter->total - iter->sent;
+      int want = (remain < needed) ? remain : needed;
+      int have = (int)iter->ahead.size();
+      if ( iter->file && !iter->readFailed && have < want ) {
+        FileRead r;
+        r.id = iter->id;
+        r.file = iter->file;
+        r.len = want - have;
+        reads.push_back( r );
+      }
+      needed -= want;
+    }
+  }
+
+  //The reads are done without the lock so a slow disk doesn't hold it.
+  for ( std::vector<FileRead>::iterator r = reads.begin(); r != reads.end();
+        ++r ) {
+    std::vector<gbyte> chunk( r->len );
+    bool ok = (int)fread( &chunk[0], 1, r->len, r->file.get() ) == r->len;
+
+    LockMutex lock( sync );
+    for ( std::deque<OutMessage>::iterator iter = out.begin();
+          iter != out.end(); ++iter ) {
+      if ( iter->id == r->id && iter->file == r->file ) {
+        if ( ok )
+          iter->ahead.insert( iter->ahead.end(), chunk.begin(), chunk.end() );
+        else
+          iter->readFailed = true;
+        break;
+      }
+    }
+  }
+}
+
+int MessageFragmenter::fill(Buffer& raw, std::vector<Progress>& progress) {
+  LockMutex lock( sync );
+
+  int start = raw.getPosition();
+  while ( !out.empty() ) {
+    OutMessage& msg = out.front();
+    int total = msg.total;
+    int remain = total - msg.sent;
+
+    //Packets must end before the last byte of the frame, see prepareSend.
+    int room = Buffer::RAW_PACKET_LEN - (int)sizeof(PacketParser::END_OF_PACKET)
+      - raw.getPosition() - MessagePacket::HEADER_LEN - 1;
+    if ( room < 0 )
+      break;
+    int len = (remain < room) ? remain : room;
+    if ( msg.file ) {
+      if ( msg.readFailed ) {
+        gnedbgo1(1, "Could not read file for message %d.", (int)msg.id);
+        out.pop_front();
+        return -1;
+      }
+      //Only what prefetch has read can be sent.
+      if ( len > (int)msg.ahead.size() )
+        len = (int)msg.ahead.size();
+    }
+    if ( len < remain && len < MIN_FRAGMENT_LEN )
+      break;
+
+    if ( msg.file ) {
+      MessagePacket::writeHeader( raw, msg.id, (guint32)total,
+                                  (guint32)msg.sent, len );
+      if ( len > 0 ) {
+        raw.writeRaw( &msg.ahead[0], len );
+        msg.ahead.erase( msg.ahead.begin(), msg.ahead.begin() + len );
+      }
+
+    } else {
+      MessagePacket fragment( msg.id, (guint32)total, (guint32)msg.sent,
+                              msg.data, msg.sent, len );
+      fragment.writePacket( raw );
+    }
+    msg.sent += len;
+
+    Progress p;
+    p.messageId = msg.id;
+    p.done = msg.sent;
+    p.total = total;
+    progress.push_back( p );
+
+    if ( msg.sent == total )
+      out.pop_front();
+  }
+  return raw.getPosition() - start;
+}
+
+void MessageFragmenter::setMaxMessageSize(int bytes) {
+  assert( bytes >= 0 );
+
+  LockMutex lock( sync );
+  if ( bytes >= 0 )
+    maxMessageSize = bytes;
+}
+
+int MessageFragmenter::getMaxMessageSize() const {
+  LockMutex lock( sync );
+  return maxMessageSize;
+}
+
+MessageFragmenter::Result
+MessageFragmenter::receive(const MessagePacket& fragment, Progress& progress,
+                           MessagePacket*& message) {
+  LockMutex lock( sync );
+  message = NULL;
+
+  if ( !inData ) {
+    //The fragment must start a new message.
+    if ( fragment.offset != 0 ||
+         fragment.totalLen > (guint32)maxMessageSize ) {
+      gnedbgo2(1, "Refused message of %u bytes starting at %u.",
+               fragment.totalLen, fragment.offset);
+      return Invalid;
+    }
+    inData.reset( new Buffer( (int)fragment.totalLen ) );
+    inId = fragment.messageId;
+
+  } else if ( fragment.messageId != inId ||
+              fragment.offset != (guint32)inData->getPosition() ||
+              fragment.totalLen != (guint32)inData->getCapacity() ) {
+    gnedbgo2(1, "Message fragment at %u does not continue message %d.",
+             fragment.offset, (int)inId);
+    return Invalid;
+  }
+
+  if ( fragment.length > inData->getRemaining() )
+    return Invalid;
+  inData->writeRaw( fragment.data->getData() + fragment.start,
+                    fragment.length );
+
+  progress.messageId = inId;
+  progress.done = inData->getPosition();
+  progress.total = inData->getCapacity();
+  if ( progress.done < progress.total )
+    return Partial;
+
+  inData->flip();
+  message = new MessagePacket( inId, (guint32)progress.total, 0, inData, 0,
+                               progress.total );
+  inData.reset();
+  return Complete;
+}
+
+} //namespace GNE
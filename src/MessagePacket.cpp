@@ -0,0 +1,99 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/MessagePacket.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Error.h>
+
+namespace GNE {
+
+const int MessagePacket::ID = 12;
+
+//The packet ID, message ID, total length, offset and fragment length.
+const int MessagePacket::HEADER_LEN = 13;
+
+MessagePacket::MessagePacket()
+: Packet(ID), messageId(0), totalLen(0), offset(0), data(new Buffer(0)),
+start(0), length(0) {
+}
+
+MessagePacket::MessagePacket( const MessagePacket& o )
+: Packet(ID), messageId(o.messageId), totalLen(o.totalLen), offset(o.offset),
+data(o.data), start(o.start), length(o.length) {
+}
+
+MessagePacket::MessagePacket( guint16 messageId, guint32 totalLen,
+                              guint32 offset, const SmartPtr<Buffer>& data,
+                              int start, int length )
+: Packet(ID), messageId(messageId), totalLen(totalLen), offset(offset),
+data(data), start(start), length(length) {
+  assert( start >= 0 && start + length <= data->getCapacity() );
+}
+
+MessagePacket::~MessagePacket() {
+}
+
+int MessagePacket::getMessageId() const {
+  return messageId;
+}
+
+int MessagePacket::getLength() const {
+  return (int)totalLen;
+}
+
+Buffer& MessagePacket::getBuffer() {
+  return *data;
+}
+
+int MessagePacket::getSize() const {
+  return HEADER_LEN + length;
+}
+
+void MessagePacket::writePacket( Buffer& raw ) const {
+  writeHeader( raw, messageId, totalLen, offset, length );
+  raw.writeRaw( data->getData() + start, length );
+}
+
+void MessagePacket::writeHeader( Buffer& raw, guint16 messageId,
+                                 guint32 totalLen, guint32 offset,
+                                 int length ) {
+  raw << (guint8)ID << messageId << totalLen << offset << (guint16)length;
+}
+
+void MessagePacket::readPacket( Buffer& raw ) {
+  Packet::readPacket( raw );
+  guint16 len;
+  raw >> messageId >> totalLen >> offset >> len;
+  if ( (int)len > raw.getRemaining() ) {
+    raw.failRead( Error::BufferUnderflow );
+    return;
+  }
+
+  data.reset( new Buffer( len ) );
+  raw.readRaw( data->getData(), len );
+  start = 0;
+  length = len;
+}
+
+Packet* MessagePacket::create() {
+  return new MessagePacket;
+}
+
+} //namespace GNE
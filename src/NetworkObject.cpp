@@ -25,20 +25,27 @@
 #include <gnelib/ObjectCreationPacket.h>
 #include <gnelib/ObjectUpdatePacket.h>
 #include <gnelib/ObjectDeathPacket.h>
+#include <gnelib/ObjectBrokerPacket.h>
+#include <gnelib/PacketParser.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Error.h>
 
 namespace GNE {
   
-NetworkObject::NetworkObject() : objectId(-1) {
+NetworkObject::NetworkObject()
+: objectId(-1), server(NULL), dirty(false), serial(0), deltaSeq(0) {
 }
 
 NetworkObject::~NetworkObject() {
 }
 
-NetworkObject::NetworkObject( int objectId ) : objectId(objectId) {
+NetworkObject::NetworkObject( int objectId )
+: objectId(objectId), server(NULL), dirty(false), serial(0), deltaSeq(0) {
 }
 
 NetworkObject::NetworkObject( const NetworkObject& o )
-: objectId( -1 ) {
+: objectId( -1 ), server( NULL ), dirty( false ), serial( 0 ),
+  deltaSeq( 0 ) {
 }
 
 NetworkObject& NetworkObject::operator= ( const NetworkObject& rhs ) {
@@ -50,10 +57,55 @@ int NetworkObject::getObjectId() const {
 }
 
 bool NetworkObject::hasValidId() const {
-  assert( objectId <= 65535 );
+  assert( objectId <= ObjectBrokerPacket::getMaxObjectId() );
   return ( objectId >= 0 );
 }
   
+void NetworkObject::markDirty() {
+  if ( server != NULL )
+    server->markDirty( *this );
+}
+
+bool NetworkObject::isDirty() const {
+  return dirty;
+}
+
+void NetworkObject::writeUpdate( Buffer& raw, const void* param ) {
+  Packet* packet = createUpdatePacket( param );
+  assert( packet != NULL );
+  raw << *packet;
+  delete packet;
+}
+
+void NetworkObject::readUpdate( Buffer& raw ) {
+  guint8 type;
+  raw >> type;
+  //The type comes from the network, so it may not be registered.
+  Packet* packet = PacketParser::tryCreatePacket( type );
+  if ( packet == NULL )
+    throw Error( Error::UnknownPacket );
+  try {
+    packet->readPacket( raw );
+    incomingUpdatePacket( *packet );
+  } catch ( ... ) {
+    PacketParser::destroyPacket( packet );
+    throw;
+  }
+  PacketParser::destroyPacket( packet );
+}
+
+int NetworkObject::getFieldCount() const {
+  return 1;
+}
+
+void NetworkObject::writeField( Buffer& raw, int field ) {
+  writeUpdate( raw, NULL );
+}
+
+void NetworkObject::readField( Buffer& raw, int field ) {
+  readUpdate( raw );
+}
+
 void NetworkObject::onDeregistration( int oldId ) {
 }
 
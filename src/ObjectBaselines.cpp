@@ -0,0 +1,195 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ObjectBaselines.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <gnelib/UpdateScheduler.h>
+#include <gnelib/Errors.h>
+#include <cstring>
+
+namespace GNE {
+
+static const int MAX_HISTORY = 1024;
+
+ObjectBaselines::ObjectBaselines( int maxHistory )
+: maxHistory( maxHistory ), nextSequence( 0 ) {
+  assert( maxHistory > 0 && maxHistory <= MAX_HISTORY );
+}
+
+ObjectBaselines::~ObjectBaselines() {
+}
+
+int ObjectBaselines::getMaxHistory() const {
+  return maxHistory;
+}
+
+int ObjectBaselines::getBaselineCount() const {
+  return (int)baselines.size();
+}
+
+int ObjectBaselines::getPendingCount() const {
+  return (int)history.size();
+}
+
+void ObjectBaselines::reset() {
+  baselines.clear();
+  history.clear();
+}
+
+int ObjectBaselines::State::getStart( int field ) const {
+  return ( field == 0 ) ? 0 : ends[field - 1];
+}
+
+bool ObjectBaselines::State::sameField( const State& o, int field ) const {
+  int start = getStart( field );
+  int len = ends[field] - start;
+  int oStart = o.getStart( field );
+  return len == o.ends[field] - oStart &&
+    ( len == 0 || memcmp( &data[start], &o.data[oStart], len ) == 0 );
+}
+
+guint32 ObjectBaselines::getChangedFields( int id, int serial,
+                                           const State& state ) const {
+  int fields = (int)state.ends.size();
+  guint32 all = ( fields >= 32 ) ? 0xffffffff : ( ( 1u << fields ) - 1 );
+
+  std::map<int, Baseline>::const_iterator iter = baselines.find( id );
+  if ( iter == baselines.end() )
+    return all;
+  const Baseline& b = iter->second;
+  if ( b.serial != serial || b.state->ends.size() != state.ends.size() )
+    return all;
+
+  guint32 ret = b.sentSince;
+  for ( int i = 0; i < fields; ++i )
+    if ( !state.sameField( *b.state, i ) )
+      ret |= ( 1u << i );
+  return ret;
+}
+
+ObjectBaselines::Output::Output( UpdateScheduler* scheduler, int budget )
+: packet( NULL ), used( 0 ), scheduler( scheduler ), budget( budget ) {
+}
+
+void ObjectBaselines::writeDelta( Output& out, int id, int serial,
+                                  const State& state,
+                                  const StatePtr& shared ) {
+  guint32 mask = getChangedFields( id, serial, state );
+  if ( mask == 0 ) {
+    if ( out.scheduler != NULL )
+      out.scheduler->sent( id );
+    return;
+  }
+
+  int fieldCount = (int)state.ends.size();
+  Buffer& fields = out.fields;
+  fields.clear();
+  for ( int f = 0; f < fieldCount; ++f ) {
+    int start = state.getStart( f );
+    if ( ( mask & ( 1u << f ) ) && state.ends[f] > start )
+      fields.writeRaw( &state.data[start], state.ends[f] - start );
+  }
+
+  //Objects that do not fit in the budget are skipped, but smaller ones
+  //after them might still fit.
+  bool fits = ( out.packet != NULL &&
+                out.packet->canAdd( id, fieldCount, fields.getPosition() ) );
+  int cost = ObjectDeltaPacket::getEntrySize( id, fieldCount,
+                                              fields.getPosition() );
+  if ( !fits )
+    cost += ObjectDeltaPacket::getEmptySize();
+  if ( out.budget >= 0 && out.used + cost > out.budget )
+    return;
+  out.used += cost;
+
+  if ( !fits ) {
+    out.packet = new ObjectDeltaPacket();
+    out.packets.push_back( ObjectDeltaPacket::sptr( out.packet ) );
+    out.packet->sequence = startPacket();
+  }
+  if ( !out.packet->add( id, mask, fieldCount, fields ) )
+    throw BufferError( Error::BufferOverflow );
+  addSent( id, serial, mask, shared ? shared : StatePtr( new State( state ) ) );
+  if ( out.scheduler != NULL )
+    out.scheduler->sent( id );
+}
+
+guint16 ObjectBaselines::startPacket() {
+  //A packet that falls out of the history is treated as lost.  Any fields
+  //it sent are still in the sentSince of the baselines it came after.
+  while ( (int)history.size() >= maxHistory )
+    history.pop_front();
+
+  history.push_back( SentPacket() );
+  history.back().sequence = nextSequence;
+  return (guint16)nextSequence++;
+}
+
+void ObjectBaselines::addSent( int id, int serial, guint32 mask,
+                               const StatePtr& state ) {
+  assert( !history.empty() );
+  SentObject sent;
+  sent.id = id;
+  sent.serial = serial;
+  sent.mask = mask;
+  sent.state = state;
+  history.back().objects.push_back( sent );
+
+  std::map<int, Baseline>::iterator iter = baselines.find( id );
+  if ( iter != baselines.end() && iter->second.serial == serial )
+    iter->second.sentSince |= mask;
+}
+
+void ObjectBaselines::acknowledge( guint16 sequence ) {
+  std::deque<SentPacket>::iterator packet = history.begin();
+  //The history is much shorter than the range of 16 bit sequences, so the
+  //low bits find the one packet.
+  while ( packet != history.end() && (guint16)packet->sequence != sequence )
+    ++packet;
+  if ( packet == history.end() )
+    return;
+
+  //The client may have any of the packets sent after this one, so the
+  //fields in them are sent again until a newer baseline is acknowledged.
+  std::map<int, guint32> sentLater;
+  std::deque<SentPacket>::const_iterator later = packet;
+  for ( ++later; later != history.end(); ++later )
+    for ( size_t i = 0; i < later->objects.size(); ++i )
+      sentLater[later->objects[i].id] |= later->objects[i].mask;
+
+  for ( size_t i = 0; i < packet->objects.size(); ++i ) {
+    const SentObject& sent = packet->objects[i];
+    std::map<int, Baseline>::iterator iter = baselines.find( sent.id );
+    if ( iter != baselines.end() && iter->second.serial == sent.serial &&
+         iter->second.sequence >= packet->sequence )
+      continue;
+
+    Baseline& b = baselines[sent.id];
+    b.serial = sent.serial;
+    b.sequence = packet->sequence;
+    b.state = sent.state;
+    std::map<int, guint32>::const_iterator mask = sentLater.find( sent.id );
+    b.sentSince = ( mask == sentLater.end() ) ? 0 : mask->second;
+  }
+
+  history.erase( packet );
+}
+
+} //namespace GNE
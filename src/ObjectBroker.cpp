@@ -20,10 +20,15 @@
 #include "gneintern.h"
 #include <gnelib/ObjectBroker.h>
 #include <gnelib/NetworkObject.h>
+#include <gnelib/ObjectBrokerPacket.h>
 #include <gnelib/Lock.h>
 
 namespace GNE {
 
+ObjectBroker::ObjectBroker()
+: objects( ObjectBrokerPacket::getWideObjectIds() ) {
+}
+
 int ObjectBroker::numObjects() const {
   LockMutex lock(sync);
   return objects.size();
@@ -31,11 +36,7 @@ int ObjectBroker::numObjects() const {
 
 NetworkObject* ObjectBroker::getObjectById( int objId ) {
   LockMutex lock(sync);
-  ObjectsIter iter = objects.find( objId );
-  if ( iter == objects.end() )
-    return NULL;
-  else
-    return (*iter).second;
+  return objects.find( objId );
 }
 
 void ObjectBroker::deregisterObject( NetworkObject& obj ) {
@@ -44,15 +45,19 @@ void ObjectBroker::deregisterObject( NetworkObject& obj ) {
   sync.acquire();
   int oldId = obj.getObjectId();
   assert( exists( oldId ) );
-  objects.erase( oldId );
+  objects.remove( oldId );
   assignId( obj, -1 );
+  obj.server = NULL;
+  obj.dirty = false;
+  obj.deltaSeq = 0;
+  obj.creationCache.clear();
   sync.release();
 
   obj.onDeregistration( oldId );
 }
 
 bool ObjectBroker::exists( int objId ) {
-  return (objects.find( objId ) != objects.end());
+  return (objects.find( objId ) != NULL);
 }
 
 void ObjectBroker::assignId( NetworkObject& o, int newId ) {
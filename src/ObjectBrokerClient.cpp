@@ -22,11 +22,18 @@
 #include <gnelib/ObjectCreationPacket.h>
 #include <gnelib/ObjectUpdatePacket.h>
 #include <gnelib/ObjectDeathPacket.h>
+#include <gnelib/ObjectUpdateBatchPacket.h>
+#include <gnelib/ObjectDeltaPacket.h>
 #include <gnelib/ObjectBrokerClient.h>
 #include <gnelib/NetworkObject.h>
 #include <gnelib/Mutex.h>
 #include <gnelib/Error.h>
 #include <gnelib/Lock.h>
+#include <gnelib/PacketParser.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Timer.h>
+#include <gnelib/Time.h>
+#include <set>
 
 namespace GNE {
 
@@ -38,7 +45,7 @@ void ObjectBrokerClient::staticInit() {
     funcs[i] = NULL;
 }
 
-ObjectBrokerClient::ObjectBrokerClient() {
+ObjectBrokerClient::ObjectBrokerClient() : lastDeltaSeq( 0 ) {
 }
 
 ObjectBrokerClient::~ObjectBrokerClient() {
@@ -50,12 +57,240 @@ void ObjectBrokerClient::registerObject( guint8 id, ObjCreationFunc createFunc )
   funcs[id] = createFunc;
 }
 
-/**
- * \todo optimize container usage (exists, find, erase, etc).  Applies to
- * other ObjectBroker (base, client, and server) methods.
- */
 NetworkObject* ObjectBrokerClient::usePacket( const Packet& packet,
                                               bool ignoreUpdateError) {
+  LockMutex lock(sync);
+  return useLocked( packet, ignoreUpdateError );
+}
+
+int ObjectBrokerClient::usePackets( const std::vector<Packet*>& packets,
+                                    bool ignoreUpdateError, bool latestOnly,
+                                    Time* elapsed ) {
+  Time start = Timer::getCurrentTime();
+
+  //Going backwards, an update is superseded if a later one for the same
+  //object was seen before any creation or death of it.
+  std::vector<bool> skip( packets.size(), false );
+  if ( latestOnly ) {
+    std::set<int> updated;
+    for ( size_t i = packets.size(); i-- > 0; ) {
+      int type = packets[i]->getType();
+      if ( type == ObjectUpdatePacket::ID ) {
+        int objectId =
+          static_cast<const ObjectBrokerPacket*>( packets[i] )->getObjectId();
+        skip[i] = !updated.insert( objectId ).second;
+      } else if ( type == ObjectCreationPacket::ID ||
+                  type == ObjectDeathPacket::ID ) {
+        updated.erase(
+          static_cast<const ObjectBrokerPacket*>( packets[i] )->getObjectId() );
+      }
+    }
+  }
+
+  int ret = 0;
+  {
+    //Both mutexes are recursive, so the calls below lock them cheaply.
+    LockMutex lock(sync);
+    LockMutex staticLock(staticSync);
+    for ( size_t i = 0; i < packets.size(); ++i ) {
+      if ( skip[i] )
+        continue;
+      const Packet& packet = *packets[i];
+      int type = packet.getType();
+      if ( type == ObjectUpdateBatchPacket::ID ) {
+        useUpdateBatch( static_cast<const ObjectUpdateBatchPacket&>( packet ),
+                        ignoreUpdateError );
+        ++ret;
+      } else if ( type == ObjectDeltaPacket::ID ) {
+        useDeltaPacket( static_cast<const ObjectDeltaPacket&>( packet ),
+                        ignoreUpdateError );
+        ++ret;
+      } else if ( useLocked( packet, ignoreUpdateError ) != NULL ) {
+        ++ret;
+      }
+    }
+  }
+
+  if ( elapsed != NULL )
+    *elapsed = Timer::getCurrentTime() - start;
+  return ret;
+}
+
+int ObjectBrokerClient::useUpdateBatch( const ObjectUpdateBatchPacket& packet,
+                                        bool ignoreUpdateError ) {
+  Buffer data( packet.data );
+  data.flip();
+  int ret = 0;
+
+  LockMutex lock(sync);
+  for ( int i = 0; i < packet.getCount(); ++i ) {
+    int objectId = (int)ObjectBrokerPacket::readObjectId( data );
+    guint16 len;
+    data >> len;
+    int end = data.getPosition() + len;
+    if ( end > data.getLimit() )
+      throw Error( Error::InvalidObjectPacket );
+
+    NetworkObject* obj = objects.find( objectId );
+    if ( obj != NULL ) {
+      //Limit the object to its own update.
+      int limit = data.getLimit();
+      data.setLimit( end );
+      obj->readUpdate( data );
+      data.setLimit( limit );
+      ++ret;
+    } else if ( !ignoreUpdateError )
+      throw Error( Error::UnknownObjectId );
+
+    data.setPosition( end );
+  }
+
+  return ret;
+}
+
+int ObjectBrokerClient::useSnapshot( Buffer& data ) {
+  guint32 count;
+  data >> count;
+
+  LockMutex lock(sync);
+  for ( guint32 i = 0; i < count; ++i ) {
+    int objectId = (int)ObjectBrokerPacket::readObjectId( data );
+    guint16 len;
+    data >> len;
+    int end = data.getPosition() + len;
+    if ( end > data.getLimit() )
+      throw Error( Error::InvalidObjectPacket );
+
+    guint8 type;
+    data >> type;
+    staticSync.acquire();
+    ObjCreationFunc func = funcs[type];
+    staticSync.release();
+    if ( func == NULL )
+      throw Error( Error::InvalidCreationPacketType );
+    if ( !objects.isValid( objectId ) )
+      throw Error( Error::InvalidObjectPacket );
+    if ( exists( objectId ) )
+      throw Error( Error::DuplicateObjectId );
+
+    Packet* packet = PacketParser::createPacket( type );
+    if ( packet == NULL )
+      throw Error( Error::UnknownPacket );
+    int limit = data.getLimit();
+    data.setLimit( end );
+    NetworkObject* obj;
+    try {
+      packet->readPacket( data );
+      obj = func( objectId, *packet );
+    } catch ( ... ) {
+      PacketParser::destroyPacket( packet );
+      throw;
+    }
+    PacketParser::destroyPacket( packet );
+    data.setLimit( limit );
+
+    assert( obj != NULL );
+    assert( obj->getObjectId() == objectId );
+    objects.add( objectId, obj );
+
+    data.setPosition( end );
+  }
+
+  return (int)count;
+}
+
+int ObjectBrokerClient::useDeltaPacket( const ObjectDeltaPacket& packet,
+                                        bool ignoreUpdateError ) {
+  if ( !packet.getAcks().empty() )
+    throw Error( Error::InvalidObjectPacket );
+
+  Buffer data( packet.data );
+  data.flip();
+  int ret = 0;
+  bool complete = true;
+
+  LockMutex lock(sync);
+  //The sequence is unwrapped against the newest one received, so that an
+  //object that has not changed for half the range of 16 bit sequences
+  //still takes its next change.  The first starts above 0, which means none.
+  guint32 seq;
+  if ( lastDeltaSeq == 0 )
+    seq = 0x10000 + packet.getSequence();
+  else
+    seq = lastDeltaSeq +
+      (gint16)(guint16)( packet.getSequence() - (guint16)lastDeltaSeq );
+  if ( seq > lastDeltaSeq )
+    lastDeltaSeq = seq;
+
+  for ( int i = 0; i < packet.getCount(); ++i ) {
+    int objectId = (int)ObjectBrokerPacket::readObjectId( data );
+    guint16 len;
+    data >> len;
+    int end = data.getPosition() + len;
+    if ( end > data.getLimit() )
+      throw Error( Error::InvalidObjectPacket );
+
+    NetworkObject* obj = objects.find( objectId );
+    if ( obj == NULL ) {
+      if ( !ignoreUpdateError )
+        throw Error( Error::UnknownObjectId );
+      complete = false;
+
+    } else if ( seq > obj->deltaSeq ) {
+      int limit = data.getLimit();
+      data.setLimit( end );
+
+      int fieldCount = obj->getFieldCount();
+      guint32 mask = 0;
+      for ( int b = 0; b < ( fieldCount + 7 ) / 8; ++b ) {
+        guint8 maskByte;
+        data >> maskByte;
+        mask |= (guint32)maskByte << ( b * 8 );
+      }
+      if ( fieldCount < 32 && ( mask >> fieldCount ) != 0 )
+        throw Error( Error::InvalidObjectPacket );
+
+      for ( int f = 0; f < fieldCount; ++f )
+        if ( mask & ( 1u << f ) )
+          obj->readField( data, f );
+      obj->deltaSeq = seq;
+
+      data.setLimit( limit );
+      ++ret;
+    }
+
+    data.setPosition( end );
+  }
+
+  if ( complete ) {
+    deltaAcks.push_back( packet.getSequence() );
+    if ( (int)deltaAcks.size() > ObjectDeltaPacket::MAX_ACKS )
+      deltaAcks.erase( deltaAcks.begin() );
+  }
+
+  return ret;
+}
+
+ObjectDeltaPacket::sptr ObjectBrokerClient::getDeltaAck() {
+  LockMutex lock(sync);
+  if ( deltaAcks.empty() )
+    return ObjectDeltaPacket::sptr();
+
+  ObjectDeltaPacket* ret = new ObjectDeltaPacket();
+  for ( size_t i = 0; i < deltaAcks.size(); ++i )
+    ret->addAck( deltaAcks[i] );
+  deltaAcks.clear();
+  return ObjectDeltaPacket::sptr( ret );
+}
+
+NetworkObject& ObjectBrokerClient::usePacket( const Packet& packet ) {
+  NetworkObject* ret = usePacket( packet, false );
+  assert ( ret != NULL );
+  return *ret;
+}
+
+NetworkObject* ObjectBrokerClient::useLocked( const Packet& packet,
+                                              bool ignoreUpdateError ) {
   int type = packet.getType();
   int objectId = -1;
   NetworkObject* ret = NULL;
@@ -71,32 +306,32 @@ NetworkObject* ObjectBrokerClient::usePacket( const Packet& packet,
     if ( func == NULL )
       throw Error( Error::InvalidCreationPacketType );
 
-    LockMutex lock(sync);
+    if ( !objects.isValid( objectId ) )
+      throw Error( Error::InvalidObjectPacket );
     if ( exists( objectId ) )
       throw Error( Error::DuplicateObjectId );
     ret = func( objectId, *ocp.getData() );
     assert ( ret != NULL );
     assert ( ret->getObjectId() == objectId );
 
-    objects[objectId] = ret;
+    objects.add( objectId, ret );
 
   } else if ( type == ObjectUpdatePacket::ID ) {
     const ObjectUpdatePacket& oup = static_cast<const ObjectUpdatePacket&>(packet);
     objectId = oup.getObjectId();
     assert( oup.getData() != NULL );
 
-    LockMutex lock(sync);
-    ret = getObjectById( objectId );
-    if ( ret == NULL )
+    ret = objects.find( objectId );
+    if ( ret != NULL )
+      ret->incomingUpdatePacket( *oup.getData() );
+    else if ( !ignoreUpdateError )
       throw Error( Error::UnknownObjectId );
-    ret->incomingUpdatePacket( *oup.getData() );
 
   } else if ( type == ObjectDeathPacket::ID ) {
     const ObjectDeathPacket& odp = static_cast<const ObjectDeathPacket&>(packet);
     objectId = odp.getObjectId();
 
-    LockMutex lock(sync);
-    ret = getObjectById( objectId );
+    ret = objects.find( objectId );
     if ( ret == NULL )
       throw Error( Error::UnknownObjectId );
     ret->incomingDeathPacket( odp.getData() );
@@ -110,10 +345,4 @@ NetworkObject* ObjectBrokerClient::usePacket( const Packet& packet,
   return ret;
 }
 
-NetworkObject& ObjectBrokerClient::usePacket( const Packet& packet ) {
-  NetworkObject* ret = usePacket( packet, false );
-  assert ( ret != NULL );
-  return *ret;
-}
-
 } //namespace GNE
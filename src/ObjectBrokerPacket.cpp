@@ -20,9 +20,12 @@
 #include "gneintern.h"
 #include <gnelib/ObjectBrokerPacket.h>
 #include <gnelib/Buffer.h>
+#include <gnelib/ObjectIdTable.h>
 
 namespace GNE {
-  
+
+static bool wideIds = false;
+
 ObjectBrokerPacket::ObjectBrokerPacket( int id )
 : WrapperPacket( id ), objectId( 65535 ) {
 }
@@ -43,22 +46,78 @@ int ObjectBrokerPacket::getObjectId() const {
 }
 
 void ObjectBrokerPacket::setObjectId( int newId ) {
-  assert( newId >= 0 && newId <= 65535 );
-  objectId = (guint16)newId;
+  assert( newId >= 0 && newId <= getMaxObjectId() );
+  objectId = (guint32)newId;
+}
+
+void ObjectBrokerPacket::setWideObjectIds( bool wide ) {
+  wideIds = wide;
+}
+
+bool ObjectBrokerPacket::getWideObjectIds() {
+  return wideIds;
+}
+
+int ObjectBrokerPacket::getMaxObjectId() {
+  return ObjectIdTable::getMaxId( wideIds );
+}
+
+void ObjectBrokerPacket::writeObjectId( Buffer& raw, guint32 id ) {
+  if ( wideIds ) {
+    //A variable length integer, 7 bits per byte, low bits first.
+    while ( id >= 0x80 ) {
+      raw << (guint8)( ( id & 0x7f ) | 0x80 );
+      id >>= 7;
+    }
+    raw << (guint8)id;
+  } else
+    raw << (guint16)id;
+}
+
+guint32 ObjectBrokerPacket::readObjectId( Buffer& raw ) {
+  if ( wideIds ) {
+    guint32 ret = 0;
+    guint8 b = 0x80;
+    for ( int shift = 0; ( b & 0x80 ) != 0; shift += 7 ) {
+      if ( shift > 28 ) {
+        raw.failRead( Error::BufferUnderflow );
+        return 0;
+      }
+      raw >> b;
+      ret |= (guint32)( b & 0x7f ) << shift;
+    }
+    return ret;
+  } else {
+    guint16 temp;
+    raw >> temp;
+    return temp;
+  }
+}
+
+int ObjectBrokerPacket::getObjectIdSize( guint32 id ) {
+  if ( !wideIds )
+    return Buffer::getSizeOf( guint16(0) );
+
+  int ret = 1;
+  while ( id >= 0x80 ) {
+    id >>= 7;
+    ++ret;
+  }
+  return ret;
 }
 
 int ObjectBrokerPacket::getSize() const {
-  return WrapperPacket::getSize() + Buffer::getSizeOf( objectId );
+  return WrapperPacket::getSize() + getObjectIdSize( objectId );
 }
 
 void ObjectBrokerPacket::writePacket(Buffer& raw) const {
   WrapperPacket::writePacket( raw );
-  raw << objectId;
+  writeObjectId( raw, objectId );
 }
 
 void ObjectBrokerPacket::readPacket(Buffer& raw) {
   WrapperPacket::readPacket( raw );
-  raw >> objectId;
+  objectId = readObjectId( raw );
 }
 
 } //namespace GNE
@@ -23,14 +23,17 @@
 #include <gnelib/ObjectUpdatePacket.h>
 #include <gnelib/ObjectDeathPacket.h>
 #include <gnelib/ObjectBrokerServer.h>
+#include <gnelib/ObjectBaselines.h>
+#include <gnelib/UpdateScheduler.h>
 #include <gnelib/NetworkObject.h>
 #include <gnelib/Mutex.h>
 #include <gnelib/Lock.h>
+#include <gnelib/Buffer.h>
+#include <gnelib/Errors.h>
 
 namespace GNE {
 
-ObjectBrokerServer::ObjectBrokerServer()
-: nextId( 1 ) {
+ObjectBrokerServer::ObjectBrokerServer() : lastSerial( 0 ) {
 }
 
 ObjectBrokerServer::~ObjectBrokerServer() {
@@ -90,24 +93,244 @@ ObjectBrokerServer::getDeathPacket( NetworkObject& obj ) {
     return ObjectDeathPacket::sptr( (ObjectDeathPacket*)NULL );
 }
 
-/**
- * \todo This method could use some optimization really badly, by using an
- * iterator over the map.
- */
-bool ObjectBrokerServer::assignNextId( NetworkObject& o ) {
-  if ( numObjects() >= 65535 )
-    return false;
+void ObjectBrokerServer::markDirty( NetworkObject& obj ) {
+  LockMutex lock(sync);
+
+  if ( obj.server != this )
+    return;
+  obj.creationCache.clear();
+  if ( !obj.dirty ) {
+    obj.dirty = true;
+    dirtyIds.push_back( obj.getObjectId() );
+  }
+}
+
+SmartPtr<Buffer> ObjectBrokerServer::getSnapshot() {
+  LockMutex lock(sync);
+
+  std::vector<NetworkObject*> objs;
+  objects.getObjects( objs );
+  return writeSnapshot( objs );
+}
+
+SmartPtr<Buffer>
+ObjectBrokerServer::getSnapshot( const std::set<int>& objectIds ) {
+  LockMutex lock(sync);
+
+  std::vector<NetworkObject*> objs;
+  objs.reserve( objectIds.size() );
+  for ( std::set<int>::const_iterator iter = objectIds.begin();
+        iter != objectIds.end(); ++iter ) {
+    NetworkObject* obj = objects.find( *iter );
+    if ( obj != NULL )
+      objs.push_back( obj );
+  }
+  return writeSnapshot( objs );
+}
+
+SmartPtr<Buffer>
+ObjectBrokerServer::writeSnapshot( const std::vector<NetworkObject*>& objs ) {
+  //Fill in the missing creation data first, so the size is known.
+  Buffer raw;
+  int size = Buffer::getSizeOf( guint32(0) );
+  for ( size_t i = 0; i < objs.size(); ++i ) {
+    NetworkObject& obj = *objs[i];
+    if ( obj.creationCache.empty() ) {
+      Packet* packet = obj.createCreationPacket();
+      assert( packet != NULL );
+      raw.clear();
+      raw << *packet;
+      delete packet;
+      obj.creationCache.assign( raw.getData(),
+                                raw.getData() + raw.getPosition() );
+    }
+    size += ObjectBrokerPacket::getObjectIdSize( obj.getObjectId() ) +
+      Buffer::getSizeOf( guint16(0) ) + (int)obj.creationCache.size();
+  }
 
-  //Find the next valid ID
-  while ( exists( nextId ) ) {
-    ++nextId;
-    if ( nextId >= 65536 )
-      nextId = 1;
+  SmartPtr<Buffer> ret( new Buffer( size ) );
+  *ret << (guint32)objs.size();
+  for ( size_t i = 0; i < objs.size(); ++i ) {
+    const std::vector<gbyte>& blob = objs[i]->creationCache;
+    ObjectBrokerPacket::writeObjectId( *ret, objs[i]->getObjectId() );
+    *ret << (guint16)blob.size();
+    ret->writeRaw( &blob[0], (int)blob.size() );
   }
+  return ret;
+}
+
+int ObjectBrokerServer::getDirtyCount() const {
+  LockMutex lock(sync);
+  return (int)dirtyIds.size();
+}
+
+std::vector<ObjectUpdateBatchPacket::sptr>
+ObjectBrokerServer::flushUpdates( const void* param ) {
+  LockMutex lock(sync);
+
+  std::vector<ObjectUpdateBatchPacket::sptr> ret;
+  ObjectUpdateBatchPacket* batch = NULL;
+  Buffer update;
+  size_t i = 0;
+  try {
+    for ( ; i < dirtyIds.size(); ++i ) {
+      NetworkObject* obj = objects.find( dirtyIds[i] );
+      if ( obj == NULL || !obj->dirty )
+        continue;
+      obj->dirty = false;
+
+      update.clear();
+      obj->writeUpdate( update, param );
+      if ( batch == NULL || !batch->add( dirtyIds[i], update ) ) {
+        batch = new ObjectUpdateBatchPacket();
+        ret.push_back( ObjectUpdateBatchPacket::sptr( batch ) );
+        if ( !batch->add( dirtyIds[i], update ) )
+          throw BufferError( Error::BufferOverflow );
+      }
+    }
+  } catch ( ... ) {
+    //Keep the failed object and those after it marked for the next flush.
+    if ( i < dirtyIds.size() ) {
+      NetworkObject* obj = objects.find( dirtyIds[i] );
+      if ( obj != NULL )
+        obj->dirty = true;
+    }
+    dirtyIds.erase( dirtyIds.begin(), dirtyIds.begin() + i );
+    throw;
+  }
+  dirtyIds.clear();
+
+  return ret;
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectBrokerServer::getDeltaPackets( ObjectBaselines& baselines ) {
+  LockMutex lock(sync);
+
+  forgetBaselines( baselines, NULL );
+  std::vector<NetworkObject*> objs;
+  objects.getObjects( objs );
+  return writeDeltas( baselines, objs, NULL, -1 );
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectBrokerServer::getDeltaPackets( ObjectBaselines& baselines,
+                                     const std::set<int>& objectIds ) {
+  LockMutex lock(sync);
+
+  forgetBaselines( baselines, &objectIds );
+  std::vector<NetworkObject*> objs;
+  objs.reserve( objectIds.size() );
+  for ( std::set<int>::const_iterator iter = objectIds.begin();
+        iter != objectIds.end(); ++iter ) {
+    NetworkObject* obj = objects.find( *iter );
+    if ( obj != NULL )
+      objs.push_back( obj );
+  }
+  return writeDeltas( baselines, objs, NULL, -1 );
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectBrokerServer::getDeltaPackets( ObjectBaselines& baselines,
+                                     const std::set<int>& objectIds,
+                                     UpdateScheduler& scheduler,
+                                     int budget ) {
+  LockMutex lock(sync);
+
+  forgetBaselines( baselines, &objectIds );
+  scheduler.accumulate( objectIds );
+  std::vector<int> order;
+  scheduler.getOrder( order );
+
+  std::vector<NetworkObject*> objs;
+  objs.reserve( order.size() );
+  for ( size_t i = 0; i < order.size(); ++i ) {
+    NetworkObject* obj = objects.find( order[i] );
+    if ( obj != NULL )
+      objs.push_back( obj );
+  }
+  return writeDeltas( baselines, objs, &scheduler, budget );
+}
+
+void ObjectBrokerServer::forgetBaselines( ObjectBaselines& baselines,
+                                          const std::set<int>* keep ) {
+  std::map<int, ObjectBaselines::Baseline>::iterator iter =
+    baselines.baselines.begin();
+  while ( iter != baselines.baselines.end() ) {
+    NetworkObject* obj = objects.find( iter->first );
+    if ( obj == NULL || obj->serial != iter->second.serial ||
+         ( keep != NULL && keep->find( iter->first ) == keep->end() ) )
+      baselines.baselines.erase( iter++ );
+    else
+      ++iter;
+  }
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectBrokerServer::writeDeltas( ObjectBaselines& baselines,
+                                 const std::vector<NetworkObject*>& objs,
+                                 UpdateScheduler* scheduler, int budget ) {
+  ObjectBaselines::Output out( scheduler, budget );
+  ObjectBaselines::State state;
+  Buffer raw;
+  for ( size_t i = 0; i < objs.size(); ++i ) {
+    writeState( *objs[i], raw, state );
+    baselines.writeDelta( out, objs[i]->getObjectId(), objs[i]->serial, state,
+                          ObjectBaselines::StatePtr() );
+  }
+  return out.packets;
+}
+
+void ObjectBrokerServer::writeState( NetworkObject& obj, Buffer& raw,
+                                     ObjectBaselines::State& state ) {
+  int fieldCount = obj.getFieldCount();
+  assert( fieldCount > 0 && fieldCount <= ObjectDeltaPacket::MAX_FIELDS );
+
+  raw.clear();
+  state.ends.clear();
+  for ( int f = 0; f < fieldCount; ++f ) {
+    obj.writeField( raw, f );
+    state.ends.push_back( raw.getPosition() );
+  }
+  state.data.assign( raw.getData(), raw.getData() + raw.getPosition() );
+}
+
+ObjectStates::sptr ObjectBrokerServer::captureStates() {
+  LockMutex lock(sync);
+
+  std::vector<NetworkObject*> objs;
+  objects.getObjects( objs );
+
+  ObjectStates::sptr ret( new ObjectStates() );
+  ret->entries.resize( objs.size() );
+  Buffer raw;
+  for ( size_t i = 0; i < objs.size(); ++i ) {
+    ObjectStates::Entry& e = ret->entries[i];
+    e.id = objs[i]->getObjectId();
+    e.serial = objs[i]->serial;
+    e.state = ObjectBaselines::StatePtr( new ObjectBaselines::State() );
+    writeState( *objs[i], raw, *e.state );
+  }
+  return ret;
+}
+
+void ObjectBrokerServer::useDeltaAck( ObjectBaselines& baselines,
+                                      const ObjectDeltaPacket& packet ) {
+  LockMutex lock(sync);
+
+  const std::vector<guint16>& acks = packet.getAcks();
+  for ( size_t i = 0; i < acks.size(); ++i )
+    baselines.acknowledge( acks[i] );
+}
+
+bool ObjectBrokerServer::assignNextId( NetworkObject& o ) {
+  int id = objects.allocate( &o );
+  if ( id < 0 )
+    return false;
 
-  //Mark it used and return it
-  objects[ nextId ] = &o;
-  assignId( o, nextId );
+  assignId( o, id );
+  o.server = this;
+  o.serial = ++lastSerial;
   return true;
 }
   
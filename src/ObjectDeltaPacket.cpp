@@ -0,0 +1,155 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ObjectDeltaPacket.h>
+#include <gnelib/ObjectBrokerPacket.h>
+#include <gnelib/PacketParser.h>
+
+namespace GNE {
+
+const int ObjectDeltaPacket::ID = 14;
+
+const int ObjectDeltaPacket::MAX_FIELDS = 32;
+
+const int ObjectDeltaPacket::MAX_ACKS = 64;
+
+//The packet ID, sequence, ack count, update count, and length.
+static const int HEADER_LEN = 8;
+
+ObjectDeltaPacket::ObjectDeltaPacket()
+: Packet( ID ), sequence( 0 ), count( 0 ), data( getMaxDataSize() ) {
+}
+
+ObjectDeltaPacket::ObjectDeltaPacket( const ObjectDeltaPacket& o )
+: Packet( ID ), sequence( o.sequence ), count( o.count ), acks( o.acks ),
+  data( o.data ) {
+}
+
+ObjectDeltaPacket::~ObjectDeltaPacket() {
+}
+
+int ObjectDeltaPacket::getMaxDataSize() {
+  //PacketStream only adds a packet to a frame if it ends before the last
+  //byte, which is the end of packet marker.
+  return Buffer::RAW_PACKET_LEN - HEADER_LEN -
+    (int)sizeof(PacketParser::END_OF_PACKET) - 1;
+}
+
+int ObjectDeltaPacket::getEmptySize() {
+  return HEADER_LEN;
+}
+
+int ObjectDeltaPacket::getEntrySize( int objectId, int fieldCount,
+                                     int fieldsLength ) {
+  return ObjectBrokerPacket::getObjectIdSize( (guint32)objectId ) +
+    Buffer::getSizeOf( guint16(0) ) + ( fieldCount + 7 ) / 8 + fieldsLength;
+}
+
+bool ObjectDeltaPacket::canAdd( int objectId, int fieldCount,
+                                int fieldsLength ) const {
+  return count < 65535 &&
+    getEntrySize( objectId, fieldCount, fieldsLength ) <= data.getRemaining();
+}
+
+bool ObjectDeltaPacket::isNewer( guint16 a, guint16 b ) {
+  return (gint16)( a - b ) > 0;
+}
+
+guint16 ObjectDeltaPacket::getSequence() const {
+  return sequence;
+}
+
+int ObjectDeltaPacket::getCount() const {
+  return count;
+}
+
+const std::vector<guint16>& ObjectDeltaPacket::getAcks() const {
+  return acks;
+}
+
+bool ObjectDeltaPacket::add( int objectId, guint32 mask, int fieldCount,
+                             const Buffer& fields ) {
+  assert( fieldCount > 0 && fieldCount <= MAX_FIELDS );
+  if ( !canAdd( objectId, fieldCount, fields.getPosition() ) )
+    return false;
+  int maskLen = ( fieldCount + 7 ) / 8;
+  int len = maskLen + fields.getPosition();
+
+  ObjectBrokerPacket::writeObjectId( data, (guint32)objectId );
+  data << (guint16)len;
+  for ( int i = 0; i < maskLen; ++i )
+    data << (guint8)( mask >> ( i * 8 ) );
+  data.writeRaw( fields.getData(), fields.getPosition() );
+  ++count;
+  return true;
+}
+
+bool ObjectDeltaPacket::addAck( guint16 seq ) {
+  if ( (int)acks.size() >= MAX_ACKS )
+    return false;
+  acks.push_back( seq );
+  return true;
+}
+
+int ObjectDeltaPacket::getSize() const {
+  return HEADER_LEN + (int)acks.size() * Buffer::getSizeOf( guint16(0) ) +
+    data.getPosition();
+}
+
+void ObjectDeltaPacket::writePacket( Buffer& raw ) const {
+  Packet::writePacket( raw );
+  raw << sequence << (guint8)acks.size();
+  for ( size_t i = 0; i < acks.size(); ++i )
+    raw << acks[i];
+  raw << count << (guint16)data.getPosition();
+  raw.writeRaw( data.getData(), data.getPosition() );
+}
+
+void ObjectDeltaPacket::readPacket( Buffer& raw ) {
+  Packet::readPacket( raw );
+  guint8 ackCount;
+  raw >> sequence >> ackCount;
+  acks.clear();
+  data.clear();
+  count = 0;
+  if ( (int)ackCount > MAX_ACKS ) {
+    raw.failRead( Error::BufferUnderflow );
+    return;
+  }
+  acks.resize( ackCount );
+  for ( int i = 0; i < (int)ackCount; ++i )
+    raw >> acks[i];
+
+  guint16 len;
+  raw >> count >> len;
+  if ( (int)len > data.getCapacity() || (int)len > raw.getRemaining() ) {
+    raw.failRead( Error::BufferUnderflow );
+    count = 0;
+    return;
+  }
+  raw.readRaw( data.getData(), len );
+  data.setPosition( len );
+}
+
+Packet* ObjectDeltaPacket::create() {
+  return new ObjectDeltaPacket;
+}
+
+} //namespace GNE
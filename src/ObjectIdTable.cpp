@@ -0,0 +1,122 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ObjectIdTable.h>
+
+namespace GNE {
+
+const int ObjectIdTable::GEN_BITS = 7;
+
+static const int GEN_MASK = ( 1 << ObjectIdTable::GEN_BITS ) - 1;
+
+//Slot 0 is not used, so both kinds of IDs start from 1.
+static const int MAX_SLOT = 65535;
+static const int MAX_WIDE_SLOT = ( 1 << 24 ) - 1;
+
+ObjectIdTable::ObjectIdTable( bool wide )
+: wide( wide ), allocating( false ), count( 0 ), slots( 1 ) {
+}
+
+ObjectIdTable::~ObjectIdTable() {
+}
+
+int ObjectIdTable::getMaxId( bool wide ) {
+  return wide ? ( ( MAX_WIDE_SLOT << GEN_BITS ) | GEN_MASK ) : MAX_SLOT;
+}
+
+bool ObjectIdTable::isValid( int id ) const {
+  return id > 0 && id <= getMaxId( wide ) && getSlot( id ) != 0;
+}
+
+int ObjectIdTable::size() const {
+  return count;
+}
+
+int ObjectIdTable::getSlot( int id ) const {
+  return wide ? ( id >> GEN_BITS ) : id;
+}
+
+NetworkObject* ObjectIdTable::find( int id ) const {
+  int slot = getSlot( id );
+  if ( id < 0 || slot >= (int)slots.size() || slots[slot].id != id )
+    return NULL;
+  return slots[slot].obj;
+}
+
+void ObjectIdTable::getObjects( std::vector<NetworkObject*>& out ) const {
+  out.reserve( out.size() + count );
+  for ( size_t i = 1; i < slots.size(); ++i )
+    if ( slots[i].id != -1 )
+      out.push_back( slots[i].obj );
+}
+
+bool ObjectIdTable::add( int id, NetworkObject* obj ) {
+  if ( !isValid( id ) )
+    return false;
+  int slot = getSlot( id );
+
+  if ( slot >= (int)slots.size() )
+    slots.resize( slot + 1 );
+  Slot& s = slots[slot];
+  if ( s.id != -1 )
+    return false;
+
+  s.obj = obj;
+  s.id = id;
+  ++count;
+  return true;
+}
+
+int ObjectIdTable::allocate( NetworkObject* obj ) {
+  allocating = true;
+  int maxSlot = wide ? MAX_WIDE_SLOT : MAX_SLOT;
+  int slot;
+  bool fresh = ( (int)slots.size() <= maxSlot );
+  if ( !freeSlots.empty() && ( wide || !fresh ) ) {
+    slot = freeSlots.front();
+    freeSlots.pop_front();
+  } else if ( fresh ) {
+    slot = (int)slots.size();
+    slots.push_back( Slot() );
+  } else
+    return -1;
+
+  Slot& s = slots[slot];
+  assert( s.id == -1 );
+  s.obj = obj;
+  s.id = wide ? ( ( slot << GEN_BITS ) | s.gen ) : slot;
+  ++count;
+  return s.id;
+}
+
+void ObjectIdTable::remove( int id ) {
+  int slot = getSlot( id );
+  assert( find( id ) != NULL );
+
+  Slot& s = slots[slot];
+  s.obj = NULL;
+  s.id = -1;
+  s.gen = ( s.gen + 1 ) & GEN_MASK;
+  if ( allocating )
+    freeSlots.push_back( slot );
+  --count;
+}
+
+} //namespace GNE
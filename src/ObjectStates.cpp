@@ -0,0 +1,123 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ObjectStates.h>
+#include <gnelib/UpdateScheduler.h>
+#include <algorithm>
+
+namespace GNE {
+
+namespace {
+  struct EntryIdLess {
+    template <class T>
+    bool operator()( const T& e, int id ) const {
+      return e.id < id;
+    }
+  };
+}
+
+ObjectStates::ObjectStates() {
+}
+
+ObjectStates::~ObjectStates() {
+}
+
+int ObjectStates::getObjectCount() const {
+  return (int)entries.size();
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectStates::getDeltaPackets( ObjectBaselines& baselines ) const {
+  forgetBaselines( baselines, NULL );
+  std::vector<const Entry*> objs;
+  objs.reserve( entries.size() );
+  for ( size_t i = 0; i < entries.size(); ++i )
+    objs.push_back( &entries[i] );
+  return writeDeltas( baselines, objs, NULL, -1 );
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectStates::getDeltaPackets( ObjectBaselines& baselines,
+                               const std::set<int>& objectIds ) const {
+  forgetBaselines( baselines, &objectIds );
+  std::vector<const Entry*> objs;
+  objs.reserve( objectIds.size() );
+  for ( std::set<int>::const_iterator iter = objectIds.begin();
+        iter != objectIds.end(); ++iter ) {
+    const Entry* e = find( *iter );
+    if ( e != NULL )
+      objs.push_back( e );
+  }
+  return writeDeltas( baselines, objs, NULL, -1 );
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectStates::getDeltaPackets( ObjectBaselines& baselines,
+                               const std::set<int>& objectIds,
+                               UpdateScheduler& scheduler, int budget ) const {
+  forgetBaselines( baselines, &objectIds );
+  scheduler.accumulate( objectIds );
+  std::vector<int> order;
+  scheduler.getOrder( order );
+
+  std::vector<const Entry*> objs;
+  objs.reserve( order.size() );
+  for ( size_t i = 0; i < order.size(); ++i ) {
+    const Entry* e = find( order[i] );
+    if ( e != NULL )
+      objs.push_back( e );
+  }
+  return writeDeltas( baselines, objs, &scheduler, budget );
+}
+
+const ObjectStates::Entry* ObjectStates::find( int id ) const {
+  std::vector<Entry>::const_iterator iter =
+    std::lower_bound( entries.begin(), entries.end(), id, EntryIdLess() );
+  if ( iter == entries.end() || iter->id != id )
+    return NULL;
+  return &*iter;
+}
+
+void ObjectStates::forgetBaselines( ObjectBaselines& baselines,
+                                    const std::set<int>* keep ) const {
+  std::map<int, ObjectBaselines::Baseline>::iterator iter =
+    baselines.baselines.begin();
+  while ( iter != baselines.baselines.end() ) {
+    const Entry* e = find( iter->first );
+    if ( e == NULL || e->serial != iter->second.serial ||
+         ( keep != NULL && keep->find( iter->first ) == keep->end() ) )
+      baselines.baselines.erase( iter++ );
+    else
+      ++iter;
+  }
+}
+
+std::vector<ObjectDeltaPacket::sptr>
+ObjectStates::writeDeltas( ObjectBaselines& baselines,
+                           const std::vector<const Entry*>& objs,
+                           UpdateScheduler* scheduler, int budget ) const {
+  ObjectBaselines::Output out( scheduler, budget );
+  for ( size_t i = 0; i < objs.size(); ++i )
+    baselines.writeDelta( out, objs[i]->id, objs[i]->serial, *objs[i]->state,
+                          objs[i]->state );
+  return out.packets;
+}
+
+} //namespace GNE
@@ -0,0 +1,97 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ObjectUpdateBatchPacket.h>
+#include <gnelib/ObjectBrokerPacket.h>
+#include <gnelib/PacketParser.h>
+
+namespace GNE {
+
+const int ObjectUpdateBatchPacket::ID = 13;
+
+//The packet ID, count, and length.
+static const int HEADER_LEN = 5;
+
+ObjectUpdateBatchPacket::ObjectUpdateBatchPacket()
+: Packet( ID ), count( 0 ), data( getMaxDataSize() ) {
+}
+
+ObjectUpdateBatchPacket::ObjectUpdateBatchPacket(
+  const ObjectUpdateBatchPacket& o )
+: Packet( ID ), count( o.count ), data( o.data ) {
+}
+
+ObjectUpdateBatchPacket::~ObjectUpdateBatchPacket() {
+}
+
+int ObjectUpdateBatchPacket::getMaxDataSize() {
+  //PacketStream only adds a packet to a frame if it ends before the last
+  //byte, which is the end of packet marker.
+  return Buffer::RAW_PACKET_LEN - HEADER_LEN -
+    (int)sizeof(PacketParser::END_OF_PACKET) - 1;
+}
+
+int ObjectUpdateBatchPacket::getCount() const {
+  return count;
+}
+
+bool ObjectUpdateBatchPacket::add( int objectId, const Buffer& update ) {
+  int len = update.getPosition();
+  int needed = ObjectBrokerPacket::getObjectIdSize( (guint32)objectId ) +
+    Buffer::getSizeOf( guint16(0) ) + len;
+  if ( needed > data.getRemaining() || count == 65535 )
+    return false;
+
+  ObjectBrokerPacket::writeObjectId( data, (guint32)objectId );
+  data << (guint16)len;
+  data.writeRaw( update.getData(), len );
+  ++count;
+  return true;
+}
+
+int ObjectUpdateBatchPacket::getSize() const {
+  return HEADER_LEN + data.getPosition();
+}
+
+void ObjectUpdateBatchPacket::writePacket( Buffer& raw ) const {
+  Packet::writePacket( raw );
+  raw << count << (guint16)data.getPosition();
+  raw.writeRaw( data.getData(), data.getPosition() );
+}
+
+void ObjectUpdateBatchPacket::readPacket( Buffer& raw ) {
+  Packet::readPacket( raw );
+  guint16 len;
+  raw >> count >> len;
+  data.clear();
+  if ( (int)len > data.getCapacity() || (int)len > raw.getRemaining() ) {
+    raw.failRead( Error::BufferUnderflow );
+    count = 0;
+    return;
+  }
+  raw.readRaw( data.getData(), len );
+  data.setPosition( len );
+}
+
+Packet* ObjectUpdateBatchPacket::create() {
+  return new ObjectUpdateBatchPacket;
+}
+
+} //namespace GNE
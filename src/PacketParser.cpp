@@ -35,6 +35,10 @@
 #include <gnelib/ObjectUpdatePacket.h>
 #include <gnelib/ObjectDeathPacket.h>
 #include <gnelib/ChannelPacket.h>
+#include <gnelib/ReliablePacket.h>
+#include <gnelib/MessagePacket.h>
+#include <gnelib/ObjectDeltaPacket.h>
+#include <gnelib/ObjectUpdateBatchPacket.h>
 
 namespace GNE {
 namespace PacketParser {
@@ -75,6 +79,10 @@ void registerGNEPackets() {
   defaultRegisterPacket<ObjectCreationPacket>();
   defaultRegisterPacket<ObjectUpdatePacket>();
   defaultRegisterPacket<ObjectDeathPacket>();
+  defaultRegisterPacket<ReliablePacket>();
+  defaultRegisterPacket<MessagePacket>();
+  defaultRegisterPacket<ObjectUpdateBatchPacket>();
+  defaultRegisterPacket<ObjectDeltaPacket>();
   /*
   packets[0] = Packet::create;
   packets[1] = CustomPacket::create;
@@ -86,6 +94,7 @@ void registerGNEPackets() {
   packets[7] = ObjectUpdatePacket::create;
   packets[8] = ObjectDeathPacket::create;
   */
+  //WrapperPacket::OPAQUE_ID (15) is reserved and must never be registered.
 }
 
 void registerPacket( guint8 id,
@@ -119,6 +128,17 @@ Packet* createPacket( guint8 id ) {
     return NULL;
 }
 
+Packet* tryCreatePacket( guint8 id ) {
+  mapSync.acquire();
+  PacketCreateFunc func = packets[id].createFunc;
+  mapSync.release();
+
+  if ( func )
+    return func();
+  else
+    return NULL;
+}
+
 Packet* clonePacket( const Packet* p ) {
   guint8 id = (guint8)p->getType();
 
@@ -148,6 +168,13 @@ void destroyPacket( Packet* p ) {
   }
 }
 
+static PacketCreateFunc getCreateFunc( guint8 id ) {
+  //This is split off to keep the critial section small as many threads will
+  //be using the parse functions.
+  LockMutex lock( mapSync );
+  return packets[id].createFunc;
+}
+
 Packet* parseNextPacket( Buffer& raw ) {
   //Read next packet ID
   guint8 nextId;
@@ -158,12 +185,7 @@ Packet* parseNextPacket( Buffer& raw ) {
     return NULL;
 
   //Check for packet registration, parsing if it is registered.
-  mapSync.acquire();
-  PacketCreateFunc func = packets[nextId].createFunc;
-  mapSync.release();
-
-  //This section is split off to keep the above critial section small as
-  //many threads will be using this function.
+  PacketCreateFunc func = getCreateFunc( nextId );
   if (!func) {
     gnedbg1(1, "Unknown packet type %i received.", (int)nextId);
     throw UnknownPacket( (int)nextId );
@@ -184,5 +206,60 @@ Packet* parseNextPacket( Buffer& raw ) {
 
 }
 
+Error::ErrorCode tryParseNextPacket( Buffer& raw, Packet*& packet,
+                                     int& packetId ) {
+  packet = NULL;
+  packetId = END_OF_PACKET;
+  if ( raw.getReadError() != Error::NoError ) {
+    packetId = raw.getUnknownPacketId();
+    return raw.getReadError();
+  }
+
+  bool oldExceptions = raw.getReadExceptions();
+  raw.setReadExceptions( false );
+
+  guint8 nextId;
+  raw >> nextId;
+  if ( raw.getReadError() != Error::NoError ) {
+    raw.setReadExceptions( oldExceptions );
+    return raw.getReadError();
+  }
+
+  packetId = nextId;
+  if (nextId == END_OF_PACKET) {
+    raw.setReadExceptions( oldExceptions );
+    return Error::NoError;
+  }
+
+  PacketCreateFunc func = getCreateFunc( nextId );
+  if (!func) {
+    gnedbg1(1, "Unknown packet type %i received.", (int)nextId);
+    raw.setReadExceptions( oldExceptions );
+    return Error::UnknownPacket;
+  }
+
+  Packet* ret = func();
+  try {
+    ret->readPacket(raw);
+  } catch( ... ) {
+    raw.setReadExceptions( oldExceptions );
+    destroyPacket( ret );
+    throw;
+  }
+  raw.setReadExceptions( oldExceptions );
+
+  Error::ErrorCode code = raw.getReadError();
+  if ( code != Error::NoError ) {
+    //A packet inside this one may be the unknown one.
+    if ( code == Error::UnknownPacket )
+      packetId = raw.getUnknownPacketId();
+    destroyPacket( ret );
+    return code;
+  }
+
+  packet = ret;
+  return Error::NoError;
+}
+
 } //namespace PacketParser
 } //namespace GNE
@@ -21,15 +21,19 @@
 #include <gnelib/PacketStream.h>
 #include <gnelib/Packet.h>
 #include <gnelib/PacketFeeder.h>
+#include <gnelib/MessageListener.h>
+#include <gnelib/MessagePacket.h>
 #include <gnelib/Connection.h>
 #include <gnelib/Buffer.h>
 #include <gnelib/RateAdjustPacket.h>
+#include <gnelib/ReliablePacket.h>
 #include <gnelib/ExitPacket.h>
 #include <gnelib/PacketParser.h>
 #include <gnelib/Time.h>
 #include <gnelib/Timer.h>
 #include <gnelib/Errors.h>
 #include <gnelib/Lock.h>
+#include <gnelib/ConnectionEventGenerator.h>
 
 const int BUF_LEN = 1024;
 
@@ -41,12 +45,16 @@ const int TIME_STEPS_PER_SEC = 1000000 / TIME_STEP;
 
 namespace GNE {
 
-PacketStream::PacketStream(int reqOutRate, int maxOutRate, Connection& ourOwner)
+PacketStream::PacketStream(int reqOutRate, int maxOutRate, Connection& ourOwner,
+                           int maxInRate)
 : Thread("PktStrm", Thread::HIGH_PRI), owner(ourOwner), maxOutRate(maxOutRate),
-reqOutRate(reqOutRate), feederAllowed(true), feederTimeout(0),
+reqOutRate(reqOutRate), maxInRate(0), inRemain(0), inRateStep(0),
+inQueueLimit(0), inQueuePaused(false), messageShare(50), messageAllowance(0),
+feederAllowed(true), feederTimeout(0),
 lowPacketsThreshold(0) {
   assert(reqOutRate >= 0);
   assert(maxOutRate >= 0);
+  assert(maxInRate >= 0);
 
   setType( CONNECTION );
 
@@ -59,13 +67,16 @@ lowPacketsThreshold(0) {
   //Set the last calculation time:
   lastTime = Timer::getCurrentTime();
 
+  setupInRate( maxInRate );
+
   gnedbgo2(2, "PacketStream negotiated: max: %d requested: %d",
     maxOutRate, reqOutRate);
   gnedbgo(5, "created");
 }
 
-PacketStream::sptr PacketStream::create(int reqOutRate, int maxOutRate, Connection& ourOwner) {
-  sptr ret( new PacketStream( reqOutRate, maxOutRate, ourOwner ) );
+PacketStream::sptr PacketStream::create(int reqOutRate, int maxOutRate,
+                                        Connection& ourOwner, int maxInRate) {
+  sptr ret( new PacketStream( reqOutRate, maxOutRate, ourOwner, maxInRate ) );
   ret->setThisPointer( ret );
   return ret;
 }
@@ -89,7 +100,9 @@ PacketStream::~PacketStream() {
   }
   outQCtrl.release();
 
-  //Empty the incoming queue.
+  //Empty the incoming queue.  The connection is gone, so don't try to
+  //resume reading from it.
+  inQueuePaused = false;
   while ((temp = getNextPacket()) != NULL)
     delete temp;
 
@@ -101,6 +114,19 @@ int PacketStream::getInLength() const {
   return in.size();
 }
 
+int PacketStream::getInQueueLimit() const {
+  LockMutex lock( inQCtrl );
+  return inQueueLimit;
+}
+
+void PacketStream::setInQueueLimit(int limit) {
+  assert(limit >= 0);
+
+  LockMutex lock( inQCtrl );
+  if (limit >= 0)
+    inQueueLimit = limit;
+}
+
 int PacketStream::getOutLength(bool reliable) const {
   LockCV lock( outQCtrl );
   return reliable ? outRel.size() : outUnrel.size();
@@ -146,12 +172,34 @@ bool PacketStream::isNextPacket() const {
 
 Packet* PacketStream::getNextPacket() {
   Packet* ret = NULL;
+  bool wakePeer = false;
   inQCtrl.acquire();
   if (!in.empty()) {
     ret = in.front();
     in.pop();
+
+    //Start reading again if we stopped because the queue was full.  This is
+    //done while inQCtrl is held so it can't race with throttleReliableIn.
+    if (inQueuePaused && (int)in.size() <= inQueueLimit / 2) {
+      inQueuePaused = false;
+      if (owner.loopback) {
+        wakePeer = true;
+      } else if (owner.sockets.r != NL_INVALID && eGen) {
+        updateInRates();
+        int wait = getInWaitTime();
+        if (wait > 0)
+          eGen->pause(owner.sockets.r, wait);
+        else
+          eGen->resume(owner.sockets.r);
+      }
+    }
   }
   inQCtrl.release();
+
+  //The other end checks our queue while holding its outQCtrl, so it is
+  //woken without inQCtrl.
+  if (wakePeer)
+    owner.wakeLoopbackPeer();
   return ret;
 }
 
@@ -181,6 +229,92 @@ void PacketStream::writePacket(const Packet::sptr& packet, bool reliable) {
   writePacket( *packet, reliable );
 }
 
+void PacketStream::writeStreamPacket(const Packet& packet, int stream,
+                                     bool ordered) {
+  assert(stream >= 0 && stream < ReliableStreams::NUM_STREAMS);
+
+  if (owner.sockets.u == NL_INVALID && !owner.sockets.shared) {
+    //The reliable connection is already reliable and ordered.
+    writePacket(packet, true);
+    return;
+  }
+
+  streams.write(packet, stream, ordered);
+
+  LockCV lock( outQCtrl );
+  outQCtrl.broadcast();
+}
+
+int PacketStream::writeMessage(const Buffer& data) {
+  int ret = messages.write(data);
+
+  LockCV lock( outQCtrl );
+  outQCtrl.broadcast();
+  return ret;
+}
+
+int PacketStream::writeFile(const std::string& fileName, long offset,
+                            long length) {
+  int ret = messages.writeFile(fileName, offset, length);
+  if (ret >= 0) {
+    LockCV lock( outQCtrl );
+    outQCtrl.broadcast();
+  }
+  return ret;
+}
+
+int PacketStream::getOutMessageCount() const {
+  return messages.getCount();
+}
+
+void PacketStream::setMessageShare(int percent) {
+  assert(percent >= 1 && percent <= 100);
+
+  LockCV lock( outQCtrl );
+  if (percent >= 1 && percent <= 100)
+    messageShare = percent;
+}
+
+int PacketStream::getMessageShare() const {
+  LockCV lock( outQCtrl );
+  return messageShare;
+}
+
+void PacketStream::setMaxMessageSize(int bytes) {
+  messages.setMaxMessageSize(bytes);
+}
+
+int PacketStream::getMaxMessageSize() const {
+  return messages.getMaxMessageSize();
+}
+
+void PacketStream::setMessageListener(const MessageListener::sptr& listener) {
+  LockCV lock( outQCtrl );
+  if ( feederAllowed )
+    messageListener = listener;
+}
+
+int PacketStream::getStreamRtt() const {
+  return streams.getRtt();
+}
+
+int PacketStream::getStreamUnackedCount() const {
+  return streams.getUnackedCount();
+}
+
+void PacketStream::setFecGroupSize(int size) {
+  assert(size == 0 || (size >= 2 && size <= 255));
+
+  LockCV lock( outQCtrl );
+  if (size == 0 || (size >= 2 && size <= 255))
+    fecEncoder.setGroupSize(size);
+}
+
+int PacketStream::getFecGroupSize() const {
+  LockCV lock( outQCtrl );
+  return fecEncoder.getGroupSize();
+}
+
 int PacketStream::getCurrOutRate() const {
   return currOutRate;
 }
@@ -193,6 +327,11 @@ int PacketStream::getRemoteOutLimit() const {
   return maxOutRate;
 }
 
+int PacketStream::getMaxInRate() const {
+  LockMutex lock( inQCtrl );
+  return maxInRate;
+}
+
 void PacketStream::setRates(int reqOutRate2, int maxInRate2) {
   if (reqOutRate2 >= 0) {
     outQCtrl.acquire();
@@ -203,6 +342,10 @@ void PacketStream::setRates(int reqOutRate2, int maxInRate2) {
 
   //Now handle the inRate changes, sending a notice if needed.
   if (maxInRate2 >= 0) {
+    inQCtrl.acquire();
+    setupInRate( maxInRate2 );
+    inQCtrl.release();
+
     RateAdjustPacket notice;
     notice.rate = maxInRate2;
     writePacket(notice, true);
@@ -219,7 +362,8 @@ void PacketStream::waitToSendAll(int waitTime) const {
   int ms = waitTime;
 
   outQCtrl.acquire();
-  while ((!outRel.empty() || !outUnrel.empty()) && !shutdown && !timeOut) {
+  while ((!outRel.empty() || !outUnrel.empty() || messages.getCount() > 0) &&
+         !shutdown && !timeOut) {
     outQCtrl.timedWait(ms);
 
     t = Timer::getCurrentTime();
@@ -244,11 +388,15 @@ void PacketStream::shutDown() {
  */
 void PacketStream::run() {
   int numPackets = 0;
+  bool streamsOK = true;
 
   outQCtrl.acquire();
-  while (!shutdown) {
+  while (!shutdown && streamsOK) {
+    //Queue any stream packets and acknowledgements that are due.
+    streamsOK = pollStreams();
+
     //Check the numpackets and call the feeder if needed.
-    numPackets = (int)(outRel.size() + outUnrel.size());
+    numPackets = (int)(outRel.size() + outUnrel.size()) + messages.getCount();
 
     if (numPackets > 0) {
       //Trigger the onLowPackets event if needed
@@ -256,48 +404,139 @@ void PacketStream::run() {
 
     } else {
       //Waiting loop for when there are no packets
-      while (numPackets == 0 && !shutdown) {
+      while (numPackets == 0 && !shutdown && streamsOK) {
         //Notify any threads waiting on waitToSendAll
         outQCtrl.broadcast();
 
         onLowPackets(numPackets);
         //Reevaluate numPackets because onLowPackets may add more packets.
-        numPackets = (int)(outRel.size() + outUnrel.size());
+        numPackets = (int)(outRel.size() + outUnrel.size()) +
+          messages.getCount();
 
         if (numPackets <= 0) {
-          if (feederTimeout)
-            outQCtrl.timedWait(feederTimeout);
-          else
+          //Wake up in time to resend stream packets that are not
+          //acknowledged.
+          int wait = streams.getWaitTime(Timer::getCurrentTime());
+          if (feederTimeout && (wait < 0 || feederTimeout < wait))
+            wait = feederTimeout;
+
+          if (wait > 0)
+            outQCtrl.timedWait(wait);
+          else if (wait < 0)
             outQCtrl.wait();
+
+          streamsOK = pollStreams();
+          numPackets = (int)(outRel.size() + outUnrel.size()) +
+          messages.getCount();
         }
       }
     }
 
-    if (!shutdown) {
+    if (!shutdown && streamsOK) {
       //Check which queue woke us up.  Doing the check this way gives
-      //absolute priority to reliable packets.
-      bool reliable = !outRel.empty();
+      //absolute priority to reliable packets, except that messages take
+      //turns with the other packets to get their share of the bandwidth.
+      bool competing = !outRel.empty() || !outUnrel.empty();
+      bool messageTurn = messages.getCount() > 0 &&
+        (!competing || messageAllowance > 0 || messageShare == 100);
+      bool reliable = messageTurn || !outRel.empty();
       assert(reliable || !outUnrel.empty());
 
       //Do throttled writes
       updateRates();
-      if (outRemain > 0) {
+      if (outRemain > 0 && owner.loopback && !messageTurn) {
+        //The packets are given to the other end of a loopback connection as
+        //they are, as many at once as we may send, instead of in a frame.
+        //The other end has no socket to stop reading from, so we give it
+        //no more reliable packets than its in queue can hold.
+        int room = (reliable) ? owner.getLoopbackPeerRoom() : -1;
+        if (room == 0) {
+          outQCtrl.wait();
+          continue;
+        }
+        std::vector<Packet*> batch;
+        int sent = prepareLoopback( ((reliable) ? outRel : outUnrel), batch,
+                                    room);
+        outRemain -= sent;
+        if (messages.getCount() > 0 && messageShare < 100)
+          messageAllowance += sent * messageShare / (100 - messageShare);
+
+        outQCtrl.release();
+        if (!owner.writeLoopback(batch, reliable))
+          owner.processError( Error::ConnectionDropped );
+        outQCtrl.acquire();
+
+      } else if (outRemain > 0) {
+        if (messageTurn) {
+          //Files are read before the frame is built so that a slow disk
+          //does not hold outQCtrl.
+          outQCtrl.release();
+          messages.prefetch();
+          outQCtrl.acquire();
+        }
+
         //Yes, this check will let us dip below 0, but overall we will make
         //up for it by waiting for it to go above 0 again.
         Buffer raw;
-        prepareSend( ((reliable) ? outRel : outUnrel), raw);
+        //Parity is only added if there is a real unreliable connection, and
+        //if the next packet still fits in a frame with the parity header.
+        bool fec = !reliable && fecEncoder.getGroupSize() > 0 &&
+          (owner.sockets.u != NL_INVALID || owner.sockets.shared) &&
+          outUnrel.front()->getSize() + ParityFecEncoder::HEADER_LEN <
+          Buffer::RAW_PACKET_LEN - (int)sizeof(PacketParser::END_OF_PACKET);
+        if (fec)
+          fecEncoder.beginFrame(raw);
+        std::vector<MessageFragmenter::Progress> progress;
+        bool fileError = false;
+        if (messageTurn) {
+          int sent = messages.fill(raw, progress);
+          if (sent < 0) {
+            fileError = true;
+            sent = 0;
+          }
+          prepareSend(outRel, raw);
+          messageAllowance = competing ? (messageAllowance - sent) : 0;
+        } else {
+          prepareSend( ((reliable) ? outRel : outUnrel), raw);
+          if (messages.getCount() > 0 && messageShare < 100)
+            messageAllowance +=
+              raw.getPosition() * messageShare / (100 - messageShare);
+        }
+        if (fileError) {
+          //The frame ends with part of a fragment that can't be finished,
+          //and the remote side can't be told to drop the message.
+          outQCtrl.release();
+          owner.processError( LowLevelError(Error::Read) );
+          outQCtrl.acquire();
+          continue;
+        }
         raw << PacketParser::END_OF_PACKET;
+
+        //Reliable frames are sent compressed if that is smaller.
+        Buffer packed;
+        if (reliable && owner.compressOut && owner.compressor.compress(raw, packed))
+          raw = packed;
         outRemain -= raw.getPosition();
 
+        Buffer parity;
+        bool sendParity = fec && fecEncoder.endFrame(raw, parity);
+        if (sendParity)
+          outRemain -= parity.getPosition();
+
         //Release the mutex in case rawWrite blocks
         outQCtrl.release();
-        if (owner.sockets.rawWrite(reliable, raw) != raw.getPosition()) {
+        bool written = (owner.loopback) ? owner.writeLoopbackFrame(raw) :
+          (owner.sockets.rawWrite(reliable, raw) == raw.getPosition());
+        if (written && sendParity)
+          written = (owner.sockets.rawWrite(false, parity) == parity.getPosition());
+        if (!written) {
           //We sleep here for a bit because we want to favor onExit if that is going to
           //happen.  Else this failure will occur.  Or we will favor a "real" error
           //more descriptive than a write error.
           Thread::sleep( 250 );
           owner.processError( LowLevelError(Error::Write) );
-        }
+        } else if (!progress.empty())
+          onMessagesSent(progress);
         outQCtrl.acquire();
         
       } else {
@@ -310,29 +549,108 @@ void PacketStream::run() {
   }
   outQCtrl.release();
 
+  if (!streamsOK) {
+    //The remote side stopped acknowledging our stream packets.
+    owner.processError( Error::ConnectionDropped );
+  }
+
   //We want to try to send the required ExitPacket, if possible, over the
   //reliable connection.
   //We need a good way to make sure this doesn't block though, but the
   //current solution here of assuming rawWrite won't block will have to do
   //for now.
-  Buffer raw;
-  ExitPacket temp;
-  raw << temp << PacketParser::END_OF_PACKET;
-  int ret = owner.sockets.rawWrite(true, raw);
-  if (ret > raw.getPosition()) {
-    gnedbgo1(4, "ExitPacket sent (%d).", ret);
-  } else if ( ret > 0 ) {
-    gnedbgo1(4, "ExitPackt not completely sent (%d).", ret);
+  if (owner.loopback) {
+    owner.exitLoopback();
+    gnedbgo(4, "Exit given to the other end of the loopback connection.");
   } else {
-    gnedbgo1(4, "ExitPacket not sent (%d).", ret);
+    Buffer raw;
+    ExitPacket temp;
+    raw << temp << PacketParser::END_OF_PACKET;
+    int ret = owner.sockets.rawWrite(true, raw);
+    if (ret > raw.getPosition()) {
+      gnedbgo1(4, "ExitPacket sent (%d).", ret);
+    } else if ( ret > 0 ) {
+      gnedbgo1(4, "ExitPackt not completely sent (%d).", ret);
+    } else {
+      gnedbgo1(4, "ExitPacket not sent (%d).", ret);
+    }
   }
 
   //Now that we have finished, release the PacketFeeder.
   LockCV lock( outQCtrl );
   feeder.reset();
+  messageListener.reset();
   feederAllowed = false;
 }
 
+bool PacketStream::acceptInFrame(int bytes, bool reliable) {
+  LockMutex lock( inQCtrl );
+
+  if (!reliable) {
+    //Unreliable data we can't take is simply dropped.
+    if (inQueueLimit > 0 && (int)in.size() >= inQueueLimit) {
+      gnedbgo1(3, "In queue full, dropping unreliable frame of %d bytes.",
+               bytes);
+      return false;
+    }
+    if (maxInRate > 0) {
+      updateInRates();
+      if (inRemain < 0) {
+        gnedbgo1(3, "In rate exceeded, dropping unreliable frame of %d bytes.",
+                 bytes);
+        return false;
+      }
+    }
+  }
+
+  //Reliable data was already taken off the socket so we have to count it.
+  if (maxInRate > 0) {
+    updateInRates();
+    inRemain -= bytes;
+  }
+  return true;
+}
+
+void PacketStream::throttleReliableIn() {
+  LockMutex lock( inQCtrl );
+  if (owner.sockets.r == NL_INVALID || !eGen)
+    return;
+
+  if (inQueueLimit > 0 && (int)in.size() >= inQueueLimit) {
+    gnedbgo1(3, "In queue full (%d packets), pausing reliable reads.",
+             (int)in.size());
+    inQueuePaused = true;
+    eGen->pause(owner.sockets.r, 0);
+
+  } else if (maxInRate > 0) {
+    int wait = getInWaitTime();
+    if (wait > 0) {
+      gnedbgo1(3, "In rate exceeded, pausing reliable reads for %d ms.", wait);
+      eGen->pause(owner.sockets.r, wait);
+    }
+  }
+}
+
+int PacketStream::getInQueueRoom() {
+  LockMutex lock( inQCtrl );
+  if (inQueueLimit <= 0)
+    return -1;
+
+  int room = inQueueLimit - (int)in.size();
+  if (room <= 0) {
+    gnedbgo1(3, "In queue full (%d packets), pausing loopback writes.",
+             (int)in.size());
+    inQueuePaused = true;
+    return 0;
+  }
+  return room;
+}
+
+void PacketStream::wakeWriter() {
+  LockCV lock( outQCtrl );
+  outQCtrl.broadcast();
+}
+
 void PacketStream::addIncomingPacket(Packet* packet) {
   if (packet->getType() != RateAdjustPacket::ID) {
     inQCtrl.acquire();
@@ -348,6 +666,89 @@ void PacketStream::addIncomingPacket(Packet* packet) {
   }
 }
 
+void PacketStream::addIncomingPackets(const std::vector<Packet*>& packets) {
+  //The RateAdjustPackets are intercepted as in addIncomingPacket, but only
+  //the last one matters.
+  int newRate = -1;
+  inQCtrl.acquire();
+  for (size_t i = 0; i < packets.size(); ++i) {
+    if (packets[i]->getType() != RateAdjustPacket::ID) {
+      in.push(packets[i]);
+    } else {
+      newRate = ((RateAdjustPacket*)packets[i])->rate;
+      delete packets[i];
+    }
+  }
+  inQCtrl.release();
+
+  if (newRate >= 0) {
+    LockCV lock( outQCtrl );
+    maxOutRate = newRate;
+    gnedbgo1(2, "Received new outgoing rate limit of %d", maxOutRate);
+    setupCurrRate();
+  }
+}
+
+bool PacketStream::pollStreams() {
+  //outQCtrl must be acquired for this function.
+  std::vector<Packet*> toSend;
+  bool ret = streams.poll(Timer::getCurrentTime(), toSend);
+  for (size_t i = 0; i < toSend.size(); ++i)
+    outUnrel.push(toSend[i]);
+  return ret;
+}
+
+void PacketStream::receiveStreamPacket(ReliablePacket* packet) {
+  std::vector<Packet*> deliver;
+  bool wake = streams.receive(packet, Timer::getCurrentTime(), deliver);
+
+  for (size_t i = 0; i < deliver.size(); ++i)
+    addIncomingPacket(deliver[i]);
+
+  //Wake up the writer thread to send the acknowledgement.
+  if (wake) {
+    LockCV lock( outQCtrl );
+    outQCtrl.broadcast();
+  }
+}
+
+bool PacketStream::receiveMessagePacket(MessagePacket* packet) {
+  MessageFragmenter::Progress progress;
+  MessagePacket* message;
+  MessageFragmenter::Result res =
+    messages.receive(*packet, progress, message);
+  PacketParser::destroyPacket(packet);
+  if (res == MessageFragmenter::Invalid)
+    return false;
+
+  if (message)
+    addIncomingPacket(message);
+
+  MessageListener::sptr listener;
+  {
+    LockCV lock( outQCtrl );
+    listener = messageListener;
+  }
+  if (listener)
+    listener->onMessageReceived(*this, progress.messageId, progress.done,
+                                progress.total);
+  return true;
+}
+
+void PacketStream::onMessagesSent(
+  const std::vector<MessageFragmenter::Progress>& progress) {
+  MessageListener::sptr listener;
+  {
+    LockCV lock( outQCtrl );
+    listener = messageListener;
+  }
+  if (listener) {
+    for (size_t i = 0; i < progress.size(); ++i)
+      listener->onMessageSent(*this, progress[i].messageId, progress[i].done,
+                              progress[i].total);
+  }
+}
+
 void PacketStream::prepareSend(std::queue<Packet*>& q, Buffer& raw) {
   //outQCtrl must be acquired for this function.
   //While there are packets left and they won't overflow the Buffer
@@ -361,6 +762,20 @@ void PacketStream::prepareSend(std::queue<Packet*>& q, Buffer& raw) {
   }
 }
 
+int PacketStream::prepareLoopback(std::queue<Packet*>& q,
+                                  std::vector<Packet*>& batch, int room) {
+  //outQCtrl must be acquired for this function.
+  //Without a rate limit, everything waiting is taken at once.
+  int sent = 0;
+  while (!q.empty() && (currOutRate == 0 || sent < outRemain) &&
+         (room < 0 || (int)batch.size() < room)) {
+    sent += q.front()->getSize();
+    batch.push_back(q.front());
+    q.pop();
+  }
+  return sent;
+}
+
 void PacketStream::setupCurrRate() {
   //Precalculate the current outgoing rate, keeping in mind that the value of
   //is the "largest" and means unlimited rate (or "unchecked").  Unlimited is
@@ -403,6 +818,41 @@ void PacketStream::updateRates() {
   }
 }
 
+void PacketStream::setupInRate( int newRate ) {
+  //inQCtrl should be acquired when this function is running.
+  maxInRate = newRate;
+  inRateStep = maxInRate / TIME_STEPS_PER_SEC;
+  if (maxInRate > 0 && inRateStep == 0)
+    inRateStep = 1;
+  inRemain = getInBurst();
+  lastInTime = Timer::getCurrentTime();
+}
+
+int PacketStream::getInBurst() const {
+  //The sender may have a full second of data to send at once, and its rate
+  //control can dip below 0 by up to one frame.
+  return maxInRate + Buffer::RAW_PACKET_LEN;
+}
+
+void PacketStream::updateInRates() {
+  //Works like updateRates, but for data coming in.
+  int timeDiff =
+    (Timer::getCurrentTime() - lastInTime).getTotaluSec() / TIME_STEP;
+
+  inRemain += inRateStep * timeDiff;
+  lastInTime += TIME_STEP * timeDiff;
+  if (inRemain > getInBurst())
+    inRemain = getInBurst();
+}
+
+int PacketStream::getInWaitTime() const {
+  if (maxInRate == 0 || inRemain >= 0)
+    return 0;
+
+  int steps = (-inRemain + inRateStep - 1) / inRateStep;
+  return steps * (TIME_STEP / 1000);
+}
+
 void PacketStream::onLowPackets( int numPackets ) {
   if (feeder && numPackets <= lowPacketsThreshold) {
     gnedbgo(4, "onLowPackets event generated.");
@@ -0,0 +1,198 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ParityFec.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+const int ParityFecEncoder::FRAME_ID = 10;
+const int ParityFecEncoder::HEADER_LEN = 8;
+const int ParityFecEncoder::MAX_PAYLOAD =
+  Buffer::RAW_PACKET_LEN - ParityFecEncoder::HEADER_LEN;
+
+//Flag in the header marking a parity frame.
+const guint8 PARITY_FLAG = 0x01;
+
+//How many groups back the decoder remembers.
+const int MAX_GROUPS = 16;
+
+ParityFecEncoder::ParityFecEncoder()
+: groupSize(0), group(0), index(0), lenXor(0), maxLen(0) {
+}
+
+void ParityFecEncoder::setGroupSize(int size) {
+  assert(size == 0 || (size >= 2 && size <= 255));
+  groupSize = size;
+
+  //Start over with a new group.
+  if (index > 0)
+    group++;
+  index = 0;
+  lenXor = 0;
+  maxLen = 0;
+  data.clear();
+}
+
+int ParityFecEncoder::getGroupSize() const {
+  return groupSize;
+}
+
+void ParityFecEncoder::beginFrame(Buffer& raw) {
+  assert(groupSize > 0);
+  assert(raw.getPosition() == 0);
+  raw << (guint8)FRAME_ID << (guint8)0 << group << (guint8)index
+      << (guint8)groupSize << (guint16)0;
+}
+
+bool ParityFecEncoder::endFrame(const Buffer& raw, Buffer& parity) {
+  int len = raw.getPosition() - HEADER_LEN;
+  assert(len > 0 && len <= MAX_PAYLOAD);
+
+  const gbyte* payload = raw.getData() + HEADER_LEN;
+  if ((int)data.size() < len)
+    data.resize(len, 0);
+  for (int i = 0; i < len; ++i)
+    data[i] ^= payload[i];
+  lenXor ^= (guint16)len;
+  if (len > maxLen)
+    maxLen = len;
+
+  if (++index < groupSize)
+    return false;
+
+  parity.clear();
+  parity << (guint8)FRAME_ID << PARITY_FLAG << group << (guint8)index
+         << (guint8)groupSize << lenXor;
+  parity.writeRaw(&data[0], maxLen);
+
+  group++;
+  index = 0;
+  lenXor = 0;
+  maxLen = 0;
+  data.clear();
+  return true;
+}
+
+ParityFecDecoder::ParityFecDecoder()
+: newest(0), haveNewest(false), recoveredCount(0) {
+}
+
+ParityFecDecoder::Result ParityFecDecoder::receive(Buffer& frame,
+                                                   Buffer& recovered) {
+  LockMutex lock( sync );
+
+  if (frame.getRemaining() < ParityFecEncoder::HEADER_LEN)
+    return Invalid;
+
+  guint8 id, flags, index, count;
+  guint16 g, lenXor;
+  frame >> id >> flags >> g >> index >> count >> lenXor;
+  bool parity = (flags & PARITY_FLAG) != 0;
+  if (id != ParityFecEncoder::FRAME_ID || count < 2 ||
+      (!parity && index >= count))
+    return Invalid;
+
+  //Forget groups too old to still be completed.
+  if (haveNewest) {
+    gint16 diff = (gint16)(g - newest);
+    if (diff <= -MAX_GROUPS)
+      return Invalid;
+    if (diff > 0) {
+      newest = g;
+      std::map<guint16, Group>::iterator iter = groups.begin();
+      while (iter != groups.end()) {
+        if ((gint16)(iter->first - newest) <= -MAX_GROUPS)
+          groups.erase(iter++);
+        else
+          ++iter;
+      }
+    }
+  } else {
+    newest = g;
+    haveNewest = true;
+  }
+
+  Group& grp = groups[g];
+  if (grp.count == 0) {
+    grp.count = count;
+    grp.have.resize(count, false);
+  } else if (grp.count != count) {
+    return Invalid;
+  }
+
+  const gbyte* payload = frame.getData() + frame.getPosition();
+  int len = frame.getRemaining();
+
+  if (parity) {
+    if (grp.hasParity || grp.done)
+      return Parity;
+    grp.hasParity = true;
+    addXor(grp.data, payload, len);
+    grp.lenXor ^= lenXor;
+    return tryRecover(grp, recovered) ? Recovered : Parity;
+  }
+
+  //A data frame we have, or that we already rebuilt, is a duplicate.
+  if (grp.have[index] || grp.done)
+    return Invalid;
+  grp.have[index] = true;
+  grp.received++;
+  addXor(grp.data, payload, len);
+  grp.lenXor ^= (guint16)len;
+  if (grp.received == grp.count)
+    grp.done = true;
+
+  return tryRecover(grp, recovered) ? DataRecovered : Data;
+}
+
+int ParityFecDecoder::getRecoveredCount() const {
+  LockMutex lock( sync );
+  return recoveredCount;
+}
+
+void ParityFecDecoder::addXor(std::vector<gbyte>& dest, const gbyte* src,
+                              int len) {
+  if ((int)dest.size() < len)
+    dest.resize(len, 0);
+  for (int i = 0; i < len; ++i)
+    dest[i] ^= src[i];
+}
+
+bool ParityFecDecoder::tryRecover(Group& g, Buffer& recovered) {
+  if (!g.hasParity || g.done || g.received != g.count - 1)
+    return false;
+
+  //With all but one frame XORed into the parity, what is left is the
+  //missing frame.
+  g.done = true;
+  int len = g.lenXor;
+  if (len <= 0 || len > ParityFecEncoder::MAX_PAYLOAD ||
+      len > (int)g.data.size())
+    return false;
+
+  recovered.clear();
+  recovered.writeRaw(&g.data[0], len);
+  recovered.flip();
+  recoveredCount++;
+  return true;
+}
+
+} //namespace GNE
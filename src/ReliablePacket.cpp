@@ -0,0 +1,132 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ReliablePacket.h>
+#include <gnelib/Buffer.h>
+
+namespace GNE {
+
+const int ReliablePacket::ID = 9;
+
+ReliablePacket::ReliablePacket()
+: WrapperPacket(ID), flags(AckFlag), stream(0), seq(0), streamSeq(0),
+ackBits(0) {
+}
+
+ReliablePacket::ReliablePacket( const Packet& packet, int stream,
+                                bool ordered )
+: WrapperPacket(ID, &packet), flags(ordered ? OrderedFlag : 0),
+stream((guint8)stream), seq(0), streamSeq(0), ackBits(0) {
+  assert( stream >= 0 && stream <= 255 );
+}
+
+ReliablePacket::~ReliablePacket() {
+}
+
+bool ReliablePacket::isAck() const {
+  return (flags & AckFlag) != 0;
+}
+
+bool ReliablePacket::isOrdered() const {
+  return (flags & OrderedFlag) != 0;
+}
+
+int ReliablePacket::getStream() const {
+  return stream;
+}
+
+guint16 ReliablePacket::getSequence() const {
+  return seq;
+}
+
+void ReliablePacket::setSequence( guint16 seq ) {
+  this->seq = seq;
+}
+
+guint16 ReliablePacket::getStreamSequence() const {
+  return streamSeq;
+}
+
+void ReliablePacket::setStreamSequence( guint16 seq ) {
+  streamSeq = seq;
+}
+
+void ReliablePacket::setAck( guint16 next, guint32 bits ) {
+  setData( NULL );
+  flags = AckFlag;
+  stream = 0;
+  seq = next;
+  streamSeq = 0;
+  ackBits = bits;
+}
+
+guint16 ReliablePacket::getAckNext() const {
+  return seq;
+}
+
+guint32 ReliablePacket::getAckBits() const {
+  return ackBits;
+}
+
+int ReliablePacket::getSize() const {
+  int ret = WrapperPacket::getSize() + Buffer::getSizeOf( flags ) +
+    Buffer::getSizeOf( seq );
+  if ( isAck() )
+    ret += Buffer::getSizeOf( ackBits );
+  else {
+    ret += Buffer::getSizeOf( stream );
+    if ( isOrdered() )
+      ret += Buffer::getSizeOf( streamSeq );
+  }
+  return ret;
+}
+
+void ReliablePacket::writePacket(Buffer& raw) const {
+  WrapperPacket::writePacket( raw );
+  raw << flags << seq;
+  if ( isAck() )
+    raw << ackBits;
+  else {
+    raw << stream;
+    if ( isOrdered() )
+      raw << streamSeq;
+  }
+}
+
+void ReliablePacket::readPacket(Buffer& raw) {
+  WrapperPacket::readPacket( raw );
+  raw >> flags >> seq;
+  stream = 0;
+  streamSeq = 0;
+  ackBits = 0;
+  if ( isAck() )
+    raw >> ackBits;
+  else {
+    raw >> stream;
+    if ( isOrdered() )
+      raw >> streamSeq;
+  }
+}
+
+Packet* ReliablePacket::create() {
+  return new ReliablePacket;
+}
+
+} //namespace GNE
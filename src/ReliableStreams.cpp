@@ -0,0 +1,267 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ReliableStreams.h>
+#include <gnelib/ReliablePacket.h>
+#include <gnelib/PacketParser.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+const int ReliableStreams::NUM_STREAMS = 256;
+const int ReliableStreams::MAX_UNACKED = 256;
+const int ReliableStreams::MAX_RETRIES = 10;
+
+//Bounds and starting value of the retransmission timeout, in microseconds.
+//The minimum is much lower than TCP's since games expect low latency.
+const int MIN_RTO = 50000;
+const int MAX_RTO = 3000000;
+const int INITIAL_RTO = 300000;
+
+//How far ahead of the next expected sequence number we accept data.  This
+//is larger than MAX_UNACKED so a sender cannot get out of our window.
+const int RECV_WINDOW = 1024;
+
+//The number of bits in an acknowledgement after the next expected number.
+const int ACK_BITS = 32;
+
+ReliableStreams::ReliableStreams()
+: nextSeq(0), nextStreamSeq(NUM_STREAMS, 0), srtt(0), rttVar(0),
+rto(INITIAL_RTO), recvNext(0), ackPending(false), inStreams(NUM_STREAMS) {
+}
+
+ReliableStreams::~ReliableStreams() {
+  while (!waiting.empty()) {
+    delete waiting.front();
+    waiting.pop_front();
+  }
+  for (SentMap::iterator iter = unacked.begin(); iter != unacked.end(); ++iter)
+    delete iter->second.packet;
+  for (int i = 0; i < NUM_STREAMS; ++i) {
+    std::map<guint16, Packet*>& p = inStreams[i].pending;
+    for (std::map<guint16, Packet*>::iterator iter = p.begin();
+         iter != p.end(); ++iter)
+      PacketParser::destroyPacket(iter->second);
+  }
+}
+
+void ReliableStreams::write(const Packet& packet, int stream, bool ordered) {
+  assert(stream >= 0 && stream < NUM_STREAMS);
+  ReliablePacket* p = new ReliablePacket(packet, stream, ordered);
+
+  LockMutex lock( sync );
+  if (ordered)
+    p->setStreamSequence(nextStreamSeq[stream]++);
+  waiting.push_back(p);
+}
+
+bool ReliableStreams::poll(const Time& now, std::vector<Packet*>& toSend) {
+  LockMutex lock( sync );
+
+  //Send packets that have waited too long.
+  for (SentMap::iterator iter = unacked.begin(); iter != unacked.end(); ++iter) {
+    Sent& s = iter->second;
+    if (s.due <= now) {
+      if (s.retries >= MAX_RETRIES) {
+        gnedbgo1(2, "Reliable packet %d was never acknowledged.", iter->first);
+        return false;
+      }
+      //Back off exponentially, like TCP.
+      s.retries++;
+      int wait = rto << (s.retries < 6 ? s.retries : 6);
+      if (wait > MAX_RTO)
+        wait = MAX_RTO;
+      s.due = now + wait;
+      toSend.push_back(new ReliablePacket(*s.packet));
+      gnedbgo2(4, "Resending reliable packet %d (try %d).", iter->first,
+               s.retries);
+    }
+  }
+
+  //Then send new packets as the window allows.
+  while (!waiting.empty() && (int)unacked.size() < MAX_UNACKED) {
+    ReliablePacket* p = waiting.front();
+    waiting.pop_front();
+    p->setSequence(nextSeq);
+
+    Sent& s = unacked[nextSeq];
+    s.packet = p;
+    s.sendTime = now;
+    s.due = now + rto;
+    s.retries = 0;
+    nextSeq++;
+
+    toSend.push_back(new ReliablePacket(*p));
+  }
+
+  if (ackPending) {
+    guint32 bits = 0;
+    for (int i = 0; i < ACK_BITS; ++i) {
+      if (recvAhead.find((guint16)(recvNext + 1 + i)) != recvAhead.end())
+        bits |= (1u << i);
+    }
+    ReliablePacket* ack = new ReliablePacket();
+    ack->setAck(recvNext, bits);
+    toSend.push_back(ack);
+    ackPending = false;
+  }
+
+  return true;
+}
+
+int ReliableStreams::getWaitTime(const Time& now) const {
+  LockMutex lock( sync );
+
+  if (ackPending || (!waiting.empty() && (int)unacked.size() < MAX_UNACKED))
+    return 0;
+
+  int ret = -1;
+  for (SentMap::const_iterator iter = unacked.begin();
+       iter != unacked.end(); ++iter) {
+    int wait = (iter->second.due - now).getTotaluSec() / 1000;
+    if (wait < 0)
+      wait = 0;
+    if (ret < 0 || wait < ret)
+      ret = wait;
+  }
+  return ret;
+}
+
+bool ReliableStreams::receive(ReliablePacket* packet, const Time& now,
+                              std::vector<Packet*>& deliver) {
+  LockMutex lock( sync );
+
+  if (packet->isAck()) {
+    processAck(*packet, now);
+    delete packet;
+    //Acknowledged packets may have made room for waiting ones.
+    return !waiting.empty();
+  }
+
+  processData(packet, deliver);
+  return true;
+}
+
+int ReliableStreams::getRtt() const {
+  LockMutex lock( sync );
+  return srtt / 1000;
+}
+
+int ReliableStreams::getUnackedCount() const {
+  LockMutex lock( sync );
+  return (int)(unacked.size() + waiting.size());
+}
+
+void ReliableStreams::addRttSample(int sample) {
+  //The estimator from RFC 2988, with gains of 1/8 and 1/4.
+  if (srtt == 0) {
+    srtt = sample;
+    rttVar = sample / 2;
+  } else {
+    int err = sample - srtt;
+    srtt += err / 8;
+    rttVar += ((err < 0 ? -err : err) - rttVar) / 4;
+  }
+  rto = srtt + 4 * rttVar;
+  if (rto < MIN_RTO)
+    rto = MIN_RTO;
+  else if (rto > MAX_RTO)
+    rto = MAX_RTO;
+}
+
+void ReliableStreams::processAck(const ReliablePacket& ack, const Time& now) {
+  guint16 next = ack.getAckNext();
+  guint32 bits = ack.getAckBits();
+
+  SentMap::iterator iter = unacked.begin();
+  while (iter != unacked.end()) {
+    gint16 diff = (gint16)(iter->first - next);
+    bool acked = diff < 0 ||
+      (diff > 0 && diff <= ACK_BITS && (bits & (1u << (diff - 1))) != 0);
+
+    if (acked) {
+      //Like TCP, only measure packets that were sent once, since we can't
+      //know which send an acknowledgement of a resent packet is for.
+      if (iter->second.retries == 0)
+        addRttSample((now - iter->second.sendTime).getTotaluSec());
+      delete iter->second.packet;
+      unacked.erase(iter++);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+void ReliableStreams::processData(ReliablePacket* packet,
+                                  std::vector<Packet*>& deliver) {
+  //Even duplicates are acknowledged, since our last acknowledgement may
+  //have been lost.
+  ackPending = true;
+
+  guint16 seq = packet->getSequence();
+  gint16 diff = (gint16)(seq - recvNext);
+  if (diff < 0 || diff >= RECV_WINDOW ||
+      recvAhead.find(seq) != recvAhead.end() || !packet->hasData()) {
+    delete packet;
+    return;
+  }
+
+  if (diff == 0) {
+    recvNext++;
+    while (recvAhead.erase(recvNext) > 0)
+      recvNext++;
+  } else {
+    recvAhead.insert(seq);
+  }
+
+  Packet* data = packet->releaseData();
+  if (!packet->isOrdered()) {
+    deliver.push_back(data);
+
+  } else {
+    InStream& s = inStreams[packet->getStream()];
+    guint16 sseq = packet->getStreamSequence();
+    gint16 sdiff = (gint16)(sseq - s.next);
+    if (sdiff != 0) {
+      //A sender never has more than MAX_UNACKED packets in flight, so one
+      //far ahead, behind, or already waiting is from a broken or hostile
+      //peer, and keeping it would let the pending map grow without bound.
+      if (sdiff < 0 || sdiff >= RECV_WINDOW ||
+          s.pending.find(sseq) != s.pending.end()) {
+        PacketParser::destroyPacket(data);
+      } else {
+        s.pending[sseq] = data;
+      }
+    } else {
+      deliver.push_back(data);
+      s.next++;
+      std::map<guint16, Packet*>::iterator iter;
+      while ((iter = s.pending.find(s.next)) != s.pending.end()) {
+        deliver.push_back(iter->second);
+        s.pending.erase(iter);
+        s.next++;
+      }
+    }
+  }
+
+  delete packet;
+}
+
+} //namespace GNE
@@ -0,0 +1,179 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/ReplicationFanout.h>
+#include <gnelib/ObjectBrokerServer.h>
+#include <gnelib/ObjectStates.h>
+#include <gnelib/InterestGrid.h>
+#include <gnelib/NetworkObject.h>
+#include <gnelib/PacketStream.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+class ReplicationFanout::ClientJob : public WorkerPool::Job {
+public:
+  ClientJob( ReplicationFanout& fanout, Client& client,
+             const ObjectStates& states )
+    : fanout( fanout ), client( client ), states( states ) {
+  }
+
+  void run() {
+    fanout.sendTick( client, states );
+  }
+
+private:
+  ReplicationFanout& fanout;
+  Client& client;
+  const ObjectStates& states;
+};
+
+ReplicationFanout::Client::Client( int id, const Connection::sptr& conn,
+                                   int viewer )
+: id( id ), conn( conn ), viewer( viewer ) {
+}
+
+ReplicationFanout::ReplicationFanout( ObjectBrokerServer& server,
+                                      InterestGrid* grid, int threads,
+                                      int ticksPerSecond )
+: server( server ), grid( grid ), ticksPerSecond( ticksPerSecond ),
+  pool( threads ), nextId( 0 ) {
+  assert( ticksPerSecond > 0 );
+}
+
+ReplicationFanout::~ReplicationFanout() {
+  for ( std::map<int, Client*>::iterator iter = clients.begin();
+        iter != clients.end(); ++iter )
+    delete iter->second;
+}
+
+int ReplicationFanout::addClient( const Connection::sptr& conn, int viewer ) {
+  LockMutex lock( sync );
+  int id = nextId++;
+  clients[id] = new Client( id, conn, viewer );
+  return id;
+}
+
+void ReplicationFanout::removeClient( int client ) {
+  Client* c;
+  {
+    LockMutex lock( sync );
+    std::map<int, Client*>::iterator iter = clients.find( client );
+    assert( iter != clients.end() );
+    c = iter->second;
+    clients.erase( iter );
+  }
+  //Wait for any useDeltaAck still using the client.
+  c->sync.acquire();
+  c->sync.release();
+  delete c;
+}
+
+int ReplicationFanout::getClientCount() const {
+  LockMutex lock( sync );
+  return (int)clients.size();
+}
+
+void ReplicationFanout::setWeight( int client, int objectId, float weight ) {
+  getClient( client ).scheduler.setWeight( objectId, weight );
+}
+
+void ReplicationFanout::useDeltaAck( int client,
+                                     const ObjectDeltaPacket& packet ) {
+  LockMutex lock( sync );
+  std::map<int, Client*>::iterator iter = clients.find( client );
+  if ( iter == clients.end() )
+    return;
+  LockMutex clientLock( iter->second->sync );
+  server.useDeltaAck( iter->second->baselines, packet );
+}
+
+void ReplicationFanout::tick() {
+  ObjectStates::sptr states = server.captureStates();
+
+  std::vector<ClientJob*> jobs;
+  {
+    LockMutex lock( sync );
+    jobs.reserve( clients.size() );
+    for ( std::map<int, Client*>::iterator iter = clients.begin();
+          iter != clients.end(); ++iter )
+      jobs.push_back( new ClientJob( *this, *iter->second, *states ) );
+  }
+
+  std::vector<WorkerPool::Job*> poolJobs( jobs.begin(), jobs.end() );
+  try {
+    pool.runAll( poolJobs );
+  } catch ( ... ) {
+    for ( size_t i = 0; i < jobs.size(); ++i )
+      delete jobs[i];
+    throw;
+  }
+  for ( size_t i = 0; i < jobs.size(); ++i )
+    delete jobs[i];
+}
+
+void ReplicationFanout::send( int client, const Connection::sptr& conn,
+                              const Packet& packet, bool reliable ) {
+  conn->stream().writePacket( packet, reliable );
+}
+
+void ReplicationFanout::sendTick( Client& client, const ObjectStates& states ) {
+  int budget = -1;
+  if ( client.conn )
+    budget = UpdateScheduler::getTickBudget( client.conn->stream(),
+                                             ticksPerSecond );
+
+  std::vector<ObjectDeltaPacket::sptr> deltas;
+  if ( grid != NULL ) {
+    std::vector<int> entered, left;
+    grid->getChanges( client.viewer, entered, left );
+
+    for ( size_t i = 0; i < entered.size(); ++i ) {
+      NetworkObject* obj = server.getObjectById( entered[i] );
+      if ( obj == NULL )
+        continue;
+      ObjectCreationPacket::sptr packet = server.getCreationPacket( *obj );
+      if ( packet )
+        send( client.id, client.conn, *packet, true );
+    }
+    for ( size_t i = 0; i < left.size(); ++i )
+      send( client.id, client.conn, ObjectDeathPacket( left[i], NULL ), true );
+
+    LockMutex lock( client.sync );
+    deltas = states.getDeltaPackets( client.baselines,
+                                     grid->getInterests( client.viewer ),
+                                     client.scheduler, budget );
+  } else {
+    LockMutex lock( client.sync );
+    deltas = states.getDeltaPackets( client.baselines );
+  }
+
+  for ( size_t i = 0; i < deltas.size(); ++i )
+    send( client.id, client.conn, *deltas[i], false );
+}
+
+ReplicationFanout::Client& ReplicationFanout::getClient( int client ) {
+  LockMutex lock( sync );
+  std::map<int, Client*>::iterator iter = clients.find( client );
+  assert( iter != clients.end() );
+  return *iter->second;
+}
+
+} //namespace GNE
@@ -0,0 +1,75 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "gneintern.h"
+
+#ifdef WIN32
+#include <wincrypt.h>
+#ifdef _MSC_VER
+#pragma comment( lib, "advapi32.lib" )
+#endif
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace GNE {
+
+bool getSecureRandom( void* buf, int len ) {
+  assert( len >= 0 );
+#ifdef WIN32
+  HCRYPTPROV prov;
+  if ( !CryptAcquireContext( &prov, NULL, NULL, PROV_RSA_FULL,
+                             CRYPT_VERIFYCONTEXT | CRYPT_SILENT ) ) {
+    gnedbg(1, "Could not open the system's random source.");
+    return true;
+  }
+  bool failed = !CryptGenRandom( prov, (DWORD)len, (BYTE*)buf );
+  CryptReleaseContext( prov, 0 );
+  if ( failed )
+    gnedbg(1, "Could not read the system's random source.");
+  return failed;
+
+#else
+  int fd = open( "/dev/urandom", O_RDONLY );
+  if ( fd < 0 ) {
+    gnedbg(1, "Could not open /dev/urandom.");
+    return true;
+  }
+  char* next = (char*)buf;
+  while ( len > 0 ) {
+    ssize_t got = read( fd, next, len );
+    if ( got < 0 && errno == EINTR )
+      continue;
+    if ( got <= 0 ) {
+      gnedbg(1, "Could not read /dev/urandom.");
+      close( fd );
+      return true;
+    }
+    next += got;
+    len -= (int)got;
+  }
+  close( fd );
+  return false;
+#endif
+}
+
+} //namespace GNE
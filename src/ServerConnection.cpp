@@ -30,6 +30,11 @@
 #include <gnelib/Error.h>
 #include <gnelib/Errors.h>
 #include <gnelib/SocketPair.h>
+#include <gnelib/SharedUnreliableSocket.h>
+#include <gnelib/SessionTable.h>
+#include <gnelib/FrameCompressor.h>
+#include <gnelib/HandshakeQueue.h>
+#include <gnelib/Timer.h>
 #include <gnelib/GNE.h>
 
 namespace GNE {
@@ -43,8 +48,150 @@ public:
   ConnectionParams cp;
   ServerConnectionListener::sptr creator;
   bool doJoin;
+  bool sharedUnrel;
+  bool compress;
+  //Whether the client takes a session token, and the one it wants resumed.
+  bool takesToken;
+  SessionToken resumeToken;
+  //The table we started a session in, if we did.
+  SessionTable::sptr sessions;
+  //The SyncConnection onNewConn is called with.
+  SyncConnection::sptr sConn;
 };
 
+/**
+ * The steps of an event driven handshake, run on serverHandshakes.  Each
+ * runs when the next packet the client has to send arrives: first the CRP,
+ * then the compression dictionary and unreliable port if they were agreed.
+ * Each stage has its own timeout.  The socket does not block until the
+ * handshake is done, so a client that sends part of a packet and stalls
+ * holds no thread: HawkNL keeps the part with the socket, and the step
+ * waits again for the rest.  The last stage calls onNewConn as the first
+ * event of the EventThread.
+ */
+class ServerConnection::HandshakeStep : public HandshakeQueue::Step {
+public:
+  typedef SmartPtr<HandshakeStep> sptr;
+
+  enum Stage { CRP, Compression, Unreliable, Loopback, NewConn };
+
+  HandshakeStep( const ServerConnection::sptr& conn, Stage first = CRP )
+    : conn( conn ), stage( first ), rAddr( conn->getRemoteAddress(true) ),
+      origListener( conn->getListener() ) {
+  }
+
+  void run();
+
+  void cancel( const Error& error );
+
+  /**
+   * Moves to the given stage, which has the handshake timeout to get the
+   * client's next packet.
+   */
+  void startStage( Stage next ) {
+    stage = next;
+    int timeout = conn->params->cp.getHandshakeTimeout();
+    if ( timeout > 0 )
+      deadline = Timer::getCurrentTime() + timeout * 1000;
+    else
+      deadline = Time();
+  }
+
+  /**
+   * Waits for the client's next packet, or the rest of it, without holding
+   * a thread, for the time left in the stage.
+   */
+  void waitForData() {
+    int ms = 0;
+    if ( deadline != Time() ) {
+      ms = ( deadline - Timer::getCurrentTime() ).getTotalmSec();
+      if ( ms <= 0 ) {
+        cancel( Error( Error::ConnectionTimeOut ) );
+        return;
+      }
+    }
+    serverHandshakes->waitForData( sptr( thisPtr.lock() ), conn->sockets.r,
+                                   ms );
+  }
+
+  /**
+   * Weak pointer to this, set when created.
+   */
+  WeakPtr<HandshakeStep> thisPtr;
+
+private:
+  ServerConnection::sptr conn;
+  Stage stage;
+  //When the stage times out, or 0 for never.
+  Time deadline;
+  Address rAddr;
+  ConnectionListener::sptr origListener;
+};
+
+void ServerConnection::HandshakeStep::run() {
+  if ( stage == NewConn ) {
+    conn->callOnNewConn( rAddr, origListener );
+    return;
+  } else if ( stage == Loopback ) {
+    //A loopback connection has no handshake.
+    stage = NewConn;
+    conn->finishConnect( rAddr, origListener, sptr( thisPtr.lock() ) );
+    return;
+  }
+
+  Buffer raw( 64 );
+  int check = conn->sockets.rawRead( true, raw );
+  if ( check == 0 ) {
+    //Only part of the packet has arrived.
+    waitForData();
+    return;
+  }
+
+  try {
+    switch ( stage ) {
+    case CRP:
+      conn->answerCRP( raw, check );
+      break;
+    case Compression:
+      conn->getCompressionInfo( raw, check );
+      break;
+    case Unreliable:
+      conn->getUnreliableInfo( raw, check );
+      break;
+    case Loopback:
+    case NewConn:
+      break;
+    }
+  } catch ( Error& e ) {
+    cancel( e );
+    return;
+  }
+
+  //Read the next packet the client has to send, if any.  It is tried at
+  //once, since the client may have sent it with the last.
+  if ( stage == CRP && conn->params->compress ) {
+    gnedbgo(2, "Compression agreed.  Waiting for the client's dictionary.");
+    startStage( Compression );
+    serverHandshakes->post( sptr( thisPtr.lock() ) );
+  } else if ( stage != Unreliable && conn->params->cp.getUnrel() ) {
+    gnedbgo(2, "Unreliable requested.  Waiting for unrel info.");
+    startStage( Unreliable );
+    serverHandshakes->post( sptr( thisPtr.lock() ) );
+  } else if ( !nlSetSocketOpt( conn->sockets.r, NL_BLOCKING_IO, NL_TRUE ) ) {
+    //The connection's threads expect the socket to block.
+    cancel( LowLevelError() );
+  } else {
+    stage = NewConn;
+    conn->finishConnect( rAddr, origListener, sptr( thisPtr.lock() ) );
+  }
+}
+
+void ServerConnection::HandshakeStep::cancel( const Error& error ) {
+  gnedbgo1(1, "Connection failure during GNE handshake: %s", error.toString().c_str());
+  conn->doFailure( conn->params->creator, error, rAddr, origListener );
+  conn->params.reset();
+}
+
 ServerConnection::ServerConnection()
 : Thread("SrvrConn", Thread::HIGH_PRI) {
   gnedbgo(5, "created");
@@ -66,6 +213,9 @@ void ServerConnection::init(
   params->cp = p;
   params->creator = creator;
   params->doJoin = true;
+  params->sharedUnrel = false;
+  params->compress = false;
+  params->takesToken = false;
 
   startConnecting(); //we move right into Connecting state
 }
@@ -84,6 +234,42 @@ ServerConnection::~ServerConnection() {
   gnedbgo(5, "destroyed");
 }
 
+void ServerConnection::startHandshake() {
+  assert(sockets.r != NL_INVALID);
+  assert(getListener());
+  gnedbgo1(1, "New connection incoming from %s",
+    getRemoteAddress(true).toString().c_str());
+
+  HandshakeStep::sptr step( new HandshakeStep(
+    static_pointer_cast<ServerConnection>( this_.lock() ) ) );
+  step->thisPtr = step;
+  if ( !nlSetSocketOpt( sockets.r, NL_BLOCKING_IO, NL_FALSE ) ) {
+    step->cancel( LowLevelError() );
+    return;
+  }
+  gnedbgo(2, "Waiting for the client's CRP.");
+  step->startStage( HandshakeStep::CRP );
+  step->waitForData();
+}
+
+void ServerConnection::startLoopback( Connection& client,
+                                      const ConnectionParams& clientParams ) {
+  assert(getListener());
+  gnedbgo(1, "New loopback connection incoming");
+  linkLoopback( client, clientParams, *this, params->cp );
+
+  //Without a network there are no shared handshake threads.
+  if ( params->cp.getAsyncConnect() && serverHandshakes ) {
+    HandshakeStep::sptr step( new HandshakeStep(
+      static_pointer_cast<ServerConnection>( this_.lock() ),
+      HandshakeStep::Loopback ) );
+    step->thisPtr = step;
+    serverHandshakes->post( step );
+  } else {
+    start();
+  }
+}
+
 /**
  * \todo better test GNE shutting down while connection is being made.
  *
@@ -94,7 +280,7 @@ ServerConnection::~ServerConnection() {
  *      in the ConnectionParams AND in onNewConn.
  */
 void ServerConnection::run() {
-  assert(sockets.r != NL_INVALID);
+  assert(sockets.r != NL_INVALID || isLoopback());
   assert(getListener());
   //endConnect will set the null listener to discard the events, so we
   //have to cache the current listener.
@@ -105,31 +291,54 @@ void ServerConnection::run() {
   Address rAddr = getRemoteAddress(true);
   gnedbgo1(1, "New connection incoming from %s", rAddr.toString().c_str());
 
-  //Do the GNE protocol handshake.
+  //Do the GNE protocol handshake, which a loopback connection doesn't have.
   try {
-    doHandshake();
+    if ( !isLoopback() )
+      doHandshake();
   } catch (Error& e) {
     doFailure( params->creator, e, rAddr, origListener );
+    params.reset();
     return;
   }
+
+  finishConnect( rAddr, origListener, HandshakeStep::sptr() );
+}
+
+void ServerConnection::finishConnect( const Address& rAddr,
+                                      const ConnectionListener::sptr& origListener,
+                                      const HandshakeStep::sptr& step ) {
   gnedbgo(2, "GNE Protocol Handshake Successful.");
 
   //Start up the connecting SyncConnection and start the onNewConn event.
-  bool onNewConnFinished = false;
-  SyncConnection::sptr sConnPtr = SyncConnection::create( this_.lock() );
-  SyncConnection& sConn = *sConnPtr;
+  params->sConn = SyncConnection::create( this_.lock() );
+  params->sConn->startConnect();
 
-  try {
-    sConn.startConnect();
+  //Setup the packet feeder
+  ps->setFeederTimeout( params->cp.getFeederTimeout() );
+  ps->setLowPacketThreshold( params->cp.getLowPacketThreshold() );
+
+  //Once the threads start, the EventThread may run the step and release
+  //params, so they are not used after this unless there is no step.
+  if ( step ) {
+    startThreads( step, params->sConn );
+    reg(true, true);
+  } else {
     startThreads();
     reg(true, true);
+    callOnNewConn( rAddr, origListener );
+  }
+}
 
-    //Setup the packet feeder
-    ps->setFeederTimeout( params->cp.getFeederTimeout() );
-    ps->setLowPacketThreshold( params->cp.getLowPacketThreshold() );
+void ServerConnection::callOnNewConn( const Address& rAddr,
+                                      const ConnectionListener::sptr& origListener ) {
+  bool onNewConnFinished = false;
+  SyncConnection& sConn = *params->sConn;
 
+  try {
     gnedbgo2(2, "Starting onNewConn r: %i, u: %i", sockets.r, sockets.u);
-    getListener()->onNewConn(sConn); //SyncConnection will relay this
+    //SyncConnection will relay this.  It is called directly, since the
+    //listener is cleared if the other end fails or exits first.
+    sConn.onNewConn(sConn);
     onNewConnFinished = true;
 
     finishedConnecting(); //move state to Connected
@@ -162,10 +371,29 @@ void ServerConnection::shutDown() {
 }
 
 void ServerConnection::doHandshake() {
+  Buffer raw( 64 );
+
   //Receive the client's CRP.
   gnedbgo(2, "Waiting for the client's CRP.");
+  answerCRP(raw, sockets.rawRead(true, raw));
+
+  if (params->compress) {
+    gnedbgo(2, "Compression agreed.  Getting the client's dictionary.");
+    getCompressionInfo(raw, sockets.rawRead(true, raw));
+  }
+  
+  //Then we handle anything related to the unreliable connection if needed.
+  if (params->cp.getUnrel()) {
+    gnedbgo(2, "Unreliable requested.  Getting unrel info.");
+    getUnreliableInfo(raw, sockets.rawRead(true, raw));
+  } else {
+    gnedbgo(2, "Unreliable connection not requested or refused.");
+  }
+}
+
+void ServerConnection::answerCRP(Buffer& crp, int check) {
   try {
-    getCRP();
+    getCRP(crp, check);
   } catch (Error& e) {
     if (e.getCode() == Error::GNETheirVersionHigh ||
       e.getCode() == Error::GNETheirVersionLow ||
@@ -180,23 +408,14 @@ void ServerConnection::doHandshake() {
   //Else, we send the CAP
   gnedbgo(2, "Got CRP, now sending CAP.");
   sendCAP();
-  
-  //Then we handle anything related to the unreliable connection if needed.
-  if (params->cp.getUnrel()) {
-    gnedbgo(2, "Unreliable requested.  Getting unrel info.");
-    getUnreliableInfo();
-  } else {
-    gnedbgo(2, "Unreliable connection not requested or refused.");
-  }
 }
 
 const int CRPLEN = 48;
+//The length of the SessionToken a client may add to resume a session.
+const int CRPTOKENLEN = 4 + 4 * SessionToken::SECRET_WORDS;
 
-void ServerConnection::getCRP() {
-  Buffer crp( 64 );
-
-  int check = sockets.rawRead(true, crp);
-  if (check != CRPLEN) {
+void ServerConnection::getCRP(Buffer& crp, int check) {
+  if (check != CRPLEN && check != CRPLEN + CRPTOKENLEN) {
     if (check == NL_INVALID) {
       gnedbgo(1, "nlRead error when trying to get CRP.");
       throw LowLevelError(Error::Read);
@@ -212,7 +431,15 @@ void ServerConnection::getCRP() {
   //Check the header and versions.  These will throw exceptions if there is
   //a problem.
   checkHeader(crp, ProtocolViolation::InvalidCRP);
-  checkVersions(crp);
+  gbyte features = checkVersions(crp);
+  params->compress =
+    (features & CompressFlag) != 0 && params->cp.getCompression();
+  params->takesToken = (features & ResumeFlag) != 0;
+  if (check != CRPLEN && !params->takesToken) {
+    gnedbgo1(1, "Protocol violation: CRP of %d bytes without a session token.",
+      check);
+    throw ProtocolViolation(ProtocolViolation::InvalidCRP);
+  }
 
   guint32 maxOutRate;
   crp >> maxOutRate;
@@ -221,9 +448,16 @@ void ServerConnection::getCRP() {
   crp >> unreliable;
   //We use the unreliable connection only if both sides allow it.
   params->cp.setUnrel(unreliable && params->cp.getUnrel());
+  params->sharedUnrel = (unreliable & SharedUnrelFlag) != 0;
+
+  if (check != CRPLEN)
+    params->resumeToken = readToken(crp);
 
   //Now that we know the versions are OK, make the PacketStream
-  ps = PacketStream::create(params->cp.getOutRate(), maxOutRate, *this);
+  ps = PacketStream::create(params->cp.getOutRate(), maxOutRate, *this,
+                            params->cp.getInRate());
+  ps->setInQueueLimit(params->cp.getInQueueLimit());
+  ps->setFecGroupSize(params->cp.getFecGroupSize());
 }
 
 void ServerConnection::sendRefusal() {
@@ -243,11 +477,50 @@ void ServerConnection::sendRefusal() {
 }
 
 void ServerConnection::sendCAP() {
+  SharedUnreliableSocket::sptr shared;
+  if (params->cp.getUnrel() && params->sharedUnrel) {
+    shared = params->creator->getSharedUnreliableSocket();
+    if (shared && !shared->isOpen())
+      shared.reset();
+  }
+
+  gbool flags = gTrue;
+  if (shared)
+    flags |= SharedUnrelFlag;
+  if (params->compress)
+    flags |= CompressFlag;
+
+  if (params->takesToken) {
+    SessionTable::sptr sessions = params->creator->getSessionTable();
+    if (sessions) {
+      Connection::sptr replaced;
+      sessionToken = sessions->startSession(params->resumeToken, this_.lock(),
+                                            resumed, replaced);
+      params->sessions = sessions;
+      sessionTable = sessions;
+      flags |= ResumeFlag;
+      gnedbgo2(2, "Session %x %s", sessionToken.id,
+               resumed ? "resumed" : "started");
+      if (replaced) {
+        //The client came back before we noticed its old connection was lost.
+        gnedbgo1(2, "Dropping the old connection of session %x",
+                 sessionToken.id);
+        replaced->disconnect();
+      }
+    }
+  }
+
   Buffer cap;
   addHeader(cap);
-  cap << gTrue;
+  cap << flags;
   cap << params->cp.getInRate();
-  if (params->cp.getUnrel()) {
+  if (shared) {
+    //The client supports tokens, so send it the shared port and its token.
+    sockets.shared = shared;
+    sockets.token = shared->addConnection(this_.lock(), getRemoteAddress(true));
+    cap << (gint32)shared->getLocalAddress().getPort();
+    cap << sockets.token;
+  } else if (params->cp.getUnrel()) {
     //If the client requested it and we allowed it, open an unreliable port
     //and send the port number to the client.
     sockets.u = nlOpen(0, NL_UNRELIABLE);
@@ -256,6 +529,10 @@ void ServerConnection::sendCAP() {
     //Send -1 to tell the client there will be no unreliable port
     cap << (gint32)-1;
   }
+  if (params->compress)
+    cap << FrameCompressor::getDictionaryHash();
+  if (params->sessions)
+    writeToken(cap, sessionToken);
 
   int check = sockets.rawWrite(true, cap);
   gnedbgo1(5, "Sent a CAP with %d bytes.", check);
@@ -264,10 +541,24 @@ void ServerConnection::sendCAP() {
     throw LowLevelError(Error::Write);
 }
 
-void ServerConnection::getUnreliableInfo() {
-  Buffer raw( 64 );
+void ServerConnection::getCompressionInfo(Buffer& raw, int check) {
+  if (check != sizeof(guint32)) {
+    if (check == NL_INVALID) {
+      gnedbgo(1, "nlRead error when trying to get compression info.");
+      throw LowLevelError(Error::Read);
+    } else {
+      gnedbgo2(1, "Protocol violation trying to get compression info.  Got %d bytes expected %d",
+        check, sizeof(guint32));
+      throw Error(Error::ProtocolViolation);
+    }
+  }
+
+  guint32 dictHash;
+  raw >> dictHash;
+  startCompression(dictHash);
+}
 
-  int check = sockets.rawRead(true, raw);
+void ServerConnection::getUnreliableInfo(Buffer& raw, int check) {
   if (check != sizeof(gint32)) {
     if (check == NL_INVALID) {
       gnedbgo(1, "nlRead error when trying to get unreliable info.");
@@ -288,14 +579,22 @@ void ServerConnection::getUnreliableInfo() {
 
   Address uDest = sockets.getRemoteAddress(true);
   uDest.setPort((int)portNum);
-  NLaddress temp = uDest.getAddress();
-  nlSetRemoteAddr(sockets.u, &temp);
+  if (sockets.shared) {
+    sockets.shared->setRemoteAddress(sockets.token, uDest);
+  } else {
+    NLaddress temp = uDest.getAddress();
+    nlSetRemoteAddr(sockets.u, &temp);
+  }
 }
 
 void ServerConnection::doFailure( const SmartPtr< ServerConnectionListener >& l,
                                   const Error& e,
                                   const Address& addr,
                                   const SmartPtr< ConnectionListener >& listener ) {
+  //Hold a session we started, so the client can try again.
+  if ( params && params->sessions )
+    params->sessions->hold( sessionToken, *this );
+
   if ( shutdown ) {
     Error err( Error::ConnectionAborted );
     l->onListenFailure( err, addr, listener );
@@ -21,6 +21,8 @@
 #include <gnelib/ServerConnectionListener.h>
 #include <gnelib/ConnectionEventGenerator.h>
 #include <gnelib/ServerConnection.h>
+#include <gnelib/SharedUnreliableSocket.h>
+#include <gnelib/SessionTable.h>
 #include <gnelib/ConnectionListener.h>
 #include <gnelib/Connection.h>
 #include <gnelib/ConnectionParams.h>
@@ -37,8 +39,12 @@ typedef SCLList::iterator SCLListIter;
 static SCLList listeners;
 static Mutex listSync;
 
+//The most connections accepted for one event, so that a flood of them does
+//not keep the event generator from the other sockets.
+static const int MAX_ACCEPTS = 64;
+
 ServerConnectionListener::ServerConnectionListener()
-: listening(false), socket( NL_INVALID ) {
+: listening(false), socket( NL_INVALID ), acceptGroup( NL_INVALID ) {
   gnedbgo(5, "created");
 }
 
@@ -97,6 +103,10 @@ bool ServerConnectionListener::listen() {
   if (ret == NL_TRUE) {
     gnedbgo1(3, "Registering listen socket %i", socket);
 
+    acceptGroup = nlGroupCreate();
+    if (acceptGroup != NL_INVALID)
+      nlGroupAddSocket(acceptGroup, socket);
+
     //Lock our strong pointer, making sure setThisPointer was called.
     sptr this_strong = this_.lock();
     assert( this_strong );
@@ -125,33 +135,76 @@ bool ServerConnectionListener::isListening() const {
 }
 
 void ServerConnectionListener::onReceive() {
-  LockMutex lock(sync);
+  //Accept all of the connections waiting, then start them without the lock.
+  std::vector<NLsocket> accepted;
+  {
+    LockMutex lock(sync);
+
+    while ( (int)accepted.size() < MAX_ACCEPTS ) {
+      NLsocket sock = nlAcceptConnection(socket);
+      if (sock == NL_INVALID) {
+        LowLevelError err = LowLevelError();
+        gnedbgo1(1, "Listening failure (accept failed): %s",
+          err.toString().c_str());
+        onListenFailure( err, Address(), ConnectionListener::sptr() );
+        break;
+      }
+      accepted.push_back( sock );
+
+      //Accept again only if another connection is already waiting, since
+      //nlAcceptConnection blocks.
+      NLsocket waiting;
+      if ( acceptGroup == NL_INVALID ||
+           nlPollGroup(acceptGroup, NL_READ_STATUS, &waiting, 1, 0) != 1 )
+        break;
+    }
+  }
+
+  if ( accepted.size() > 1 )
+    gnedbgo1(4, "Accepted %i connections at once", (int)accepted.size());
+  for ( size_t i = 0; i < accepted.size(); ++i )
+    newConnection( accepted[i] );
+}
 
-  NLsocket sock = nlAcceptConnection(socket);
-  if (sock != NL_INVALID) {
-    ConnectionParams params;
-    getNewConnectionParams(params);
-
-    if (!params) {
-      //If the params were valid
-      assert( !this_.expired() );
-      ServerConnection::sptr newConn = ServerConnection::create(params, sock, this_.lock());
-      gnedbgo2(4, "Spawning a new ServerConnection %x on socket %i",
-        newConn.get(), sock);
+void ServerConnectionListener::newConnection( NLsocket sock ) {
+  ConnectionParams params;
+  getNewConnectionParams(params);
+
+  if (!params) {
+    //If the params were valid
+    assert( !this_.expired() );
+    ServerConnection::sptr newConn = ServerConnection::create(params, sock, this_.lock());
+    gnedbgo2(4, "Spawning a new ServerConnection %x on socket %i",
+      newConn.get(), sock);
+    if ( params.getAsyncConnect() )
+      newConn->startHandshake();
+    else
       newConn->start();
-    } else {
-      //If the params are not valid, report the error
-      onListenFailure( Error(Error::OtherGNELevelError), Address(),
-        params.getListener());
-    }
   } else {
-    LowLevelError err = LowLevelError();
-    gnedbgo1(1, "Listening failure (accept failed): %s",
-      err.toString().c_str());
-    onListenFailure( err, Address(), ConnectionListener::sptr() );
+    //If the params are not valid, report the error
+    nlClose(sock);
+    onListenFailure( Error(Error::OtherGNELevelError), Address(),
+      params.getListener());
   }
 }
 
+ServerConnection::sptr ServerConnectionListener::newLoopbackConnection() {
+  ConnectionParams params;
+  getNewConnectionParams(params);
+
+  if (params) {
+    onListenFailure( Error(Error::OtherGNELevelError), Address(),
+      params.getListener());
+    return ServerConnection::sptr();
+  }
+
+  assert( !this_.expired() );
+  ServerConnection::sptr newConn =
+    ServerConnection::create(params, NL_INVALID, this_.lock());
+  gnedbgo1(4, "Spawning a new loopback ServerConnection %x", newConn.get());
+  return newConn;
+}
+
 Address ServerConnectionListener::getLocalAddress() const {
   LockMutex lock(sync);
 
@@ -164,6 +217,29 @@ Address ServerConnectionListener::getLocalAddress() const {
   }
 }
 
+void ServerConnectionListener::setSharedUnreliableSocket(
+  const SharedUnreliableSocket::sptr& s ) {
+  LockMutex lock(sync);
+  sharedSocket = s;
+}
+
+SharedUnreliableSocket::sptr
+ServerConnectionListener::getSharedUnreliableSocket() const {
+  LockMutex lock(sync);
+  return sharedSocket;
+}
+
+void ServerConnectionListener::setSessionTable(
+  const SessionTable::sptr& table ) {
+  LockMutex lock(sync);
+  sessions = table;
+}
+
+SessionTable::sptr ServerConnectionListener::getSessionTable() const {
+  LockMutex lock(sync);
+  return sessions;
+}
+
 void ServerConnectionListener::setThisPointer( const sptr& thisPointer ) {
   this_ = thisPointer;
 }
@@ -176,6 +252,11 @@ void ServerConnectionListener::rawClose() {
     GNE::eGen->unreg(socket);
     listening = false;
   }
+
+  if ( acceptGroup != NL_INVALID ) {
+    nlGroupDestroy(acceptGroup);
+    acceptGroup = NL_INVALID;
+  }
   
   if ( socket != NL_INVALID ) {
     nlClose(socket);
@@ -0,0 +1,186 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/SessionTable.h>
+#include <gnelib/Timer.h>
+#include <gnelib/Error.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+SessionTable::Session::~Session() {
+}
+
+SessionTable::SessionTable( int graceMs )
+: graceMs( graceMs ), heldCount( 0 ), nextId( 1 ) {
+  assert( graceMs >= 0 );
+}
+
+SessionTable::sptr SessionTable::create( int graceMs ) {
+  return sptr( new SessionTable( graceMs ) );
+}
+
+SessionTable::~SessionTable() {
+}
+
+int SessionTable::getGracePeriod() const {
+  LockMutex lock( sync );
+  return graceMs;
+}
+
+void SessionTable::setGracePeriod( int ms ) {
+  assert( ms >= 0 );
+  LockMutex lock( sync );
+  graceMs = ms;
+}
+
+SessionToken SessionTable::startSession( const SessionToken& requested,
+                                         const SmartPtr<Connection>& conn,
+                                         bool& resumed,
+                                         SmartPtr<Connection>& replaced ) {
+  LockMutex lock( sync );
+
+  replaced.reset();
+  Entry* e = find( requested );
+  if ( e != NULL && ( !e->held || e->deadline > Timer::getCurrentTime() ) ) {
+    if ( e->held ) {
+      e->held = false;
+      --heldCount;
+    } else {
+      //The client knows the secret, so its old connection must be lost.
+      replaced = e->conn.lock();
+    }
+    e->conn = conn;
+    e->owner = conn.get();
+    resumed = true;
+    return requested;
+  }
+
+  //Skip 0, which is the invalid id, and any ids still in use when wrapping.
+  while ( nextId == 0 || entries.find( nextId ) != entries.end() )
+    ++nextId;
+
+  //The ids are in order, so only the secret keeps a client from naming
+  //another's session.  It never comes from a generator whose state a
+  //client could work out from its own token.
+  SessionToken ret;
+  if ( getSecureRandom( ret.secret, sizeof( ret.secret ) ) )
+    throw Error( Error::OtherGNELevelError );
+  ret.id = nextId++;
+  Entry& added = entries[ ret.id ];
+  added.token = ret;
+  added.held = false;
+  added.conn = conn;
+  added.owner = conn.get();
+  resumed = false;
+  return ret;
+}
+
+void SessionTable::setSession( const SessionToken& token,
+                               const Session::sptr& session ) {
+  LockMutex lock( sync );
+  Entry* e = find( token );
+  if ( e != NULL )
+    e->session = session;
+}
+
+SessionTable::Session::sptr
+SessionTable::getSession( const SessionToken& token ) const {
+  LockMutex lock( sync );
+  const Entry* e = find( token );
+  return ( e != NULL ) ? e->session : Session::sptr();
+}
+
+void SessionTable::hold( const SessionToken& token ) {
+  LockMutex lock( sync );
+  Entry* e = find( token );
+  if ( e != NULL && !e->held ) {
+    e->held = true;
+    e->deadline = Timer::getCurrentTime() + graceMs * 1000;
+    ++heldCount;
+  }
+}
+
+void SessionTable::hold( const SessionToken& token, const Connection& conn ) {
+  LockMutex lock( sync );
+  Entry* e = find( token );
+  if ( e != NULL && !e->held && e->owner == &conn ) {
+    e->held = true;
+    e->deadline = Timer::getCurrentTime() + graceMs * 1000;
+    ++heldCount;
+  }
+}
+
+void SessionTable::close( const SessionToken& token ) {
+  LockMutex lock( sync );
+  Entry* e = find( token );
+  if ( e != NULL ) {
+    if ( e->held )
+      --heldCount;
+    entries.erase( token.id );
+  }
+}
+
+void SessionTable::expire( std::vector<Session::sptr>& expired ) {
+  LockMutex lock( sync );
+  if ( heldCount == 0 )
+    return;
+
+  Time now = Timer::getCurrentTime();
+  Entries::iterator iter = entries.begin();
+  while ( iter != entries.end() ) {
+    Entry& e = iter->second;
+    if ( e.held && e.deadline <= now ) {
+      if ( e.session )
+        expired.push_back( e.session );
+      --heldCount;
+      entries.erase( iter++ );
+    } else {
+      ++iter;
+    }
+  }
+}
+
+int SessionTable::getSessionCount() const {
+  LockMutex lock( sync );
+  return (int)entries.size();
+}
+
+int SessionTable::getHeldCount() const {
+  LockMutex lock( sync );
+  return heldCount;
+}
+
+SessionTable::Entry* SessionTable::find( const SessionToken& token ) {
+  Entries::iterator iter = entries.find( token.id );
+  if ( iter == entries.end() || !iter->second.token.sameSecret( token ) )
+    return NULL;
+  return &iter->second;
+}
+
+const SessionTable::Entry*
+SessionTable::find( const SessionToken& token ) const {
+  Entries::const_iterator iter = entries.find( token.id );
+  if ( iter == entries.end() || !iter->second.token.sameSecret( token ) )
+    return NULL;
+  return &iter->second;
+}
+
+} //namespace GNE
@@ -0,0 +1,262 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/SharedUnreliableSocket.h>
+#include <gnelib/ConnectionEventGenerator.h>
+#include <gnelib/Connection.h>
+#include <gnelib/Error.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+const int SharedUnreliableSocket::TOKEN_LEN = sizeof(guint32);
+
+SharedUnreliableSocket::SharedUnreliableSocket()
+: socket( NL_INVALID ), sending( false ) {
+  gnedbgo(5, "created");
+}
+
+SharedUnreliableSocket::sptr SharedUnreliableSocket::create() {
+  sptr ret( new SharedUnreliableSocket() );
+  ret->setThisPointer( ret );
+  return ret;
+}
+
+void SharedUnreliableSocket::setThisPointer( const sptr& thisPointer ) {
+  this_ = thisPointer;
+}
+
+SharedUnreliableSocket::~SharedUnreliableSocket() {
+  close();
+  gnedbgo(5, "destroyed");
+}
+
+bool SharedUnreliableSocket::open(int port) {
+  LockMutex lock( sockSync );
+
+  if ( socket != NL_INVALID )
+    return false;
+
+  socket = nlOpen( (NLushort)port, NL_UNRELIABLE );
+  if ( socket == NL_INVALID )
+    return true;
+
+  gnedbgo1(3, "Registering shared unreliable socket %i", socket);
+  eGen->reg( socket, ReceiveEventListener::sptr( new Listener( this_.lock() ) ) );
+  return false;
+}
+
+void SharedUnreliableSocket::close() {
+  LockMutex lock( sockSync );
+  rawClose();
+}
+
+void SharedUnreliableSocket::rawClose() {
+  if ( socket != NL_INVALID ) {
+    gnedbgo1(3, "Unregistering shared unreliable socket %i", socket);
+    if ( eGen )
+      eGen->unreg( socket );
+    nlClose( socket );
+    socket = NL_INVALID;
+  }
+}
+
+bool SharedUnreliableSocket::isOpen() const {
+  LockMutex lock( sockSync );
+  return socket != NL_INVALID;
+}
+
+Address SharedUnreliableSocket::getLocalAddress() const {
+  LockMutex lock( sockSync );
+
+  if ( socket != NL_INVALID ) {
+    NLaddress ret;
+    nlGetLocalAddr( socket, &ret );
+    return Address( ret );
+  } else {
+    return Address();
+  }
+}
+
+int SharedUnreliableSocket::getConnectionCount() const {
+  LockMutex lock( connSync );
+  return (int)conns.size();
+}
+
+guint32 SharedUnreliableSocket::addConnection( const SmartPtr<Connection>& conn,
+                                               const Address& remote ) {
+  LockMutex lock( connSync );
+
+  //The source IP is checked too, but a host behind the same NAT as the
+  //client must still not be able to guess its token.
+  guint32 token;
+  do {
+    if ( getSecureRandom( &token, sizeof( token ) ) )
+      throw Error( Error::OtherGNELevelError );
+  } while ( token == 0 || conns.find( token ) != conns.end() );
+
+  Entry& e = conns[token];
+  e.conn = conn;
+  e.remote = remote;
+  gnedbgo2(4, "Added connection from %s with token %x",
+           remote.toString().c_str(), token);
+  return token;
+}
+
+void SharedUnreliableSocket::setRemoteAddress( guint32 token,
+                                               const Address& remote ) {
+  LockMutex lock( connSync );
+
+  ConnMapIter iter = conns.find( token );
+  if ( iter != conns.end() )
+    iter->second.remote = remote;
+}
+
+Address SharedUnreliableSocket::getRemoteAddress( guint32 token ) const {
+  LockMutex lock( connSync );
+
+  ConnMap::const_iterator iter = conns.find( token );
+  if ( iter != conns.end() )
+    return iter->second.remote;
+  else
+    return Address();
+}
+
+void SharedUnreliableSocket::removeConnection( guint32 token ) {
+  LockMutex lock( connSync );
+  conns.erase( token );
+}
+
+int SharedUnreliableSocket::write( guint32 token, const Buffer& buf ) {
+  Outgoing out;
+  {
+    LockMutex lock( connSync );
+    ConnMapIter iter = conns.find( token );
+    if ( iter == conns.end() )
+      return NL_INVALID;
+    out.dest = iter->second.remote.getAddress();
+  }
+  out.data.assign( buf.getData(), buf.getData() + buf.getPosition() );
+
+  {
+    LockMutex lock( queueSync );
+    queue.push_back( out );
+    //If another thread is sending, it will send ours too.
+    if ( sending )
+      return buf.getPosition();
+    sending = true;
+  }
+
+  std::vector<Outgoing> batch;
+  queueSync.acquire();
+  while ( !queue.empty() ) {
+    batch.swap( queue );
+    queueSync.release();
+
+    {
+      LockMutex lock( sockSync );
+      for ( size_t i = 0; i < batch.size(); ++i )
+        send( batch[i].dest, &batch[i].data[0], (int)batch[i].data.size() );
+    }
+
+    batch.clear();
+    queueSync.acquire();
+  }
+  sending = false;
+  queueSync.release();
+
+  return buf.getPosition();
+}
+
+void SharedUnreliableSocket::send( const NLaddress& dest, const gbyte* data,
+                                   int length ) {
+  if ( socket == NL_INVALID )
+    return;
+
+  nlSetRemoteAddr( socket, &dest );
+  if ( nlWrite( socket, (const NLvoid*)data, (NLint)length ) == NL_INVALID ) {
+    gnedbgo1(3, "Write on shared unreliable socket failed: %s",
+             LowLevelError().toString().c_str());
+  }
+}
+
+void SharedUnreliableSocket::onReceive() {
+  Buffer buf( Buffer::RAW_PACKET_LEN + TOKEN_LEN );
+  NLaddress from;
+  int read;
+  {
+    LockMutex lock( sockSync );
+    if ( socket == NL_INVALID )
+      return;
+    read = nlRead( socket, (NLvoid*)buf.getData(), (NLint)buf.getCapacity() );
+    if ( read != NL_INVALID )
+      nlGetRemoteAddr( socket, &from );
+  }
+
+  if ( read == NL_INVALID ) {
+    gnedbgo(4, "Ignoring bad read on shared unreliable socket");
+    return;
+  }
+  buf.setLimit( read );
+  process( buf, Address( from ) );
+}
+
+Connection::sptr SharedUnreliableSocket::process( Buffer& buf,
+                                                  const Address& source ) {
+  int bytes = buf.getRemaining() - TOKEN_LEN;
+  if ( bytes < 0 ) {
+    gnedbgo1(4, "Ignoring datagram of %d bytes on shared unreliable socket",
+             buf.getRemaining());
+    return Connection::sptr();
+  }
+
+  guint32 token;
+  buf >> token;
+
+  Connection::sptr conn;
+  {
+    LockMutex lock( connSync );
+    ConnMapIter iter = conns.find( token );
+    if ( iter == conns.end() ) {
+      gnedbgo2(4, "Dropping datagram from %s with unknown token %x",
+               source.toString().c_str(), token);
+      return Connection::sptr();
+    }
+
+    //Only the IP must match, since NATs may change the port.
+    Address expected = iter->second.remote;
+    expected.setPort( source.getPort() );
+    if ( !( expected == source ) ) {
+      gnedbgo2(3, "Dropping datagram from %s with token %x of another host",
+               source.toString().c_str(), token);
+      return Connection::sptr();
+    }
+
+    //Send to wherever the client's data is really coming from.
+    iter->second.remote = source;
+    conn = iter->second.conn.lock();
+  }
+
+  if ( conn )
+    conn->onReceiveShared( buf, bytes );
+  return conn;
+}
+
+} //namespace GNE
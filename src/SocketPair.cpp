@@ -20,11 +20,12 @@
 #include "gneintern.h"
 #include <gnelib/SocketPair.h>
 #include <gnelib/Address.h>
+#include <gnelib/SharedUnreliableSocket.h>
 
 namespace GNE {
 
 SocketPair::SocketPair(NLsocket reliable, NLsocket unreliable)
-: r(reliable), u(unreliable) {
+: r(reliable), u(unreliable), token(0) {
 }
 
 SocketPair::~SocketPair() {
@@ -40,6 +41,11 @@ void SocketPair::disconnect() {
     nlClose(u);
     u = NL_INVALID;
   }
+  if (shared) {
+    shared->removeConnection(token);
+    shared.reset();
+    token = 0;
+  }
 }
 
 Address SocketPair::getLocalAddress(bool reliable) const {
@@ -50,7 +56,9 @@ Address SocketPair::getLocalAddress(bool reliable) const {
     else
       ret.valid = NL_FALSE;
   } else {
-    if (u != NL_INVALID)
+    if (shared)
+      return shared->getLocalAddress();
+    else if (u != NL_INVALID)
       nlGetLocalAddr(u, &ret);
     else
       ret.valid = NL_FALSE;
@@ -66,7 +74,9 @@ Address SocketPair::getRemoteAddress(bool reliable) const {
     else
       ret.valid = NL_FALSE;
   } else {
-    if (u != NL_INVALID)
+    if (shared)
+      return shared->getRemoteAddress(token);
+    else if (u != NL_INVALID)
       nlGetRemoteAddr(u, &ret);
     else
       ret.valid = NL_FALSE;
@@ -113,6 +123,19 @@ int SocketPair::rawRead(bool reliable, Buffer& buf) const {
 }
 
 int SocketPair::rawWrite(bool reliable, const Buffer& buf) const {
+  if (!reliable && shared)
+    return shared->write(token, buf);
+
+  if (!reliable && u != NL_INVALID && token != 0) {
+    Buffer temp(buf.getPosition() + SharedUnreliableSocket::TOKEN_LEN);
+    temp << token;
+    temp.writeRaw(buf.getData(), buf.getPosition());
+    int ret = nlWrite(u, (const NLvoid*)temp.getData(), (NLint)temp.getPosition());
+    if (ret != NL_INVALID)
+      ret -= SharedUnreliableSocket::TOKEN_LEN;
+    return ret;
+  }
+
   NLsocket act;
   if (reliable)
     act = r;
@@ -89,7 +89,7 @@ void SyncConnection::connect() {
   sptr temp = thisPtr.lock();
   assert( temp );
   cliConn->connect( temp );
-  cliConn->join();
+  cliConn->waitForConnect();
   checkError();
 }
 
@@ -152,16 +152,17 @@ void SyncConnection::doRelease() {
       throw currError;
     }
 
-    //Notify the old listener for onReceive and onDoneWriting if needed, and
-    //there are no errors that invalidated the stream (detected above).
+    //Start the events up again knowing that if there was a failure that
+    //onDisconnect will go to the original listener.
+    conn->setListener(oldListener);
+
+    //Then notify the old listener for onReceive if packets came while we
+    //held the events, and there are no errors that invalidated the stream
+    //(detected above).  Doing this before setListener could let the event
+    //thread hand the event to us instead, and the packets would wait for
+    //the next one.
     if (conn->stream().isNextPacket())
       conn->onReceive();
-
-    //Then we can start the events up again knowing that if there was a
-    //failure that onDisconnect will go to the original listener.
-    conn->setListener(oldListener);
-    //From this point we cannot access conn as once onDisconnect is called
-    //conn could be deleted at any time.
   }
 }
 
@@ -172,10 +173,8 @@ bool SyncConnection::isReleased() const {
 /**
  * \todo consider timed waits in the future, but this won't be needed when
  *       the %GNE protocol implementation is finished and detects timeouts.
- * \todo This probably could be optimized quite a bit -- each packet gets
- *       copied twice!
  */
-SyncConnection& SyncConnection::operator >> (Packet& packet) {
+Packet::sptr SyncConnection::waitForPacket() {
   //We have to acquire the mutex now so that an error cannot occur between
   //checkError and our wait.
   {
@@ -191,21 +190,34 @@ SyncConnection& SyncConnection::operator >> (Packet& packet) {
   }
 
   //Now that we have some data, do the actual receiving.
-  Packet* recv = conn->stream().getNextPacket();
-  assert(recv != NULL);  //There had better be some data!
-  if (recv->getType() != packet.getType()) {
+  Packet::sptr recv = conn->stream().getNextPacketSp();
+  assert(recv);  //There had better be some data!
+  return recv;
+}
+
+void SyncConnection::checkPacketType( const Packet& packet, int expectedType ) {
+  if (packet.getType() != expectedType) {
     gnedbgo2(1, "Packet type mismatch.  Got %d, expected %d.",
-                recv->getType(), packet.getType());
-    throw PacketTypeMismatch( recv->getType() );
+                packet.getType(), expectedType);
+    throw PacketTypeMismatch( packet.getType() );
   }
+}
+
+Packet::sptr SyncConnection::receivePacket() {
+  return waitForPacket();
+}
+
+SyncConnection& SyncConnection::operator >> (Packet& packet) {
+  Packet::sptr recv = waitForPacket();
+  checkPacketType( *recv, packet.getType() );
 
   //Copy the packet.
   //The original method was to use operator=() but doing it this way makes
   //things complicated in several ways, including how to overload it, and the
   //fact that you can't copy the children to children w/o another operator.
-  //This should be optimized in the future.  This new method will be easier
-  //to optimize later to allow better optimizations.
-  Buffer temp;
+  //Callers that want to avoid this copy should use receive or receivePacket,
+  //which hand back the parsed packet itself.
+  Buffer temp( recv->getSize() );
   recv->writePacket(temp);
   temp.flip();
   NLubyte dummy;
@@ -0,0 +1,100 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/UpdateScheduler.h>
+#include <gnelib/PacketStream.h>
+#include <algorithm>
+
+namespace GNE {
+
+UpdateScheduler::UpdateScheduler() {
+}
+
+UpdateScheduler::~UpdateScheduler() {
+}
+
+int UpdateScheduler::getTickBudget( const PacketStream& ps,
+                                    int ticksPerSecond ) {
+  assert( ticksPerSecond > 0 );
+  int rate = ps.getCurrOutRate();
+  return ( rate == 0 ) ? -1 : rate / ticksPerSecond;
+}
+
+void UpdateScheduler::setWeight( int objectId, float weight ) {
+  entries[objectId].weight = weight;
+}
+
+float UpdateScheduler::getPriority( int objectId ) const {
+  std::map<int, Entry>::const_iterator iter = entries.find( objectId );
+  return ( iter == entries.end() ) ? 0.0f : iter->second.priority;
+}
+
+int UpdateScheduler::getObjectCount() const {
+  return (int)entries.size();
+}
+
+void UpdateScheduler::accumulate( const std::set<int>& objectIds ) {
+  //Both are sorted by ID, so they are walked together.
+  std::map<int, Entry>::iterator entry = entries.begin();
+  std::set<int>::const_iterator id = objectIds.begin();
+  while ( id != objectIds.end() ) {
+    if ( entry == entries.end() || *id < entry->first ) {
+      entry = entries.insert( entry, std::make_pair( *id, Entry() ) );
+    } else if ( entry->first < *id ) {
+      entries.erase( entry++ );
+      continue;
+    }
+    entry->second.priority += entry->second.weight;
+    ++entry;
+    ++id;
+  }
+  entries.erase( entry, entries.end() );
+}
+
+namespace {
+  struct HigherPriority {
+    bool operator()( const std::pair<float, int>& a,
+                     const std::pair<float, int>& b ) const {
+      return a.first > b.first || ( a.first == b.first && a.second < b.second );
+    }
+  };
+}
+
+void UpdateScheduler::getOrder( std::vector<int>& out ) const {
+  std::vector<std::pair<float, int> > order;
+  order.reserve( entries.size() );
+  for ( std::map<int, Entry>::const_iterator iter = entries.begin();
+        iter != entries.end(); ++iter )
+    if ( iter->second.priority > 0.0f )
+      order.push_back( std::make_pair( iter->second.priority, iter->first ) );
+  std::sort( order.begin(), order.end(), HigherPriority() );
+
+  out.reserve( out.size() + order.size() );
+  for ( size_t i = 0; i < order.size(); ++i )
+    out.push_back( order[i].second );
+}
+
+void UpdateScheduler::sent( int objectId ) {
+  std::map<int, Entry>::iterator iter = entries.find( objectId );
+  if ( iter != entries.end() )
+    iter->second.priority = 0.0f;
+}
+
+} //namespace GNE
@@ -0,0 +1,182 @@
+/* GNE - Game Networking Engine, a portable multithreaded networking library.
+ * Copyright (C) 2001-2006 Jason Winnebeck 
+ * Project website: http://www.gillius.org/gne/
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gneintern.h"
+#include <gnelib/WorkerPool.h>
+#include <gnelib/Lock.h>
+
+namespace GNE {
+
+class WorkerPool::Worker : public Thread {
+public:
+  typedef SmartPtr<Worker> sptr;
+
+  static sptr create( WorkerPool& pool, int queue ) {
+    sptr ret( new Worker( pool, queue ) );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void shutDown() {
+    Thread::shutDown();
+    LockCV lock( pool.runSync );
+    pool.stopping = true;
+    pool.runSync.broadcast();
+  }
+
+protected:
+  void run() {
+    pool.work( queue );
+  }
+
+private:
+  Worker( WorkerPool& pool, int queue )
+    : Thread( "PoolThr" ), pool( pool ), queue( queue ) {
+  }
+
+  WorkerPool& pool;
+  int queue;
+};
+
+WorkerPool::Job::~Job() {
+}
+
+WorkerPool::WorkerPool( int threads )
+: run( 0 ), remaining( 0 ), stopping( false ), failed( false ) {
+  assert( threads >= 0 );
+  for ( int i = 0; i <= threads; ++i )
+    queues.push_back( new Queue() );
+  for ( int i = 0; i < threads; ++i ) {
+    Worker::sptr worker = Worker::create( *this, i );
+    workers.push_back( worker );
+    worker->start();
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    LockCV lock( runSync );
+    stopping = true;
+    runSync.broadcast();
+  }
+  for ( size_t i = 0; i < workers.size(); ++i )
+    workers[i]->join();
+  for ( size_t i = 0; i < queues.size(); ++i )
+    delete queues[i];
+}
+
+int WorkerPool::getThreadCount() const {
+  return (int)workers.size();
+}
+
+void WorkerPool::runAll( const std::vector<Job*>& jobs ) {
+  if ( jobs.empty() )
+    return;
+
+  {
+    LockCV lock( runSync );
+    assert( remaining == 0 );
+    remaining = (int)jobs.size();
+    failed = false;
+
+    //Deal the jobs out so each queue starts with about the same number.
+    for ( size_t i = 0; i < jobs.size(); ++i ) {
+      Queue& q = *queues[i % queues.size()];
+      LockMutex qlock( q.sync );
+      q.jobs.push_back( jobs[i] );
+    }
+    ++run;
+    runSync.broadcast();
+  }
+
+  int self = (int)queues.size() - 1;
+  while ( runOne( self ) ) {
+  }
+
+  LockCV lock( runSync );
+  while ( remaining > 0 )
+    runSync.wait();
+  if ( failed )
+    throw error;
+}
+
+bool WorkerPool::runOne( int queue ) {
+  Job* job = NULL;
+  {
+    Queue& own = *queues[queue];
+    LockMutex lock( own.sync );
+    if ( !own.jobs.empty() ) {
+      job = own.jobs.back();
+      own.jobs.pop_back();
+    }
+  }
+  //Steal from the other queues, oldest job first.
+  for ( size_t i = 1; job == NULL && i < queues.size(); ++i ) {
+    Queue& other = *queues[( queue + i ) % queues.size()];
+    LockMutex lock( other.sync );
+    if ( !other.jobs.empty() ) {
+      job = other.jobs.front();
+      other.jobs.pop_front();
+    }
+  }
+  if ( job == NULL )
+    return false;
+
+  Error jobError;
+  bool jobFailed = false;
+  try {
+    job->run();
+  } catch ( Error& e ) {
+    jobError = e;
+    jobFailed = true;
+  } catch ( ... ) {
+    //Anything else can't be carried to the caller as is, but it must still
+    //count the job as done and fail the run, or runAll would never return.
+    gnedbg(1, "A WorkerPool job threw something other than an Error.");
+    jobError = Error( Error::OtherGNELevelError );
+    jobFailed = true;
+  }
+
+  LockCV lock( runSync );
+  if ( jobFailed && !failed ) {
+    error = jobError;
+    failed = true;
+  }
+  if ( --remaining == 0 )
+    runSync.broadcast();
+  return true;
+}
+
+void WorkerPool::work( int queue ) {
+  int seen = 0;
+  while ( true ) {
+    {
+      LockCV lock( runSync );
+      while ( !stopping && run == seen )
+        runSync.wait();
+      if ( stopping )
+        return;
+      seen = run;
+    }
+    while ( runOne( queue ) ) {
+    }
+  }
+}
+
+} //namespace GNE
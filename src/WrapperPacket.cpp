@@ -21,66 +21,166 @@
 #include <gnelib/WrapperPacket.h>
 #include <gnelib/PacketParser.h>
 #include <gnelib/Buffer.h>
+#include <gnelib/Errors.h>
 
 namespace GNE {
-  
-WrapperPacket::WrapperPacket( int id ) : Packet( id ), packet( NULL ) {
+
+const int WrapperPacket::OPAQUE_ID = 15;
+
+WrapperPacket::WrapperPacket( int id )
+: Packet( id ), packet( NULL ), opaque( false ) {
 }
 
 WrapperPacket::WrapperPacket( int id, const Packet* packet )
-: Packet( id ), packet( NULL ) {
+: Packet( id ), packet( NULL ), opaque( false ) {
   setData( packet );
 }
 
-WrapperPacket::WrapperPacket( const WrapperPacket& o ) : Packet( o ) {
-  if ( o.getData() != NULL )
-    packet = o.getData()->makeClone();
-  else
-    packet = NULL;
+WrapperPacket::WrapperPacket( const WrapperPacket& o )
+: Packet( o ), packet( NULL ), rawData( o.rawData ), opaque( o.opaque ) {
+  //If we have the raw form, we don't need to clone the parsed form.
+  if ( rawData.empty() && o.packet != NULL )
+    packet = o.packet->makeClone();
 }
 
 WrapperPacket::~WrapperPacket() {
+  delete packet;
 }
 
 int WrapperPacket::getSize() const {
   int temp = 1;
-  if ( packet != NULL )
+  if ( !rawData.empty() )
+    temp = (int)rawData.size();
+  else if ( packet != NULL )
     temp = packet->getSize();
+
+  if ( opaque && hasData() )
+    temp += Buffer::getSizeOf( (guint8)OPAQUE_ID ) + Buffer::getSizeOf( (guint16)0 );
+
   return Packet::getSize() + temp;
 }
 
+bool WrapperPacket::hasData() const {
+  return packet != NULL || !rawData.empty();
+}
+
+void WrapperPacket::parseData() const {
+  if ( packet == NULL && !rawData.empty() ) {
+    Buffer temp( (int)rawData.size() );
+    temp.writeRaw( &rawData[0], (int)rawData.size() );
+    temp.flip();
+    packet = PacketParser::parseNextPacket( temp );
+  }
+}
+
 const Packet* WrapperPacket::getData() const {
+  parseData();
   return packet;
 }
 
 Packet* WrapperPacket::getData() {
+  parseData();
+  rawData.clear();
   return packet;
 }
 
+Packet* WrapperPacket::releaseData() {
+  parseData();
+  rawData.clear();
+  Packet* ret = packet;
+  packet = NULL;
+  return ret;
+}
+
 void WrapperPacket::setData( const Packet* packet ) {
   delete this->packet;
+  rawData.clear();
   if ( packet != NULL )
     this->packet = packet->makeClone();
   else
     this->packet = NULL;
 }
 
+bool WrapperPacket::isOpaque() const {
+  return opaque;
+}
+
+void WrapperPacket::setOpaque( bool opaque ) {
+  this->opaque = opaque;
+}
+
 void WrapperPacket::writePacket(Buffer& raw) const {
   Packet::writePacket( raw );
-  if ( packet != NULL )
-    packet->writePacket( raw );
-  else
+  if ( !hasData() ) {
     raw << PacketParser::END_OF_PACKET;
+    return;
+  }
+
+  int lenPos = 0;
+  if ( opaque ) {
+    raw << (guint8)OPAQUE_ID;
+    lenPos = raw.getPosition();
+    raw << (guint16)0; //placeholder for the length
+  }
+
+  int start = raw.getPosition();
+  if ( !rawData.empty() )
+    raw.writeRaw( &rawData[0], (int)rawData.size() );
+  else
+    packet->writePacket( raw );
+
+  if ( opaque ) {
+    //getSize can overestimate, so we fill in the length after writing.
+    int end = raw.getPosition();
+    raw.setPosition( lenPos );
+    raw << (guint16)(end - start);
+    raw.setPosition( end );
+  }
 }
 
 void WrapperPacket::readPacket(Buffer& raw) {
   Packet::readPacket( raw );
-  packet = PacketParser::parseNextPacket( raw );
+  delete packet;
+  packet = NULL;
+  rawData.clear();
+
+  guint8 nextId;
+  raw >> nextId;
+  if ( nextId == OPAQUE_ID ) {
+    opaque = true;
+    guint16 len;
+    raw >> len;
+    if ( len > 0 ) {
+      //readRaw checks that len bytes remain.
+      rawData.resize( len );
+      raw.readRaw( &rawData[0], len );
+    }
+  } else {
+    opaque = false;
+    raw.setPosition( raw.getPosition() - 1 );
+
+    //Use the non-throwing parse so that we honor raw's exception setting.
+    int id;
+    Error::ErrorCode code = PacketParser::tryParseNextPacket( raw, packet, id );
+    if ( code == Error::UnknownPacket )
+      raw.failUnknownPacket( id );
+    else if ( code != Error::NoError )
+      raw.failRead( code );
+  }
 }
 
 WrapperPacket& WrapperPacket::operator= ( const WrapperPacket& rhs ) {
-  Packet::operator =( rhs );
-  setData( rhs.getData() );
+  if ( this != &rhs ) {
+    Packet::operator =( rhs );
+    opaque = rhs.opaque;
+    if ( !rhs.rawData.empty() ) {
+      delete packet;
+      packet = NULL;
+      rawData = rhs.rawData;
+    } else {
+      setData( rhs.packet );
+    }
+  }
   return *this;
 }
 
@@ -78,6 +78,7 @@
 
 namespace GNE {
   class ConnectionEventGenerator;
+  class HandshakeQueue;
   template <class T> class SmartPtr;
 
   /**
@@ -86,6 +87,31 @@ namespace GNE {
    * this object under any normal circumstances.
    */
   extern SmartPtr<ConnectionEventGenerator> eGen;
+
+  /**
+   * The global queue that runs the steps of event driven handshakes.
+   */
+  extern SmartPtr<HandshakeQueue> handshakes;
+
+  /**
+   * The global queue that connects the sockets of event driven connects,
+   * which blocks, so it is kept off of handshakes.
+   */
+  extern SmartPtr<HandshakeQueue> connects;
+
+  /**
+   * The global queue that runs the server's side of event driven
+   * handshakes, apart from handshakes so a flood of clients cannot hold up
+   * our own connects.
+   */
+  extern SmartPtr<HandshakeQueue> serverHandshakes;
+
+  /**
+   * Fills buf with len bytes from the system's cryptographically secure
+   * random source, for secrets that remote hosts must not be able to guess.
+   * Returns true on error, when the source could not be read.
+   */
+  bool getSecureRandom( void* buf, int len );
 };
 
 #endif // _GNEINTERN_H_
@@ -3,6 +3,17 @@
 
 #include <iostream>
 #include <gnelib.h>
+#include <gnelib/ChannelPacket.h>
+#include <gnelib/RateAdjustPacket.h>
+#include <gnelib/ReliablePacket.h>
+#include <gnelib/ReliableStreams.h>
+#include <gnelib/ParityFec.h>
+#include <gnelib/FrameCompressor.h>
+#include <gnelib/MessageFragmenter.h>
+#include <gnelib/ObjectIdTable.h>
+#include <gnelib/HandshakeQueue.h>
+#include <gnelib/ConnectionEventGenerator.h>
+#include <gnelib/ReceiveEventListener.h>
 
 using namespace std;
 using namespace GNE;
@@ -85,4 +96,2403 @@ BOOST_AUTO_TEST_CASE( gne_first_packet ) {
   BOOST_CHECK_EQUAL_COLLECTIONS( data, data+expectedSize, expected, expected+expectedSize );
 
   GNE::shutdownGNE();
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE( opaque_channel_packet_relay ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  //A ChannelPacket in opaque mode holding packet type 200, which is not
+  //registered, followed by channel 3 and source 4.
+  gbyte wire[] = { (gbyte)ChannelPacket::ID, (gbyte)WrapperPacket::OPAQUE_ID,
+    3, 0, 200, 1, 2, 3, 4 };
+  int wireSize = sizeof(wire)/sizeof(wire[0]);
+
+  Buffer in;
+  in.writeRaw( wire, wireSize );
+  in << PacketParser::END_OF_PACKET;
+  in.flip();
+
+  Packet* p = PacketParser::parseNextPacket( in );
+  BOOST_REQUIRE( p != NULL );
+  BOOST_REQUIRE_EQUAL( ChannelPacket::ID, p->getType() );
+  ChannelPacket* cp = static_cast<ChannelPacket*>( p );
+  BOOST_CHECK( cp->hasData() );
+  BOOST_CHECK( cp->isOpaque() );
+  BOOST_CHECK_EQUAL( 3, cp->getChannel() );
+  BOOST_CHECK_EQUAL( 4, cp->getSource() );
+
+  //Forwarding a clone must reproduce the original bytes exactly.
+  Packet* fwd = cp->makeClone();
+  BOOST_CHECK_EQUAL( wireSize, fwd->getSize() );
+  Buffer out;
+  out << *fwd;
+  BOOST_CHECK_EQUAL_COLLECTIONS( out.getData(), out.getData() + out.getPosition(),
+                                 wire, wire + wireSize );
+
+  PacketParser::destroyPacket( fwd );
+  PacketParser::destroyPacket( p );
+
+  //A registered packet in opaque mode can still be decoded on demand.
+  CustomPacket custom;
+  custom.getBuffer() << (guint32)0x11223344;
+  ChannelPacket sent( 1, 2, custom );
+  sent.setOpaque( true );
+  Buffer buf;
+  buf << sent;
+  buf.flip();
+  p = PacketParser::parseNextPacket( buf );
+  BOOST_REQUIRE( p != NULL );
+  const ChannelPacket* recv = static_cast<const ChannelPacket*>( p );
+  BOOST_REQUIRE( recv->getData() != NULL );
+  BOOST_CHECK_EQUAL( CustomPacket::ID, recv->getData()->getType() );
+  PacketParser::destroyPacket( p );
+
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( parse_malformed_without_exceptions ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  Packet* packet;
+  int id;
+
+  //A CustomPacket claiming more data than the buffer holds.
+  Buffer truncated;
+  truncated << (guint8)CustomPacket::ID << (guint16)100 << (guint32)0;
+  truncated.flip();
+  BOOST_CHECK_EQUAL( Error::BufferUnderflow,
+    PacketParser::tryParseNextPacket( truncated, packet, id ) );
+  BOOST_CHECK( packet == NULL );
+  BOOST_CHECK_EQUAL( CustomPacket::ID, id );
+  BOOST_CHECK( truncated.getReadExceptions() );
+
+  //The throwing interface still throws for the same data.
+  truncated.rewind();
+  truncated.clearReadError();
+  BOOST_CHECK_THROW( PacketParser::parseNextPacket( truncated ), BufferError );
+
+  Buffer unknown;
+  unknown << (guint8)200 << PacketParser::END_OF_PACKET;
+  unknown.flip();
+  BOOST_CHECK_EQUAL( Error::UnknownPacket,
+    PacketParser::tryParseNextPacket( unknown, packet, id ) );
+  BOOST_CHECK_EQUAL( 200, id );
+
+  //An unknown packet inside a ChannelPacket is reported by its own ID.
+  Buffer wrapped;
+  wrapped << (guint8)ChannelPacket::ID << (guint8)201
+          << PacketParser::END_OF_PACKET;
+  wrapped.flip();
+  BOOST_CHECK_EQUAL( Error::UnknownPacket,
+    PacketParser::tryParseNextPacket( wrapped, packet, id ) );
+  BOOST_CHECK( packet == NULL );
+  BOOST_CHECK_EQUAL( 201, id );
+  wrapped.rewind();
+  wrapped.clearReadError();
+  BOOST_CHECK_THROW( PacketParser::parseNextPacket( wrapped ), UnknownPacket );
+
+  Buffer valid;
+  valid << RateAdjustPacket() << PacketParser::END_OF_PACKET;
+  valid.flip();
+  BOOST_CHECK_EQUAL( Error::NoError,
+    PacketParser::tryParseNextPacket( valid, packet, id ) );
+  BOOST_REQUIRE( packet != NULL );
+  BOOST_CHECK_EQUAL( RateAdjustPacket::ID, packet->getType() );
+  PacketParser::destroyPacket( packet );
+  BOOST_CHECK_EQUAL( Error::NoError,
+    PacketParser::tryParseNextPacket( valid, packet, id ) );
+  BOOST_CHECK( packet == NULL );
+
+  GNE::shutdownGNE();
+}
+
+/**
+ * A SharedUnreliableSocket that keeps what it sends instead of using a
+ * socket, and can hold the thread sending until released.
+ */
+class TestSharedSocket : public SharedUnreliableSocket {
+public:
+  static SmartPtr<TestSharedSocket> create() {
+    SmartPtr<TestSharedSocket> ret( new TestSharedSocket() );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  using SharedUnreliableSocket::addConnection;
+  using SharedUnreliableSocket::getRemoteAddress;
+  using SharedUnreliableSocket::removeConnection;
+  using SharedUnreliableSocket::write;
+
+  void send( const NLaddress& dest, const gbyte* data, int length ) {
+    LockCV lock( sync );
+    Buffer buf( length );
+    buf.writeRaw( data, length );
+    buf.flip();
+    gint32 value;
+    buf >> value;
+    values.push_back( value );
+    dests.push_back( Address( dest ) );
+    senders.push_back( Thread::currentThread() );
+    sync.broadcast();
+    while ( holding )
+      sync.wait();
+  }
+
+  /**
+   * Waits up to about 5 seconds for count datagrams to be sent.
+   */
+  bool waitForSent( size_t count ) {
+    LockCV lock( sync );
+    for ( int i = 0; i < 100 && values.size() < count; ++i )
+      sync.timedWait( 50 );
+    return values.size() >= count;
+  }
+
+  void release() {
+    LockCV lock( sync );
+    holding = false;
+    sync.broadcast();
+  }
+
+  ConditionVariable sync;
+  bool holding;
+  std::vector<gint32> values;
+  std::vector<Address> dests;
+  std::vector<Thread::sptr> senders;
+
+private:
+  TestSharedSocket() : holding( false ) {}
+};
+
+/**
+ * Writes a value to a connection of a SharedUnreliableSocket on its own
+ * thread.
+ */
+class SharedWriter : public Thread {
+public:
+  static SmartPtr<SharedWriter> create( TestSharedSocket& socket,
+                                        guint32 token, gint32 value ) {
+    SmartPtr<SharedWriter> ret( new SharedWriter( socket, token, value ) );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+protected:
+  void run() {
+    Buffer buf;
+    buf << value;
+    socket.write( token, buf );
+  }
+
+private:
+  SharedWriter( TestSharedSocket& socket, guint32 token, gint32 value )
+    : Thread( "SharedWr" ), socket( socket ), token( token ), value( value ) {}
+
+  TestSharedSocket& socket;
+  guint32 token;
+  gint32 value;
+};
+
+static Connection::sptr processShared( SharedUnreliableSocket& shared,
+                                       guint32 token, const char* from ) {
+  Buffer buf;
+  buf << token << (gint32)1;
+  buf.flip();
+  return shared.process( buf, Address( from ) );
+}
+
+BOOST_AUTO_TEST_CASE( shared_unreliable_socket_demuxes_and_batches ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+
+  SmartPtr<TestSharedSocket> shared = TestSharedSocket::create();
+  Connection::sptr a = ClientConnection::create();
+  Connection::sptr b = ClientConnection::create();
+  guint32 ta = shared->addConnection( a, Address( "10.0.0.1:5000" ) );
+  guint32 tb = shared->addConnection( b, Address( "10.0.0.2:5000" ) );
+  BOOST_CHECK( ta != 0 && tb != 0 && ta != tb );
+  BOOST_CHECK_EQUAL( 2, shared->getConnectionCount() );
+
+  //Each datagram goes to the connection its token names.
+  BOOST_CHECK( processShared( *shared, ta, "10.0.0.1:5000" ) == a );
+  BOOST_CHECK( processShared( *shared, tb, "10.0.0.2:5000" ) == b );
+
+  //Another port of the client's host, as through a NAT, is accepted, and
+  //data for the client is sent there after.
+  BOOST_CHECK( processShared( *shared, tb, "10.0.0.2:6000" ) == b );
+  BOOST_CHECK( shared->getRemoteAddress( tb ) == Address( "10.0.0.2:6000" ) );
+
+  //A good token from another host is dropped, and does not move where the
+  //client's data is sent.
+  BOOST_CHECK( !processShared( *shared, ta, "10.0.0.9:5000" ) );
+  BOOST_CHECK( shared->getRemoteAddress( ta ) == Address( "10.0.0.1:5000" ) );
+
+  //So are unknown tokens and datagrams too short to hold one.
+  guint32 unknown = 1;
+  while ( unknown == ta || unknown == tb )
+    ++unknown;
+  BOOST_CHECK( !processShared( *shared, unknown, "10.0.0.1:5000" ) );
+  Buffer tooShort;
+  tooShort << (gbyte)1;
+  tooShort.flip();
+  BOOST_CHECK( !shared->process( tooShort, Address( "10.0.0.1:5000" ) ) );
+
+  //Whichever thread finds the queue idle sends it all.  While the writer
+  //is held sending its datagram, ours are only queued, and it sends them
+  //after.
+  shared->holding = true;
+  SmartPtr<SharedWriter> writer = SharedWriter::create( *shared, ta, 10 );
+  writer->start();
+  BOOST_REQUIRE( shared->waitForSent( 1 ) );
+  Buffer buf;
+  buf << (gint32)11;
+  BOOST_CHECK_EQUAL( 4, shared->write( tb, buf ) );
+  buf.clear();
+  buf << (gint32)12;
+  BOOST_CHECK_EQUAL( 4, shared->write( ta, buf ) );
+  BOOST_CHECK_EQUAL( NL_INVALID, shared->write( unknown, buf ) );
+  {
+    LockCV lock( shared->sync );
+    BOOST_CHECK_EQUAL( 1u, shared->values.size() );
+  }
+  shared->release();
+  writer->join();
+
+  BOOST_REQUIRE_EQUAL( 3u, shared->values.size() );
+  const gint32 values[] = { 10, 11, 12 };
+  const char* dests[] = { "10.0.0.1:5000", "10.0.0.2:6000", "10.0.0.1:5000" };
+  for ( int i = 0; i < 3; ++i ) {
+    BOOST_CHECK_EQUAL( values[i], shared->values[i] );
+    BOOST_CHECK( shared->dests[i] == Address( dests[i] ) );
+    BOOST_CHECK( shared->senders[i] == writer );
+  }
+
+  shared->removeConnection( ta );
+  BOOST_CHECK_EQUAL( 1, shared->getConnectionCount() );
+  shared->senders.clear();
+  GNE::shutdownGNE();
+}
+
+//Sends a packet through a Buffer, as it would be over the network.
+static Packet* sendThroughBuffer( Packet* p ) {
+  Buffer buf;
+  buf << *p << PacketParser::END_OF_PACKET;
+  buf.flip();
+  PacketParser::destroyPacket( p );
+  return PacketParser::parseNextPacket( buf );
+}
+
+static guint32 customValue( Packet* p ) {
+  guint32 ret;
+  Buffer& buf = static_cast<CustomPacket*>( p )->getBuffer();
+  buf.flip();
+  buf >> ret;
+  PacketParser::destroyPacket( p );
+  return ret;
+}
+
+BOOST_AUTO_TEST_CASE( reliable_streams_recover_loss ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  ReliableStreams sender, receiver;
+  for ( guint32 i = 0; i < 6; ++i ) {
+    CustomPacket p;
+    p.getBuffer() << i;
+    //0 to 3 are ordered on stream 0, and 4 and 5 unordered on stream 1.
+    sender.write( p, (i < 4) ? 0 : 1, i < 4 );
+  }
+
+  Time now = Timer::getCurrentTime();
+  vector<Packet*> toSend, delivered;
+  BOOST_REQUIRE( sender.poll( now, toSend ) );
+  BOOST_REQUIRE_EQUAL( 6u, toSend.size() );
+
+  //Lose the second packet.  The rest of stream 0 must wait for it, but
+  //stream 1 must not.
+  for ( size_t i = 0; i < toSend.size(); ++i ) {
+    Packet* p = sendThroughBuffer( toSend[i] );
+    BOOST_REQUIRE_EQUAL( ReliablePacket::ID, p->getType() );
+    if ( i == 1 )
+      PacketParser::destroyPacket( p );
+    else
+      receiver.receive( static_cast<ReliablePacket*>( p ), now, delivered );
+  }
+  BOOST_REQUIRE_EQUAL( 3u, delivered.size() );
+  BOOST_CHECK_EQUAL( 0u, customValue( delivered[0] ) );
+  BOOST_CHECK_EQUAL( 4u, customValue( delivered[1] ) );
+  BOOST_CHECK_EQUAL( 5u, customValue( delivered[2] ) );
+  delivered.clear();
+
+  //The acknowledgement lets the sender resend only the lost packet.
+  toSend.clear();
+  receiver.poll( now, toSend );
+  BOOST_REQUIRE_EQUAL( 1u, toSend.size() );
+  now += 10000;
+  sender.receive( static_cast<ReliablePacket*>( sendThroughBuffer( toSend[0] ) ),
+                  now, delivered );
+  BOOST_CHECK_EQUAL( 1, sender.getUnackedCount() );
+  BOOST_CHECK( sender.getRtt() > 0 );
+
+  toSend.clear();
+  now += 5000000;
+  BOOST_REQUIRE( sender.poll( now, toSend ) );
+  BOOST_REQUIRE_EQUAL( 1u, toSend.size() );
+  receiver.receive( static_cast<ReliablePacket*>( sendThroughBuffer( toSend[0] ) ),
+                    now, delivered );
+  BOOST_REQUIRE_EQUAL( 3u, delivered.size() );
+  for ( guint32 i = 0; i < 3; ++i )
+    BOOST_CHECK_EQUAL( i + 1, customValue( delivered[i] ) );
+  delivered.clear();
+
+  toSend.clear();
+  receiver.poll( now, toSend );
+  BOOST_REQUIRE_EQUAL( 1u, toSend.size() );
+  sender.receive( static_cast<ReliablePacket*>( sendThroughBuffer( toSend[0] ) ),
+                  now, delivered );
+  BOOST_CHECK_EQUAL( 0, sender.getUnackedCount() );
+  BOOST_CHECK( delivered.empty() );
+
+  GNE::shutdownGNE();
+}
+
+static ReliablePacket* streamPacket( guint32 value, guint16 seq,
+                                     guint16 streamSeq ) {
+  CustomPacket p;
+  p.getBuffer() << value;
+  ReliablePacket* ret = new ReliablePacket( p, 0, true );
+  ret->setSequence( seq );
+  ret->setStreamSequence( streamSeq );
+  return ret;
+}
+
+BOOST_AUTO_TEST_CASE( reliable_streams_reject_out_of_window ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  ReliableStreams receiver;
+  Time now = Timer::getCurrentTime();
+  vector<Packet*> delivered;
+
+  //Stream sequence numbers far ahead or behind are dropped, and so is a
+  //second packet for a stream sequence number already waiting.
+  receiver.receive( streamPacket( 100, 0, 5000 ), now, delivered );
+  receiver.receive( streamPacket( 101, 1, 0xffff ), now, delivered );
+  receiver.receive( streamPacket( 1, 2, 1 ), now, delivered );
+  receiver.receive( streamPacket( 102, 3, 1 ), now, delivered );
+  BOOST_CHECK( delivered.empty() );
+
+  receiver.receive( streamPacket( 0, 4, 0 ), now, delivered );
+  BOOST_REQUIRE_EQUAL( 2u, delivered.size() );
+  BOOST_CHECK_EQUAL( 0u, customValue( delivered[0] ) );
+  BOOST_CHECK_EQUAL( 1u, customValue( delivered[1] ) );
+
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( parity_fec_rebuilds_lost_frame ) {
+  ParityFecEncoder encoder;
+  ParityFecDecoder decoder;
+  encoder.setGroupSize( 3 );
+
+  //Frames of different lengths, so the rebuilt length is checked too.
+  Buffer frames[3];
+  Buffer parity;
+  for ( int i = 0; i < 3; ++i ) {
+    encoder.beginFrame( frames[i] );
+    for ( int j = 0; j <= i * 5; ++j )
+      frames[i] << (guint8)( i * 16 + j );
+    frames[i] << PacketParser::END_OF_PACKET;
+    BOOST_CHECK_EQUAL( i == 2, encoder.endFrame( frames[i], parity ) );
+  }
+  parity.flip();
+
+  //Lose the middle frame.
+  Buffer recovered;
+  frames[0].flip();
+  BOOST_CHECK_EQUAL( ParityFecDecoder::Data, decoder.receive( frames[0], recovered ) );
+  BOOST_CHECK_EQUAL( 0, frames[0].getPosition() - ParityFecEncoder::HEADER_LEN );
+  frames[2].flip();
+  BOOST_CHECK_EQUAL( ParityFecDecoder::Data, decoder.receive( frames[2], recovered ) );
+  BOOST_CHECK_EQUAL( ParityFecDecoder::Recovered, decoder.receive( parity, recovered ) );
+
+  frames[1].flip();
+  frames[1].setPosition( ParityFecEncoder::HEADER_LEN );
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+    recovered.getData(), recovered.getData() + recovered.getLimit(),
+    frames[1].getData() + frames[1].getPosition(),
+    frames[1].getData() + frames[1].getLimit() );
+  BOOST_CHECK_EQUAL( 1, decoder.getRecoveredCount() );
+
+  //The lost frame arriving late is a duplicate of the rebuilt one.
+  frames[1].rewind();
+  BOOST_CHECK_EQUAL( ParityFecDecoder::Invalid, decoder.receive( frames[1], recovered ) );
+}
+
+BOOST_AUTO_TEST_CASE( frame_compressor_round_trip ) {
+  //A frame with the repetition typical of game state.
+  Buffer raw;
+  for ( int i = 0; i < 40; ++i )
+    raw << (guint8)7 << (guint16)( i % 4 ) << (gsingle)1.5f;
+  raw << PacketParser::END_OF_PACKET;
+
+  for ( int pass = 0; pass < 2; ++pass ) {
+    //The second pass uses a dictionary of the same data.
+    if ( pass == 1 )
+      FrameCompressor::setDictionary( raw.getData(), raw.getPosition() );
+    FrameCompressor compressor;
+    compressor.setUseDictionary( pass == 1 );
+
+    Buffer packed;
+    BOOST_REQUIRE( compressor.compress( raw, packed ) );
+    BOOST_CHECK( packed.getPosition() < raw.getPosition() );
+    packed.flip();
+    BOOST_CHECK_EQUAL( FrameCompressor::FRAME_ID, (int)packed.getData()[0] );
+
+    Buffer unpacked;
+    BOOST_REQUIRE( compressor.decompress( packed, unpacked ) );
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+      unpacked.getData(), unpacked.getData() + unpacked.getLimit(),
+      raw.getData(), raw.getData() + raw.getPosition() );
+
+    //A truncated frame is rejected.
+    packed.rewind();
+    packed.setLimit( packed.getLimit() - 1 );
+    BOOST_CHECK( !compressor.decompress( packed, unpacked ) );
+  }
+  FrameCompressor::setDictionary( NULL, 0 );
+  BOOST_CHECK_EQUAL( 0u, FrameCompressor::getDictionaryHash() );
+}
+
+BOOST_AUTO_TEST_CASE( message_fragmenter_reassembles ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  MessageFragmenter sender, receiver;
+  Buffer large( 2000 );
+  for ( int i = 0; i < 2000; ++i )
+    large << (guint8)( i * 7 );
+  Buffer small;
+  small << (guint32)1234;
+  BOOST_CHECK_EQUAL( 0, sender.write( large ) );
+  BOOST_CHECK_EQUAL( 1, sender.write( small ) );
+  BOOST_CHECK_EQUAL( 2, sender.getCount() );
+
+  std::vector<MessagePacket*> messages;
+  int frames = 0;
+  while ( sender.getCount() > 0 ) {
+    Buffer frame;
+    std::vector<MessageFragmenter::Progress> progress;
+    BOOST_REQUIRE( sender.fill( frame, progress ) > 0 );
+    BOOST_REQUIRE( !progress.empty() );
+    frame << PacketParser::END_OF_PACKET;
+    BOOST_REQUIRE( frame.getPosition() <= Buffer::RAW_PACKET_LEN );
+    ++frames;
+
+    frame.flip();
+    Packet* p;
+    while ( ( p = PacketParser::parseNextPacket( frame ) ) != NULL ) {
+      BOOST_REQUIRE_EQUAL( MessagePacket::ID, p->getType() );
+      MessageFragmenter::Progress got;
+      MessagePacket* done;
+      MessageFragmenter::Result res =
+        receiver.receive( *static_cast<MessagePacket*>( p ), got, done );
+      PacketParser::destroyPacket( p );
+      BOOST_REQUIRE( res != MessageFragmenter::Invalid );
+      BOOST_CHECK_EQUAL( res == MessageFragmenter::Complete, done != NULL );
+      if ( done )
+        messages.push_back( done );
+    }
+  }
+  BOOST_CHECK_EQUAL( 5, frames );
+
+  BOOST_REQUIRE_EQUAL( 2u, messages.size() );
+  BOOST_CHECK_EQUAL( 0, messages[0]->getMessageId() );
+  BOOST_REQUIRE_EQUAL( 2000, messages[0]->getLength() );
+  Buffer& data = messages[0]->getBuffer();
+  BOOST_CHECK_EQUAL_COLLECTIONS( data.getData(), data.getData() + 2000,
+                                 large.getData(), large.getData() + 2000 );
+  guint32 value;
+  messages[1]->getBuffer() >> value;
+  BOOST_CHECK_EQUAL( 1234u, value );
+  for ( size_t i = 0; i < messages.size(); ++i )
+    PacketParser::destroyPacket( messages[i] );
+
+  //A message larger than allowed is refused when it starts.
+  receiver.setMaxMessageSize( 1000 );
+  sender.write( large );
+  Buffer frame;
+  std::vector<MessageFragmenter::Progress> progress;
+  sender.fill( frame, progress );
+  frame.flip();
+  Packet* p = PacketParser::parseNextPacket( frame );
+  MessageFragmenter::Progress got;
+  MessagePacket* done;
+  BOOST_CHECK_EQUAL( MessageFragmenter::Invalid,
+    receiver.receive( *static_cast<MessagePacket*>( p ), got, done ) );
+  PacketParser::destroyPacket( p );
+
+  //A range of a file is read ahead by prefetch, and sent by fill.
+  const char* fileName = "gne_test_message.tmp";
+  FILE* f = fopen( fileName, "wb" );
+  BOOST_REQUIRE( f != NULL );
+  fwrite( large.getData(), 1, 2000, f );
+  fclose( f );
+  MessageFragmenter fileSender, fileReceiver;
+  BOOST_CHECK_EQUAL( -1, fileSender.writeFile( fileName, 1500, 600 ) );
+  BOOST_CHECK_EQUAL( 0, fileSender.writeFile( fileName, 1000, 700 ) );
+  frame.clear();
+  BOOST_CHECK_EQUAL( 0, fileSender.fill( frame, progress ) );
+  done = NULL;
+  while ( fileSender.getCount() > 0 ) {
+    frame.clear();
+    fileSender.prefetch();
+    BOOST_REQUIRE( fileSender.fill( frame, progress ) > 0 );
+    frame << PacketParser::END_OF_PACKET;
+    frame.flip();
+    while ( ( p = PacketParser::parseNextPacket( frame ) ) != NULL ) {
+      fileReceiver.receive( *static_cast<MessagePacket*>( p ), got, done );
+      PacketParser::destroyPacket( p );
+    }
+  }
+  BOOST_REQUIRE( done != NULL );
+  BOOST_REQUIRE_EQUAL( 700, done->getLength() );
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+    done->getBuffer().getData(), done->getBuffer().getData() + 700,
+    large.getData() + 1000, large.getData() + 1700 );
+  PacketParser::destroyPacket( done );
+  remove( fileName );
+
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( object_id_table_reuses_slots ) {
+  int dummy[3];
+  NetworkObject* a = reinterpret_cast<NetworkObject*>( &dummy[0] );
+  NetworkObject* b = reinterpret_cast<NetworkObject*>( &dummy[1] );
+  NetworkObject* c = reinterpret_cast<NetworkObject*>( &dummy[2] );
+
+  //16 bit IDs are used in order, so a freed one is not reused right away.
+  ObjectIdTable narrow( false );
+  BOOST_CHECK_EQUAL( 1, narrow.allocate( a ) );
+  BOOST_CHECK_EQUAL( 2, narrow.allocate( b ) );
+  narrow.remove( 1 );
+  BOOST_CHECK_EQUAL( 3, narrow.allocate( c ) );
+  BOOST_CHECK( narrow.find( 1 ) == NULL );
+  BOOST_CHECK( narrow.find( 3 ) == c );
+  BOOST_CHECK_EQUAL( 2, narrow.size() );
+
+  //Wide IDs reuse the slot with a new generation, so the old ID is stale.
+  ObjectIdTable wide( true );
+  int first = wide.allocate( a );
+  wide.remove( first );
+  int second = wide.allocate( b );
+  BOOST_CHECK( first != second );
+  BOOST_CHECK_EQUAL( first >> ObjectIdTable::GEN_BITS,
+                     second >> ObjectIdTable::GEN_BITS );
+  BOOST_CHECK( wide.find( first ) == NULL );
+  BOOST_CHECK( wide.find( second ) == b );
+
+  //The client side adds the IDs it is given.
+  ObjectIdTable client( true );
+  BOOST_CHECK( client.add( second, b ) );
+  BOOST_CHECK( !client.add( second, c ) );
+  BOOST_CHECK( !client.add( 0, c ) );
+  BOOST_CHECK( client.find( second ) == b );
+  BOOST_CHECK_EQUAL( ObjectIdTable::getMaxId( true ), 0x7fffffff );
+}
+
+BOOST_AUTO_TEST_CASE( wide_object_ids_round_trip ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  ObjectBrokerPacket::setWideObjectIds( true );
+  int ids[] = { 1, 127, 128, 70000, 0x7fffffff };
+  for ( int i = 0; i < 5; ++i ) {
+    ObjectDeathPacket* odp = new ObjectDeathPacket( ids[i], NULL );
+    Packet* p = sendThroughBuffer( odp );
+    BOOST_REQUIRE_EQUAL( ObjectDeathPacket::ID, p->getType() );
+    BOOST_CHECK_EQUAL( ids[i],
+                       static_cast<ObjectDeathPacket*>( p )->getObjectId() );
+    PacketParser::destroyPacket( p );
+  }
+  ObjectDeathPacket small( 100, NULL );
+  ObjectDeathPacket large( 70000, NULL );
+  BOOST_CHECK_EQUAL( 2, large.getSize() - small.getSize() );
+  ObjectBrokerPacket::setWideObjectIds( false );
+
+  GNE::shutdownGNE();
+}
+
+/**
+ * A NetworkObject holding one number, sent in a RateAdjustPacket.
+ */
+class TestObject : public NetworkObject {
+public:
+  explicit TestObject( int id = -1 ) : NetworkObject( id ), value( 0 ) {}
+
+  static NetworkObject* create( int id, const Packet& packet ) {
+    TestObject* ret = new TestObject( id );
+    ret->incomingUpdatePacket( packet );
+    return ret;
+  }
+
+  Packet* createCreationPacket() { return createUpdatePacket( NULL ); }
+
+  Packet* createUpdatePacket( const void* param ) {
+    RateAdjustPacket* ret = new RateAdjustPacket();
+    ret->rate = value;
+    return ret;
+  }
+
+  Packet* createDeathPacket() { return NULL; }
+
+  void incomingUpdatePacket( const Packet& packet ) {
+    value = static_cast<const RateAdjustPacket&>( packet ).rate;
+  }
+
+  void incomingDeathPacket( const Packet* packet ) {}
+
+  guint32 value;
+};
+
+/**
+ * A TestObject whose updates can't be written while fail is set.
+ */
+class FailingObject : public TestObject {
+public:
+  FailingObject() : fail( true ) {}
+
+  void writeUpdate( Buffer& raw, const void* param ) {
+    if ( fail )
+      throw Error( Error::BufferOverflow );
+    TestObject::writeUpdate( raw, param );
+  }
+
+  bool fail;
+};
+
+BOOST_AUTO_TEST_CASE( object_broker_flushes_dirty_objects ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+  ObjectBrokerClient::registerObject( RateAdjustPacket::ID, TestObject::create );
+
+  ObjectBrokerServer server;
+  ObjectBrokerClient client;
+  TestObject objs[3];
+  for ( int i = 0; i < 3; ++i ) {
+    objs[i].value = i;
+    Packet* p = sendThroughBuffer( server.getCreationPacket( objs[i] )->makeClone() );
+    client.usePacket( *p );
+    PacketParser::destroyPacket( p );
+  }
+
+  //Marking an object twice sends it once, and unmarked objects are not sent.
+  objs[0].value = 100;
+  objs[0].markDirty();
+  objs[2].value = 102;
+  objs[2].markDirty();
+  objs[0].markDirty();
+  BOOST_CHECK_EQUAL( 2, server.getDirtyCount() );
+
+  std::vector<ObjectUpdateBatchPacket::sptr> batches = server.flushUpdates();
+  BOOST_REQUIRE_EQUAL( 1u, batches.size() );
+  BOOST_CHECK_EQUAL( 2, batches[0]->getCount() );
+  BOOST_CHECK_EQUAL( 0, server.getDirtyCount() );
+  BOOST_CHECK( !objs[0].isDirty() );
+
+  Packet* p = sendThroughBuffer( batches[0]->makeClone() );
+  BOOST_REQUIRE_EQUAL( ObjectUpdateBatchPacket::ID, p->getType() );
+  BOOST_CHECK_EQUAL( 2, client.useUpdateBatch(
+    *static_cast<ObjectUpdateBatchPacket*>( p ), false ) );
+  PacketParser::destroyPacket( p );
+  for ( int i = 0; i < 3; ++i ) {
+    TestObject* obj = static_cast<TestObject*>(
+      client.getObjectById( objs[i].getObjectId() ) );
+    BOOST_REQUIRE( obj != NULL );
+    BOOST_CHECK_EQUAL( i == 1 ? 1u : 100u + i, obj->value );
+  }
+
+  //Many updates are split into packets that each fit in a frame.
+  TestObject many[100];
+  for ( int i = 0; i < 100; ++i ) {
+    server.getCreationPacket( many[i] );
+    many[i].markDirty();
+  }
+  batches = server.flushUpdates();
+  BOOST_REQUIRE_EQUAL( 2u, batches.size() );
+  BOOST_CHECK_EQUAL( 100, batches[0]->getCount() + batches[1]->getCount() );
+  BOOST_CHECK( batches[0]->getSize() < Buffer::RAW_PACKET_LEN );
+
+  //An update that fails to write leaves its object marked.
+  FailingObject failing;
+  server.getCreationPacket( failing );
+  failing.markDirty();
+  objs[1].markDirty();
+  BOOST_CHECK_THROW( server.flushUpdates(), Error );
+  BOOST_CHECK( failing.isDirty() );
+  BOOST_CHECK_EQUAL( 2, server.getDirtyCount() );
+  failing.fail = false;
+  batches = server.flushUpdates();
+  BOOST_REQUIRE_EQUAL( 1u, batches.size() );
+  BOOST_CHECK_EQUAL( 2, batches[0]->getCount() );
+  server.deregisterObject( failing );
+
+  //An update of an unregistered packet type is an error, not an assert.
+  Buffer unknown;
+  unknown << (guint8)250;
+  unknown.flip();
+  BOOST_CHECK_THROW( objs[1].readUpdate( unknown ), Error );
+
+  for ( int i = 0; i < 100; ++i )
+    server.deregisterObject( many[i] );
+  for ( int i = 0; i < 3; ++i ) {
+    NetworkObject* obj = client.getObjectById( objs[i].getObjectId() );
+    client.deregisterObject( *obj );
+    delete obj;
+    server.deregisterObject( objs[i] );
+  }
+  objs[0].markDirty();
+  BOOST_CHECK_EQUAL( 0, server.getDirtyCount() );
+
+  GNE::shutdownGNE();
+}
+
+/**
+ * A TestObject that also has three fields sent by ObjectBrokerServer's
+ * delta packets.
+ */
+class DeltaObject : public TestObject {
+public:
+  explicit DeltaObject( int id = -1 ) : TestObject( id ) {
+    fields[0] = fields[1] = fields[2] = 0;
+  }
+
+  static NetworkObject* create( int id, const Packet& packet ) {
+    return new DeltaObject( id );
+  }
+
+  int getFieldCount() const { return 3; }
+
+  void writeField( Buffer& raw, int field ) { raw << fields[field]; }
+
+  void readField( Buffer& raw, int field ) { raw >> fields[field]; }
+
+  guint32 fields[3];
+};
+
+static int applyDelta( ObjectBrokerClient& client,
+                       ObjectDeltaPacket::sptr packet ) {
+  Packet* p = sendThroughBuffer( packet->makeClone() );
+  BOOST_REQUIRE_EQUAL( ObjectDeltaPacket::ID, p->getType() );
+  int ret = client.useDeltaPacket( *static_cast<ObjectDeltaPacket*>( p ),
+                                   false );
+  PacketParser::destroyPacket( p );
+  return ret;
+}
+
+static void ackDeltas( ObjectBrokerServer& server, ObjectBaselines& baselines,
+                       ObjectBrokerClient& client ) {
+  Packet* p = sendThroughBuffer( client.getDeltaAck()->makeClone() );
+  server.useDeltaAck( baselines, *static_cast<ObjectDeltaPacket*>( p ) );
+  PacketParser::destroyPacket( p );
+}
+
+BOOST_AUTO_TEST_CASE( object_broker_sends_deltas_against_acked_baselines ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+  ObjectBrokerClient::registerObject( RateAdjustPacket::ID, DeltaObject::create );
+
+  ObjectBrokerServer server;
+  ObjectBrokerClient client;
+  ObjectBaselines baselines;
+  DeltaObject objs[2];
+  DeltaObject* remote[2];
+  for ( int i = 0; i < 2; ++i ) {
+    Packet* p = sendThroughBuffer( server.getCreationPacket( objs[i] )->makeClone() );
+    remote[i] = static_cast<DeltaObject*>( &client.usePacket( *p ) );
+    PacketParser::destroyPacket( p );
+  }
+
+  //Objects are sent whole until the client acknowledges them.
+  objs[1].fields[2] = 7;
+  std::vector<ObjectDeltaPacket::sptr> packets = server.getDeltaPackets( baselines );
+  BOOST_REQUIRE_EQUAL( 1u, packets.size() );
+  BOOST_CHECK_EQUAL( 2, packets[0]->getCount() );
+  int wholeSize = packets[0]->getSize();
+  BOOST_CHECK_EQUAL( 2, applyDelta( client, packets[0] ) );
+  BOOST_CHECK_EQUAL( 7u, remote[1]->fields[2] );
+  ackDeltas( server, baselines, client );
+  BOOST_CHECK_EQUAL( 2, baselines.getBaselineCount() );
+  BOOST_CHECK_EQUAL( 0, baselines.getPendingCount() );
+  BOOST_CHECK( server.getDeltaPackets( baselines ).empty() );
+
+  //Only the changed field is sent, and it is sent again until acknowledged,
+  //even after changing back to the baseline.
+  objs[0].fields[1] = 5;
+  ObjectDeltaPacket::sptr changed = server.getDeltaPackets( baselines )[0];
+  BOOST_CHECK_EQUAL( 1, changed->getCount() );
+  BOOST_CHECK( changed->getSize() < wholeSize - 8 );
+  BOOST_CHECK_EQUAL( 1, applyDelta( client, changed ) );
+  BOOST_CHECK_EQUAL( 5u, remote[0]->fields[1] );
+
+  ObjectDeltaPacket::sptr lost = server.getDeltaPackets( baselines )[0];
+  BOOST_CHECK_EQUAL( changed->getSize(), lost->getSize() );
+  objs[0].fields[1] = 0;
+  ObjectDeltaPacket::sptr reverted = server.getDeltaPackets( baselines )[0];
+  BOOST_CHECK_EQUAL( 1, applyDelta( client, reverted ) );
+  BOOST_CHECK_EQUAL( 0u, remote[0]->fields[1] );
+  ackDeltas( server, baselines, client );
+  BOOST_CHECK( server.getDeltaPackets( baselines ).empty() );
+
+  //An update arriving after a newer one is skipped.
+  BOOST_CHECK_EQUAL( 0, applyDelta( client, lost ) );
+  BOOST_CHECK_EQUAL( 0u, remote[0]->fields[1] );
+
+  //An object idle for more than half the range of 16 bit sequences still
+  //takes its next change, and its acknowledgement still makes a baseline.
+  int applied = 0;
+  for ( int i = 0; i < 40000; ++i ) {
+    objs[1].fields[0] = i + 1;
+    applied += applyDelta( client, server.getDeltaPackets( baselines )[0] );
+    ackDeltas( server, baselines, client );
+  }
+  BOOST_CHECK_EQUAL( 40000, applied );
+  objs[0].fields[2] = 9;
+  packets = server.getDeltaPackets( baselines );
+  BOOST_REQUIRE_EQUAL( 1u, packets.size() );
+  BOOST_CHECK_EQUAL( 1, packets[0]->getCount() );
+  BOOST_CHECK_EQUAL( 1, applyDelta( client, packets[0] ) );
+  BOOST_CHECK_EQUAL( 9u, remote[0]->fields[2] );
+  ackDeltas( server, baselines, client );
+  BOOST_CHECK( server.getDeltaPackets( baselines ).empty() );
+
+  //Deregistered objects lose their baselines, and new objects are sent
+  //whole.
+  server.deregisterObject( objs[1] );
+  BOOST_CHECK( server.getDeltaPackets( baselines ).empty() );
+  BOOST_CHECK_EQUAL( 1, baselines.getBaselineCount() );
+  DeltaObject reused;
+  server.getCreationPacket( reused );
+  packets = server.getDeltaPackets( baselines );
+  BOOST_REQUIRE_EQUAL( 1u, packets.size() );
+  BOOST_CHECK_EQUAL( 1, packets[0]->getCount() );
+
+  for ( int i = 0; i < 2; ++i ) {
+    client.deregisterObject( *remote[i] );
+    delete remote[i];
+  }
+  server.deregisterObject( objs[0] );
+  server.deregisterObject( reused );
+
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( interest_grid_tracks_views ) {
+  InterestGrid grid( 10.0f );
+  grid.moveObject( 1, 5.0f, 5.0f );
+  grid.moveObject( 2, 55.0f, 5.0f );
+  int viewer = grid.addViewer( 0.0f, 0.0f, 10.0f );
+
+  std::vector<int> entered, left;
+  grid.getChanges( viewer, entered, left );
+  BOOST_REQUIRE_EQUAL( 1u, entered.size() );
+  BOOST_CHECK_EQUAL( 1, entered[0] );
+  BOOST_CHECK( left.empty() );
+  BOOST_CHECK( grid.isInterested( viewer, 1 ) );
+  BOOST_CHECK( !grid.isInterested( viewer, 2 ) );
+
+  //Moving within the view or out and back in again is not a change.
+  grid.moveObject( 1, -5.0f, -5.0f );
+  grid.moveObject( 1, 30.0f, 5.0f );
+  grid.moveObject( 1, 5.0f, 5.0f );
+  entered.clear();
+  grid.getChanges( viewer, entered, left );
+  BOOST_CHECK( entered.empty() && left.empty() );
+
+  //Objects and views moving between cells.
+  grid.moveObject( 2, 15.0f, 5.0f );
+  grid.moveViewer( viewer, 60.0f, 0.0f );
+  grid.getChanges( viewer, entered, left );
+  BOOST_REQUIRE_EQUAL( 1u, left.size() );
+  BOOST_CHECK_EQUAL( 1, left[0] );
+  BOOST_CHECK( entered.empty() );
+  BOOST_CHECK( grid.getInterests( viewer ).empty() );
+
+  grid.moveViewer( viewer, 20.0f, 0.0f );
+  grid.removeObject( 1 );
+  left.clear();
+  grid.getChanges( viewer, entered, left );
+  BOOST_REQUIRE_EQUAL( 1u, entered.size() );
+  BOOST_CHECK_EQUAL( 2, entered[0] );
+  BOOST_CHECK( left.empty() );
+  BOOST_CHECK_EQUAL( 1, grid.getObjectCount() );
+
+  grid.removeViewer( viewer );
+  BOOST_CHECK_EQUAL( 0, grid.getViewerCount() );
+}
+
+BOOST_AUTO_TEST_CASE( update_scheduler_fills_budget_by_priority ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  ObjectBrokerServer server;
+  ObjectBaselines baselines;
+  UpdateScheduler scheduler;
+  DeltaObject objs[3];
+  std::set<int> ids;
+  for ( int i = 0; i < 3; ++i ) {
+    server.getCreationPacket( objs[i] );
+    ids.insert( objs[i].getObjectId() );
+  }
+  int a = objs[0].getObjectId(), b = objs[1].getObjectId();
+  int c = objs[2].getObjectId();
+  scheduler.setWeight( c, 10.0f );
+
+  //The budget fits one whole object, so the heaviest goes first.
+  int budget = ObjectDeltaPacket::getEmptySize() +
+    ObjectDeltaPacket::getEntrySize( c, 3, 12 ) + 4;
+  std::vector<ObjectDeltaPacket::sptr> packets =
+    server.getDeltaPackets( baselines, ids, scheduler, budget );
+  BOOST_REQUIRE_EQUAL( 1u, packets.size() );
+  BOOST_CHECK_EQUAL( 1, packets[0]->getCount() );
+  BOOST_CHECK( packets[0]->getSize() <= budget );
+  BOOST_CHECK_EQUAL( 0.0f, scheduler.getPriority( c ) );
+  BOOST_CHECK_EQUAL( 1.0f, scheduler.getPriority( a ) );
+
+  //Once the client has it, the waiting objects get their turn.
+  ObjectDeltaPacket ack;
+  ack.addAck( packets[0]->getSequence() );
+  server.useDeltaAck( baselines, ack );
+  packets = server.getDeltaPackets( baselines, ids, scheduler, budget );
+  BOOST_REQUIRE_EQUAL( 1u, packets.size() );
+  BOOST_CHECK_EQUAL( 0.0f, scheduler.getPriority( a ) );
+  BOOST_CHECK_EQUAL( 2.0f, scheduler.getPriority( b ) );
+  BOOST_CHECK_EQUAL( 0.0f, scheduler.getPriority( c ) );
+
+  //Objects no longer seen are forgotten.
+  ids.erase( b );
+  server.getDeltaPackets( baselines, ids, scheduler, -1 );
+  BOOST_CHECK_EQUAL( 2, scheduler.getObjectCount() );
+
+  for ( int i = 0; i < 3; ++i )
+    server.deregisterObject( objs[i] );
+
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( object_broker_snapshot_creates_objects ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+  ObjectBrokerClient::registerObject( RateAdjustPacket::ID, TestObject::create );
+
+  ObjectBrokerServer server;
+  TestObject objs[50];
+  std::set<int> some;
+  for ( int i = 0; i < 50; ++i ) {
+    objs[i].value = i * 10;
+    server.getCreationPacket( objs[i] );
+    if ( i % 2 )
+      some.insert( objs[i].getObjectId() );
+  }
+
+  //The creation data is kept until the object is marked as changed.
+  server.getSnapshot();
+  objs[3].value = 7;
+  SmartPtr<Buffer> snapshot = server.getSnapshot();
+  ObjectBrokerClient client;
+  snapshot->flip();
+  BOOST_CHECK_EQUAL( 50, client.useSnapshot( *snapshot ) );
+  NetworkObject* stale = client.getObjectById( objs[3].getObjectId() );
+  BOOST_CHECK_EQUAL( 30u, static_cast<TestObject*>( stale )->value );
+  for ( int i = 0; i < 50; ++i ) {
+    NetworkObject* obj = client.getObjectById( objs[i].getObjectId() );
+    client.deregisterObject( *obj );
+    delete obj;
+  }
+
+  objs[3].markDirty();
+  snapshot = server.getSnapshot();
+  snapshot->flip();
+  BOOST_CHECK_EQUAL( 50, client.useSnapshot( *snapshot ) );
+  BOOST_CHECK_EQUAL( 50, client.numObjects() );
+  for ( int i = 0; i < 50; ++i ) {
+    TestObject* obj = static_cast<TestObject*>(
+      client.getObjectById( objs[i].getObjectId() ) );
+    BOOST_REQUIRE( obj != NULL );
+    BOOST_CHECK_EQUAL( objs[i].value, obj->value );
+    client.deregisterObject( *obj );
+    delete obj;
+  }
+
+  //A snapshot of only some objects.
+  snapshot = server.getSnapshot( some );
+  snapshot->flip();
+  BOOST_CHECK_EQUAL( 25, client.useSnapshot( *snapshot ) );
+  BOOST_CHECK( client.getObjectById( objs[0].getObjectId() ) == NULL );
+  snapshot->rewind();
+  BOOST_CHECK_THROW( client.useSnapshot( *snapshot ), Error );
+  for ( int i = 0; i < 50; ++i ) {
+    NetworkObject* obj = client.getObjectById( objs[i].getObjectId() );
+    if ( obj != NULL ) {
+      client.deregisterObject( *obj );
+      delete obj;
+    }
+    server.deregisterObject( objs[i] );
+  }
+
+  GNE::shutdownGNE();
+}
+
+/**
+ * A ReplicationFanout that keeps the packets sent to each client.
+ */
+class TestFanout : public ReplicationFanout {
+public:
+  TestFanout( ObjectBrokerServer& server, InterestGrid* grid )
+    : ReplicationFanout( server, grid, 3, 20 ) {}
+
+  std::map<int, std::vector<int> > reliable;
+  std::map<int, int> deltaObjects;
+
+protected:
+  void send( int client, const Connection::sptr& conn,
+             const Packet& packet, bool isReliable ) {
+    LockMutex lock( sync );
+    if ( isReliable )
+      reliable[client].push_back( packet.getType() );
+    else
+      deltaObjects[client] +=
+        static_cast<const ObjectDeltaPacket&>( packet ).getCount();
+  }
+
+private:
+  Mutex sync;
+};
+
+class FailingJob : public WorkerPool::Job {
+public:
+  FailingJob( bool fail ) : fail( fail ), foreign( false ), ran( 0 ) {}
+  void run() {
+    ++ran;
+    if ( foreign )
+      throw 1;
+    if ( fail )
+      throw Error( Error::User );
+  }
+  bool fail;
+  bool foreign;
+  int ran;
+};
+
+BOOST_AUTO_TEST_CASE( replication_fanout_sends_each_client ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  //Every job runs once, and an error is passed on after all of them.
+  {
+    WorkerPool pool( 2 );
+    std::vector<FailingJob> jobs( 50, FailingJob( false ) );
+    jobs[7].fail = true;
+    std::vector<WorkerPool::Job*> ptrs;
+    for ( size_t i = 0; i < jobs.size(); ++i )
+      ptrs.push_back( &jobs[i] );
+    BOOST_CHECK_THROW( pool.runAll( ptrs ), Error );
+    jobs[7].fail = false;
+    pool.runAll( ptrs );
+    for ( size_t i = 0; i < jobs.size(); ++i )
+      BOOST_CHECK_EQUAL( 2, jobs[i].ran );
+
+    //Something other than an Error is passed on as one.
+    jobs[31].foreign = true;
+    Error::ErrorCode code = Error::NoError;
+    try {
+      pool.runAll( ptrs );
+    } catch ( Error& e ) {
+      code = e.getCode();
+    }
+    BOOST_CHECK_EQUAL( Error::OtherGNELevelError, code );
+    for ( size_t i = 0; i < jobs.size(); ++i )
+      BOOST_CHECK_EQUAL( 3, jobs[i].ran );
+
+    //The idle workers stop when asked, as on shutdownGNE, and the caller
+    //runs the jobs alone after that.
+    Thread::requestAllShutdown( Thread::USER );
+    BOOST_CHECK( !Thread::waitForAllThreads( 2000 ) );
+    jobs[31].foreign = false;
+    pool.runAll( ptrs );
+    for ( size_t i = 0; i < jobs.size(); ++i )
+      BOOST_CHECK_EQUAL( 4, jobs[i].ran );
+  }
+
+  ObjectBrokerServer server;
+  InterestGrid grid( 10.0f );
+  DeltaObject objs[6];
+  for ( int i = 0; i < 6; ++i ) {
+    server.getCreationPacket( objs[i] );
+    grid.moveObject( objs[i].getObjectId(), i * 20.0f, 0.0f );
+  }
+  TestFanout fanout( server, &grid );
+  int near = fanout.addClient( Connection::sptr(),
+                               grid.addViewer( 0.0f, 0.0f, 5.0f ) );
+  int farViewer = grid.addViewer( 100.0f, 0.0f, 25.0f );
+  int far = fanout.addClient( Connection::sptr(), farViewer );
+
+  fanout.tick();
+  BOOST_CHECK_EQUAL( 1u, fanout.reliable[near].size() );
+  BOOST_CHECK_EQUAL( 1, fanout.deltaObjects[near] );
+  BOOST_CHECK_EQUAL( 2u, fanout.reliable[far].size() );
+  BOOST_CHECK_EQUAL( 2, fanout.deltaObjects[far] );
+
+  //Without acknowledgements the objects are sent again, and a viewer
+  //moving has objects created and destroyed.
+  grid.moveViewer( farViewer, 70.0f, 0.0f );
+  fanout.tick();
+  BOOST_REQUIRE_EQUAL( 5u, fanout.reliable[far].size() );
+  BOOST_CHECK_EQUAL( ObjectCreationPacket::ID, fanout.reliable[far][3] );
+  BOOST_CHECK_EQUAL( ObjectDeathPacket::ID, fanout.reliable[far][4] );
+  BOOST_CHECK_EQUAL( 5, fanout.deltaObjects[far] );
+  BOOST_CHECK_EQUAL( 2, fanout.deltaObjects[near] );
+
+  fanout.removeClient( near );
+  BOOST_CHECK_EQUAL( 1, fanout.getClientCount() );
+  for ( int i = 0; i < 6; ++i )
+    server.deregisterObject( objs[i] );
+
+  GNE::shutdownGNE();
+}
+
+static Packet* testObjectPacket( ObjectBrokerServer& server, TestObject& obj,
+                                 guint32 value, bool create ) {
+  obj.value = value;
+  if ( create )
+    return sendThroughBuffer( server.getCreationPacket( obj )->makeClone() );
+  return sendThroughBuffer( server.getUpdatePacket( obj )->makeClone() );
+}
+
+BOOST_AUTO_TEST_CASE( object_broker_client_uses_packets_in_batch ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+  ObjectBrokerClient::registerObject( RateAdjustPacket::ID, TestObject::create );
+
+  ObjectBrokerServer server;
+  ObjectBrokerClient client;
+  TestObject a, b, unknown;
+  std::vector<Packet*> packets;
+  packets.push_back( testObjectPacket( server, a, 1, true ) );
+  packets.push_back( testObjectPacket( server, a, 2, false ) );
+  packets.push_back( testObjectPacket( server, a, 3, false ) );
+  packets.push_back( testObjectPacket( server, b, 4, true ) );
+  packets.push_back( testObjectPacket( server, b, 5, false ) );
+  server.getCreationPacket( unknown );
+  packets.push_back( testObjectPacket( server, unknown, 6, false ) );
+
+  //Only the last update of a is used, and the unknown object is skipped.
+  Time elapsed;
+  BOOST_CHECK_EQUAL( 4, client.usePackets( packets, true, true, &elapsed ) );
+  BOOST_CHECK( elapsed >= Time() );
+  TestObject* remoteA = static_cast<TestObject*>(
+    client.getObjectById( a.getObjectId() ) );
+  TestObject* remoteB = static_cast<TestObject*>(
+    client.getObjectById( b.getObjectId() ) );
+  BOOST_REQUIRE( remoteA != NULL && remoteB != NULL );
+  BOOST_CHECK_EQUAL( 3u, remoteA->value );
+  BOOST_CHECK_EQUAL( 5u, remoteB->value );
+  for ( size_t i = 0; i < packets.size(); ++i )
+    PacketParser::destroyPacket( packets[i] );
+  packets.clear();
+
+  packets.push_back( testObjectPacket( server, a, 7, false ) );
+  packets.push_back( sendThroughBuffer( server.getDeathPacket( b )->makeClone() ) );
+  packets.push_back( testObjectPacket( server, unknown, 8, false ) );
+  BOOST_CHECK_THROW( client.usePackets( packets, false, false ), Error );
+  BOOST_CHECK_EQUAL( 7u, remoteA->value );
+  BOOST_CHECK( client.getObjectById( b.getObjectId() ) == NULL );
+  for ( size_t i = 0; i < packets.size(); ++i )
+    PacketParser::destroyPacket( packets[i] );
+
+  delete remoteB;
+  client.deregisterObject( *remoteA );
+  delete remoteA;
+  server.deregisterObject( a );
+  server.deregisterObject( b );
+  server.deregisterObject( unknown );
+
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( interpolation_buffer_samples_between_states ) {
+  InterpolationBuffer buf( 2, 4 );
+  float out[2] = { -1.0f, -1.0f };
+  BOOST_CHECK( !buf.sampleAt( Time( 1, 0 ), out ) );
+
+  //States arriving out of order are put in their place.
+  float s1[2] = { 0.0f, 10.0f }, s2[2] = { 10.0f, 10.0f };
+  float s3[2] = { 20.0f, 0.0f };
+  BOOST_CHECK( buf.add( Time( 1, 0 ), s1 ) );
+  BOOST_CHECK( buf.add( Time( 1, 200000 ), s3 ) );
+  BOOST_CHECK( buf.add( Time( 1, 100000 ), s2 ) );
+  BOOST_CHECK( buf.getNewestTime() == Time( 1, 200000 ) );
+
+  buf.sampleAt( Time( 1, 50000 ), out );
+  BOOST_CHECK_CLOSE( 5.0f, out[0], 0.01f );
+  BOOST_CHECK_CLOSE( 10.0f, out[1], 0.01f );
+  buf.sampleAt( Time( 1, 150000 ), out );
+  BOOST_CHECK_CLOSE( 15.0f, out[0], 0.01f );
+  BOOST_CHECK_CLOSE( 5.0f, out[1], 0.01f );
+  buf.sampleAt( Time( 0, 0 ), out );
+  BOOST_CHECK_EQUAL( 0.0f, out[0] );
+
+  //Extrapolation stops at the limit.
+  buf.setMaxExtrapolation( Time( 0, 100000 ) );
+  buf.sampleAt( Time( 1, 250000 ), out );
+  BOOST_CHECK_CLOSE( 25.0f, out[0], 0.01f );
+  buf.sampleAt( Time( 5, 0 ), out );
+  BOOST_CHECK_CLOSE( 30.0f, out[0], 0.01f );
+
+  //sample uses the delay and the offset of the ping with the lowest time.
+  PingInformation ping;
+  ping.pingTime = Time( 0, 50000 );
+  ping.clockOffset = Time( 1, 0 );
+  buf.useClockOffset( ping );
+  ping.pingTime = Time( 0, 90000 );
+  ping.clockOffset = Time( 3, 0 );
+  buf.useClockOffset( ping );
+  BOOST_CHECK( buf.getClockOffset() == Time( 1, 0 ) );
+  buf.sample( Time( 0, 150000 ), out );
+  BOOST_CHECK_CLOSE( 5.0f, out[0], 0.01f );
+
+  //When full the oldest is dropped, and older states are refused.
+  float s4[2] = { 30.0f, 0.0f }, s5[2] = { 40.0f, 0.0f };
+  BOOST_CHECK( buf.add( Time( 1, 300000 ), s4 ) );
+  BOOST_CHECK( buf.add( Time( 1, 400000 ), s5 ) );
+  BOOST_CHECK_EQUAL( 4, buf.getSampleCount() );
+  BOOST_CHECK( !buf.add( Time( 1, 0 ), s1 ) );
+  buf.sampleAt( Time( 0, 0 ), out );
+  BOOST_CHECK_CLOSE( 10.0f, out[0], 0.01f );
+}
+
+/**
+ * A HandshakeQueue step that counts how it ended.
+ */
+class CountingStep : public HandshakeQueue::Step {
+public:
+  CountingStep() : runs( 0 ), error( Error::NoError ) {}
+
+  void run() {
+    LockCV lock( done );
+    ++runs;
+    done.broadcast();
+  }
+
+  void cancel( const Error& e ) {
+    LockCV lock( done );
+    error = e.getCode();
+    done.broadcast();
+  }
+
+  void waitUntilEnded() {
+    LockCV lock( done );
+    while ( runs == 0 && error == Error::NoError )
+      done.timedWait( 100 );
+  }
+
+  ConditionVariable done;
+  int runs;
+  Error::ErrorCode error;
+};
+
+BOOST_AUTO_TEST_CASE( handshake_queue_runs_and_times_out_steps ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+
+  HandshakeQueue::sptr queue = HandshakeQueue::create( 2 );
+  SmartPtr<CountingStep> posted( new CountingStep );
+  queue->post( posted );
+  posted->waitUntilEnded();
+  BOOST_CHECK_EQUAL( 1, posted->runs );
+
+  //A step still waiting when its time is up is cancelled, but not one that
+  //stopped waiting.
+  SmartPtr<CountingStep> late( new CountingStep );
+  SmartPtr<CountingStep> answered( new CountingStep );
+  queue->wait( late, 50 );
+  queue->wait( answered, 50 );
+  BOOST_CHECK_EQUAL( 2, queue->getWaitingCount() );
+  BOOST_CHECK( queue->endWait( answered ) );
+  late->waitUntilEnded();
+  BOOST_CHECK_EQUAL( Error::ConnectionTimeOut, late->error );
+  BOOST_CHECK( !queue->endWait( late ) );
+  BOOST_CHECK_EQUAL( 0, queue->getWaitingCount() );
+
+  SmartPtr<CountingStep> forever( new CountingStep );
+  queue->wait( forever, 0 );
+  queue->shutDown();
+  BOOST_CHECK_EQUAL( Error::ConnectionAborted, forever->error );
+  BOOST_CHECK_EQUAL( Error::NoError, answered->error );
+  BOOST_CHECK_EQUAL( 0, answered->runs );
+
+  GNE::shutdownGNE();
+}
+
+/**
+ * A listener for sockets that never get events.
+ */
+class IdleReceiver : public ReceiveEventListener {
+public:
+  void onReceive() {}
+};
+
+BOOST_AUTO_TEST_CASE( event_generator_pauses_sockets ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+
+  ConnectionEventGenerator::sptr gen = ConnectionEventGenerator::create();
+  gen->start();
+  ReceiveEventListener::sptr listener( new IdleReceiver() );
+  NLsocket a = 1000, b = 1001;
+  gen->reg( a, listener );
+  gen->reg( b, listener );
+  BOOST_CHECK( gen->isPolled( a ) );
+  BOOST_CHECK( gen->isPolled( b ) );
+
+  //A socket paused without a time is left out until resumed.
+  gen->pause( a, 0 );
+  BOOST_CHECK( !gen->isPolled( a ) );
+  BOOST_CHECK( gen->isPolled( b ) );
+  gen->resume( a );
+  BOOST_CHECK( gen->isPolled( a ) );
+
+  //A socket paused with a time is put back once it passes.
+  gen->pause( b, 100 );
+  BOOST_CHECK( !gen->isPolled( b ) );
+  for ( int i = 0; i < 200 && !gen->isPolled( b ); ++i )
+    Thread::sleep( 10 );
+  BOOST_CHECK( gen->isPolled( b ) );
+
+  //A paused socket that is unregistered is not put back by resume.
+  gen->pause( a, 0 );
+  gen->unreg( a );
+  gen->resume( a );
+  BOOST_CHECK( !gen->isPolled( a ) );
+  gen->unreg( b );
+  BOOST_CHECK( !gen->isPolled( b ) );
+
+  gen->shutDown();
+  gen->join();
+  GNE::shutdownGNE();
+}
+
+/**
+ * Session state for the SessionTable test.
+ */
+class TestSession : public SessionTable::Session {
+public:
+  explicit TestSession( int channel ) : channel( channel ) {}
+
+  int channel;
+};
+
+BOOST_AUTO_TEST_CASE( session_table_resumes_held_sessions ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+  SessionTable::sptr table = SessionTable::create( 50 );
+  Connection::sptr first = ClientConnection::create();
+  Connection::sptr second = ClientConnection::create();
+  Connection::sptr replaced;
+
+  bool resumed = true;
+  SessionToken token = table->startSession( SessionToken(), first, resumed,
+                                            replaced );
+  BOOST_CHECK( token.isValid() );
+  BOOST_CHECK( !resumed );
+  BOOST_CHECK( !replaced );
+  table->setSession( token, SessionTable::Session::sptr( new TestSession( 7 ) ) );
+
+  //A client with the token takes an active session over, and the old
+  //connection is reported so it can be dropped.  The old connection
+  //disconnecting then does not hold the session.
+  BOOST_CHECK( table->startSession( token, second, resumed, replaced ) ==
+               token );
+  BOOST_CHECK( resumed );
+  BOOST_CHECK( replaced == first );
+  table->hold( token, *first );
+  BOOST_CHECK_EQUAL( 0, table->getHeldCount() );
+
+  table->hold( token, *second );
+  BOOST_CHECK_EQUAL( 1, table->getHeldCount() );
+
+  //A wrong secret starts a new session.
+  SessionToken guess = token;
+  guess.secret[1] ^= 1;
+  SessionToken fresh = table->startSession( guess, first, resumed, replaced );
+  BOOST_CHECK( !resumed );
+  BOOST_CHECK( !replaced );
+  BOOST_CHECK( fresh != token );
+  BOOST_CHECK( !table->getSession( fresh ) );
+
+  BOOST_CHECK( table->startSession( token, first, resumed, replaced ) ==
+               token );
+  BOOST_CHECK( resumed );
+  BOOST_CHECK( !replaced );
+  BOOST_CHECK_EQUAL( 0, table->getHeldCount() );
+  SmartPtr<TestSession> state =
+    static_pointer_cast<TestSession>( table->getSession( token ) );
+  BOOST_REQUIRE( state );
+  BOOST_CHECK_EQUAL( 7, state->channel );
+
+  //Once the grace period is over, the session is expired and is not resumed.
+  table->hold( token );
+  table->hold( fresh );
+  std::vector<SessionTable::Session::sptr> expired;
+  table->expire( expired );
+  BOOST_CHECK( expired.empty() );
+  Thread::sleep( 60 );
+  table->expire( expired );
+  BOOST_REQUIRE_EQUAL( 1u, expired.size() );
+  BOOST_CHECK( expired[0] == state );
+  BOOST_CHECK_EQUAL( 0, table->getSessionCount() );
+  table->startSession( token, first, resumed, replaced );
+  BOOST_CHECK( !resumed );
+
+  first.reset();
+  second.reset();
+  GNE::shutdownGNE();
+}
+
+/**
+ * Returns the number of bits that differ between the secrets of a and b.
+ */
+static int secretDistance( const SessionToken& a, const SessionToken& b ) {
+  int bits = 0;
+  for ( int i = 0; i < SessionToken::SECRET_WORDS; ++i ) {
+    for ( guint32 diff = a.secret[i] ^ b.secret[i]; diff != 0; diff &= diff - 1 )
+      ++bits;
+  }
+  return bits;
+}
+
+BOOST_AUTO_TEST_CASE( session_secrets_are_not_derived_from_each_other ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+  SessionTable::sptr table = SessionTable::create( 50 );
+  Connection::sptr conn = ClientConnection::create();
+  Connection::sptr replaced;
+  bool resumed;
+
+  const int SESSIONS = 200;
+  std::vector<SessionToken> tokens;
+  for ( int i = 0; i < SESSIONS; ++i )
+    tokens.push_back( table->startSession( SessionToken(), conn, resumed,
+                                           replaced ) );
+
+  int bits = 0;
+  for ( int i = 1; i < SESSIONS; ++i ) {
+    const SessionToken& last = tokens[i - 1];
+    const SessionToken& next = tokens[i];
+    BOOST_REQUIRE_EQUAL( last.id + 1, next.id );
+    BOOST_CHECK( !next.sameSecret( last ) );
+    bits += secretDistance( last, next );
+
+    //A client holding last can name the next session, but not its secret:
+    //neither its own secret nor the next state of a generator it came from
+    //resumes it.
+    SessionToken guess = last;
+    guess.id = next.id;
+    table->startSession( guess, conn, resumed, replaced );
+    BOOST_CHECK( !resumed );
+    for ( int w = 0; w < SessionToken::SECRET_WORDS; ++w ) {
+      guint32 state = last.secret[SessionToken::SECRET_WORDS - 1];
+      for ( int step = 0; step <= w; ++step ) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+      }
+      guess.secret[w] = state;
+    }
+    table->startSession( guess, conn, resumed, replaced );
+    BOOST_CHECK( !resumed );
+  }
+  //About half of the bits change from one secret to the next, as they
+  //would for independent random secrets.
+  double average = (double)bits / ( SESSIONS - 1 );
+  BOOST_CHECK( average > 28.0 && average < 36.0 );
+
+  conn.reset();
+  GNE::shutdownGNE();
+}
+
+/**
+ * A ListServer that keeps its answers instead of sending them.
+ */
+class TestListServer : public ListServer {
+public:
+  static SmartPtr<TestListServer> create() {
+    SmartPtr<TestListServer> ret( new TestListServer() );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void send( const Address& dest, const Buffer& data ) {
+    answers.push_back( std::vector<gbyte>( data.getData(),
+                                           data.getData() + data.getPosition() ) );
+  }
+
+  std::vector< std::vector<gbyte> > answers;
+};
+
+static void processDatagram( ListServer& server, Buffer& buf, const char* from ) {
+  server.process( buf.getData(), buf.getPosition(), Address( from ) );
+}
+
+BOOST_AUTO_TEST_CASE( list_server_answers_filtered_pages ) {
+  SmartPtr<TestListServer> server = TestListServer::create();
+  server->setRefreshInterval( 0 );
+
+  const int SERVERS = 200;
+  for ( int i = 0; i < SERVERS; ++i ) {
+    Buffer hb( ListServer::PAGE_LEN );
+    std::ostringstream name;
+    name << "Server number " << i;
+    hb << ListServer::MAGIC << (gbyte)ListServer::Heartbeat << (gint32)0
+       << std::string( "testgame" ) << std::string( i % 2 ? "ctf" : "dm" )
+       << name.str() << (gint32)( i % 4 ) << (gint32)3 << std::string( "info" );
+    std::ostringstream from;
+    from << "10.0." << i / 100 << "." << i % 100 << ":4000";
+    processDatagram( *server, hb, from.str().c_str() );
+  }
+  BOOST_CHECK_EQUAL( SERVERS, server->getServerCount( "testgame" ) );
+
+  //Garbage is ignored.
+  Buffer bad;
+  bad << ListServer::MAGIC << (gbyte)ListServer::Heartbeat << (gint32)5;
+  processDatagram( *server, bad, "10.0.1.1:4000" );
+  BOOST_CHECK_EQUAL( SERVERS, server->getServerCount() );
+
+  //A query that is not padded to the size of an answer is ignored.
+  Buffer unpadded;
+  unpadded << ListServer::MAGIC << (gbyte)ListServer::Query << (guint32)77
+           << std::string( "testgame" ) << std::string( "dm" ) << (gbyte)0
+           << (gint32)0;
+  processDatagram( *server, unpadded, "10.0.2.1:5000" );
+  BOOST_CHECK( server->answers.empty() );
+
+  //Ask for the dm servers that are not full or empty, page by page.
+  int listed = 0;
+  gint32 pageCount = 1;
+  for ( gint32 page = 0; page < pageCount; ++page ) {
+    Buffer q( ListServer::PAGE_LEN );
+    q << ListServer::MAGIC << (gbyte)ListServer::Query << (guint32)77
+      << std::string( "testgame" ) << std::string( "dm" )
+      << (gbyte)( ListServer::NotFull | ListServer::NotEmpty ) << page;
+    while ( q.getPosition() < ListServer::PAGE_LEN )
+      q << (gbyte)0;
+    processDatagram( *server, q, "10.0.2.1:5000" );
+    BOOST_REQUIRE_EQUAL( (size_t)( page + 1 ), server->answers.size() );
+
+    std::vector<gbyte>& data = server->answers.back();
+    BOOST_CHECK( (int)data.size() <= ListServer::PAGE_LEN );
+    Buffer a( (int)data.size() );
+    a.writeRaw( &data[0], (int)data.size() );
+    a.flip();
+    guint32 magic, id;
+    gbyte type;
+    gint32 answerPage, servers;
+    a >> magic >> type >> id >> answerPage >> pageCount >> servers;
+    BOOST_CHECK_EQUAL( ListServer::MAGIC, magic );
+    BOOST_CHECK_EQUAL( 77u, id );
+    BOOST_CHECK_EQUAL( page, answerPage );
+    for ( int i = 0; i < servers; ++i ) {
+      std::string addr, mod, name, info;
+      gint32 players, maxPlayers;
+      a >> addr >> mod >> name >> players >> maxPlayers >> info;
+      BOOST_CHECK_EQUAL( "dm", mod );
+      BOOST_CHECK( players > 0 && players < maxPlayers );
+      ++listed;
+    }
+  }
+  //The even servers are dm, and half of them have 0 players.
+  BOOST_CHECK( pageCount > 1 );
+  BOOST_CHECK_EQUAL( SERVERS / 4, listed );
+
+  Buffer rm;
+  rm << ListServer::MAGIC << (gbyte)ListServer::Remove << (gint32)0;
+  processDatagram( *server, rm, "10.0.0.3:4000" );
+  BOOST_CHECK_EQUAL( SERVERS - 1, server->getServerCount() );
+}
+
+/**
+ * Records what one end of a loopback connection receives.
+ */
+class LoopbackListener : public ConnectionListener {
+public:
+  typedef SmartPtr<LoopbackListener> sptr;
+
+  LoopbackListener() : messageLength( 0 ), exited( false ) {}
+
+  void onConnect( SyncConnection& conn ) { connected( conn.getConnection() ); }
+
+  void onNewConn( SyncConnection& conn ) { connected( conn.getConnection() ); }
+
+  void onReceive( Connection& conn ) {
+    Packet* next;
+    while ( ( next = conn.stream().getNextPacket() ) != NULL ) {
+      LockCV lock( sync );
+      if ( next->getType() == CustomPacket::ID ) {
+        Buffer& buf = ( (CustomPacket*)next )->getBuffer();
+        buf.flip();
+        gint32 value;
+        buf >> value;
+        values.push_back( value );
+      } else if ( next->getType() == MessagePacket::ID ) {
+        messageLength = ( (MessagePacket*)next )->getLength();
+      }
+      sync.broadcast();
+      PacketParser::destroyPacket( next );
+    }
+  }
+
+  void onExit( Connection& ) {
+    LockCV lock( sync );
+    exited = true;
+    sync.broadcast();
+  }
+
+  /**
+   * Waits up to about 5 seconds for cond to be true.
+   */
+  template <class Cond>
+  bool waitFor( Cond cond ) {
+    LockCV lock( sync );
+    for ( int i = 0; i < 100 && !cond( *this ); ++i )
+      sync.timedWait( 50 );
+    return cond( *this );
+  }
+
+  static bool hasConn( LoopbackListener& l ) { return (bool)l.conn; }
+  static bool hasExited( LoopbackListener& l ) { return l.exited; }
+
+  Connection::sptr conn;
+  std::vector<gint32> values;
+  int messageLength;
+  bool exited;
+  ConditionVariable sync;
+
+private:
+  void connected( const Connection::sptr& c ) {
+    LockCV lock( sync );
+    conn = c;
+    sync.broadcast();
+  }
+};
+
+struct HasValues {
+  explicit HasValues( size_t count ) : count( count ) {}
+  bool operator()( LoopbackListener& l ) const { return l.values.size() >= count; }
+  size_t count;
+};
+
+static bool hasMessage( LoopbackListener& l ) { return l.messageLength > 0; }
+
+/**
+ * A ServerConnectionListener that is never opened, for loopback connections.
+ */
+class LoopbackServer : public ServerConnectionListener {
+public:
+  static SmartPtr<LoopbackServer> create() {
+    SmartPtr<LoopbackServer> ret( new LoopbackServer() );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void getNewConnectionParams( ConnectionParams& params ) {
+    params.setListener( listener );
+  }
+
+  void onListenFailure( const Error&, const Address&,
+                        const ConnectionListener::sptr& ) {}
+
+  LoopbackListener::sptr listener;
+};
+
+static void writeValue( Connection& conn, gint32 value, bool reliable ) {
+  CustomPacket packet;
+  packet.getBuffer() << value;
+  conn.stream().writePacket( packet, reliable );
+}
+
+BOOST_AUTO_TEST_CASE( loopback_connection_passes_packets ) {
+  //No network is needed.
+  GNE::initGNE( NO_NET, atexit, 1000 );
+
+  SmartPtr<LoopbackServer> server = LoopbackServer::create();
+  server->listener = LoopbackListener::sptr( new LoopbackListener );
+  LoopbackListener::sptr clientListener( new LoopbackListener );
+
+  ClientConnection::sptr client = ClientConnection::create();
+  BOOST_REQUIRE( !client->open( server, ConnectionParams( clientListener ) ) );
+  client->connect();
+  BOOST_REQUIRE_EQUAL( Error::NoError, client->waitForConnect().getCode() );
+  BOOST_CHECK( client->isLoopback() );
+  BOOST_REQUIRE( server->listener->waitFor( LoopbackListener::hasConn ) );
+  Connection::sptr serverConn = server->listener->conn;
+  BOOST_CHECK( serverConn->isLoopback() );
+  BOOST_CHECK( !client->getRemoteAddress( true ) );
+
+  const int COUNT = 1000;
+  for ( int i = 0; i < COUNT; ++i )
+    writeValue( *client, i, true );
+  BOOST_REQUIRE( server->listener->waitFor( HasValues( COUNT ) ) );
+  for ( int i = 0; i < COUNT; ++i )
+    BOOST_CHECK_EQUAL( i, server->listener->values[i] );
+
+  //Unreliable packets and messages go the other way.
+  for ( int i = 0; i < 10; ++i )
+    writeValue( *serverConn, i, false );
+  Buffer message( 5000 );
+  for ( int i = 0; i < 1000; ++i )
+    message << (gint32)i;
+  serverConn->stream().writeMessage( message );
+  BOOST_CHECK( clientListener->waitFor( HasValues( 10 ) ) );
+  BOOST_REQUIRE( clientListener->waitFor( hasMessage ) );
+  BOOST_CHECK_EQUAL( 4000, clientListener->messageLength );
+
+  //The other end gets onExit.
+  client->disconnect();
+  BOOST_CHECK( server->listener->waitFor( LoopbackListener::hasExited ) );
+  serverConn->disconnect();
+
+  server->listener->conn.reset();
+  clientListener->conn.reset();
+  GNE::shutdownGNE();
+}
+
+/**
+ * Leaves the packets it receives in the queue.
+ */
+class IdleListener : public LoopbackListener {
+public:
+  void onReceive( Connection& ) {}
+};
+
+BOOST_AUTO_TEST_CASE( loopback_connection_holds_in_queue_limit ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+
+  SmartPtr<LoopbackServer> server = LoopbackServer::create();
+  server->listener = LoopbackListener::sptr( new LoopbackListener );
+  LoopbackListener::sptr clientListener( new IdleListener );
+  ConnectionParams params( clientListener );
+  params.setInQueueLimit( 8 );
+
+  ClientConnection::sptr client = ClientConnection::create();
+  BOOST_REQUIRE( !client->open( server, params ) );
+  client->connect();
+  BOOST_REQUIRE_EQUAL( Error::NoError, client->waitForConnect().getCode() );
+  BOOST_REQUIRE( server->listener->waitFor( LoopbackListener::hasConn ) );
+  Connection::sptr serverConn = server->listener->conn;
+
+  const int COUNT = 100;
+  for ( int i = 0; i < COUNT; ++i )
+    writeValue( *serverConn, i, true );
+
+  //The server stops giving packets once the queue is full.
+  PacketStream& in = client->stream();
+  for ( int i = 0; i < 100 && in.getInLength() < 8; ++i )
+    Thread::sleep( 10 );
+  Thread::sleep( 100 );
+  BOOST_CHECK_EQUAL( 8, in.getInLength() );
+
+  //And goes on as the queue is read, in order.
+  std::vector<gint32> values;
+  int longest = 0;
+  for ( int i = 0; i < 500 && (int)values.size() < COUNT; ++i ) {
+    Thread::sleep( 5 );
+    longest = std::max( longest, in.getInLength() );
+    Packet* next;
+    while ( ( next = in.getNextPacket() ) != NULL ) {
+      BOOST_REQUIRE_EQUAL( CustomPacket::ID, next->getType() );
+      Buffer& buf = ( (CustomPacket*)next )->getBuffer();
+      buf.flip();
+      gint32 value;
+      buf >> value;
+      values.push_back( value );
+      PacketParser::destroyPacket( next );
+    }
+  }
+  BOOST_CHECK_EQUAL( 8, longest );
+  BOOST_REQUIRE_EQUAL( COUNT, (int)values.size() );
+  for ( int i = 0; i < COUNT; ++i )
+    BOOST_CHECK_EQUAL( i, values[i] );
+
+  client->disconnect();
+  BOOST_CHECK( server->listener->waitFor( LoopbackListener::hasExited ) );
+  serverConn->disconnect();
+
+  server->listener->conn.reset();
+  clientListener->conn.reset();
+  GNE::shutdownGNE();
+}
+
+/**
+ * Writes a value to each new connection in onNewConn.
+ */
+class GreetingListener : public LoopbackListener {
+public:
+  void onNewConn( SyncConnection& conn ) {
+    CustomPacket greeting;
+    greeting.getBuffer() << (gint32)9;
+    conn << greeting;
+    LoopbackListener::onNewConn( conn );
+  }
+};
+
+/**
+ * Reads the greeting in onConnect, and records the thread it ran on.
+ */
+class GreetedListener : public LoopbackListener {
+public:
+  GreetedListener() : greeting( 0 ) {}
+
+  void onConnect( SyncConnection& conn ) {
+    thread = Thread::currentThread()->getName();
+    CustomPacket packet;
+    conn >> packet;
+    packet.getBuffer().flip();
+    packet.getBuffer() >> greeting;
+    LoopbackListener::onConnect( conn );
+  }
+
+  std::string thread;
+  gint32 greeting;
+};
+
+BOOST_AUTO_TEST_CASE( async_connect_calls_on_connect_on_event_thread ) {
+  //The handshake queues are only made with a network.  One thread is
+  //enough, since onConnect does not hold it.
+  GNE::setHandshakeThreads( 1 );
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  SmartPtr<LoopbackServer> server = LoopbackServer::create();
+  server->listener = LoopbackListener::sptr( new GreetingListener );
+  SmartPtr<GreetedListener> clientListener( new GreetedListener );
+
+  ConnectionParams params( clientListener );
+  params.setAsyncConnect( true );
+  ClientConnection::sptr client = ClientConnection::create();
+  BOOST_REQUIRE( !client->open( server, params ) );
+  client->connect();
+  BOOST_REQUIRE_EQUAL( Error::NoError, client->waitForConnect().getCode() );
+  //onConnect could wait for a packet while running on the EventThread.
+  BOOST_CHECK_EQUAL( "EventThr", clientListener->thread );
+  BOOST_CHECK_EQUAL( 9, clientListener->greeting );
+
+  client->disconnect();
+  BOOST_REQUIRE( server->listener->waitFor( LoopbackListener::hasConn ) );
+  server->listener->conn->disconnect();
+  server->listener->conn.reset();
+  clientListener->conn.reset();
+  GNE::shutdownGNE();
+  GNE::setHandshakeThreads( 4 );
+}
+
+/**
+ * A packet that counts how often it is parsed from raw data.
+ */
+class CountedPacket : public Packet {
+public:
+  typedef SmartPtr<CountedPacket> sptr;
+
+  enum { ID = PacketParser::MIN_USER_ID };
+
+  explicit CountedPacket( gint32 value = 0 ) : Packet( ID ), value( value ) {}
+
+  int getSize() const { return Packet::getSize() + Buffer::getSizeOf( value ); }
+
+  void writePacket( Buffer& raw ) const {
+    Packet::writePacket( raw );
+    raw << value;
+  }
+
+  void readPacket( Buffer& raw ) {
+    Packet::readPacket( raw );
+    raw >> value;
+    ++reads;
+  }
+
+  gint32 value;
+  static int reads;
+};
+
+int CountedPacket::reads = 0;
+
+/**
+ * Writes CountedPacket 7, a CustomPacket, then CountedPacket 8 to each new
+ * connection.
+ */
+class TypedSender : public LoopbackListener {
+public:
+  void onNewConn( SyncConnection& conn ) {
+    conn << CountedPacket( 7 ) << CustomPacket() << CountedPacket( 8 );
+    LoopbackListener::onNewConn( conn );
+  }
+};
+
+/**
+ * Reads what TypedSender writes with receive, then with operator >>.
+ */
+class TypedReceiver : public LoopbackListener {
+public:
+  TypedReceiver()
+    : first( 0 ), readsAfterReceive( -1 ), wrongId( -1 ), last( 0 ),
+      readsAfterCopy( -1 ) {}
+
+  void onConnect( SyncConnection& conn ) {
+    CountedPacket::sptr p = conn.receive<CountedPacket>();
+    first = p->value;
+    readsAfterReceive = CountedPacket::reads;
+    try {
+      conn.receive<CountedPacket>();
+    } catch ( PacketTypeMismatch& e ) {
+      wrongId = e.getWrongID();
+    }
+    CountedPacket copy;
+    conn >> copy;
+    last = copy.value;
+    readsAfterCopy = CountedPacket::reads;
+    LoopbackListener::onConnect( conn );
+  }
+
+  gint32 first;
+  int readsAfterReceive;
+  int wrongId;
+  gint32 last;
+  int readsAfterCopy;
+};
+
+BOOST_AUTO_TEST_CASE( sync_receive_returns_the_parsed_packet ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+  PacketParser::defaultRegisterPacket<CountedPacket>();
+  CountedPacket::reads = 0;
+
+  SmartPtr<LoopbackServer> server = LoopbackServer::create();
+  server->listener = LoopbackListener::sptr( new TypedSender );
+  SmartPtr<TypedReceiver> clientListener( new TypedReceiver );
+
+  ClientConnection::sptr client = ClientConnection::create();
+  BOOST_REQUIRE( !client->open( server, ConnectionParams( clientListener ) ) );
+  client->connect();
+  BOOST_REQUIRE_EQUAL( Error::NoError, client->waitForConnect().getCode() );
+  BOOST_REQUIRE( clientListener->waitFor( LoopbackListener::hasConn ) );
+
+  //A loopback connection passes the packet objects themselves, so receive
+  //hands back the written packet without parsing or copying it, while
+  //operator >> has to copy into the caller's packet.
+  BOOST_CHECK_EQUAL( 7, clientListener->first );
+  BOOST_CHECK_EQUAL( 0, clientListener->readsAfterReceive );
+  BOOST_CHECK_EQUAL( (int)CustomPacket::ID, clientListener->wrongId );
+  BOOST_CHECK_EQUAL( 8, clientListener->last );
+  BOOST_CHECK_EQUAL( 1, clientListener->readsAfterCopy );
+
+  client->disconnect();
+  BOOST_REQUIRE( server->listener->waitFor( LoopbackListener::hasConn ) );
+  server->listener->conn->disconnect();
+  server->listener->conn.reset();
+  clientListener->conn.reset();
+  GNE::shutdownGNE();
+}
+
+/**
+ * Records the connections onNewConn was called for, and the threads it ran
+ * on.
+ */
+class NewConnRecorder : public ConnectionListener {
+public:
+  typedef SmartPtr<NewConnRecorder> sptr;
+
+  void onNewConn( SyncConnection& conn ) {
+    LockMutex lock( sync );
+    threads.push_back( Thread::currentThread()->getName() );
+    conns.push_back( conn.getConnection() );
+  }
+
+  Mutex sync;
+  std::vector<std::string> threads;
+  std::vector<Connection::sptr> conns;
+};
+
+/**
+ * A ServerConnectionListener making event driven connections, that counts
+ * how their handshakes ended.
+ */
+class AsyncServer : public ServerConnectionListener {
+public:
+  static SmartPtr<AsyncServer> create() {
+    SmartPtr<AsyncServer> ret( new AsyncServer() );
+    ret->setThisPointer( ret );
+    return ret;
+  }
+
+  void getNewConnectionParams( ConnectionParams& params ) {
+    params.setListener( listener );
+    params.setAsyncConnect( true );
+    params.setHandshakeTimeout( handshakeTimeout );
+  }
+
+  void onListenFailure( const Error& error, const Address&,
+                        const ConnectionListener::sptr& ) {
+    LockCV lock( sync );
+    failures.push_back( error.getCode() );
+    sync.broadcast();
+  }
+
+  void onListenSuccess( const ConnectionListener::sptr& ) {
+    LockCV lock( sync );
+    ++successes;
+    sync.broadcast();
+  }
+
+  /**
+   * Waits up to about 5 seconds for count handshakes to end.
+   */
+  bool waitFor( int count ) {
+    LockCV lock( sync );
+    for ( int i = 0; i < 100 && ended() < count; ++i )
+      sync.timedWait( 50 );
+    return ended() >= count;
+  }
+
+  NewConnRecorder::sptr listener;
+  int handshakeTimeout;
+  ConditionVariable sync;
+  int successes;
+  std::vector<Error::ErrorCode> failures;
+
+private:
+  AsyncServer()
+    : listener( new NewConnRecorder ), handshakeTimeout( 10000 ),
+      successes( 0 ) {}
+
+  int ended() const { return successes + (int)failures.size(); }
+};
+
+BOOST_AUTO_TEST_CASE( server_handshake_step_times_out ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  SmartPtr<AsyncServer> server = AsyncServer::create();
+  ConnectionParams params( server->listener );
+  params.setAsyncConnect( true );
+  params.setHandshakeTimeout( 100 );
+  //A socket the client never writes its CRP to, or a made up one without a
+  //network.
+  NLsocket accepted = 1002;
+  NLsocket listening = nlOpen( 0, NL_RELIABLE_PACKETS );
+  NLsocket client = NL_INVALID;
+  NLaddress local;
+  if ( listening != NL_INVALID && nlListen( listening ) &&
+       nlGetLocalAddr( listening, &local ) ) {
+    client = nlOpen( 0, NL_RELIABLE_PACKETS );
+    BOOST_REQUIRE( client != NL_INVALID );
+    BOOST_REQUIRE( nlConnect( client, &local ) );
+    accepted = nlAcceptConnection( listening );
+    BOOST_REQUIRE( accepted != NL_INVALID );
+  }
+  ServerConnection::sptr conn = ServerConnection::create( params, accepted, server );
+  conn->startHandshake();
+  BOOST_REQUIRE( server->waitFor( 1 ) );
+  BOOST_CHECK_EQUAL( Error::ConnectionTimeOut, server->failures[0] );
+  BOOST_CHECK_EQUAL( 0, server->successes );
+  BOOST_CHECK( server->listener->conns.empty() );
+
+  conn.reset();
+  if ( client != NL_INVALID )
+    nlClose( client );
+  if ( listening != NL_INVALID )
+    nlClose( listening );
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( server_listener_drains_pending_accepts ) {
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  SmartPtr<AsyncServer> server = AsyncServer::create();
+  if ( server->open( 0 ) || server->listen() ) {
+    BOOST_TEST_MESSAGE( "Could not listen on a socket, skipping." );
+    server->close();
+    GNE::shutdownGNE();
+    return;
+  }
+  Address dest( "localhost" );
+  dest.setPort( server->getLocalAddress().getPort() );
+
+  //All of the clients connect before the listener wakes for any of them.
+  const int CLIENTS = 8;
+  std::vector<ClientConnection::sptr> clients;
+  for ( int i = 0; i < CLIENTS; ++i ) {
+    ConnectionParams params( ConnectionListener::getNullListener() );
+    params.setAsyncConnect( true );
+    ClientConnection::sptr client = ClientConnection::create();
+    BOOST_REQUIRE( !client->open( dest, params ) );
+    clients.push_back( client );
+  }
+  for ( int i = 0; i < CLIENTS; ++i )
+    clients[i]->connect();
+  for ( int i = 0; i < CLIENTS; ++i )
+    BOOST_CHECK_EQUAL( Error::NoError, clients[i]->waitForConnect().getCode() );
+
+  BOOST_REQUIRE( server->waitFor( CLIENTS ) );
+  BOOST_CHECK_EQUAL( CLIENTS, server->successes );
+  //onNewConn is the first event of each connection's EventThread.
+  {
+    LockMutex lock( server->listener->sync );
+    BOOST_CHECK_EQUAL( CLIENTS, (int)server->listener->threads.size() );
+    for ( size_t i = 0; i < server->listener->threads.size(); ++i )
+      BOOST_CHECK_EQUAL( "EventThr", server->listener->threads[i] );
+  }
+
+  for ( int i = 0; i < CLIENTS; ++i )
+    clients[i]->disconnect();
+  for ( size_t i = 0; i < server->listener->conns.size(); ++i )
+    server->listener->conns[i]->disconnect();
+  server->listener->conns.clear();
+  server->close();
+  GNE::shutdownGNE();
+}
+
+BOOST_AUTO_TEST_CASE( server_handshake_survives_stalled_clients ) {
+  //One thread, which a stalled client must not hold.
+  GNE::setHandshakeThreads( 1 );
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  SmartPtr<AsyncServer> server = AsyncServer::create();
+  server->handshakeTimeout = 500;
+  if ( server->open( 0 ) || server->listen() ) {
+    BOOST_TEST_MESSAGE( "Could not listen on a socket, skipping." );
+    server->close();
+    GNE::shutdownGNE();
+    GNE::setHandshakeThreads( 4 );
+    return;
+  }
+  Address dest( "localhost" );
+  dest.setPort( server->getLocalAddress().getPort() );
+  NLaddress destAddr = dest.getAddress();
+
+  //Each sends a byte, less than any packet, and never the rest.
+  const int STALLED = 4;
+  std::vector<NLsocket> stalled;
+  for ( int i = 0; i < STALLED; ++i ) {
+    NLsocket s = nlOpen( 0, NL_RELIABLE );
+    BOOST_REQUIRE( s != NL_INVALID );
+    stalled.push_back( s );
+    BOOST_REQUIRE( nlConnect( s, &destAddr ) );
+    gbyte part = 1;
+    BOOST_REQUIRE_EQUAL( 1, nlWrite( s, &part, 1 ) );
+  }
+  Thread::sleep( 100 );
+
+  ConnectionParams params( ConnectionListener::getNullListener() );
+  params.setAsyncConnect( true );
+  ClientConnection::sptr client = ClientConnection::create();
+  BOOST_REQUIRE( !client->open( dest, params ) );
+  client->connect();
+  BOOST_CHECK_EQUAL( Error::NoError, client->waitForConnect().getCode() );
+
+  //The stalled clients time out.
+  BOOST_REQUIRE( server->waitFor( STALLED + 1 ) );
+  BOOST_CHECK_EQUAL( 1, server->successes );
+  BOOST_REQUIRE_EQUAL( STALLED, (int)server->failures.size() );
+  for ( int i = 0; i < STALLED; ++i )
+    BOOST_CHECK_EQUAL( Error::ConnectionTimeOut, server->failures[i] );
+
+  for ( int i = 0; i < STALLED; ++i )
+    nlClose( stalled[i] );
+  client->disconnect();
+  for ( size_t i = 0; i < server->listener->conns.size(); ++i )
+    server->listener->conns[i]->disconnect();
+  server->listener->conns.clear();
+  server->close();
+  GNE::shutdownGNE();
+  GNE::setHandshakeThreads( 4 );
+}
+
+BOOST_AUTO_TEST_CASE( async_connect_survives_stalled_servers ) {
+  //One thread of each, which a stalled connect must not hold.
+  GNE::setHandshakeThreads( 1 );
+  GNE::setConnectThreads( 1 );
+  GNE::initGNE( NL_IP, atexit, 1000 );
+
+  //A server that answers the CRP with part of a packet, and a GNE server.
+  SmartPtr<AsyncServer> server = AsyncServer::create();
+  NLsocket stalling = nlOpen( 0, NL_RELIABLE );
+  NLaddress stallingAddr;
+  if ( stalling == NL_INVALID || !nlListen( stalling ) ||
+       !nlGetLocalAddr( stalling, &stallingAddr ) ||
+       server->open( 0 ) || server->listen() ) {
+    BOOST_TEST_MESSAGE( "Could not listen on a socket, skipping." );
+    if ( stalling != NL_INVALID )
+      nlClose( stalling );
+    server->close();
+    GNE::shutdownGNE();
+    GNE::setHandshakeThreads( 4 );
+    GNE::setConnectThreads( 4 );
+    return;
+  }
+  Address dest( "localhost" );
+  dest.setPort( server->getLocalAddress().getPort() );
+
+  ConnectionParams params( ConnectionListener::getNullListener() );
+  params.setAsyncConnect( true );
+  params.setHandshakeTimeout( 500 );
+
+  ClientConnection::sptr stalled = ClientConnection::create();
+  BOOST_REQUIRE( !stalled->open( Address( stallingAddr ), params ) );
+  stalled->connect();
+  NLsocket accepted = nlAcceptConnection( stalling );
+  BOOST_REQUIRE( accepted != NL_INVALID );
+  gbyte crp[64];
+  BOOST_REQUIRE( nlRead( accepted, crp, sizeof( crp ) ) > 0 );
+  gbyte part = 1;
+  BOOST_REQUIRE_EQUAL( 1, nlWrite( accepted, &part, 1 ) );
+
+  //Connects that may never finish, if the address goes nowhere.
+  const int UNREACHABLE = 4;
+  std::vector<ClientConnection::sptr> lost;
+  for ( int i = 0; i < UNREACHABLE; ++i ) {
+    ClientConnection::sptr client = ClientConnection::create();
+    BOOST_REQUIRE( !client->open( Address( "10.255.255.1:4000" ), params ) );
+    client->connect();
+    lost.push_back( client );
+  }
+  Thread::sleep( 100 );
+
+  ClientConnection::sptr client = ClientConnection::create();
+  BOOST_REQUIRE( !client->open( dest, params ) );
+  client->connect();
+  BOOST_CHECK_EQUAL( Error::NoError, client->waitForConnect().getCode() );
+
+  BOOST_CHECK_EQUAL( Error::ConnectionTimeOut,
+                     stalled->waitForConnect().getCode() );
+  for ( int i = 0; i < UNREACHABLE; ++i )
+    BOOST_CHECK( lost[i]->waitForConnect().getCode() != Error::NoError );
+
+  nlClose( accepted );
+  nlClose( stalling );
+  client->disconnect();
+  BOOST_REQUIRE( server->waitFor( 1 ) );
+  for ( size_t i = 0; i < server->listener->conns.size(); ++i )
+    server->listener->conns[i]->disconnect();
+  server->listener->conns.clear();
+  server->close();
+  GNE::shutdownGNE();
+  GNE::setHandshakeThreads( 4 );
+  GNE::setConnectThreads( 4 );
+}
+
+/**
+ * Records how an AsyncConnection operation completed.
+ */
+class RecordingHandler : public AsyncConnection::Handler {
+public:
+  RecordingHandler() : done( false ), code( Error::NoError ) {}
+
+  void onComplete( const Packet::sptr& packet, const Error& error ) {
+    LockCV lock( sync );
+    this->packet = packet;
+    code = error.getCode();
+    done = true;
+    sync.broadcast();
+  }
+
+  /**
+   * Waits up to about 5 seconds for the operation to complete.
+   */
+  bool waitUntilDone() {
+    LockCV lock( sync );
+    for ( int i = 0; i < 100 && !done; ++i )
+      sync.timedWait( 50 );
+    return done;
+  }
+
+  ConditionVariable sync;
+  bool done;
+  Packet::sptr packet;
+  Error::ErrorCode code;
+};
+
+/**
+ * Refuses every connection it is told of in onConnect.
+ */
+class RefusingListener : public ConnectionListener {
+public:
+  void onConnect( SyncConnection& ) { throw Error( Error::User ); }
+};
+
+static gint32 readValue( const Packet::sptr& packet ) {
+  BOOST_REQUIRE( packet );
+  BOOST_REQUIRE_EQUAL( CustomPacket::ID, packet->getType() );
+  Buffer& buf = static_cast<CustomPacket&>( *packet ).getBuffer();
+  buf.flip();
+  gint32 value;
+  buf >> value;
+  return value;
+}
+
+BOOST_AUTO_TEST_CASE( async_connection_completes_handlers ) {
+  GNE::initGNE( NO_NET, atexit, 1000 );
+
+  SmartPtr<LoopbackServer> server = LoopbackServer::create();
+  server->listener = LoopbackListener::sptr( new LoopbackListener );
+
+  AsyncConnection::sptr async = AsyncConnection::create();
+  ClientConnection::sptr client = ClientConnection::create();
+  BOOST_REQUIRE( !client->open( server, ConnectionParams( async ) ) );
+  RecordingHandler connected;
+  async->connect( client, connected );
+  BOOST_REQUIRE( connected.waitUntilDone() );
+  BOOST_CHECK_EQUAL( Error::NoError, connected.code );
+  BOOST_CHECK( !connected.packet );
+  BOOST_CHECK( async->getConnection() == client );
+  BOOST_REQUIRE( server->listener->waitFor( LoopbackListener::hasConn ) );
+  Connection::sptr serverConn = server->listener->conn;
+
+  //A receive waits for the next packet, and tryReceive does not wait.
+  BOOST_CHECK( !async->tryReceive() );
+  RecordingHandler first;
+  async->receive( first );
+  writeValue( *serverConn, 5, true );
+  BOOST_REQUIRE( first.waitUntilDone() );
+  BOOST_CHECK_EQUAL( Error::NoError, first.code );
+  BOOST_CHECK_EQUAL( 5, readValue( first.packet ) );
+
+  writeValue( *serverConn, 6, true );
+  Packet::sptr polled;
+  for ( int i = 0; i < 100 && !polled; ++i ) {
+    polled = async->tryReceive();
+    if ( !polled )
+      Thread::sleep( 50 );
+  }
+  BOOST_CHECK_EQUAL( 6, readValue( polled ) );
+
+  CustomPacket reply;
+  reply.getBuffer() << (gint32)7;
+  async->write( reply );
+  BOOST_REQUIRE( server->listener->waitFor( HasValues( 1 ) ) );
+  BOOST_CHECK_EQUAL( 7, server->listener->values[0] );
+
+  //A receive waiting when the other end exits gets the error, and so does
+  //everything after it.
+  RecordingHandler exited;
+  async->receive( exited );
+  serverConn->disconnect();
+  BOOST_REQUIRE( exited.waitUntilDone() );
+  BOOST_CHECK_EQUAL( Error::ExitNoticeReceived, exited.code );
+  BOOST_CHECK( !exited.packet );
+  BOOST_CHECK_EQUAL( Error::ExitNoticeReceived, async->getError().getCode() );
+  BOOST_CHECK_THROW( async->tryReceive(), Error );
+  BOOST_CHECK_THROW( async->write( reply ), Error );
+  RecordingHandler late;
+  async->receive( late );
+  BOOST_CHECK( late.done );
+  BOOST_CHECK_EQUAL( Error::ExitNoticeReceived, late.code );
+  client->disconnect();
+
+  //A connection refused by the next listener completes connect with the
+  //error.
+  AsyncConnection::sptr refused =
+    AsyncConnection::create( ConnectionListener::sptr( new RefusingListener ) );
+  ClientConnection::sptr refusedClient = ClientConnection::create();
+  BOOST_REQUIRE( !refusedClient->open( server, ConnectionParams( refused ) ) );
+  RecordingHandler failed;
+  refused->connect( refusedClient, failed );
+  BOOST_REQUIRE( failed.waitUntilDone() );
+  BOOST_CHECK_EQUAL( Error::User, failed.code );
+  BOOST_CHECK_EQUAL( Error::User, refused->getError().getCode() );
+  refusedClient->disconnect();
+
+  server->listener->conn.reset();
+  GNE::shutdownGNE();
+}